@@ -48,10 +48,12 @@ except ImportError:
 if not np is None:
     import checkpoint
     import parameters
+    import trajectory
     import surface
     import grid
 else:
     print 'disable: langmuir.checkpoint'
+    print 'disable: langmuir.trajectory'
     print 'disable: langmuir.parameters'
     print 'disable: langmuir.grid'
 
@@ -28,12 +28,27 @@ parameters = [
     Parameter('current.step', int, 0, None, '%d'),
     Parameter('iterations.real', int, 1, None, '%d'),
     Parameter('random.seed', int, -1, None, '%d'),
+    Parameter('random.engine', str, 'mt19937', None, '%s'),
     Parameter('grid.z', int, 1, None, '%d'),
     Parameter('grid.y', int, 1, None, '%d'),
     Parameter('grid.x', int, 1, None, '%d'),
+    Parameter('grid.tiled', bool, False, None, '%s'),
+    Parameter('grid.sparse', bool, False, None, '%s'),
+    Parameter('grid.periodic.y', bool, False, None, '%s'),
+    Parameter('grid.periodic.z', bool, False, None, '%s'),
+    Parameter('potential.analytic', bool, False, None, '%s'),
     Parameter('hopping.range', int, 1, None, '%d'),
+    Parameter('hopping.spherical', bool, True, None, '%s'),
+    Parameter('hopping.alias', bool, False, None, '%s'),
+    Parameter('metropolis.fast', bool, False, None, '%s'),
+    Parameter('metropolis.fast.memory', int, 512, None, '%d'),
     Parameter('output.is.on', bool, True, None, '%s'),
+    Parameter('output.async', bool, False, None, '%s'),
+    Parameter('output.queue.size', int, 2, None, '%d'),
     Parameter('iterations.print', int, 1, None, '%d'),
+    Parameter('convergence.error', float, 0.0, None, '%.15e'),
+    Parameter('convergence.min.steps', int, 0, None, '%d'),
+    Parameter('convergence.batches', int, 10, None, '%d'),
     Parameter('output.precision', int, 15, None, '%d'),
     Parameter('output.width', int, 23, None, '%d'),
     Parameter('output.stub', str, 'out', None, '%s'),
@@ -42,6 +57,8 @@ parameters = [
     Parameter('output.coulomb', int, 0, None, '%d'),
     Parameter('output.step.chk', int, 1, None, '%d'),
     Parameter('output.chk.trap.potential', bool, False, None, '%s'),
+    Parameter('output.chk.format', str, 'text', None, '%s'),
+    Parameter('output.gzip', bool, False, None, '%s'),
     Parameter('output.potential', bool, False, None, '%s'),
     Parameter('output.xyz', int, 0, None, '%d'),
     Parameter('output.xyz.e', bool, True, None, '%s'),
@@ -49,6 +66,8 @@ parameters = [
     Parameter('output.xyz.d', bool, True, None, '%s'),
     Parameter('output.xyz.t', bool, True, None, '%s'),
     Parameter('output.xyz.mode', int, 0, None, '%d'),
+    Parameter('output.xyz.format', str, 'text', None, '%s'),
+    Parameter('output.xyz.keyframe', int, 100, None, '%d'),
     Parameter('image.traps', bool, False, None, '%s'),
     Parameter('image.defects', bool, False, None, '%s'),
     Parameter('image.carriers', int, 0, None, '%d'),
@@ -60,6 +79,8 @@ parameters = [
     Parameter('trap.potential', float, 0.0, None, '%.15e'),
     Parameter('gaussian.stdev', float, 0.0, None, '%.15e'),
     Parameter('seed.percentage', float, 1.0, None, '%.15e'),
+    Parameter('placement.algorithm', str, 'legacy', None, '%s'),
+    Parameter('cache.directory', str, '', None, '%s'),
     Parameter('voltage.right', float, 0.0, None, '%.15e'),
     Parameter('voltage.left', float, 0.0, None, '%.15e'),
     Parameter('slope.z', float, 0.0, None, '%.15e'),
@@ -68,6 +89,8 @@ parameters = [
     Parameter('defects.charge', int, 0, None, '%d'),
     Parameter('exciton.binding', float, 0.0, None, '%.15e'),
     Parameter('temperature.kelvin', float, 300.0, None, '%.15e'),
+    Parameter('sweep.voltage.right', str, '', None, '%s'),
+    Parameter('sweep.temperature.kelvin', str, '', None, '%s'),
     Parameter('source.rate', float, 0.9, None, '%.15e'),
     Parameter('e.source.l.rate', float, -1.0, None, '%.15e'),
     Parameter('e.source.r.rate', float, -1.0, None, '%.15e'),
@@ -78,6 +101,7 @@ parameters = [
     Parameter('source.coulomb', bool, False, None, '%s'),
     Parameter('source.scale.area', float, 65536.0, None, '%.15e'),
     Parameter('balance.charges', bool, False, None, '%s'),
+    Parameter('free.site.index', bool, False, None, '%s'),
     Parameter('drain.rate', float, 0.9, None, '%.15e'),
     Parameter('e.drain.l.rate', float, -1.0, None, '%.15e'),
     Parameter('e.drain.r.rate', float, -1.0, None, '%.15e'),
@@ -85,14 +109,19 @@ parameters = [
     Parameter('h.drain.r.rate', float, -1.0, None, '%.15e'),
     Parameter('recombination.rate', float, 0.0, None, '%.15e'),
     Parameter('recombination.range', int, 0, None, '%d'),
+    Parameter('recombination.parallel', bool, False, None, '%s'),
     Parameter('use.opencl', bool, False, None, '%s'),
     Parameter('work.x', int, 4, None, '%d'),
     Parameter('work.y', int, 4, None, '%d'),
     Parameter('work.z', int, 4, None, '%d'),
     Parameter('work.size', int, 256, None, '%d'),
     Parameter('opencl.threshold', int, 256, None, '%d'),
+    Parameter('coulomb.tuner.interval', int, 0, None, '%d'),
+    Parameter('coulomb.tuner.samples', int, 5, None, '%d'),
+    Parameter('coulomb.tuner.hysteresis', float, 0.1, None, '%.15e'),
     Parameter('opencl.device.id', int, 0, None, '%d'),
-    Parameter('max.threads', int, -1, None, '%d')
+    Parameter('max.threads', int, -1, None, '%d'),
+    Parameter('threads.affinity', bool, False, None, '%s')
 ]
 parameters = collections.OrderedDict(((p.key, p) for p in parameters))
 
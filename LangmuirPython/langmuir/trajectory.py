@@ -0,0 +1,244 @@
+# -*- coding: utf-8 -*-
+"""
+.. note::
+    Functions for reading binary Langmuir trajectory files
+    (output.xyz.format = binary).
+
+.. moduleauthor:: Adam Gagorik <adam.gagorik@gmail.com>
+"""
+import langmuir as lm
+import numpy as np
+import bisect
+import struct
+import zlib
+
+_file_magic = 'LANGTRJ\0'
+_chunk_magic = 'LTCK'
+_trailer_magic = 'LANGIDX\0'
+_header_size = 32
+_chunk_header_size = 24
+_index_entry_size = 24
+
+_carrier_dtype = np.dtype([('id', np.uint64), ('s', np.int64), ('x', np.int64),
+                           ('y', np.int64), ('z', np.int64),
+                           ('lifetime', np.int64), ('pathlength', np.int64)])
+
+
+class Frame(object):
+    """
+    A frame of a trajectory.
+
+    ==================== ==============================================
+    **Attribute**        **Description**
+    ==================== ==============================================
+    :py:attr:`step`      :py:obj:`int`
+    :py:attr:`electrons` :py:obj:`numpy.ndarray` (id, s, x, y, z, lifetime, pathlength)
+    :py:attr:`holes`     :py:obj:`numpy.ndarray` (id, s, x, y, z, lifetime, pathlength)
+    :py:attr:`defects`   :py:obj:`numpy.ndarray` of site ids
+    :py:attr:`traps`     :py:obj:`numpy.ndarray` of site ids
+    ==================== ==============================================
+    """
+
+    def __init__(self, step, electrons, holes, defects, traps):
+        self.step = step
+        self.electrons = electrons
+        self.holes = holes
+        self.defects = defects
+        self.traps = traps
+
+    def __repr__(self):
+        return 'Frame(step=%d, electrons=%d, holes=%d)' % (
+            self.step, len(self.electrons), len(self.holes))
+
+
+class _Reader(object):
+    """
+    Decode the varints and columns of a chunk.
+    """
+
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            byte = ord(self.data[self.pos])
+            self.pos += 1
+            value |= (byte & 0x7f) << shift
+            if byte < 0x80:
+                return value
+            shift += 7
+
+    def signed(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def bits(self, count, width):
+        if count * width == 0:
+            return np.zeros((count, width), dtype=np.uint8)
+        nbytes = (count * width + 7) // 8
+        data = np.frombuffer(self.data, np.uint8, nbytes, self.pos)
+        self.pos += nbytes
+        bits = np.unpackbits(data).reshape(-1, 8)[:, ::-1].ravel()
+        return bits[:count * width].reshape(count, width)
+
+    def column(self, count):
+        if count == 0:
+            return np.zeros(0, dtype=np.int64)
+        minimum = self.signed()
+        width = ord(self.data[self.pos])
+        self.pos += 1
+        if width == 0:
+            return np.zeros(count, dtype=np.int64) + minimum
+        bits = self.bits(count, width).astype(object)
+        values = bits.dot([1 << i for i in range(width)])
+        return (values + minimum).astype(np.int64)
+
+
+class Trajectory(object):
+    """
+    A class to read binary Langmuir trajectory files.  Only the index is read
+    when the file is opened; a frame is found by decoding the frames of its
+    chunk, starting from the keyframe at the start of the chunk.
+
+    :param handle: filename
+    :type handle: str
+
+    >>> traj = lm.trajectory.Trajectory('out.traj')
+    >>> frame = traj.at_step(1000)
+    >>> print frame.electrons['x']
+    """
+
+    def __init__(self, handle):
+        self.handle = open(handle, 'rb')
+        header = self.handle.read(_header_size)
+        if len(header) != _header_size or header[:8] != _file_magic:
+            raise RuntimeError('not a binary trajectory: %s' % handle)
+        (self.version, self.species, self.nx, self.ny, self.nz,
+         self.keyframe) = struct.unpack('<6I', header[8:])
+        self._load_index()
+        self._cache = (None, None)
+
+    def _load_index(self):
+        """
+        Read the index at the end of the file; scan the chunks if it is
+        missing (the run was killed).
+        """
+        self.handle.seek(0, 2)
+        size = self.handle.tell()
+        self.steps, self.frames, self.offsets = [], [], []
+        if size >= _header_size + 16:
+            self.handle.seek(size - 16)
+            offset, magic = struct.unpack('<Q8s', self.handle.read(16))
+            if magic == _trailer_magic:
+                self.handle.seek(offset + 4)
+                count, = struct.unpack('<I', self.handle.read(4))
+                data = self.handle.read(count * _index_entry_size)
+                for i in range(count):
+                    step, frames, zero, offset = struct.unpack_from(
+                        '<QIIQ', data, i * _index_entry_size)
+                    self.steps.append(step)
+                    self.frames.append(frames)
+                    self.offsets.append(offset)
+                return
+        offset = _header_size
+        while offset + _chunk_header_size <= size:
+            self.handle.seek(offset)
+            magic, frames, step, nbytes = struct.unpack(
+                '<4sIQQ', self.handle.read(_chunk_header_size))
+            if magic != _chunk_magic or \
+                    offset + _chunk_header_size + nbytes > size:
+                break
+            self.steps.append(step)
+            self.frames.append(frames)
+            self.offsets.append(offset)
+            offset += _chunk_header_size + nbytes
+
+    def __len__(self):
+        return sum(self.frames)
+
+    def __iter__(self):
+        for chunk in range(len(self.offsets)):
+            for frame in self._decode(chunk):
+                yield frame
+
+    def __getitem__(self, index):
+        if index < 0:
+            index += len(self)
+        for chunk, frames in enumerate(self.frames):
+            if index < frames:
+                return self._decode(chunk)[index]
+            index -= frames
+        raise IndexError('frame out of range')
+
+    def at_step(self, step):
+        """
+        Get the last frame written at or before a step.
+
+        :param step: simulation step
+        :type step: int
+        """
+        chunk = bisect.bisect_right(self.steps, step) - 1
+        if chunk < 0:
+            raise IndexError('no frame at or before step %d' % step)
+        found = None
+        for frame in self._decode(chunk):
+            if frame.step > step:
+                break
+            found = frame
+        return found
+
+    def _decode(self, chunk):
+        """
+        Decode all of the frames of a chunk (the last chunk is cached).
+        """
+        if self._cache[0] == chunk:
+            return self._cache[1]
+        self.handle.seek(self.offsets[chunk])
+        magic, count, step, nbytes = struct.unpack(
+            '<4sIQQ', self.handle.read(_chunk_header_size))
+        data = zlib.decompress(self.handle.read(nbytes), 15 + 32)
+        reader = _Reader(data)
+
+        empty = np.zeros(0, dtype=_carrier_dtype)
+        electrons, holes = empty, empty
+        defects = np.zeros(0, dtype=np.int64)
+        traps = np.zeros(0, dtype=np.int64)
+
+        frames = []
+        for i in range(count):
+            step = reader.varint()
+            if self.species & 1:
+                electrons = self._carriers(reader, electrons)
+            if self.species & 2:
+                holes = self._carriers(reader, holes)
+            if i == 0 and self.species & 4:
+                defects = reader.column(reader.varint())
+            if i == 0 and self.species & 8:
+                traps = reader.column(reader.varint())
+            frames.append(Frame(step, electrons, holes, defects, traps))
+
+        self._cache = (chunk, frames)
+        return frames
+
+    def _carriers(self, reader, previous):
+        """
+        Apply the carriers of a frame to those of the last frame.
+        """
+        left = reader.bits(len(previous), 1).ravel().astype(bool)
+        kept = previous[left].copy()
+        n = len(kept)
+        for name in ['x', 'y', 'z', 'lifetime', 'pathlength']:
+            kept[name] += reader.column(n)
+
+        n = reader.varint()
+        new = np.zeros(n, dtype=_carrier_dtype)
+        new['id'] = np.cumsum(reader.column(n))
+        for name in ['x', 'y', 'z', 'lifetime', 'pathlength']:
+            new[name] = reader.column(n)
+
+        carriers = np.concatenate([kept, new])
+        carriers['s'] = carriers['x'] + self.nx * (
+            carriers['y'] + self.ny * carriers['z'])
+        return carriers
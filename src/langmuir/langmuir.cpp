@@ -5,6 +5,7 @@
   * Here we find the main Langmuir function, meant to run simulations in a terminal or on a cluster.
   */
 #include "simulation.h"
+#include "ensemble.h"
 #include "keyvalueparser.h"
 #include "writer.h"
 #include "world.h"
@@ -12,6 +13,7 @@
 #include "nodefileparser.h"
 #include "parameters.h"
 #include "clparser.h"
+#include "jobpacker.h"
 
 #include <QApplication>
 
@@ -42,82 +44,120 @@ int main (int argc, char *argv[])
     CommandLineParser clparser;
     clparser.add("-n", "cores", "the number of cores to use");
     clparser.add("--gpu", "gpu", "index of gpu to use");
+    clparser.add("--replicas", "replicas", "number of independent replicas to run");
+    clparser.add("--manifest", "manifest", "file listing input files to run at once on this node");
     clparser.addPositional("input", "input file");
     clparser.parse(args);
 
     // Figure out cores
     int cores = clparser.get<int>("cores", -1);
     int gpuID = clparser.get<int>("gpu", -1);
+    int replicas = clparser.get<int>("replicas", 1);
 
-    // Get the input file
-    QString inputFile = clparser.get<QString>("input", "sim.inp");
-
-    // Create the world
-    World world(inputFile, cores, gpuID);
-    world.logger().initialize();
-
-    // Get the simulation Parameters
-    SimulationParameters &par = world.parameters();
-
-    // Save the parameters
-    world.keyValueParser().save("%stub.parm");
-
-    // Create the simulation
-    Simulation sim(world);
-
-    qDebug("langmuir: performing iterations...");
-
-    // Perform production steps
-    for (int j = par.currentStep; j < par.iterationsReal; j += par.iterationsPrint)
+    // Run every input in the manifest in child processes, filling the node
+    QString manifest = clparser.get<QString>("manifest", "");
+    if (!manifest.isEmpty())
     {
-        // Perform iterations
-        sim.performIterations (par.iterationsPrint);
+        JobPacker packer(manifest, cores, replicas);
+        return (packer.run() == 0) ? 0 : 1;
     }
 
-    // The time this simulation stops
-    QDateTime stop = QDateTime::currentDateTime();
+    // Get the input file
+    QString inputFile = clparser.get<QString>("input", "sim.inp");
 
-    qDebug("langmuir: %s", qPrintable(stop.toString(dateFMT)));
-    qDebug("langmuir: %s", qPrintable(stop.toString(timeFMT)));
+    // Create the world (and its replicas)
+    Ensemble ensemble(inputFile, replicas, cores, gpuID);
+    // Get the simulation Parameters (the same for all replicas)
+    SimulationParameters &primaryPar = ensemble.world().parameters();
 
-    // Output some stuff
-    if (par.outputIsOn)
+    // Walk through the sweep points, each starting from the last state
+    for (int point = 0; point < ensemble.sweepSize(); point++)
     {
-        // Save a Checkpoint File
-        if (par.outputIsOn) world.checkPointer().save();
-
-        // Output time
-        OutputStream timerStream("%stub.time",&par);
-
-        timerStream << right
-                    << qSetFieldWidth(20)
-                    << qSetRealNumberPrecision(12)
-                    << "real"
-                    << "carriers"
-                    << "date_i"
-                    << "time_i"
-                    << "date_f"
-                    << "time_f"
-                    << "days"
-                    << "hours"
-                    << "min"
-                    << "secs"
-                    << "msecs"
-                    << newline;
-        timerStream.setRealNumberNotation(QTextStream::SmartNotation);
-        timerStream << par.iterationsReal
-                    << world.maxChargeAgents()
-                    << begin.toString(dateFMT)
-                    << begin.toString(timeFMT)
-                    << stop.toString(dateFMT)
-                    << stop.toString(timeFMT)
-                    << begin.msecsTo(stop) / 1000.0 / 60.0 / 60.0 / 24.0
-                    << begin.msecsTo(stop) / 1000.0 / 60.0 / 60.0
-                    << begin.msecsTo(stop) / 1000.0 / 60.0
-                    << begin.msecsTo(stop) / 1000.0
-                    << begin.msecsTo(stop)
-                    << newline
-                    << flush;
+        ensemble.setSweepPoint(point);
+
+        for (int i = 0; i < ensemble.size(); i++)
+        {
+            ensemble.world(i).logger().initialize();
+
+            // Save the parameters
+            ensemble.world(i).keyValueParser().save("%stub.parm");
+        }
+
+        // The time this point starts
+        QDateTime start = (point == 0) ? begin : QDateTime::currentDateTime();
+
+        qDebug("langmuir: performing iterations...");
+
+        // Perform production steps, stopping early once the currents are steady
+        for (int j = primaryPar.currentStep; j < primaryPar.iterationsReal; j += primaryPar.iterationsPrint)
+        {
+            // Perform iterations
+            ensemble.performIterations (primaryPar.iterationsPrint);
+
+            if (ensemble.isConverged())
+            {
+                qDebug("langmuir: stopping early at step %u", primaryPar.currentStep);
+                break;
+            }
+        }
+
+        // Wait for the output threads
+        for (int i = 0; i < ensemble.size(); i++)
+        {
+            ensemble.world(i).logger().waitForOutput();
+        }
+
+        // The time this point stops
+        QDateTime stop = QDateTime::currentDateTime();
+
+        qDebug("langmuir: %s", qPrintable(stop.toString(dateFMT)));
+        qDebug("langmuir: %s", qPrintable(stop.toString(timeFMT)));
+
+        // Output some stuff
+        for (int i = 0; i < ensemble.size(); i++)
+        {
+            World &world = ensemble.world(i);
+            SimulationParameters &par = world.parameters();
+
+            if (par.outputIsOn)
+            {
+                // Save a Checkpoint File
+                if (par.outputIsOn) world.checkPointer().save();
+
+                // Output time
+                OutputStream timerStream("%stub.time",&par);
+
+                timerStream << right
+                            << qSetFieldWidth(20)
+                            << qSetRealNumberPrecision(12)
+                            << "real"
+                            << "carriers"
+                            << "date_i"
+                            << "time_i"
+                            << "date_f"
+                            << "time_f"
+                            << "days"
+                            << "hours"
+                            << "min"
+                            << "secs"
+                            << "msecs"
+                            << newline;
+                timerStream.setRealNumberNotation(QTextStream::SmartNotation);
+                timerStream << par.currentStep
+                            << world.maxChargeAgents()
+                            << start.toString(dateFMT)
+                            << start.toString(timeFMT)
+                            << stop.toString(dateFMT)
+                            << stop.toString(timeFMT)
+                            << start.msecsTo(stop) / 1000.0 / 60.0 / 60.0 / 24.0
+                            << start.msecsTo(stop) / 1000.0 / 60.0 / 60.0
+                            << start.msecsTo(stop) / 1000.0 / 60.0
+                            << start.msecsTo(stop) / 1000.0
+                            << start.msecsTo(stop)
+                            << newline
+                            << flush;
+            }
+        }
     }
 
     qDebug("langmuir: exited successfully");
@@ -0,0 +1,359 @@
+#include "affinity.h"
+
+#include <QWaitCondition>
+#include <QStringList>
+#include <QRunnable>
+#include <QThread>
+#include <QMutex>
+#include <QFile>
+#include <QDir>
+#include <QMap>
+
+#ifdef LANGMUIR_USING_QT5
+#include <QtConcurrent/QtConcurrent>
+#endif
+
+#include <cstring>
+#include <cmath>
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#endif
+
+namespace LangmuirCore
+{
+
+namespace
+{
+
+/**
+ * @brief read the first line of a small file (like the ones in /sys)
+ */
+QString readLine(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return QString();
+    }
+    return QString(file.readLine()).trimmed();
+}
+
+/**
+ * @brief The state shared by the runnables of Affinity::pinThreads()
+ */
+struct PinBarrier
+{
+    QMutex mutex;
+    QWaitCondition condition;
+    QList<int> cpus;
+    int size;
+    int arrived;
+    int left;
+    int failed;
+};
+
+/**
+ * @brief A QRunnable that pins its worker, then waits for the others
+ *
+ * Every runnable holds on to its worker until all have arrived, so each one
+ * runs on a different worker.
+ */
+class PinRunnable : public QRunnable
+{
+public:
+    PinRunnable(PinBarrier &barrier) : QRunnable(), m_barrier(barrier)
+    {
+        setAutoDelete(true);
+    }
+
+    virtual void run()
+    {
+        QMutexLocker locker(&m_barrier.mutex);
+
+        int index = m_barrier.arrived++;
+        if (!Affinity::pinCurrentThread(m_barrier.cpus.at(index % m_barrier.cpus.size())))
+        {
+            m_barrier.failed++;
+        }
+
+        if (m_barrier.arrived == m_barrier.size)
+        {
+            m_barrier.condition.wakeAll();
+        }
+        while (m_barrier.arrived < m_barrier.size)
+        {
+            m_barrier.condition.wait(&m_barrier.mutex);
+        }
+
+        m_barrier.left++;
+        m_barrier.condition.wakeAll();
+    }
+
+protected:
+    PinBarrier &m_barrier;
+};
+
+/**
+ * @brief A QThread that pins itself to a CPU and zeros some memory
+ */
+class TouchThread : public QThread
+{
+public:
+    TouchThread(void *data, std::size_t bytes, int cpu)
+        : QThread(), m_data(data), m_bytes(bytes), m_cpu(cpu)
+    {
+    }
+
+protected:
+    virtual void run()
+    {
+        Affinity::pinCurrentThread(m_cpu);
+        memset(m_data, 0, m_bytes);
+    }
+
+    void *m_data;
+    std::size_t m_bytes;
+    int m_cpu;
+};
+
+}
+
+QList<int> Affinity::allowedCPUs()
+{
+    QList<int> cpus;
+
+#ifdef Q_OS_LINUX
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+    {
+        for (int i = 0; i < CPU_SETSIZE; i++)
+        {
+            if (CPU_ISSET(i, &mask))
+            {
+                cpus.push_back(i);
+            }
+        }
+    }
+#endif
+
+    if (cpus.isEmpty())
+    {
+        for (int i = 0; i < QThread::idealThreadCount(); i++)
+        {
+            cpus.push_back(i);
+        }
+    }
+
+    return cpus;
+}
+
+int Affinity::cgroupCPUs()
+{
+    double quota = -1;
+    double period = -1;
+
+    // cgroup v2: "max 100000" or "200000 100000"
+    QStringList tokens = readLine("/sys/fs/cgroup/cpu.max").split(' ', QString::SkipEmptyParts);
+    if (tokens.size() == 2)
+    {
+        if (tokens.at(0) == "max")
+        {
+            return -1;
+        }
+        quota = tokens.at(0).toDouble();
+        period = tokens.at(1).toDouble();
+    }
+    else
+    {
+        // cgroup v1: a quota of -1 means no quota
+        QString line = readLine("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        if (!line.isEmpty())
+        {
+            quota = line.toDouble();
+            period = readLine("/sys/fs/cgroup/cpu/cpu.cfs_period_us").toDouble();
+        }
+    }
+
+    if (quota <= 0 || period <= 0)
+    {
+        return -1;
+    }
+
+    return qMax(1, int(ceil(quota / period)));
+}
+
+int Affinity::availableCPUs()
+{
+    int cpus = allowedCPUs().size();
+
+    int quota = cgroupCPUs();
+    if (quota > 0 && quota < cpus)
+    {
+        cpus = quota;
+    }
+
+    return cpus;
+}
+
+int Affinity::numaNode(int cpu)
+{
+    QDir dir(QString("/sys/devices/system/cpu/cpu%1").arg(cpu));
+    QStringList nodes = dir.entryList(QStringList() << "node*", QDir::Dirs | QDir::System);
+    if (nodes.isEmpty())
+    {
+        return 0;
+    }
+
+    bool ok = false;
+    int node = nodes.first().mid(4).toInt(&ok);
+    return ok ? node : 0;
+}
+
+QList<int> Affinity::spreadCPUs(const QList<int> &cpus)
+{
+    QMap<int, QList<int> > nodes;
+    foreach (int cpu, cpus)
+    {
+        nodes[numaNode(cpu)].push_back(cpu);
+    }
+
+    // Take one CPU from each node in turn
+    QList<int> spread;
+    for (int i = 0; spread.size() < cpus.size(); i++)
+    {
+        foreach (const QList<int> &node, nodes)
+        {
+            if (i < node.size())
+            {
+                spread.push_back(node.at(i));
+            }
+        }
+    }
+
+    return spread;
+}
+
+int Affinity::replicaCPU(int replica)
+{
+    QList<int> cpus = spreadCPUs(allowedCPUs());
+    return cpus.at(replica % cpus.size());
+}
+
+void Affinity::pinThreads(QThreadPool &threadPool, const QList<int> &cpus)
+{
+    if (cpus.isEmpty())
+    {
+        return;
+    }
+
+    // Idle workers would otherwise exit after 30 seconds, and new ones are not pinned
+    threadPool.setExpiryTimeout(-1);
+
+    PinBarrier barrier;
+    barrier.cpus = cpus;
+    barrier.size = threadPool.maxThreadCount();
+    barrier.arrived = 0;
+    barrier.left = 0;
+    barrier.failed = 0;
+
+    for (int i = 0; i < barrier.size; i++)
+    {
+        threadPool.start(new PinRunnable(barrier));
+    }
+
+    // Not QThreadPool::waitForDone(), which also deletes the workers
+    QMutexLocker locker(&barrier.mutex);
+    while (barrier.left < barrier.size)
+    {
+        barrier.condition.wait(&barrier.mutex);
+    }
+
+    if (barrier.failed > 0)
+    {
+        qDebug("langmuir: failed to pin %d of %d threads", barrier.failed, barrier.size);
+    }
+    else
+    {
+        qDebug("langmuir: pinned %d threads", barrier.size);
+    }
+}
+
+bool Affinity::pinCurrentThread(int cpu)
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+    Q_UNUSED(cpu);
+    return false;
+#endif
+}
+
+bool Affinity::pinCurrentThread(const QList<int> &cpus)
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    foreach (int cpu, cpus)
+    {
+        CPU_SET(cpu, &mask);
+    }
+    return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+    Q_UNUSED(cpus);
+    return false;
+#endif
+}
+
+void Affinity::firstTouch(void *data, std::size_t bytes)
+{
+    const std::size_t page = 4096;
+
+    // Several partitions per worker, so that they are spread over all of them
+    int threads = QThreadPool::globalInstance()->maxThreadCount();
+    std::size_t count = 8 * std::size_t(qMax(threads, 1));
+    std::size_t size = ((bytes / count) / page + 1) * page;
+
+    if (data == 0 || threads <= 1 || bytes < 64 * page)
+    {
+        if (data != 0)
+        {
+            memset(data, 0, bytes);
+        }
+        return;
+    }
+
+    QVector<Partition> partitions;
+    for (std::size_t offset = 0; offset < bytes; offset += size)
+    {
+        Partition partition;
+        partition.data = static_cast<char *>(data) + offset;
+        partition.bytes = qMin(size, bytes - offset);
+        partitions.push_back(partition);
+    }
+
+    QtConcurrent::blockingMap(partitions, Affinity::firstTouchQtConcurrent);
+}
+
+void Affinity::firstTouch(void *data, std::size_t bytes, int cpu)
+{
+    if (data == 0)
+    {
+        return;
+    }
+
+    TouchThread thread(data, bytes, cpu);
+    thread.start();
+    thread.wait();
+}
+
+void Affinity::firstTouchQtConcurrent(Partition &partition)
+{
+    memset(partition.data, 0, partition.bytes);
+}
+
+}
@@ -20,6 +20,9 @@ ChargeAgent::ChargeAgent(Agent::Type type, World &world, Grid &grid, int site,QO
     m_pathlength = 0;
     m_openClID = 0;
     m_de = 0;
+    m_fCoupling = 0;
+    m_fDirection = -1;
+    m_id = world.nextChargeAgentID();
 }
 
 ElectronAgent::ElectronAgent(World &world, int site, QObject *parent)
@@ -55,6 +58,11 @@ int ChargeAgent::lifetime()
     return m_lifetime;
 }
 
+quint64 ChargeAgent::id()
+{
+    return m_id;
+}
+
 int ChargeAgent::pathlength()
 {
     return m_pathlength;
@@ -73,7 +81,7 @@ int ChargeAgent::getOpenCLID()
 void ChargeAgent::chooseFuture()
 {
     // Select a proposed transport site at random
-    m_fSite = m_neighbors[m_world.randomNumberGenerator().integer(0, m_neighbors.size()-1)];
+    m_fSite = m_grid.proposeNeighbor(m_site, m_fCoupling, m_fDirection);
     m_de = 0;
 }
 
@@ -96,25 +104,35 @@ void ChargeAgent::decideFuture()
     {
     case Agent::Empty:
     {
-        // Potential difference between sites
-        double pd = m_grid.potential(m_fSite)- m_grid.potential(m_site);
-        pd *= m_charge;
-
-        // Coulomb interactions
-        // Don't worry, it's zero if coulomb interactions are off
-        pd += m_de;
-
-        // Calculate the coupling constant...
-        int dx = m_grid.xDistancei(m_site, m_fSite);
-        int dy = m_grid.yDistancei(m_site, m_fSite);
-        int dz = m_grid.zDistancei(m_site, m_fSite);
-        double coupling = m_world.couplingConstants()[dx][dy][dz];
-
-        // Metropolis criterion
-        if(m_world.randomNumberGenerator().metropolisWithCoupling(
-                 pd,
-                 m_world.parameters().inverseKT,
-                 coupling))
+        Random &random = m_world.randomNumberGenerator();
+        bool accept = false;
+        if (m_grid.hasAcceptanceTable())
+        {
+            // The Boltzmann factor is in the table (see Grid::updateAcceptance)
+            accept = m_fCoupling * m_grid.acceptance(m_site, m_fDirection) > random.random();
+        }
+        else
+        {
+            // Potential difference between sites
+            double pd = m_grid.potentialDifference(m_fSite, m_site);
+            pd *= m_charge;
+
+            // Coulomb interactions
+            // Don't worry, it's zero if coulomb interactions are off
+            pd += m_de;
+
+            // Metropolis criterion (the coupling constant was found by chooseFuture)
+            if (m_world.parameters().metropolisFast)
+            {
+                accept = random.metropolisWithCouplingFast(pd, m_world.parameters().inverseKT, m_fCoupling);
+            }
+            else
+            {
+                accept = random.metropolisWithCoupling(pd, m_world.parameters().inverseKT, m_fCoupling);
+            }
+        }
+
+        if(accept)
         {
             // Accept move - increase distance traveled
             m_pathlength += 1;
@@ -131,18 +149,10 @@ void ChargeAgent::decideFuture()
 
     case Agent::Drain:
     {
-        DrainAgent *drain = dynamic_cast<DrainAgent*>(m_grid.agentAddress(m_fSite));
-        if(drain)
-        {
-            if(drain->tryToAccept(this))
-            {
-                m_pathlength += 1;
-                break;
-            }
-        }
-        else
+        if(m_grid.drainAddress(m_fSite)->tryToAccept(this))
         {
-            qFatal("langmuir: can not cast pointer to DrainAgent");
+            m_pathlength += 1;
+            break;
         }
         // Reject the move
         m_fSite = m_site;
@@ -214,6 +224,43 @@ double ChargeAgent::coulombInteraction()
 
 void ChargeAgent::coulombCPU()
 {
+    bool gauss = m_world.parameters().coulombGaussianSigma > 0;
+    bool defects = m_world.parameters().defectsCharge != 0;
+
+    if (gauss)
+    {
+        if (defects)
+        {
+            coulombCPU<true, true>();
+        }
+        else
+        {
+            coulombCPU<true, false>();
+        }
+    }
+    else
+    {
+        if (defects)
+        {
+            coulombCPU<false, true>();
+        }
+        else
+        {
+            coulombCPU<false, false>();
+        }
+    }
+}
+
+template <bool Gauss, bool Defects>
+void ChargeAgent::coulombCPU()
+{
+    // Staying put (see Grid::proposeNeighbor) is always rejected
+    if (m_fSite == m_site)
+    {
+        m_de = 0;
+        return;
+    }
+
     double p1 = 0;
     double p2 = 0;
 
@@ -224,7 +271,7 @@ void ChargeAgent::coulombCPU()
     double self = m_world.sI()[1][0][0] * m_charge;
 
     // Gaussian charges
-    if (m_world.parameters().coulombGaussianSigma > 0)
+    if (Gauss)
     {
         // Electrons
         p1 += m_world.potential().gaussE(m_site);
@@ -235,7 +282,7 @@ void ChargeAgent::coulombCPU()
         p2 += m_world.potential().gaussH(m_fSite);
 
         // Charged defects
-        if(m_world.parameters().defectsCharge != 0)
+        if (Defects)
         {
             p1 += m_world.potential().gaussD(m_site);
             p2 += m_world.potential().gaussD(m_fSite);
@@ -253,7 +300,7 @@ void ChargeAgent::coulombCPU()
         p2 += m_world.potential().coulombH(m_fSite);
 
         // Charged defects
-        if(m_world.parameters().defectsCharge != 0)
+        if (Defects)
         {
             p1 += m_world.potential().coulombD(m_site);
             p2 += m_world.potential().coulombD(m_fSite);
@@ -270,6 +317,11 @@ void ChargeAgent::coulombCPU()
     m_de = m_charge * (p2 - p1);
 }
 
+template void ChargeAgent::coulombCPU<true, true>();
+template void ChargeAgent::coulombCPU<true, false>();
+template void ChargeAgent::coulombCPU<false, true>();
+template void ChargeAgent::coulombCPU<false, false>();
+
 void ChargeAgent::coulombGPU()
 {
     double p1 = 0;
@@ -7,13 +7,152 @@
 #include "fluxagent.h"
 #include "gzipper.h"
 
+#include <QDataStream>
+#include <QtEndian>
+#include <QFile>
+
 #include <fstream>
+#include <sstream>
+#include <cstring>
+#include <climits>
 #include <limits>
 #include <iomanip>
+#include <zlib.h>
 
 namespace LangmuirCore
 {
 
+namespace
+{
+
+// The binary format (output.chk.format = binary), all numbers little-endian:
+//   header  : magic (8 bytes), version (quint32), number of sections (quint32),
+//             CRC-32 of the table of sections (quint32), zero (quint32)
+//   table   : for each section, the CheckPointer::Section (quint32), CRC-32 of
+//             the section (quint32), offset from the start of the file (quint64),
+//             and size in bytes (quint64)
+//   sections: each starts at a multiple of 8 bytes
+//     - Electrons, Holes, Defects, Traps: qint32 site ids
+//     - TrapPotentials: doubles
+//     - FluxState: quint64 attempts and successes
+//     - RandomState: the random number generator, written by a little-endian QDataStream
+//     - Parameters: key = value lines, as in the text format
+const char binaryMagic[8] = {'L', 'A', 'N', 'G', 'C', 'H', 'K', '\0'};
+const int binaryHeaderSize = 24;
+const int binaryEntrySize = 24;
+
+//! A read only std::streambuf over memory, to parse text files without a copy
+class MemoryBuffer : public std::streambuf
+{
+public:
+    MemoryBuffer(const char *data, quint64 size)
+    {
+        char *begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+quint64 align8(quint64 offset)
+{
+    return (offset + 7) & ~quint64(7);
+}
+
+//! The CRC-32 of data, computed by zlib in pieces (its lengths are 32 bits)
+quint32 checksum(const uchar *data, quint64 size)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (size > 0)
+    {
+        uInt piece = uInt(qMin<quint64>(size, 1u << 30));
+        crc = crc32(crc, data, piece);
+        data += piece;
+        size -= piece;
+    }
+    return quint32(crc);
+}
+
+QList<int> fromAgents(const QList<ChargeAgent*> &charges)
+{
+    QList<int> result;
+    foreach (ChargeAgent *charge, charges)
+    {
+        result.push_back(charge->getCurrentSite());
+    }
+    return result;
+}
+
+QByteArray fromSites(const QList<int> &values)
+{
+    QByteArray result(values.size() * 4, '\0');
+    uchar *data = reinterpret_cast<uchar*>(result.data());
+    for (int i = 0; i < values.size(); i++)
+    {
+        qToLittleEndian<qint32>(values.at(i), data + 4 * i);
+    }
+    return result;
+}
+
+QByteArray fromWords(const QList<quint64> &values)
+{
+    QByteArray result(values.size() * 8, '\0');
+    uchar *data = reinterpret_cast<uchar*>(result.data());
+    for (int i = 0; i < values.size(); i++)
+    {
+        qToLittleEndian<quint64>(values.at(i), data + 8 * i);
+    }
+    return result;
+}
+
+QByteArray fromDoubles(const QList<double> &values)
+{
+    QList<quint64> words;
+    foreach (double value, values)
+    {
+        quint64 word;
+        memcpy(&word, &value, sizeof(word));
+        words.push_back(word);
+    }
+    return fromWords(words);
+}
+
+QList<int> toSites(const uchar *data, quint64 size)
+{
+    QList<int> result;
+    result.reserve(int(size / 4));
+    for (quint64 i = 0; i < size / 4; i++)
+    {
+        result.push_back(qFromLittleEndian<qint32>(data + 4 * i));
+    }
+    return result;
+}
+
+QList<quint64> toWords(const uchar *data, quint64 size)
+{
+    QList<quint64> result;
+    result.reserve(int(size / 8));
+    for (quint64 i = 0; i < size / 8; i++)
+    {
+        result.push_back(qFromLittleEndian<quint64>(data + 8 * i));
+    }
+    return result;
+}
+
+QList<double> toDoubles(const uchar *data, quint64 size)
+{
+    QList<double> result;
+    result.reserve(int(size / 8));
+    for (quint64 i = 0; i < size / 8; i++)
+    {
+        quint64 word = qFromLittleEndian<quint64>(data + 8 * i);
+        double value;
+        memcpy(&value, &word, sizeof(value));
+        result.push_back(value);
+    }
+    return result;
+}
+
+}
+
 CheckPointer::CheckPointer(World &world, QObject *parent) :
     QObject(parent), m_world(world)
 {
@@ -21,24 +160,102 @@ CheckPointer::CheckPointer(World &world, QObject *parent) :
 
 void CheckPointer::load(const QString &fileName, ConfigurationInfo &configInfo)
 {
-    // Unzip the input file
-    bool wasZipped = false;
-    QString unzipped = gunzip(fileName, &wasZipped);
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qFatal("langmuir: error opening file: %s",qPrintable(fileName));
+    }
 
-    // Open the stream
-    std::ifstream stream;
-    stream.open(unzipped.toLatin1().constData());
+    // A QByteArray holds at most INT_MAX bytes
+    if (file.size() > INT_MAX)
+    {
+        qFatal("langmuir: file is too large (%lld bytes): %s",
+               file.size(), qPrintable(fileName));
+    }
 
-    if (!stream)
+    // Map the file; read it if that is not possible
+    QByteArray contents;
+    uchar *mapped = file.map(0, file.size());
+    if (mapped != NULL)
     {
-        qFatal("langmuir: error opening file: %s",qPrintable(fileName));
+        contents = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), int(file.size()));
+    }
+    else
+    {
+        contents = file.readAll();
     }
 
+    // Gzipped files are decompressed in memory, whatever their name
+    if (isGzipped(contents))
+    {
+        qDebug("langmuir: decompressing %s", qPrintable(fileName));
+        contents = gunzip(contents);
+    }
+
+    // We need to be careful with the random number generator
+    bool readRandomState = false;
+
+    // Binary files start with a magic number, whatever output.chk.format is
+    if (isBinary(contents))
+    {
+        readRandomState = loadBinary(contents, fileName, configInfo);
+    }
+    else
+    {
+        readRandomState = loadText(contents, configInfo);
+    }
+
+    contents.clear();
+    if (mapped != NULL)
+    {
+        file.unmap(mapped);
+    }
+
+    // The engine of a saved state wins over random.engine
+    Random &random = m_world.randomNumberGenerator();
+    if (readRandomState)
+    {
+        QString engine = RandomEngine::name(random.engine());
+        if (m_world.parameters().randomEngine != engine)
+        {
+            qDebug("langmuir: ignoring random.engine = %s; the saved state is %s",
+                   qPrintable(m_world.parameters().randomEngine), qPrintable(engine));
+            m_world.parameters().randomEngine = engine;
+        }
+    }
+    else
+    {
+        random.setEngine(RandomEngine::toType(m_world.parameters().randomEngine));
+    }
+
+    // Seed the random number generator correctly
+    if (m_world.parameters().randomSeed > 0)
+    {
+        if (readRandomState)
+        {
+            qDebug("langmuir: ignoring random.seed = %d",
+                     (unsigned int)m_world.parameters().randomSeed);
+        }
+        else
+        {
+            qDebug("langmuir: seeding random number generator with random.seed = %d",
+                     (unsigned int)m_world.parameters().randomSeed);
+            m_world.randomNumberGenerator().seed(m_world.parameters().randomSeed);
+        }
+    }
+}
+
+bool CheckPointer::loadText(const QByteArray &contents, ConfigurationInfo &configInfo)
+{
+    // Open the stream
+    MemoryBuffer buffer(contents.constData(), contents.size());
+    std::istream stream(&buffer);
+
     // Get the QMetaEnum object to map strings to the correct enum
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
     QMetaEnum QME = QMO.enumerator(QMO.indexOfEnumerator("Section"));
 
-    // We need to be careful with the random number generator
+    // Whether there is a RandomState section
     bool readRandomState = false;
 
     qDebug("langmuir: reading input file");
@@ -139,57 +356,362 @@ void CheckPointer::load(const QString &fileName, ConfigurationInfo &configInfo)
         }
     }
 
-    // Seed the random number generator correctly
-    if (m_world.parameters().randomSeed > 0)
+    return readRandomState;
+}
+
+void CheckPointer::save(const QString& fileName)
+{
+    CheckPointState state;
+    takeState(state, fileName);
+    write(state);
+}
+
+void CheckPointer::takeState(CheckPointState &state, const QString &fileName)
+{
+    QString name = fileName;
+    if (m_world.parameters().outputGzip && !name.endsWith(".gz"))
     {
-        if (readRandomState)
+        name.append(".gz");
+    }
+
+    // The name is resolved now, as %step changes while the state waits to be written
+    OutputInfo info(name,&m_world.parameters());
+    state.fileName = info.absoluteFilePath();
+    state.binary = m_world.parameters().outputChkFormat == "binary";
+    state.trapPotential = m_world.parameters().outputChkTrapPotential;
+
+    state.electrons = fromAgents(m_world.electrons());
+    state.holes = fromAgents(m_world.holes());
+    state.defects = m_world.defectSiteIDs();
+    state.traps = m_world.trapSiteIDs();
+    state.trapPotentials.clear();
+    if (state.trapPotential)
+    {
+        state.trapPotentials = m_world.trapSitePotentials();
+    }
+
+    state.fluxInfo.clear();
+    foreach (FluxAgent *flux, m_world.fluxes())
+    {
+        state.fluxInfo << flux->attempts() << flux->successes();
+    }
+
+    state.randomBinary.clear();
+    QDataStream randomStream(&state.randomBinary, QIODevice::WriteOnly);
+    randomStream.setByteOrder(QDataStream::LittleEndian);
+    randomStream << m_world.randomNumberGenerator();
+
+    std::ostringstream randomText;
+    randomText << m_world.randomNumberGenerator();
+    state.randomText = randomText.str();
+
+    std::ostringstream parameters;
+    parameters << m_world.keyValueParser();
+    state.parameters = parameters.str();
+}
+
+void CheckPointer::write(const CheckPointState &state)
+{
+    if (state.binary)
+    {
+        writeBinary(state);
+    }
+    else
+    {
+        writeText(state);
+    }
+}
+
+void CheckPointer::saveText(const QString& fileName)
+{
+    CheckPointState state;
+    takeState(state, fileName);
+    writeText(state);
+}
+
+void CheckPointer::writeText(const CheckPointState &state)
+{
+    const QString &fileName = state.fileName;
+
+    // Files named *.gz are written to memory and compressed
+    bool compress = fileName.endsWith(".gz");
+    std::ofstream file;
+    std::ostringstream buffer;
+    std::ostream &stream = compress ? static_cast<std::ostream&>(buffer) : file;
+
+    if (!compress)
+    {
+        file.open(fileName.toLatin1().constData());
+        if (!file)
         {
-            qDebug("langmuir: ignoring random.seed = %d",
-                     (unsigned int)m_world.parameters().randomSeed);
+            qFatal("langmuir: error opening file: %s",qPrintable(fileName));
         }
-        else
+    }
+
+    saveElectrons(stream, state)      << '\n';
+    saveHoles(stream, state)          << '\n';
+    saveDefects(stream, state)        << '\n';
+    saveTraps(stream, state)          << '\n';
+
+    if (state.trapPotential)
+    {
+        saveTrapPotentials(stream, state) << '\n';
+    }
+
+    saveFluxState(stream, state)      << '\n';
+    saveRandomState(stream, state)    << '\n';
+    saveParameters(stream, state);
+
+    if (compress)
+    {
+        std::string text = buffer.str();
+        QFile output(fileName);
+        QByteArray data = gzip(QByteArray(text.data(), int(text.size())));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+             output.write(data) != data.size())
         {
-            qDebug("langmuir: seeding random number generator with random.seed = %d",
-                     (unsigned int)m_world.parameters().randomSeed);
-            m_world.randomNumberGenerator().seed(m_world.parameters().randomSeed);
+            qFatal("langmuir: error writing file: %s",qPrintable(fileName));
         }
+        output.close();
     }
-
-    // zip the input file
-    if (wasZipped)
+    else
     {
-        gzip(unzipped);
+        stream.flush();
     }
 }
 
-void CheckPointer::save(const QString& fileName)
+bool CheckPointer::isBinary(const QByteArray &contents)
+{
+    return contents.size() >= int(sizeof(binaryMagic)) &&
+           memcmp(contents.constData(), binaryMagic, sizeof(binaryMagic)) == 0;
+}
+
+void CheckPointer::saveBinary(const QString &fileName)
 {
-    //qDebug("langmuir: saving checkpoint file: %d", m_world.parameters().currentStep);
-    OutputInfo info(fileName,&m_world.parameters());
+    CheckPointState state;
+    takeState(state, fileName);
+    writeBinary(state);
+}
+
+void CheckPointer::writeBinary(const CheckPointState &state)
+{
+    const QString &fileName = state.fileName;
+
+    // The sections, in the same order as the text format
+    QList<int> sections;
+    QList<QByteArray> contents;
+
+    sections << Electrons;
+    contents << fromSites(state.electrons);
+
+    sections << Holes;
+    contents << fromSites(state.holes);
+
+    sections << Defects;
+    contents << fromSites(state.defects);
 
-    std::ofstream stream;
-    stream.open(info.absoluteFilePath().toLatin1().constData());
+    sections << Traps;
+    contents << fromSites(state.traps);
 
-    if (!stream)
+    if (state.trapPotential)
+    {
+        sections << TrapPotentials;
+        contents << fromDoubles(state.trapPotentials);
+    }
+
+    sections << FluxState;
+    contents << fromWords(state.fluxInfo);
+
+    sections << RandomState;
+    contents << state.randomBinary;
+
+    sections << Parameters;
+    contents << QByteArray(state.parameters.data(), int(state.parameters.size()));
+
+    // The table of sections
+    int count = sections.size();
+    QByteArray table(count * binaryEntrySize, '\0');
+    quint64 offset = align8(binaryHeaderSize + table.size());
+    for (int i = 0; i < count; i++)
+    {
+        uchar *entry = reinterpret_cast<uchar*>(table.data()) + i * binaryEntrySize;
+        const QByteArray &data = contents.at(i);
+        qToLittleEndian<quint32>(sections.at(i), entry);
+        qToLittleEndian<quint32>(checksum(reinterpret_cast<const uchar*>(data.constData()), data.size()), entry + 4);
+        qToLittleEndian<quint64>(offset, entry + 8);
+        qToLittleEndian<quint64>(data.size(), entry + 16);
+        offset = align8(offset + data.size());
+    }
+
+    QByteArray header(binaryHeaderSize, '\0');
+    uchar *h = reinterpret_cast<uchar*>(header.data());
+    memcpy(h, binaryMagic, sizeof(binaryMagic));
+    qToLittleEndian<quint32>(BinaryVersion, h + 8);
+    qToLittleEndian<quint32>(count, h + 12);
+    qToLittleEndian<quint32>(checksum(reinterpret_cast<const uchar*>(table.constData()), table.size()), h + 16);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
     {
         qFatal("langmuir: error opening file: %s",qPrintable(fileName));
     }
 
-    saveElectrons(stream)      << '\n';
-    saveHoles(stream)          << '\n';
-    saveDefects(stream)        << '\n';
-    saveTraps(stream)          << '\n';
+    // Files named *.gz are compressed as they are written
+    GzipDevice gzipDevice(&file);
+    QIODevice *device = &file;
+    if (fileName.endsWith(".gz"))
+    {
+        gzipDevice.open(QIODevice::WriteOnly);
+        device = &gzipDevice;
+    }
+
+    const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    bool ok = device->write(header) == header.size();
+    ok = ok && device->write(table) == table.size();
+    quint64 position = header.size() + table.size();
+    for (int i = 0; i < count; i++)
+    {
+        ok = ok && device->write(padding, align8(position) - position) >= 0;
+        ok = ok && device->write(contents.at(i)) == contents.at(i).size();
+        position = align8(position) + contents.at(i).size();
+    }
+    gzipDevice.close();
+    if (!ok)
+    {
+        qFatal("langmuir: error writing file: %s",qPrintable(fileName));
+    }
+    file.close();
+}
+
+bool CheckPointer::loadBinary(const QByteArray &input, const QString &fileName, ConfigurationInfo &configInfo)
+{
+    const uchar *data = reinterpret_cast<const uchar*>(input.constData());
+    quint64 size = input.size();
+
+    qDebug("langmuir: reading binary input file");
 
-    if (m_world.parameters().outputChkTrapPotential)
+    // Check the header
+    if (size < quint64(binaryHeaderSize))
     {
-        saveTrapPotentials(stream) << '\n';
+        qFatal("langmuir: binary file %s is truncated", qPrintable(fileName));
     }
+    quint32 version = qFromLittleEndian<quint32>(data + 8);
+    quint32 count = qFromLittleEndian<quint32>(data + 12);
+    if (version > BinaryVersion)
+    {
+        qFatal("langmuir: binary file %s has version %u; this version of langmuir reads version %u or older",
+               qPrintable(fileName), version, BinaryVersion);
+    }
+    if (binaryHeaderSize + quint64(count) * binaryEntrySize > size)
+    {
+        qFatal("langmuir: binary file %s is truncated", qPrintable(fileName));
+    }
+    const uchar *table = data + binaryHeaderSize;
+    if (checksum(table, count * binaryEntrySize) != qFromLittleEndian<quint32>(data + 16))
+    {
+        qFatal("langmuir: checksum error in the table of sections of %s", qPrintable(fileName));
+    }
+
+    // Get the QMetaEnum object to map sections to strings
+    const QMetaObject &QMO = CheckPointer::staticMetaObject;
+    QMetaEnum QME = QMO.enumerator(QMO.indexOfEnumerator("Section"));
+
+    // Whether there is a RandomState section
+    bool readRandomState = false;
+
+    for (quint32 i = 0; i < count; i++)
+    {
+        const uchar *entry = table + i * binaryEntrySize;
+        quint32 section = qFromLittleEndian<quint32>(entry);
+        quint32 expected = qFromLittleEndian<quint32>(entry + 4);
+        quint64 offset = qFromLittleEndian<quint64>(entry + 8);
+        quint64 bytes = qFromLittleEndian<quint64>(entry + 16);
+
+        const char *name = QME.valueToKey(section);
+        if (name == NULL)
+        {
+            // Written by a newer version
+            qDebug("langmuir: skipping unknown section %u", section);
+            continue;
+        }
+        if (offset > size || bytes > size - offset)
+        {
+            qFatal("langmuir: section %s of %s is truncated", name, qPrintable(fileName));
+        }
+        const uchar *contents = data + offset;
+        if (checksum(contents, bytes) != expected)
+        {
+            qFatal("langmuir: checksum error in section %s of %s", name, qPrintable(fileName));
+        }
+
+        switch (section)
+        {
+            case Parameters:
+            {
+                QString text = QString::fromLatin1(reinterpret_cast<const char*>(contents), int(bytes));
+                foreach (QString line, text.split('\n'))
+                {
+                    m_world.keyValueParser().parse(line.trimmed());
+                }
+                break;
+            }
+
+            case Electrons:
+            {
+                configInfo.electrons = toSites(contents, bytes);
+                break;
+            }
+
+            case Holes:
+            {
+                configInfo.holes = toSites(contents, bytes);
+                break;
+            }
+
+            case Defects:
+            {
+                configInfo.defects = toSites(contents, bytes);
+                break;
+            }
+
+            case Traps:
+            {
+                configInfo.traps = toSites(contents, bytes);
+                break;
+            }
+
+            case TrapPotentials:
+            {
+                configInfo.trapPotentials = toDoubles(contents, bytes);
+                break;
+            }
+
+            case RandomState:
+            {
+                QByteArray random = QByteArray::fromRawData(reinterpret_cast<const char*>(contents), int(bytes));
+                QDataStream randomStream(random);
+                randomStream.setByteOrder(QDataStream::LittleEndian);
+                randomStream >> m_world.randomNumberGenerator();
+                qDebug("langmuir: loaded a random number generator state");
+                readRandomState = true;
+                break;
+            }
 
-    saveFluxState(stream)      << '\n';
-    saveRandomState(stream)    << '\n';
-    saveParameters(stream);
+            case FluxState:
+            {
+                configInfo.fluxInfo = toWords(contents, bytes);
+                break;
+            }
 
-    stream.flush();
+            default:
+            {
+                qDebug("langmuir: skipping unknown section %u", section);
+                break;
+            }
+        }
+    }
+
+    return readRandomState;
 }
 
 void CheckPointer::checkStream(std::istream& stream, const QString& message)
@@ -472,7 +994,7 @@ std::istream& CheckPointer::loadFluxState(std::istream &stream, ConfigurationInf
     return stream;
 }
 
-std::ostream& CheckPointer::saveElectrons(std::ostream &stream)
+std::ostream& CheckPointer::saveElectrons(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -481,17 +1003,17 @@ std::ostream& CheckPointer::saveElectrons(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << '\n' << m_world.electrons().size();
-    foreach(ChargeAgent* charge, m_world.electrons())
+    stream << '\n' << state.electrons.size();
+    foreach(int site, state.electrons)
     {
-        stream << '\n' << charge->getCurrentSite();
+        stream << '\n' << site;
     }
 
     // Return the stream
     return stream;
 }
 
-std::ostream& CheckPointer::saveHoles(std::ostream &stream)
+std::ostream& CheckPointer::saveHoles(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -500,17 +1022,17 @@ std::ostream& CheckPointer::saveHoles(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << '\n' << m_world.holes().size();
-    foreach(ChargeAgent* charge, m_world.holes())
+    stream << '\n' << state.holes.size();
+    foreach(int site, state.holes)
     {
-        stream << '\n' << charge->getCurrentSite();
+        stream << '\n' << site;
     }
 
     // Return the stream
     return stream;
 }
 
-std::ostream& CheckPointer::saveDefects(std::ostream &stream)
+std::ostream& CheckPointer::saveDefects(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -519,8 +1041,8 @@ std::ostream& CheckPointer::saveDefects(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << '\n' << m_world.defectSiteIDs().size();
-    foreach(int site, m_world.defectSiteIDs())
+    stream << '\n' << state.defects.size();
+    foreach(int site, state.defects)
     {
         stream << '\n' << site;
     }
@@ -529,7 +1051,7 @@ std::ostream& CheckPointer::saveDefects(std::ostream &stream)
     return stream;
 }
 
-std::ostream& CheckPointer::saveTraps(std::ostream &stream)
+std::ostream& CheckPointer::saveTraps(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -538,8 +1060,8 @@ std::ostream& CheckPointer::saveTraps(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << '\n' << m_world.trapSiteIDs().size();
-    foreach(int site, m_world.trapSiteIDs())
+    stream << '\n' << state.traps.size();
+    foreach(int site, state.traps)
     {
         stream << '\n' << site;
     }
@@ -548,7 +1070,7 @@ std::ostream& CheckPointer::saveTraps(std::ostream &stream)
     return stream;
 }
 
-std::ostream& CheckPointer::saveTrapPotentials(std::ostream &stream)
+std::ostream& CheckPointer::saveTrapPotentials(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -557,11 +1079,11 @@ std::ostream& CheckPointer::saveTrapPotentials(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << '\n' << m_world.trapSitePotentials().size();
+    stream << '\n' << state.trapPotentials.size();
 
     int precision = std::numeric_limits<double>::digits10+2;
     stream << std::scientific;
-    foreach(double value, m_world.trapSitePotentials())
+    foreach(double value, state.trapPotentials)
     {
         stream << '\n' << std::setprecision(precision) << value;
     }
@@ -570,7 +1092,7 @@ std::ostream& CheckPointer::saveTrapPotentials(std::ostream &stream)
     return stream;
 }
 
-std::ostream& CheckPointer::saveParameters(std::ostream &stream)
+std::ostream& CheckPointer::saveParameters(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -579,13 +1101,13 @@ std::ostream& CheckPointer::saveParameters(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << m_world.keyValueParser();
+    stream << state.parameters;
 
     // Return the stream
     return stream;
 }
 
-std::ostream& CheckPointer::saveRandomState(std::ostream &stream)
+std::ostream& CheckPointer::saveRandomState(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -594,13 +1116,13 @@ std::ostream& CheckPointer::saveRandomState(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << '\n' << m_world.randomNumberGenerator();
+    stream << '\n' << state.randomText;
 
     // Return the stream
     return stream;
 }
 
-std::ostream& CheckPointer::saveFluxState(std::ostream &stream)
+std::ostream& CheckPointer::saveFluxState(std::ostream &stream, const CheckPointState &state)
 {
     // Get the section name
     const QMetaObject &QMO = CheckPointer::staticMetaObject;
@@ -609,11 +1131,10 @@ std::ostream& CheckPointer::saveFluxState(std::ostream &stream)
 
     // Output info
     stream << '[' << name << ']';
-    stream << '\n' << m_world.fluxes().size() * 2;
-    foreach (FluxAgent *flux, m_world.fluxes())
+    stream << '\n' << state.fluxInfo.size();
+    foreach (quint64 value, state.fluxInfo)
     {
-        stream << '\n' << flux->attempts();
-        stream << '\n' << flux->successes();
+        stream << '\n' << value;
     }
 
     // Return the stream
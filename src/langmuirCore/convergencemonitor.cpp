@@ -0,0 +1,136 @@
+#include "convergencemonitor.h"
+#include "parameters.h"
+#include "fluxagent.h"
+#include "world.h"
+
+#include <cmath>
+
+namespace LangmuirCore
+{
+
+ConvergenceMonitor::ConvergenceMonitor(World &world, QObject *parent)
+    : QObject(parent), m_world(world)
+{
+    reset();
+}
+
+ConvergenceMonitor::~ConvergenceMonitor()
+{
+}
+
+void ConvergenceMonitor::reset()
+{
+    m_drainSamples.clear();
+    m_sourceSamples.clear();
+    m_lastDrainSuccesses = 0;
+    m_lastSourceSuccesses = 0;
+    m_lastStep = 0;
+    m_started = false;
+    m_converged = false;
+}
+
+void ConvergenceMonitor::update()
+{
+    SimulationParameters &par = m_world.parameters();
+
+    if (par.convergenceError <= 0)
+    {
+        return;
+    }
+
+    // A sweep started a new point
+    if (m_started && par.currentStep < m_lastStep)
+    {
+        reset();
+    }
+
+    quint64 drainSuccesses = 0;
+    quint64 sourceSuccesses = 0;
+    foreach (FluxAgent *flux, m_world.fluxes())
+    {
+        if (flux->getType() == Agent::Drain)
+        {
+            drainSuccesses += flux->successes();
+        }
+        else
+        {
+            sourceSuccesses += flux->successes();
+        }
+    }
+
+    if (m_started && par.currentStep > m_lastStep && m_lastStep >= quint32(par.convergenceMinSteps))
+    {
+        double steps = par.currentStep - m_lastStep;
+        m_drainSamples.push_back((drainSuccesses - m_lastDrainSuccesses) / steps);
+        m_sourceSamples.push_back((sourceSuccesses - m_lastSourceSuccesses) / steps);
+    }
+
+    m_lastDrainSuccesses = drainSuccesses;
+    m_lastSourceSuccesses = sourceSuccesses;
+    m_lastStep = par.currentStep;
+    m_started = true;
+
+    if (m_converged)
+    {
+        return;
+    }
+
+    double drainError = relativeError(m_drainSamples, par.convergenceBatches);
+    double sourceError = relativeError(m_sourceSamples, par.convergenceBatches);
+
+    if (drainError >= 0 && drainError < par.convergenceError &&
+        sourceError >= 0 && sourceError < par.convergenceError)
+    {
+        m_converged = true;
+        qDebug("langmuir: converged at step %u; drain error = %g; source error = %g",
+               par.currentStep, drainError, sourceError);
+    }
+}
+
+bool ConvergenceMonitor::isConverged() const
+{
+    return m_converged;
+}
+
+double ConvergenceMonitor::relativeError(const QVector<double> &samples, int batches)
+{
+    // At least two samples per batch
+    if (batches < 2 || samples.size() < 2 * batches)
+    {
+        return -1;
+    }
+
+    // Use the most recent samples that fill the batches evenly
+    int size = samples.size() / batches;
+    int first = samples.size() - size * batches;
+
+    QVector<double> means(batches, 0.0);
+    double mean = 0.0;
+    for (int i = 0; i < batches; i++)
+    {
+        for (int j = 0; j < size; j++)
+        {
+            means[i] += samples.at(first + i * size + j);
+        }
+        means[i] /= size;
+        mean += means[i];
+    }
+    mean /= batches;
+
+    double variance = 0.0;
+    for (int i = 0; i < batches; i++)
+    {
+        variance += (means[i] - mean) * (means[i] - mean);
+    }
+    variance /= (batches - 1);
+
+    // Nothing has flowed yet, which says nothing about the steady state
+    if (mean == 0)
+    {
+        return -1;
+    }
+
+    return sqrt(variance / batches) / fabs(mean);
+}
+
+}
@@ -0,0 +1,205 @@
+#include "coulombtuner.h"
+#include "parameters.h"
+#include "output.h"
+#include "world.h"
+
+namespace LangmuirCore
+{
+
+CoulombTuner::CoulombTuner(World &world, QObject *parent)
+    : QObject(parent), m_world(world), m_backend(ThreadedCPU), m_nsecs(NumBackends, 0),
+      m_samples(NumBackends, 0), m_timing(false), m_lastStep(0), m_tuned(false), m_stream(0)
+{
+    SimulationParameters &par = m_world.parameters();
+
+    if (par.outputIsOn && par.coulombCarriers && par.coulombTunerInterval > 0)
+    {
+        m_stream = new OutputStream(par.outputGzip ? "%stub-tuner.dat.gz" : "%stub-tuner.dat", &par, this);
+        *m_stream << right
+                  << qSetFieldWidth(par.outputWidth)
+                  << "simulation:time"
+                  << "carriers"
+                  << "serial:nsecs"
+                  << "threaded:nsecs"
+                  << "opencl:nsecs"
+                  << "backend"
+                  << newline;
+        m_stream->flush();
+    }
+}
+
+CoulombTuner::~CoulombTuner()
+{
+}
+
+CoulombTuner::Backend CoulombTuner::backend() const
+{
+    SimulationParameters &par = m_world.parameters();
+
+    if (par.coulombTunerInterval > 0)
+    {
+        return m_backend;
+    }
+
+    // Use OpenCL if there are a lot of charges
+    if (isAvailable(OpenCL) && m_world.numChargeAgents() > par.openclThreshold)
+    {
+        return OpenCL;
+    }
+    return ThreadedCPU;
+}
+
+bool CoulombTuner::isDue() const
+{
+    SimulationParameters &par = m_world.parameters();
+
+    if (par.coulombTunerInterval <= 0)
+    {
+        return false;
+    }
+
+    if (!m_tuned || m_timing)
+    {
+        return true;
+    }
+
+    // currentStep is reset by sweeps
+    return par.currentStep < m_lastStep ||
+           par.currentStep - m_lastStep >= quint32(par.coulombTunerInterval);
+}
+
+bool CoulombTuner::isAvailable(Backend backend) const
+{
+    switch (backend)
+    {
+        case SerialCPU:
+        case ThreadedCPU:
+        {
+            return true;
+        }
+        case OpenCL:
+        {
+            return m_world.parameters().useOpenCL;
+        }
+        default:
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+CoulombTuner::Backend CoulombTuner::nextBackend() const
+{
+    Backend next = ThreadedCPU;
+    for (int i = 0; i < NumBackends; i++)
+    {
+        if (isAvailable(Backend(i)) && m_samples[i] < m_samples[next])
+        {
+            next = Backend(i);
+        }
+    }
+    return next;
+}
+
+void CoulombTuner::record(Backend backend, qint64 nsecs)
+{
+    m_nsecs[backend] += nsecs;
+    m_samples[backend] += 1;
+    m_timing = true;
+}
+
+bool CoulombTuner::isComplete() const
+{
+    for (int i = 0; i < NumBackends; i++)
+    {
+        if (isAvailable(Backend(i)) && m_samples[i] < m_world.parameters().coulombTunerSamples)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CoulombTuner::decide()
+{
+    SimulationParameters &par = m_world.parameters();
+
+    // Average the times, -1 if a backend was not timed
+    QVector<qint64> nsecs(NumBackends, -1);
+    for (int i = 0; i < NumBackends; i++)
+    {
+        if (m_samples[i] > 0)
+        {
+            nsecs[i] = m_nsecs[i] / m_samples[i];
+        }
+    }
+
+    // Find the fastest backend
+    Backend best = m_backend;
+    for (int i = 0; i < NumBackends; i++)
+    {
+        if (nsecs[i] >= 0 && (nsecs[best] < 0 || nsecs[i] < nsecs[best]))
+        {
+            best = Backend(i);
+        }
+    }
+
+    // Only switch if it is faster by enough
+    if (best != m_backend && nsecs[m_backend] >= 0 &&
+        nsecs[best] >= (1.0 - par.coulombTunerHysteresis) * nsecs[m_backend])
+    {
+        best = m_backend;
+    }
+
+    if (best != m_backend || !m_tuned)
+    {
+        qDebug("langmuir: coulomb backend %s at step %u (%d carriers)",
+               qPrintable(toQString(best)), par.currentStep, m_world.numChargeAgents());
+    }
+
+    if (m_stream)
+    {
+        *m_stream << par.currentStep
+                  << m_world.numChargeAgents()
+                  << nsecs[SerialCPU]
+                  << nsecs[ThreadedCPU]
+                  << nsecs[OpenCL]
+                  << toQString(best)
+                  << newline;
+        m_stream->flush();
+    }
+
+    m_backend = best;
+    m_lastStep = par.currentStep;
+    m_tuned = true;
+    m_timing = false;
+    m_nsecs.fill(0);
+    m_samples.fill(0);
+}
+
+QString CoulombTuner::toQString(Backend backend)
+{
+    switch (backend)
+    {
+        case SerialCPU:
+        {
+            return "serial";
+        }
+        case ThreadedCPU:
+        {
+            return "threaded";
+        }
+        case OpenCL:
+        {
+            return "opencl";
+        }
+        default:
+        {
+            return "unknown";
+        }
+    }
+    return "unknown";
+}
+
+}
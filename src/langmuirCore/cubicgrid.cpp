@@ -1,28 +1,36 @@
 #include "cubicgrid.h"
 #include <cmath>
+#include <climits>
 #include "world.h"
 #include "parameters.h"
 #include "drainagent.h"
+#include "rand.h"
 
 namespace LangmuirCore
 {
-Grid::Grid(World &world, QObject *parent)
-    : QObject(parent), m_world(world)
+Grid::Grid(World &world, SiteStore &sites, SiteStore::Slot slot, QObject *parent)
+    : QObject(parent), m_world(world), m_sites(sites), m_slot(slot)
 {
     m_xSize = m_world.parameters().gridX;
     m_ySize = m_world.parameters().gridY;
     m_zSize = m_world.parameters().gridZ;
+    m_periodicY = m_world.parameters().gridPeriodicY;
+    m_periodicZ = m_world.parameters().gridPeriodicZ;
     m_xyPlaneArea = m_world.parameters().gridY * m_world.parameters().gridX;
     m_yzPlaneArea = m_world.parameters().gridY * m_world.parameters().gridZ;
     m_xzPlaneArea = m_world.parameters().gridX * m_world.parameters().gridZ;
     m_volume = m_world.parameters().gridY *
                m_world.parameters().gridX *
                m_world.parameters().gridZ;
+    m_xDivider.setDivisor(m_xSize);
+    m_yDivider.setDivisor(m_ySize);
     m_specialAgentCount = 0;
-    m_specialAgentReserve = 5*7;
-    m_agents.fill(0, m_volume+m_specialAgentReserve);
-    m_potentials.fill(0.0, m_volume+m_specialAgentReserve);
-    m_agentType.fill(Agent::Empty, m_volume+m_specialAgentReserve);
+    m_specialAgentReserve = specialAgentReserve();
+    if (m_sites.size() != m_volume+m_specialAgentReserve)
+    {
+        qFatal("langmuir: site store has %d sites, expected %d", m_sites.size(), m_volume+m_specialAgentReserve);
+    }
+    m_drainAgents.fill(0, m_specialAgentReserve);
     m_specialAgents.reserve(m_specialAgentReserve);
     for(int i = 0; i < 7; i++)
     {
@@ -30,12 +38,34 @@ Grid::Grid(World &world, QObject *parent)
         m_specialAgents.push_back(qlist);
         m_specialAgents[i].reserve(5);
     }
+
+    // Neighbors of a site are found by adding these offsets
+    buildStencil(m_world.parameters().hoppingRange, m_stencilX, m_stencilY, m_stencilZ);
+    m_interiorX = 1;
+    m_interiorY = 0;
+    m_interiorZ = 0;
+    for (int i = 0; i < m_stencilX.size(); i++)
+    {
+        m_stencilS.push_back(m_stencilX[i] + m_xSize * (m_stencilY[i] + m_ySize * m_stencilZ[i]));
+        m_interiorX = qMax(m_interiorX, abs(m_stencilX[i]));
+        m_interiorY = qMax(m_interiorY, abs(m_stencilY[i]));
+        m_interiorZ = qMax(m_interiorZ, abs(m_stencilZ[i]));
+    }
+
+    m_acceptanceVersion = -1;
+    m_acceptanceInverseKT = 0.0;
+    m_acceptanceTooLarge = false;
 }
 
 Grid::~Grid()
 {
 }
 
+int Grid::specialAgentReserve()
+{
+    return 5*7;
+}
+
 int Grid::xSize()
 {
     return m_xSize;
@@ -63,10 +93,10 @@ int Grid::volume()
 
 double Grid::totalDistance(int site1, int site2)
 {
-    return sqrt((    getIndexY(site1)-    getIndexY(site2)) *(getIndexY(site1)-    getIndexY(site2)) +
-(getIndexX(site1)- getIndexX(site2)) *(getIndexX(site1)- getIndexX(site2)) +
-(getIndexZ(site1)-  getIndexZ(site2)) *(getIndexZ(site1)-  getIndexZ(site2))
-);
+    int dx = xDistancei(site1, site2);
+    int dy = yDistancei(site1, site2);
+    int dz = zDistancei(site1, site2);
+    return sqrt(double(dx * dx + dy * dy + dz * dz));
 }
 
 double Grid::xDistance(int site1, int site2)
@@ -76,12 +106,12 @@ double Grid::xDistance(int site1, int site2)
 
 double Grid::yDistance(int site1, int site2)
 {
-    return fabs(int(getIndexY(site1)) - int(getIndexY(site2)));
+    return yDistancei(site1, site2);
 }
 
 double Grid::zDistance(int site1, int site2)
 {
-    return fabs(int(getIndexZ(site1)) - int(getIndexZ(site2)));
+    return zDistancei(site1, site2);
 }
 
 double Grid::xImageDistance(int site1, int site2)
@@ -99,51 +129,6 @@ double Grid::zImageDistance(int site1, int site2)
     return fabs(int(getIndexZ(site1)) + int(getIndexZ(site2)))+1;
 }
 
-int Grid::xDistancei(int site1, int site2)
-{
-    return abs(int(getIndexX(site1)) - int(getIndexX(site2)));
-}
-
-int Grid::yDistancei(int site1, int site2)
-{
-    return abs(int(getIndexY(site1)) - int(getIndexY(site2)));
-}
-
-int Grid::zDistancei(int site1, int site2)
-{
-    return abs(int(getIndexZ(site1)) - int(getIndexZ(site2)));
-}
-
-int Grid::xImageDistancei(int site1, int site2)
-{
-    return abs(int(getIndexX(site1)) + int(getIndexX(site2)))+1;
-}
-
-int Grid::yImageDistancei(int site1, int site2)
-{
-    return abs(int(getIndexY(site1)) + int(getIndexY(site2)))+1;
-}
-
-int Grid::zImageDistancei(int site1, int site2)
-{
-    return abs(int(getIndexZ(site1)) + int(getIndexZ(site2)))+1;
-}
-
-int Grid::getIndexX(int site)
-{
-    return site % m_xSize;
-}
-
-int Grid::getIndexY(int site)
-{
-    return(site / m_xSize -(site / m_xyPlaneArea)* m_ySize);
-}
-
-int Grid::getIndexZ(int site)
-{
-    return site /(m_xyPlaneArea);
-}
-
 double Grid::getPositionX(int site)
 {
     return getIndexX(site)+ 0.5;
@@ -159,11 +144,6 @@ double Grid::getPositionZ(int site)
     return getIndexZ(site)+ 0.5;
 }
 
-int Grid::getIndexS(int xIndex, int yIndex, int zIndex)
-{
-    return(m_xSize *(yIndex + zIndex*m_ySize)+ xIndex);
-}
-
 QVector<int> Grid::sliceIndex(int xi, int xf, int yi, int yf, int zi, int zf)
 {
     int ndx_rev = 0;
@@ -204,6 +184,90 @@ QVector<int> Grid::sliceIndex(int xi, int xf, int yi, int yf, int zi, int zf)
     return ndx;
 }
 
+void Grid::buildStencil(int hoppingRange, QVector<int> &dx, QVector<int> &dy, QVector<int> &dz)
+{
+    dx.clear();
+    dy.clear();
+    dz.clear();
+
+    // The order matters, the random number generator picks neighbors by index;
+    // these are the spheres of radius 1 and 2, in the order used before the
+    // stencils were generated
+    static const int range1[][3] = {
+        {-1, 0, 0}, { 1, 0, 0}, { 0,-1, 0}, { 0, 1, 0}, { 0, 0,-1}, { 0, 0, 1}
+    };
+
+    static const int range2[][3] = {
+        // To the west
+        {-1, 0, 0}, {-1,-1, 0}, {-1,-1,-1}, {-1,-1, 1}, {-1, 1, 0}, {-1, 1,-1}, {-1, 1, 1},
+        {-1, 0,-1}, {-1, 0, 1}, {-2, 0, 0},
+        // To the east
+        { 1, 0, 0}, { 1,-1, 0}, { 1,-1,-1}, { 1,-1, 1}, { 1, 1, 0}, { 1, 1,-1}, { 1, 1, 1},
+        { 1, 0,-1}, { 1, 0, 1}, { 2, 0, 0},
+        // Below and above
+        { 0, 0,-1}, { 0,-1,-1}, { 0, 1,-1}, { 0, 0,-2},
+        { 0, 0, 1}, { 0,-1, 1}, { 0, 1, 1}, { 0, 0, 2},
+        // To the south and north
+        { 0,-1, 0}, { 0,-2, 0}, { 0, 1, 0}, { 0, 2, 0}
+    };
+
+    QVector<int> generated;
+    const int (*offsets)[3] = 0;
+    int size = 0;
+    bool spherical = m_world.parameters().hoppingSpherical;
+    if (hoppingRange == 1 && spherical)
+    {
+        offsets = range1;
+        size = int(sizeof(range1) / sizeof(range1[0]));
+    }
+    else if (hoppingRange == 2 && spherical)
+    {
+        offsets = range2;
+        size = int(sizeof(range2) / sizeof(range2[0]));
+    }
+    else if (hoppingRange > 0)
+    {
+        // Every site in the cube (or sphere) around the site, except the site itself
+        for (int x = -hoppingRange; x <= hoppingRange; x++)
+        {
+            for (int y = -hoppingRange; y <= hoppingRange; y++)
+            {
+                for (int z = -hoppingRange; z <= hoppingRange; z++)
+                {
+                    if (x == 0 && y == 0 && z == 0)
+                    {
+                        continue;
+                    }
+                    if (spherical && x * x + y * y + z * z > hoppingRange * hoppingRange)
+                    {
+                        continue;
+                    }
+                    generated.push_back(x);
+                    generated.push_back(y);
+                    generated.push_back(z);
+                }
+            }
+        }
+        offsets = reinterpret_cast<const int (*)[3]>(generated.constData());
+        size = generated.size() / 3;
+    }
+    else
+    {
+        qFatal("langmuir: invalid neighbor list size parameter : (%d)", hoppingRange);
+    }
+
+    // Drop offsets that can never fit in the Grid (for example, along z if there is one layer)
+    for (int i = 0; i < size; i++)
+    {
+        if (abs(offsets[i][0]) < m_xSize && abs(offsets[i][1]) < m_ySize && abs(offsets[i][2]) < m_zSize)
+        {
+            dx.push_back(offsets[i][0]);
+            dy.push_back(offsets[i][1]);
+            dz.push_back(offsets[i][2]);
+        }
+    }
+}
+
 QVector<int> Grid::neighborsSite(int site, int hoppingRange)
 {
     // Return the indexes of all nearest neighbours
@@ -212,262 +276,298 @@ QVector<int> Grid::neighborsSite(int site, int hoppingRange)
     int y = getIndexY(site);
     int z = getIndexZ(site);
 
-//    qDebug() << qPrintable(QString("GRID: xsize(%1) ysize(%2) zsize(%3)").arg(m_xSize,3).arg(m_ySize,3).arg(m_zSize,3));
-//    qDebug() << qPrintable(QString("SITE:     s(%1)     x(%2)     y(%3)     z(%4)     t(%5)")
-//                           .arg(site,3)
-//                           .arg(x,3)
-//                           .arg(y,3)
-//                           .arg(z,3)
-//                           .arg(Agent::toQString(m_agentType[site])));
-    switch (hoppingRange)
+    QVector<int> dx, dy, dz;
+    buildStencil(hoppingRange, dx, dy, dz);
+
+    for (int i = 0; i < dx.size(); i++)
     {
-        case 1:
+        int neighbor = offsetSite(x, y, z, dx[i], dy[i], dz[i]);
+        if (neighbor >= 0)
         {
-            // To the west
-            if(x > 0)
-                nList.push_back(getIndexS(x-1, y, z));
-            // To the east
-            if(x < m_xSize - 1)
-                nList.push_back(getIndexS(x+1, y, z));
-            // To the south
-            if(y > 0)
-                nList.push_back(getIndexS(x, y-1, z));
-            // To the north
-            if(y < m_ySize - 1)
-                nList.push_back(getIndexS(x, y+1, z));
-            // Below
-            if(z > 0)
-                nList.push_back(getIndexS(x, y, z-1));
-            // Above
-            if(z < m_zSize - 1)
-                nList.push_back(getIndexS(x, y, z+1));
-            break;
+            nList.push_back(neighbor);
         }
-        case 2:
+    }
+
+    // Now for the drains....
+    if (x == 0)
+    {
+        nList += m_leftDrainSites;
+    }
+
+    if(x == m_xSize - 1)
+    {
+        nList += m_rightDrainSites;
+    }
+
+    return nList;
+}
+
+bool Grid::isInterior(int site)
+{
+    int x = getIndexX(site);
+    int y = getIndexY(site);
+    int z = getIndexZ(site);
+    return (x >= m_interiorX && x < m_xSize - m_interiorX &&
+            y >= m_interiorY && y < m_ySize - m_interiorY &&
+            z >= m_interiorZ && z < m_zSize - m_interiorZ);
+}
+
+int Grid::neighborCount(int site)
+{
+    if (isInterior(site))
+    {
+        return m_stencilS.size();
+    }
+
+    int x = getIndexX(site);
+    int y = getIndexY(site);
+    int z = getIndexZ(site);
+
+    int count = 0;
+    for (int i = 0; i < m_stencilS.size(); i++)
+    {
+        if (offsetSite(x, y, z, m_stencilX.at(i), m_stencilY.at(i), m_stencilZ.at(i)) >= 0)
         {
-            // Optimized for 1 layer
-            if (m_zSize == 1)
-            {
-                //qDebug() << "special case: m_zSize == 1";
-                // To the west 1
-                if (x > 0)
-                {
-                    nList.push_back(getIndexS(x-1, y, z));
-                    // To the south 1
-                    if (y > 0)
-                    {
-                        nList.push_back(getIndexS(x-1, y-1, z));
-                    }
-                    // To the north 1
-                    if (y < m_ySize - 1)
-                    {
-                        nList.push_back(getIndexS(x-1, y+1, z));
-                    }
-                    // To the west 2
-                    if (x > 1)
-                        nList.push_back(getIndexS(x-2, y, z));
-                }
+            count++;
+        }
+    }
 
-                // To the east 1
-                if (x < m_xSize - 1)
-                {
-                    nList.push_back(getIndexS(x+1, y, z));
-                    // To the south 1
-                    if (y > 0)
-                    {
-                        nList.push_back(getIndexS(x+1, y-1, z));
-                    }
-                    // To the north 1
-                    if (y < m_ySize - 1)
-                    {
-                        nList.push_back(getIndexS(x+1, y+1, z));
-                    }
-                    // To the east 2
-                    if (x < m_xSize - 2)
-                        nList.push_back(getIndexS(x+2, y, z));
-                }
+    if (x == 0)
+    {
+        count += m_leftDrainSites.size();
+    }
 
-                // To the south 1
-                if (y > 0)
-                {
-                    nList.push_back(getIndexS(x, y-1, z));
-                    // To the south 2
-                    if (y > 1)
-                        nList.push_back(getIndexS(x, y-2, z));
-                }
+    if (x == m_xSize - 1)
+    {
+        count += m_rightDrainSites.size();
+    }
 
-                // To the north 2
-                if (y < m_ySize - 1)
-                {
-                    nList.push_back(getIndexS(x, y+1, z));
-                    // To the north 2
-                    if (y < m_ySize - 2)
-                        nList.push_back(getIndexS(x, y+2, z));
-                }
-            }
-            else
-            {
-                // To the west 1
-                if (x > 0)
-                {
-                    nList.push_back(getIndexS(x-1, y, z));
-                    // To the south 1
-                    if (y > 0)
-                    {
-                        nList.push_back(getIndexS(x-1, y-1, z));
-                        // To the down 1
-                        if (z > 0)
-                            nList.push_back(getIndexS(x-1, y-1, z-1));
-                        // To the up 1
-                        if (z < m_zSize - 1)
-                            nList.push_back(getIndexS(x-1, y-1, z+1));
-                    }
-                    // To the north 1
-                    if (y < m_ySize - 1)
-                    {
-                        nList.push_back(getIndexS(x-1, y+1, z));
-                        // To the down 1
-                        if (z > 0)
-                            nList.push_back(getIndexS(x-1, y+1, z-1));
-                        // To the up 1
-                        if (z < m_zSize - 1)
-                            nList.push_back(getIndexS(x-1, y+1, z+1));
-                    }
-                    if (z > 0)
-                        nList.push_back(getIndexS(x-1, y, z-1));
-                    // To the up 1
-                    if (z < m_zSize - 1)
-                        nList.push_back(getIndexS(x-1, y, z+1));
-                    // To the west 2
-                    if (x > 1)
-                        nList.push_back(getIndexS(x-2, y, z));
-                }
+    return count;
+}
 
-                // To the east 1
-                if (x < m_xSize - 1)
-                {
-                    nList.push_back(getIndexS(x+1, y, z));
-                    // To the south 1
-                    if (y > 0)
-                    {
-                        nList.push_back(getIndexS(x+1, y-1, z));
-                        // To the down 1
-                        if (z > 0)
-                            nList.push_back(getIndexS(x+1, y-1, z-1));
-                        // To the up 1
-                        if (z < m_zSize - 1)
-                            nList.push_back(getIndexS(x+1, y-1, z+1));
-                    }
-                    // To the north 1
-                    if (y < m_ySize - 1)
-                    {
-                        nList.push_back(getIndexS(x+1, y+1, z));
-                        // To the down 1
-                        if (z > 0)
-                            nList.push_back(getIndexS(x+1, y+1, z-1));
-                        // To the up 1
-                        if (z < m_zSize - 1)
-                            nList.push_back(getIndexS(x+1, y+1, z+1));
-                    }
-                    if (z > 0)
-                        nList.push_back(getIndexS(x+1, y, z-1));
-                    // To the up 1
-                    if (z < m_zSize - 1)
-                        nList.push_back(getIndexS(x+1, y, z+1));
-                    // To the east 2
-                    if (x < m_xSize - 2)
-                        nList.push_back(getIndexS(x+2, y, z));
-                }
+int Grid::neighbor(int site, int index)
+{
+    double coupling;
+    return neighbor(site, index, coupling);
+}
 
-                // To the down 1
-                if (z > 0)
-                {
-                    nList.push_back(getIndexS(x, y, z-1));
-                    // To the south 1
-                    if (y > 0)
-                    {
-                        nList.push_back(getIndexS(x, y-1, z-1));
-                    }
-                    // To the north 1
-                    if (y < m_ySize - 1)
-                    {
-                        nList.push_back(getIndexS(x, y+1, z-1));
-                    }
-                    // To the down 2
-                    if (z > 1)
-                        nList.push_back(getIndexS(x, y, z-2));
-                }
+int Grid::neighbor(int site, int index, double &coupling)
+{
+    int direction;
+    return neighbor(site, index, coupling, direction);
+}
 
-                // To the up 1
-                if (z < m_zSize - 1)
-                {
-                    nList.push_back(getIndexS(x, y, z+1));
-                    // To the south 1
-                    if (y > 0)
-                    {
-                        nList.push_back(getIndexS(x, y-1, z+1));
-                    }
-                    // To the north 1
-                    if (y < m_ySize - 1)
-                    {
-                        nList.push_back(getIndexS(x, y+1, z+1));
-                    }
-                    // To the up 2
-                    if (z < m_zSize - 2)
-                        nList.push_back(getIndexS(x, y, z+2));
-                }
+int Grid::neighbor(int site, int index, double &coupling, int &direction)
+{
+    if (isInterior(site))
+    {
+        coupling = m_stencilCoupling.at(index);
+        direction = index;
+        return site + m_stencilS.at(index);
+    }
 
-                // To the south 1
-                if (y > 0)
-                {
-                    nList.push_back(getIndexS(x, y-1, z));
-                    // To the south 2
-                    if (y > 1)
-                        nList.push_back(getIndexS(x, y-2, z));
-                }
+    int x = getIndexX(site);
+    int y = getIndexY(site);
+    int z = getIndexZ(site);
 
-                // To the north 2
-                if (y < m_ySize - 1)
-                {
-                    nList.push_back(getIndexS(x, y+1, z));
-                    // To the north 2
-                    if (y < m_ySize - 2)
-                        nList.push_back(getIndexS(x, y+2, z));
-                }
+    for (int i = 0; i < m_stencilS.size(); i++)
+    {
+        int neighbor = offsetSite(x, y, z, m_stencilX.at(i), m_stencilY.at(i), m_stencilZ.at(i));
+        if (neighbor >= 0)
+        {
+            if (index == 0)
+            {
+                coupling = m_stencilCoupling.at(i);
+                direction = i;
+                return neighbor;
             }
-            break;
+            index--;
         }
-        default:
+    }
+
+    // Drains do not use the coupling constants
+    coupling = 0;
+    direction = -1;
+
+    if (x == 0)
+    {
+        if (index < m_leftDrainSites.size())
         {
-            qFatal("langmuir: invalid neighbor list size parameter : (%d)", hoppingRange);
-            break;
+            return m_leftDrainSites.at(index);
         }
+        index -= m_leftDrainSites.size();
     }
 
-    // Now for the drains....
-    if (x == 0)
+    if (x == m_xSize - 1)
     {
-        foreach (Agent *agent, getSpecialAgentList(Left))
+        if (index < m_rightDrainSites.size())
         {
-            if (agent->getType() == Agent::Drain)
-            {
-                nList.push_back(agent->getCurrentSite());
-            }
+            return m_rightDrainSites.at(index);
         }
     }
 
-    if(x == m_xSize - 1)
+    qFatal("langmuir: neighbor index out of range for site %d", site);
+    return -1;
+}
+
+int Grid::proposeNeighbor(int site, double &coupling, int &direction)
+{
+    Random &random = m_world.randomNumberGenerator();
+
+    if (m_world.parameters().hoppingAlias && isInterior(site))
+    {
+        // Alias sampling, the last entry means staying put
+        int size = m_aliasIndex.size();
+        double u = random.random() * size;
+        int k = qMin(int(u), size - 1);
+        if (u - k >= m_aliasProbability.at(k))
+        {
+            k = m_aliasIndex.at(k);
+        }
+
+        // The coupling was already used to choose the site
+        coupling = 1.0;
+        if (k == m_stencilS.size())
+        {
+            direction = -1;
+            return site;
+        }
+        direction = k;
+        return site + m_stencilS.at(k);
+    }
+
+    // Select a proposed transport site at random
+    return neighbor(site, random.integer(0, neighborCount(site) - 1), coupling, direction);
+}
+
+void Grid::updateAcceptance()
+{
+    SimulationParameters &par = m_world.parameters();
+    if (!par.metropolisFast || par.coulombCarriers || par.gridSparse || m_acceptanceTooLarge)
+    {
+        return;
+    }
+
+    // Without a table, ChargeAgent uses Random::metropolisWithCouplingFast
+    int size = m_stencilS.size();
+    qint64 count = qint64(m_volume) * size;
+    qint64 bytes = count * qint64(sizeof(float));
+    if (bytes > qint64(par.metropolisFastMemory) * 1024 * 1024 || count > INT_MAX)
+    {
+        qDebug("langmuir: metropolis.fast: the table of Boltzmann factors would take %lld MB "
+               "(metropolis.fast.memory = %d); bounding exp instead",
+               (bytes + 1024 * 1024 - 1) / (1024 * 1024), par.metropolisFastMemory);
+        m_acceptance.clear();
+        m_acceptanceTooLarge = true;
+        return;
+    }
+
+    if (m_acceptanceVersion == m_sites.potentialVersion() && m_acceptanceInverseKT == par.inverseKT)
+    {
+        return;
+    }
+    m_acceptanceVersion = m_sites.potentialVersion();
+    m_acceptanceInverseKT = par.inverseKT;
+
+    // Hops out of the Grid are never proposed, and are left at 0
+    int charge = (m_slot == SiteStore::Electron) ? -1 : +1;
+    m_acceptance.fill(0.0f, int(count));
+    for (int site = 0; site < m_volume; site++)
     {
-        foreach (Agent *agent, getSpecialAgentList(Right))
+        int x, y, z;
+        getIndexXYZ(site, x, y, z);
+        for (int i = 0; i < size; i++)
         {
-            if (agent->getType() == Agent::Drain)
+            int neighbor = offsetSite(x, y, z, m_stencilX.at(i), m_stencilY.at(i), m_stencilZ.at(i));
+            if (neighbor < 0)
             {
-                nList.push_back(agent->getCurrentSite());
+                continue;
             }
+
+            // The same as Random::metropolisWithCoupling
+            double pd = charge * potentialDifference(neighbor, site);
+            m_acceptance[qint64(site) * size + i] = (pd > 0.0) ? float(exp(-pd * par.inverseKT)) : 1.0f;
         }
     }
+}
 
-    return nList;
+void Grid::updateCouplingConstants()
+{
+    boost::multi_array<double, 3>& constants = m_world.couplingConstants();
+
+    int size = m_stencilS.size();
+    m_stencilCoupling.resize(size);
+    for (int i = 0; i < size; i++)
+    {
+        m_stencilCoupling[i] = constants[abs(m_stencilX[i])][abs(m_stencilY[i])][abs(m_stencilZ[i])];
+    }
+
+    // A uniform proposal followed by accepting with probability equal to the
+    // coupling moves to neighbor i with probability coupling[i] / size; the
+    // rest of the time the charge stays put
+    QVector<double> weights(size + 1, 0.0);
+    double total = 0.0;
+    for (int i = 0; i < size; i++)
+    {
+        weights[i] = m_stencilCoupling[i] / size;
+        total += weights[i];
+    }
+    weights[size] = qMax(0.0, 1.0 - total);
+
+    // Walker's alias table (Vose's method)
+    int n = weights.size();
+    double sum = total + weights[size];
+    m_aliasProbability.fill(1.0, n);
+    m_aliasIndex.resize(n);
+    QVector<int> small, large;
+    for (int i = 0; i < n; i++)
+    {
+        m_aliasIndex[i] = i;
+        weights[i] *= n / sum;
+        if (weights[i] < 1.0)
+        {
+            small.push_back(i);
+        }
+        else
+        {
+            large.push_back(i);
+        }
+    }
+    while (!small.isEmpty() && !large.isEmpty())
+    {
+        int s = small.last();
+        small.pop_back();
+        int l = large.last();
+        m_aliasProbability[s] = weights[s];
+        m_aliasIndex[s] = l;
+        weights[l] = (weights[l] + weights[s]) - 1.0;
+        if (weights[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+}
+
+void Grid::updateDrainSites()
+{
+    m_leftDrainSites.clear();
+    foreach (Agent *agent, getSpecialAgentList(Left))
+    {
+        if (agent->getType() == Agent::Drain)
+        {
+            m_leftDrainSites.push_back(agent->getCurrentSite());
+        }
+    }
+
+    m_rightDrainSites.clear();
+    foreach (Agent *agent, getSpecialAgentList(Right))
+    {
+        if (agent->getType() == Agent::Drain)
+        {
+            m_rightDrainSites.push_back(agent->getCurrentSite());
+        }
+    }
 }
 
 QVector<int> Grid::neighborsFace(Grid::CubeFace cubeFace)
@@ -486,26 +586,43 @@ QVector<int> Grid::neighborsFace(Grid::CubeFace cubeFace)
         break;
     }
 
+    // There are no faces along periodic directions
     case Grid::Top:
     {
+        if (m_periodicY)
+        {
+            return QVector<int>();
+        }
         return sliceIndex(0, m_xSize, 0, 1, 0, m_zSize);
         break;
     }
 
     case Grid::Bottom:
     {
+        if (m_periodicY)
+        {
+            return QVector<int>();
+        }
         return sliceIndex(0, m_xSize, m_ySize-1, m_ySize, 0, m_zSize);
         break;
     }
 
     case Grid::Front:
     {
+        if (m_periodicZ)
+        {
+            return QVector<int>();
+        }
         return sliceIndex(0, m_xSize, 0, m_ySize, m_zSize-1, m_zSize);
         break;
     }
 
     case Grid::Back:
     {
+        if (m_periodicZ)
+        {
+            return QVector<int>();
+        }
         return sliceIndex(0, m_xSize, 0, m_ySize, 0, 1);
         break;
     }
@@ -527,27 +644,47 @@ QVector<int> Grid::neighborsFace(Grid::CubeFace cubeFace)
 
 Agent * Grid::agentAddress(int site)
 {
-    return m_agents[site];
+    return m_sites.at(site).agent[m_slot];
 }
 
 Agent::Type Grid::agentType(int site)
 {
-    return m_agentType[site];
+    return Agent::Type(m_sites.at(site).type[m_slot]);
+}
+
+DrainAgent * Grid::drainAddress(int site)
+{
+    return m_drainAgents[site - m_volume];
 }
 
 void Grid::setPotential(int site, double potential)
 {
-    m_potentials[site] = potential;
+    m_sites.setPotential(site, potential);
 }
 
 void Grid::addToPotential(int site, double potential)
 {
-    m_potentials[site] = m_potentials[site] + potential;
+    m_sites.addToPotential(site, potential);
+}
+
+void Grid::setPotentialZero()
+{
+    m_sites.setPotentialZero();
+}
+
+void Grid::addToPotentialLinear(double slope, double offset)
+{
+    m_sites.addToPotentialLinear(slope, offset);
+}
+
+void Grid::addToPotentialGate(double slope)
+{
+    m_sites.addToPotentialGate(slope);
 }
 
-double Grid::potential(int site)
+void Grid::copyPotential(Grid &other)
 {
-    return m_potentials[site];
+    m_sites.copyPotential(other.m_sites);
 }
 
 QList<Agent *>& Grid::getSpecialAgentList(Grid::CubeFace cubeFace)
@@ -571,21 +708,35 @@ void Grid::registerSpecialAgent(Agent *agent, Grid::CubeFace cubeFace)
     specialAgents.push_back(agent);
 
     int site = m_volume+m_specialAgentCount;
-    if(m_agents[site] == 0 && m_agentType[site] == Agent::Empty)
+    SiteRecord &record = m_sites.record(site);
+    if(record.agent[m_slot] == 0 && record.type[m_slot] == Agent::Empty)
     {
-        m_agents[site] = agent;
-        m_agentType[site] = agent->getType();
+        record.agent[m_slot] = agent;
+        record.type[m_slot] = agent->getType();
+        m_sites.occupy(site);
     }
     else
     {
         qFatal("langmuir: can not register special agent: site is already occupied");
     }
 
+    if(agent->getType() == Agent::Drain)
+    {
+        DrainAgent *drain = dynamic_cast<DrainAgent*>(agent);
+        if(!drain)
+        {
+            qFatal("langmuir: can not cast pointer to DrainAgent");
+        }
+        m_drainAgents[site - m_volume] = drain;
+    }
+
     QVector<int> neighbors = neighborsFace(cubeFace);
     agent->setNeighbors(neighbors);
     agent->setCurrentSite(site);
     agent->setFutureSite(site);
     ++m_specialAgentCount;
+
+    updateDrainSites();
 }
 
 void Grid::unregisterSpecialAgent(Agent *agent, Grid::CubeFace cubeFace)
@@ -598,49 +749,58 @@ void Grid::unregisterSpecialAgent(Agent *agent, Grid::CubeFace cubeFace)
     specialAgents.removeOne(agent);
 
     int site = agent->getCurrentSite();
-    if(!(m_agents[site] == agent))
+    SiteRecord &record = m_sites.record(site);
+    if(!(record.agent[m_slot] == agent))
     {
         qFatal("langmuir: can not unregister special agent! pointers do not match");
     }
 
-    m_agentType[site] = Agent::Empty;
-    m_agents[site] = 0;
+    record.type[m_slot] = Agent::Empty;
+    record.agent[m_slot] = 0;
+    m_sites.vacate(site);
+    m_drainAgents[site - m_volume] = 0;
     --m_specialAgentCount;
+
+    updateDrainSites();
 }
 
 void Grid::registerAgent(Agent *agent)
 {
     int site = agent->getCurrentSite();
-    if((m_agents[site] == 0) && (m_agentType[site] == Agent::Empty))
+    SiteRecord &record = m_sites.record(site);
+    if((record.agent[m_slot] == 0) && (record.type[m_slot] == Agent::Empty))
     {
-        m_agents[site] = agent;
-        m_agentType[site] = agent->getType();
+        record.agent[m_slot] = agent;
+        record.type[m_slot] = agent->getType();
+        m_sites.occupy(site);
     }
     else
     {
         qFatal("langmuir: can not register agent: site %d is invalid", site);
     }
-    QVector<int> neighbors = neighborsSite(site, m_world.parameters().hoppingRange);
-    agent->setNeighbors(neighbors);
 }
 
 void Grid::unregisterAgent(Agent *agent)
 {
     int site = agent->getCurrentSite();
-    if(!(m_agents[site] == agent))
+    SiteRecord &record = m_sites.record(site);
+    if(!(record.agent[m_slot] == agent))
     {
         qFatal("langmuir: can not unregister agent! pointers do not match");
     }
-    m_agentType[site] = Agent::Empty;
-    m_agents[site] = 0;
+    record.type[m_slot] = Agent::Empty;
+    record.agent[m_slot] = 0;
+    m_sites.vacate(site);
 }
 
 void Grid::registerDefect(int site)
 {
-    if(m_agents[site] == 0 && m_agentType[site] == Agent::Empty)
+    SiteRecord &record = m_sites.record(site);
+    if(record.agent[m_slot] == 0 && record.type[m_slot] == Agent::Empty)
     {
-        m_agents[site] = 0;
-        m_agentType[site] = Agent::Defect;
+        record.agent[m_slot] = 0;
+        record.type[m_slot] = Agent::Defect;
+        m_sites.occupy(site);
     }
     else
     {
@@ -650,12 +810,14 @@ void Grid::registerDefect(int site)
 
 void Grid::unregisterDefect(int site)
 {
-    if(m_agentType[site] != Agent::Defect || m_agents[site] != 0)
+    SiteRecord &record = m_sites.record(site);
+    if(record.type[m_slot] != Agent::Defect || record.agent[m_slot] != 0)
     {
         qFatal("langmuir: can not unregister defect! type does not match");
     }
-    m_agentType[site] = Agent::Empty;
-    m_agents[site] = 0;
+    record.type[m_slot] = Agent::Empty;
+    record.agent[m_slot] = 0;
+    m_sites.vacate(site);
 }
 
 int Grid::specialAgentCount()
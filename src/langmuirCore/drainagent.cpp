@@ -5,6 +5,10 @@
 #include "world.h"
 #include "rand.h"
 
+#ifdef LANGMUIR_USING_QT5
+#include <QtConcurrent/QtConcurrent>
+#endif
+
 namespace LangmuirCore
 {
 
@@ -58,7 +62,7 @@ HoleDrainAgent::HoleDrainAgent(World &world, Grid::CubeFace cubeFace, QObject *p
 }
 
 RecombinationAgent::RecombinationAgent(World &world, QObject *parent)
-    : DrainAgent(world, world.electronGrid(), parent)
+    : DrainAgent(world, world.electronGrid(), parent), m_key(0)
 {
     initializeSite(Grid::NoFace);
     QString name;
@@ -66,6 +70,28 @@ RecombinationAgent::RecombinationAgent(World &world, QObject *parent)
     stream << "x" << m_type;
     stream.flush();
     setObjectName(name);
+
+    // The site itself, plus the sites within recombination.range (same as Grid::neighborsSite)
+    m_stencilX.push_back(0);
+    m_stencilY.push_back(0);
+    m_stencilZ.push_back(0);
+    int range = m_world.parameters().recombinationRange;
+    if (range > 0)
+    {
+        QVector<int> dx, dy, dz;
+        m_grid.buildStencil(range, dx, dy, dz);
+        m_stencilX += dx;
+        m_stencilY += dy;
+        m_stencilZ += dz;
+    }
+    m_reachX = m_reachY = m_reachZ = 0;
+    for (int i = 0; i < m_stencilX.size(); i++)
+    {
+        m_stencilS.push_back(m_stencilX[i] + m_grid.xSize() * (m_stencilY[i] + m_grid.ySize() * m_stencilZ[i]));
+        m_reachX = qMax(m_reachX, qAbs(m_stencilX[i]));
+        m_reachY = qMax(m_reachY, qAbs(m_stencilY[i]));
+        m_reachZ = qMax(m_reachZ, qAbs(m_stencilZ[i]));
+    }
 }
 
 void RecombinationAgent::guessProbability()
@@ -140,8 +166,11 @@ bool RecombinationAgent::tryToAccept(ChargeAgent *charge)
             if (m_world.parameters().hoppingRange == m_world.parameters().recombinationRange)
             {
                 // Loop over the neighbors and check if charges are there
-                foreach (int otherSite, charge->getNeighbors())
+                Grid &grid = charge->getGrid();
+                int count = grid.neighborCount(site);
+                for (int i = 0; i < count; i++)
                 {
+                    int otherSite = grid.neighbor(site, i);
                     if (charge->otherGrid().agentType(otherSite) == charge->otherType())
                     {
                         neighbors.push_back(otherSite);
@@ -213,4 +242,138 @@ bool RecombinationAgent::tryToAccept(ChargeAgent *charge)
     return false;
 }
 
+void RecombinationAgent::tryToAcceptAll(QList<ChargeAgent *> &electrons)
+{
+    Grid &holeGrid = m_world.holeGrid();
+
+    // Mark the hole sites
+    m_holeBitmap.fill(0, (holeGrid.volume() + 31) / 32);
+    foreach (ChargeAgent *hole, m_world.holes())
+    {
+        int site = hole->getCurrentSite();
+        m_holeBitmap[site >> 5] |= (quint32(1) << (site & 31));
+    }
+
+    // Draw the key in serial, so the threads need no shared state
+    m_key = m_world.randomNumberGenerator().word();
+
+    // Each electron chooses a hole
+    m_candidates.resize(electrons.size());
+    for (int i = 0; i < electrons.size(); i++)
+    {
+        RecombinationCandidate &candidate = m_candidates[i];
+        candidate.agent = this;
+        candidate.electron = electrons.at(i);
+        candidate.index = i;
+    }
+    QtConcurrent::blockingMap(m_candidates, RecombinationAgent::proposeQtConcurrent);
+
+    // Resolve in serial, the first electron to choose a hole gets it
+    for (int i = 0; i < m_candidates.size(); i++)
+    {
+        const RecombinationCandidate &candidate = m_candidates.at(i);
+        if (candidate.site < 0)
+        {
+            continue;
+        }
+
+        // We know there is a hole at the site
+        ChargeAgent *other = static_cast<ChargeAgent*>(holeGrid.agentAddress(candidate.site));
+
+        // Recombination already happened
+        if (other->removed())
+        {
+            continue;
+        }
+
+        // Try to recombine
+        m_attempts += 1;
+
+        if (candidate.accept)
+        {
+            // RecombinationAgent has succeeded
+            m_successes += 1;
+
+            // Remove both charges
+            candidate.electron->setRemoved(true);
+            other->setRemoved(true);
+        }
+    }
+}
+
+void RecombinationAgent::proposeQtConcurrent(RecombinationCandidate &candidate)
+{
+    candidate.agent->propose(candidate);
+}
+
+void RecombinationAgent::propose(RecombinationCandidate &candidate) const
+{
+    int site = candidate.electron->getCurrentSite();
+    int x = m_grid.getIndexX(site);
+    int y = m_grid.getIndexY(site);
+    int z = m_grid.getIndexZ(site);
+
+    // Away from the edges every offset is a valid site
+    bool inside = (x >= m_reachX && x < m_grid.xSize() - m_reachX &&
+                   y >= m_reachY && y < m_grid.ySize() - m_reachY &&
+                   z >= m_reachZ && z < m_grid.zSize() - m_reachZ);
+
+    // Count the holes in range, then pick one of them
+    int count = 0;
+    int chosen = -1;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int n = 0;
+        for (int i = 0; i < m_stencilS.size(); i++)
+        {
+            // Near the edges, wrap along periodic directions
+            int other = site + m_stencilS.at(i);
+            if (!inside)
+            {
+                other = m_grid.offsetSite(x, y, z, m_stencilX.at(i), m_stencilY.at(i), m_stencilZ.at(i));
+                if (other < 0)
+                {
+                    continue;
+                }
+            }
+
+            if (m_holeBitmap.at(other >> 5) & (quint32(1) << (other & 31)))
+            {
+                if (pass == 1 && n == chosen)
+                {
+                    candidate.site = other;
+                    candidate.accept = (m_probability > uniform(candidate.index, 1));
+                    return;
+                }
+                n++;
+            }
+        }
+
+        if (pass == 0)
+        {
+            count = n;
+            if (count == 0)
+            {
+                break;
+            }
+            chosen = qMin(int(uniform(candidate.index, 0) * count), count - 1);
+        }
+    }
+
+    candidate.site = -1;
+    candidate.accept = false;
+}
+
+double RecombinationAgent::uniform(int index, int stream) const
+{
+    // A counter based generator: the splitmix64 sequence starting at the key
+    quint64 counter = ((quint64(index) << 1) | quint64(stream & 1)) + 1;
+    quint64 z = m_key + counter * Q_UINT64_C(0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    z = z ^ (z >> 31);
+
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
 }
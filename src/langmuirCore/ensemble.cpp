@@ -0,0 +1,165 @@
+#include "ensemble.h"
+#include "simulation.h"
+#include "sweep.h"
+#include "parameters.h"
+#include "world.h"
+#include "affinity.h"
+
+namespace LangmuirCore
+{
+
+Ensemble::Ensemble(const QString &fileName, int replicas, int cores, int gpuID, QObject *parent)
+    : QObject(parent), m_threadPool(NULL)
+{
+    if (replicas < 1)
+    {
+        qFatal("langmuir: invalid number of replicas: %d", replicas);
+    }
+
+    // Create the primary world, which owns the shared state
+    World *primary = new World(fileName, cores, gpuID, this);
+    m_worlds.push_back(primary);
+
+    // Create the replicas
+    for (int i = 1; i < replicas; i++)
+    {
+        qDebug("langmuir: creating replica %d", i);
+        m_worlds.push_back(new World(*primary, i, gpuID, this));
+    }
+
+    // Give each replica its own output stub
+    if (replicas > 1)
+    {
+        QString stub = primary->parameters().outputStub;
+        for (int i = 0; i < m_worlds.size(); i++)
+        {
+            m_worlds[i]->parameters().outputStub = QString("%1_r%2").arg(stub).arg(i);
+        }
+    }
+
+    // Create the simulations
+    for (int i = 0; i < m_worlds.size(); i++)
+    {
+        m_simulations.push_back(new Simulation(*m_worlds[i], this));
+        m_sweeps.push_back(new Sweep(*m_worlds[i], this));
+    }
+
+    m_threadPool = new QThreadPool(this);
+    m_threadPool->setMaxThreadCount(qMin(replicas, primary->parameters().maxThreads));
+
+    // With threads.affinity, each replica is always stepped on the same CPU,
+    // the one its records were first touched from
+    if (primary->parameters().threadsAffinity)
+    {
+        m_allowedCPUs = Affinity::allowedCPUs();
+        for (int i = 0; i < m_worlds.size(); i++)
+        {
+            m_cpus.push_back(Affinity::replicaCPU(i));
+        }
+    }
+}
+
+Ensemble::~Ensemble()
+{
+    m_threadPool->waitForDone();
+
+    for (int i = m_simulations.size() - 1; i >= 0; i--)
+    {
+        delete m_sweeps[i];
+        delete m_simulations[i];
+    }
+    m_sweeps.clear();
+    m_simulations.clear();
+
+    // The replicas read the primary, so delete them first
+    for (int i = m_worlds.size() - 1; i >= 0; i--)
+    {
+        delete m_worlds[i];
+    }
+    m_worlds.clear();
+}
+
+int Ensemble::size()
+{
+    return m_worlds.size();
+}
+
+World& Ensemble::world(int replica)
+{
+    return *m_worlds[replica];
+}
+
+Simulation& Ensemble::simulation(int replica)
+{
+    return *m_simulations[replica];
+}
+
+int Ensemble::sweepSize()
+{
+    return m_sweeps.first()->size();
+}
+
+void Ensemble::setSweepPoint(int point)
+{
+    // The primary goes first, the replicas share its potential
+    for (int i = 0; i < m_sweeps.size(); i++)
+    {
+        m_sweeps[i]->setPoint(point);
+    }
+}
+
+void Ensemble::performIterations(int nIterations)
+{
+    // Skip the thread pool for a single simulation; the calling thread is
+    // only pinned while stepping, so threads it starts later are not
+    if (m_simulations.size() == 1)
+    {
+        if (!m_cpus.isEmpty())
+        {
+            Affinity::pinCurrentThread(m_cpus.first());
+        }
+        m_simulations[0]->performIterations(nIterations);
+        if (!m_cpus.isEmpty())
+        {
+            Affinity::pinCurrentThread(m_allowedCPUs);
+        }
+        return;
+    }
+
+    for (int i = 0; i < m_simulations.size(); i++)
+    {
+        int cpu = m_cpus.isEmpty() ? -1 : m_cpus.at(i);
+        m_threadPool->start(new Runner(*m_simulations[i], nIterations, cpu));
+    }
+    m_threadPool->waitForDone();
+}
+
+bool Ensemble::isConverged()
+{
+    for (int i = 0; i < m_simulations.size(); i++)
+    {
+        if (!m_simulations[i]->isConverged())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+Ensemble::Runner::Runner(Simulation &simulation, int nIterations, int cpu)
+    : QRunnable(), m_simulation(simulation), m_nIterations(nIterations), m_cpu(cpu)
+{
+    setAutoDelete(true);
+}
+
+void Ensemble::Runner::run()
+{
+    // Any worker may run any replica, so pin it every time
+    if (m_cpu >= 0)
+    {
+        Affinity::pinCurrentThread(m_cpu);
+    }
+    m_simulation.performIterations(m_nIterations);
+}
+
+}
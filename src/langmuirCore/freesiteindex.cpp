@@ -0,0 +1,63 @@
+#include "freesiteindex.h"
+
+namespace LangmuirCore
+{
+
+FreeSiteIndex::FreeSiteIndex(int xSize, int ySize, int zSize, int x0, int x1, int slotMask)
+    : m_xDivider(xSize), m_xSize(xSize), m_x0(x0), m_x1(x1), m_slotMask(slotMask), m_users(0)
+{
+    if (x0 < 0 || x1 > xSize || x0 >= x1)
+    {
+        qFatal("langmuir: invalid slab for free sites; %d <= x < %d", x0, x1);
+    }
+    m_volume = xSize * ySize * zSize;
+    m_positions.fill(-1, (x1 - x0) * ySize * zSize);
+}
+
+int FreeSiteIndex::x0() const
+{
+    return m_x0;
+}
+
+int FreeSiteIndex::x1() const
+{
+    return m_x1;
+}
+
+int FreeSiteIndex::slotMask() const
+{
+    return m_slotMask;
+}
+
+int &FreeSiteIndex::users()
+{
+    return m_users;
+}
+
+int FreeSiteIndex::localIndex(int site) const
+{
+    int row = m_xDivider.divide(site);
+    int x = site - row * m_xSize;
+    return (x - m_x0) + (m_x1 - m_x0) * row;
+}
+
+void FreeSiteIndex::update(int site, bool free)
+{
+    int &position = m_positions[localIndex(site)];
+    if (free && position < 0)
+    {
+        position = m_sites.size();
+        m_sites.push_back(site);
+    }
+    else if (!free && position >= 0)
+    {
+        // Move the last site into the hole
+        int last = m_sites.last();
+        m_sites[position] = last;
+        m_positions[localIndex(last)] = position;
+        m_sites.pop_back();
+        position = -1;
+    }
+}
+
+}
@@ -1,87 +1,234 @@
 #include "gzipper.h"
-#include <QStringList>
-#include <QFileInfo>
-#include <QProcess>
-#include <QString>
 #include <QDebug>
-#include <QDir>
 
-QString gunzip(QString fileName, bool *wasZipped)
+#include <cstring>
+#include <zlib.h>
+
+namespace
 {
-    if (wasZipped) { *wasZipped = false; }
 
-    QFileInfo info(fileName);
-    if (!info.exists())
-    {
-        qDebug("langmuir: %s does not exist", qPrintable(info.fileName()));
-        return info.absoluteFilePath();
-    }
+// zlib reads and writes at most this many bytes per call (avail_in is 32 bits)
+const qint64 zlibChunk = 1 << 20;
+
+// windowBits for deflateInit2 and inflateInit2: 15 + 16 writes a gzip header,
+// 15 + 32 reads a gzip or zlib header
+const int gzipWindowBits = 15 + 16;
+const int autoWindowBits = 15 + 32;
+
+}
 
-    if (info.suffix() != "gz")
+bool isGzipped(const QByteArray &data)
+{
+    return data.size() >= 2 && uchar(data.at(0)) == 0x1f && uchar(data.at(1)) == 0x8b;
+}
+
+QByteArray gunzip(const QByteArray &data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, autoWindowBits) != Z_OK)
     {
-        qDebug("langmuir: %s is not gzipped", qPrintable(info.fileName()));
-        return info.absoluteFilePath();
+        qFatal("langmuir: can not initialize zlib");
     }
 
-    QProcess proc;
-    qDebug("langmuir: decompressing %s", qPrintable(info.fileName()));
-    proc.start("gunzip", QStringList() << fileName);
+    const Bytef *begin = reinterpret_cast<const Bytef*>(data.constData());
+    const Bytef *end = begin + data.size();
+    stream.next_in = const_cast<Bytef*>(begin);
+
+    QByteArray result;
+    result.reserve(4 * data.size());
+    QByteArray buffer(int(zlibChunk), '\0');
 
-    if (!proc.waitForStarted(300000))
+    while (true)
     {
-        qFatal("langmuir: QProcess took too long to start");
+        if (stream.avail_in == 0)
+        {
+            stream.avail_in = uInt(qMin<qint64>(end - stream.next_in, zlibChunk));
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+        stream.avail_out = uInt(buffer.size());
+
+        int status = inflate(&stream, Z_NO_FLUSH);
+        result.append(buffer.constData(), buffer.size() - int(stream.avail_out));
+
+        if (status == Z_STREAM_END)
+        {
+            // Another member may follow (files that were appended to)
+            qint64 left = end - stream.next_in;
+            if (left < 2 || stream.next_in[0] != 0x1f || stream.next_in[1] != 0x8b)
+            {
+                break;
+            }
+            inflateReset(&stream);
+        }
+        else if (status == Z_BUF_ERROR && stream.next_in == end)
+        {
+            inflateEnd(&stream);
+            qFatal("langmuir: can not decompress: the data is truncated");
+        }
+        else if (status != Z_OK && status != Z_BUF_ERROR)
+        {
+            QString message = stream.msg ? stream.msg : "corrupt data";
+            inflateEnd(&stream);
+            qFatal("langmuir: can not decompress: %s", qPrintable(message));
+        }
     }
 
-    if (!proc.waitForFinished(300000))
+    inflateEnd(&stream);
+    return result;
+}
+
+QByteArray gzip(const QByteArray &data, int level)
+{
+    QByteArray result;
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, gzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
     {
-        qFatal("langmuir: QProcess took too long to finish");
+        qFatal("langmuir: can not initialize zlib");
     }
 
-    if (proc.exitStatus() != QProcess::NormalExit)
+    result.resize(int(deflateBound(&stream, uLong(data.size()))));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(result.data());
+    stream.avail_out = uInt(result.size());
+
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
     {
-        qFatal("langmuir: QProcess has failed (%d)", proc.exitCode());
+        deflateEnd(&stream);
+        qFatal("langmuir: can not compress data");
     }
+    result.resize(int(stream.total_out));
 
-    qDebug("langmuir: decompression complete");
+    deflateEnd(&stream);
+    return result;
+}
+
+GzipDevice::GzipDevice(QIODevice *device, int level, QObject *parent)
+    : QIODevice(parent), m_device(device), m_level(level), m_stream(NULL)
+{
+}
 
-    if (wasZipped) { *wasZipped = true; }
-    return info.absoluteDir().absoluteFilePath(info.completeBaseName());
+GzipDevice::~GzipDevice()
+{
+    close();
 }
 
-QString gzip (QString fileName)
+bool GzipDevice::open(OpenMode mode)
 {
-    QFileInfo info(fileName);
-    if (!info.exists())
+    if ((mode & ReadOnly) || !(mode & WriteOnly))
     {
-        qDebug("langmuir: %s does not exist", qPrintable(info.fileName()));
-        return info.absoluteFilePath();
+        qWarning("langmuir: GzipDevice is write only");
+        return false;
     }
 
-    if (info.suffix() == "gz")
+    if (m_device == NULL || !m_device->isWritable())
     {
-        qDebug("langmuir: %s is already gzipped", qPrintable(info.fileName()));
-        return info.absoluteFilePath();
+        qWarning("langmuir: GzipDevice needs an open device");
+        return false;
     }
 
-    QProcess proc;
-    qDebug("langmuir: compressing %s", qPrintable(info.fileName()));
-    proc.start("gzip", QStringList() << fileName);
+    if (isOpen())
+    {
+        close();
+    }
 
-    if (!proc.waitForStarted(300000))
+    z_stream *stream = new z_stream;
+    memset(stream, 0, sizeof(z_stream));
+    if (deflateInit2(stream, m_level, Z_DEFLATED, gzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
     {
-        qFatal("langmuir: QProcess took too long to start");
+        delete stream;
+        qFatal("langmuir: can not initialize zlib");
     }
+    m_stream = stream;
+    m_buffer.resize(int(zlibChunk));
+
+    return QIODevice::open(mode & ~Text);
+}
 
-    if (!proc.waitForFinished(300000))
+void GzipDevice::close()
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+    QIODevice::close();
+
+    z_stream *stream = static_cast<z_stream*>(m_stream);
+    stream->next_in = NULL;
+    stream->avail_in = 0;
+    if (!deflateToDevice(Z_FINISH))
     {
-        qFatal("langmuir: QProcess took too long to finish");
+        qWarning("langmuir: can not finish gzip stream");
     }
+    deflateEnd(stream);
+    delete stream;
+    m_stream = NULL;
+    m_buffer.clear();
+}
 
-    if (proc.exitStatus() != QProcess::NormalExit)
+bool GzipDevice::flush()
+{
+    if (!isOpen())
     {
-        qFatal("langmuir: QProcess has failed (%d)", proc.exitCode());
+        return false;
     }
 
-    qDebug("langmuir: compression complete");
-    return info.absoluteDir().absoluteFilePath(info.fileName().append(".gz"));
+    z_stream *stream = static_cast<z_stream*>(m_stream);
+    stream->next_in = NULL;
+    stream->avail_in = 0;
+    return deflateToDevice(Z_SYNC_FLUSH);
+}
+
+bool GzipDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 GzipDevice::readData(char *, qint64)
+{
+    return -1;
+}
+
+qint64 GzipDevice::writeData(const char *data, qint64 size)
+{
+    z_stream *stream = static_cast<z_stream*>(m_stream);
+    qint64 written = 0;
+    while (written < size)
+    {
+        qint64 chunk = qMin(size - written, zlibChunk);
+        stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + written));
+        stream->avail_in = uInt(chunk);
+        if (!deflateToDevice(Z_NO_FLUSH))
+        {
+            return -1;
+        }
+        written += chunk;
+    }
+    return written;
+}
+
+bool GzipDevice::deflateToDevice(int flush)
+{
+    z_stream *stream = static_cast<z_stream*>(m_stream);
+    int status = Z_OK;
+    do
+    {
+        stream->next_out = reinterpret_cast<Bytef*>(m_buffer.data());
+        stream->avail_out = uInt(m_buffer.size());
+        status = deflate(stream, flush);
+        if (status == Z_STREAM_ERROR)
+        {
+            return false;
+        }
+        qint64 bytes = m_buffer.size() - qint64(stream->avail_out);
+        if (bytes > 0 && m_device->write(m_buffer.constData(), bytes) != bytes)
+        {
+            return false;
+        }
+    }
+    while (stream->avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+    return true;
 }
@@ -0,0 +1,135 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <QThreadPool>
+#include <QList>
+
+#include <cstddef>
+
+namespace LangmuirCore
+{
+
+/**
+ * @brief A class to place threads and memory on the CPUs and NUMA nodes of a job
+ *
+ * Used when threads.affinity is on.  The CPUs a job may use are read from the
+ * CPU affinity mask (which reflects the cpuset of a batch system) and the
+ * cgroup CPU quota, instead of trusting the node file alone.  The workers of a
+ * QThreadPool are pinned to those CPUs, spread round robin over the NUMA nodes,
+ * and large arrays are first touched by all of the workers, so that their pages
+ * are spread over the memory of every node.  The threads that step the
+ * simulations are pinned too (see Ensemble), and the arrays of a replica are
+ * first touched from the CPU that steps it (see replicaCPU()).
+ *
+ * Everything here is a no-op on systems other than Linux.
+ */
+class Affinity
+{
+public:
+    /**
+     * @brief get the CPUs this process is allowed to run on
+     *
+     * Falls back to 0 ... QThread::idealThreadCount() - 1 if the mask can not be read.
+     */
+    static QList<int> allowedCPUs();
+
+    /**
+     * @brief get the number of CPUs allowed by the cgroup CPU quota (v1 or v2)
+     * @return the quota rounded up, or -1 if there is no quota
+     */
+    static int cgroupCPUs();
+
+    /**
+     * @brief get the number of CPUs the job can actually use
+     *
+     * The smaller of the size of allowedCPUs() and cgroupCPUs().
+     */
+    static int availableCPUs();
+
+    /**
+     * @brief get the NUMA node of a CPU
+     * @param cpu the CPU index
+     * @return the node index, or 0 if it is not known
+     */
+    static int numaNode(int cpu);
+
+    /**
+     * @brief reorder CPUs so that consecutive CPUs are on different NUMA nodes
+     * @param cpus the CPUs to reorder
+     */
+    static QList<int> spreadCPUs(const QList<int> &cpus);
+
+    /**
+     * @brief get the CPU a replica is stepped on
+     * @param replica the index of the replica (0 is the primary)
+     *
+     * The CPUs of spreadCPUs(allowedCPUs()), round robin, so that replicas are
+     * spread over the NUMA nodes.
+     */
+    static int replicaCPU(int replica);
+
+    /**
+     * @brief pin each worker of a QThreadPool to its own CPU
+     * @param threadPool the pool, which must be idle
+     * @param cpus the CPUs to use, in order (reused if there are more workers than CPUs)
+     *
+     * The workers are told to never expire, so that they keep their CPUs.
+     */
+    static void pinThreads(QThreadPool &threadPool, const QList<int> &cpus);
+
+    /**
+     * @brief pin the calling thread to a CPU
+     * @param cpu the CPU index
+     * @return true on success
+     */
+    static bool pinCurrentThread(int cpu);
+
+    /**
+     * @brief let the calling thread run on a set of CPUs
+     * @param cpus the CPU indices
+     * @return true on success
+     */
+    static bool pinCurrentThread(const QList<int> &cpus);
+
+    /**
+     * @brief write zeros to memory from all workers of the global QThreadPool
+     * @param data the memory, which should not have been touched yet
+     * @param bytes the size of the memory
+     *
+     * The memory is split into page aligned partitions, so every page is first
+     * touched by one of the (pinned) workers.  Small blocks are zeroed serially.
+     */
+    static void firstTouch(void *data, std::size_t bytes);
+
+    /**
+     * @brief write zeros to memory from a thread pinned to a CPU
+     * @param data the memory, which should not have been touched yet
+     * @param bytes the size of the memory
+     * @param cpu the CPU index
+     *
+     * The pages end up on the NUMA node of the CPU, for memory that one thread uses.
+     */
+    static void firstTouch(void *data, std::size_t bytes, int cpu);
+
+protected:
+    /**
+     * @brief A part of the memory given to firstTouch()
+     */
+    struct Partition
+    {
+        //! first byte
+        char *data;
+
+        //! number of bytes
+        std::size_t bytes;
+    };
+
+    /**
+     * @brief A method needed to zero a Partition in parallel
+     */
+    static void firstTouchQtConcurrent(Partition &partition);
+};
+
+}
+
+#endif
@@ -48,6 +48,9 @@ public:
     //! Number of sites ChargeAgent has traversed
     int pathlength();
 
+    //! Identifier of the ChargeAgent, unique in its World (see World::nextChargeAgentID)
+    quint64 id();
+
     //! Set the ChargeAgent OpenCL identifier
     /*!
       \see OpenClHelper
@@ -73,6 +76,15 @@ public:
      */
     void coulombCPU();
 
+    //! Calculate the Coulomb potential on the CPU for a fixed configuration
+    /*!
+      \tparam Gauss use Gaussian charges (SimulationParameters::coulombGaussianSigma > 0)
+      \tparam Defects include charged defects (SimulationParameters::defectsCharge != 0)
+      \note The result is stored in m_de
+      \note Instantiated for all four combinations in chargeagent.cpp
+     */
+    template <bool Gauss, bool Defects> void coulombCPU();
+
     //! \b Retrieve the Coulomb potential from the GPU
     /*!
       \note The result is stored in m_de
@@ -137,6 +149,15 @@ protected:
 
     //! The difference in Coulomb potential between ChargeAgent::m_site and ChargeAgent::m_fSite
     double m_de;
+
+    //! The coupling constant of the move to ChargeAgent::m_fSite (see Grid::proposeNeighbor)
+    double m_fCoupling;
+
+    //! The position of the move to ChargeAgent::m_fSite in the stencil of the Grid, or -1 (see Grid::proposeNeighbor)
+    int m_fDirection;
+
+    //! Identifier of the ChargeAgent
+    quint64 m_id;
 };
 
 //! A class to represent moving negative charges
@@ -1,9 +1,13 @@
 #ifndef CHECKPOINTER_H
 #define CHECKPOINTER_H
 
+#include <QByteArray>
 #include <QObject>
+#include <QList>
 #include <QMap>
 
+#include <string>
+
 #include "parameters.h"
 
 namespace LangmuirCore
@@ -12,10 +16,64 @@ namespace LangmuirCore
 class World;
 class KeyValueParser;
 
+/**
+ * @brief A copy of everything a checkpoint file holds
+ *
+ * The state is copied from the world on the simulation thread, and can then
+ * be written to disk on another thread (see OutputQueue), while the
+ * simulation moves on.
+ */
+struct CheckPointState
+{
+    //! absolute name of the output file (%stub and %step are replaced)
+    QString fileName;
+
+    //! true to write the binary format (output.chk.format)
+    bool binary;
+
+    //! true to write the trap potentials (output.chk.trap.potential)
+    bool trapPotential;
+
+    //! electron site ids
+    QList<int> electrons;
+
+    //! hole site ids
+    QList<int> holes;
+
+    //! defect site ids
+    QList<int> defects;
+
+    //! trap site ids
+    QList<int> traps;
+
+    //! trap potentials
+    QList<double> trapPotentials;
+
+    //! flux attempts and successes
+    QList<quint64> fluxInfo;
+
+    //! random number generator, written by a little-endian QDataStream
+    QByteArray randomBinary;
+
+    //! random number generator, written by a std::ostream
+    std::string randomText;
+
+    //! parameters, as key = value lines
+    std::string parameters;
+
+    CheckPointState() : binary(false), trapPotential(false) {}
+};
+
 /**
  * @brief A class to read and write checkpoint files
  *
- * Checkpoint files are essentially the same as input files
+ * Checkpoint files are essentially the same as input files.  They are written
+ * as text or binary (output.chk.format); load() finds the format from the
+ * first bytes of the file.  Binary files are mapped into memory, and their
+ * numbers are read without parsing (see checkpointer.cpp for the layout).
+ *
+ * Files of either format are gzipped with zlib if their name ends in .gz, and
+ * gzipped input files are decompressed in memory, whatever their name.
  */
 class CheckPointer : public QObject
 {
@@ -53,11 +111,49 @@ public:
     void load(const QString& fileName, ConfigurationInfo &configInfo);
 
     /**
-     * @brief save simulation information
-     * @param fileName name of output file
+     * @brief save simulation information, in the format of output.chk.format
+     * @param fileName name of output file; .gz is appended if output.gzip is on
      */
     void save(const QString& fileName = "%stub.chk");
 
+    /**
+     * @brief copy the simulation information that save() writes
+     * @param state the copy
+     * @param fileName name of output file; .gz is appended if output.gzip is on
+     */
+    void takeState(CheckPointState& state, const QString& fileName = "%stub.chk");
+
+    /**
+     * @brief write a copy of the simulation information to disk
+     * @param state the copy, made by takeState()
+     *
+     * The world is not used, so this is safe to call from the output thread.
+     */
+    void write(const CheckPointState& state);
+
+    /**
+     * @brief save simulation information as text
+     * @param fileName name of output file
+     */
+    void saveText(const QString& fileName = "%stub.chk");
+
+    /**
+     * @brief save simulation information as binary
+     * @param fileName name of output file
+     */
+    void saveBinary(const QString& fileName = "%stub.chk");
+
+    /**
+     * @brief check if the (decompressed) contents of a file are a binary checkpoint
+     * @param contents the contents of the file
+     */
+    static bool isBinary(const QByteArray& contents);
+
+    /**
+     * @brief The version of the binary format; older versions can always be read
+     */
+    static const quint32 BinaryVersion = 1;
+
     /**
      * @brief check to see if input stream has failed
      * @param stream input stream
@@ -67,6 +163,23 @@ public:
 
 private:
 
+    /**
+     * @brief load simulation information from a text file
+     * @param contents the (decompressed) contents of the input file
+     * @param configInfo temporary storage for electrons, holes, etc
+     * @return true if the file has a random number generator state
+     */
+    bool loadText(const QByteArray& contents, ConfigurationInfo &configInfo);
+
+    /**
+     * @brief load simulation information from a binary file
+     * @param input the (decompressed) contents of the input file
+     * @param fileName name of the input file, for error messages
+     * @param configInfo temporary storage for electrons, holes, etc
+     * @return true if the file has a random number generator state
+     */
+    bool loadBinary(const QByteArray& input, const QString& fileName, ConfigurationInfo &configInfo);
+
     /**
      * @brief load electrons sites from input file
      * @param stream the input stream
@@ -121,53 +234,73 @@ private:
      */
     std::istream& loadRandomState(std::istream &stream);
 
+    /**
+     * @brief write a copy of the simulation information as text
+     * @param state the copy
+     */
+    void writeText(const CheckPointState& state);
+
+    /**
+     * @brief write a copy of the simulation information as binary
+     * @param state the copy
+     */
+    void writeBinary(const CheckPointState& state);
+
     /**
      * @brief save electron site ids to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveElectrons(std::ostream &stream);
+    std::ostream& saveElectrons(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief save hole site ids to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveHoles(std::ostream &stream);
+    std::ostream& saveHoles(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief save defect site ids to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveDefects(std::ostream &stream);
+    std::ostream& saveDefects(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief save trap site ids to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveTraps(std::ostream &stream);
+    std::ostream& saveTraps(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief save trap energies to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveTrapPotentials(std::ostream &stream);
+    std::ostream& saveTrapPotentials(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief save flux states to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveFluxState(std::ostream &stream);
+    std::ostream& saveFluxState(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief save parameters to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveParameters(std::ostream &stream);
+    std::ostream& saveParameters(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief save random number generator state to output file
      * @param stream output stream
+     * @param state the copy of the simulation information
      */
-    std::ostream& saveRandomState(std::ostream &stream);
+    std::ostream& saveRandomState(std::ostream &stream, const CheckPointState &state);
 
     /**
      * @brief reference to world object
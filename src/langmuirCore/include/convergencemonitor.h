@@ -0,0 +1,110 @@
+#ifndef CONVERGENCEMONITOR_H
+#define CONVERGENCEMONITOR_H
+
+#include <QObject>
+#include <QVector>
+
+namespace LangmuirCore
+{
+
+class World;
+
+/**
+ * @brief A class to detect when the currents have reached a steady state
+ *
+ * After every block of steps, update() stores the success rates (successes per
+ * step) of all DrainAgents and of all SourceAgents during the block.  Blocks
+ * that start before convergence.min.steps are ignored.  The samples are split
+ * into convergence.batches batches, and the standard error of the mean is
+ * estimated from the variance of the batch means.  The run is converged once
+ * the relative standard error of both rates is below convergence.error.
+ *
+ * Nothing is done if convergence.error is 0.
+ */
+class ConvergenceMonitor : public QObject
+{
+private:
+    Q_OBJECT
+    Q_DISABLE_COPY(ConvergenceMonitor)
+
+public:
+    /**
+     * @brief Create a ConvergenceMonitor
+     * @param world reference to World Object
+     * @param parent QObject this belongs to
+     */
+    ConvergenceMonitor(World &world, QObject *parent = 0);
+
+    /**
+     * @brief Destroy the ConvergenceMonitor
+     */
+    virtual ~ConvergenceMonitor();
+
+    /**
+     * @brief take samples of the rates since the last call, and check for convergence
+     */
+    void update();
+
+    /**
+     * @brief check if the rates have converged
+     */
+    bool isConverged() const;
+
+    /**
+     * @brief forget all samples (done automatically if the current step goes backwards)
+     */
+    void reset();
+
+    /**
+     * @brief estimate the relative standard error of the mean of some samples with batch means
+     * @param samples the samples
+     * @param batches the number of batches
+     * @return the relative standard error, or -1 if there are too few samples or their mean is 0
+     */
+    static double relativeError(const QVector<double> &samples, int batches);
+
+protected:
+    /**
+     * @brief Reference to World object
+     */
+    World &m_world;
+
+    /**
+     * @brief Drain success rates, one per block of steps
+     */
+    QVector<double> m_drainSamples;
+
+    /**
+     * @brief Source success rates, one per block of steps
+     */
+    QVector<double> m_sourceSamples;
+
+    /**
+     * @brief Drain successes at the last update()
+     */
+    quint64 m_lastDrainSuccesses;
+
+    /**
+     * @brief Source successes at the last update()
+     */
+    quint64 m_lastSourceSuccesses;
+
+    /**
+     * @brief Step of the last update()
+     */
+    quint32 m_lastStep;
+
+    /**
+     * @brief True if update() was called since the last reset()
+     */
+    bool m_started;
+
+    /**
+     * @brief True once the rates have converged
+     */
+    bool m_converged;
+};
+
+}
+
+#endif
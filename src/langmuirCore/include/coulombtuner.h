@@ -0,0 +1,142 @@
+#ifndef COULOMBTUNER_H
+#define COULOMBTUNER_H
+
+#include <QObject>
+#include <QVector>
+
+namespace LangmuirCore
+{
+
+class World;
+class OutputStream;
+
+/**
+ * @brief A class to choose the fastest way of computing Coulomb interactions
+ *
+ * Every coulomb.tuner.interval steps the Simulation starts timing the
+ * available Backends, one per step in turn (see nextBackend()), and passes the
+ * times to record().  Once each Backend was timed over coulomb.tuner.samples
+ * steps, decide() switches to the fastest on average, but only if it beats the
+ * current one by more than coulomb.tuner.hysteresis.  The decisions are written
+ * to the %stub-tuner.dat file.
+ *
+ * If coulomb.tuner.interval is 0 (the default), the tuner is off, and OpenCL
+ * is used only when the number of carriers is above opencl.threshold.
+ */
+class CoulombTuner : public QObject
+{
+private:
+    Q_OBJECT
+    Q_DISABLE_COPY(CoulombTuner)
+
+public:
+    /**
+     * @brief The ways of computing Coulomb interactions
+     */
+    enum Backend
+    {
+        SerialCPU   = 0,
+        ThreadedCPU = 1,
+        OpenCL      = 2,
+        NumBackends = 3
+    };
+
+    /**
+     * @brief Create a CoulombTuner
+     * @param world reference to World Object
+     * @param parent QObject this belongs to
+     */
+    CoulombTuner(World &world, QObject *parent = 0);
+
+    /**
+     * @brief Destroy the CoulombTuner
+     */
+    virtual ~CoulombTuner();
+
+    /**
+     * @brief get the Backend to use at the current step
+     */
+    Backend backend() const;
+
+    /**
+     * @brief check if the Backends should be timed at the current step
+     */
+    bool isDue() const;
+
+    /**
+     * @brief check if a Backend can be used
+     */
+    bool isAvailable(Backend backend) const;
+
+    /**
+     * @brief get the available Backend that was timed the fewest times since the last decision
+     */
+    Backend nextBackend() const;
+
+    /**
+     * @brief store the time taken by a Backend at the current step
+     * @param backend the Backend that was timed
+     * @param nsecs nanoseconds taken to compute the Coulomb interactions
+     */
+    void record(Backend backend, qint64 nsecs);
+
+    /**
+     * @brief check if every available Backend was timed coulomb.tuner.samples times
+     */
+    bool isComplete() const;
+
+    /**
+     * @brief switch to the fastest recorded Backend (with hysteresis) and log the decision
+     */
+    void decide();
+
+    /**
+     * @brief get the name of a Backend
+     */
+    static QString toQString(Backend backend);
+
+protected:
+    /**
+     * @brief Reference to World object
+     */
+    World &m_world;
+
+    /**
+     * @brief The Backend chosen by decide()
+     */
+    Backend m_backend;
+
+    /**
+     * @brief The sum of the times passed to record() since the last decision
+     */
+    QVector<qint64> m_nsecs;
+
+    /**
+     * @brief The number of times passed to record() since the last decision
+     */
+    QVector<int> m_samples;
+
+    /**
+     * @brief True between the first record() and the next decision
+     */
+    bool m_timing;
+
+    /**
+     * @brief The step of the last decision
+     */
+    quint32 m_lastStep;
+
+    /**
+     * @brief True after the first decision
+     */
+    bool m_tuned;
+
+    /**
+     * @brief Stream the decisions are written to (0 if output is off)
+     */
+    OutputStream *m_stream;
+};
+
+}
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef CUBICGRID_H
 #define CUBICGRID_H
 
+#include "fastdivider.h"
+#include "sitestore.h"
 #include "agent.h"
 
 #include <QTextStream>
@@ -9,10 +11,13 @@
 #include <QObject>
 #include <QDebug>
 
+#include <cstdlib>
+
 namespace LangmuirCore
 {
 
 class World;
+class DrainAgent;
 
 /**
  * @brief A class to hold Agents, calculate their positions, and store the background potential
@@ -71,15 +76,25 @@ public:
     /**
      * @brief Create a grid
      * @param world reference to the world object
+     * @param sites the records of the sites, shared by the electron and hole Grids
+     * @param slot the part of the records this Grid uses
      * @param parent QObject this belongs to
+     *
+     * The Grid is a view of one Slot of the SiteStore; the background
+     * potential is shared by both views.
      */
-    Grid(World &world, QObject *parent = 0);
+    Grid(World &world, SiteStore &sites, SiteStore::Slot slot, QObject *parent = 0);
 
     /**
      * @brief Destroy the grid
      */
     ~Grid();
 
+    /**
+     * @brief Get the number of sites reserved for special Agents (after the volume)
+     */
+    static int specialAgentReserve();
+
     /**
      * @brief Get the number of sites along the x-direction
      */
@@ -214,6 +229,24 @@ public:
      */
     int zImageDistancei(int site1, int site2);
 
+    /**
+     * @brief Get the \b integer distance between two y indexes
+     * @param y1 the first y index
+     * @param y2 the second y index
+     *
+     * If grid.periodic.y is on, this is the distance to the nearest image.
+     */
+    int yIndexDistance(int y1, int y2);
+
+    /**
+     * @brief Get the \b integer distance between two z indexes
+     * @param z1 the first z index
+     * @param z2 the second z index
+     *
+     * If grid.periodic.z is on, this is the distance to the nearest image.
+     */
+    int zIndexDistance(int z1, int z2);
+
     /**
      * @brief Get the serial site ID
      * @param xIndex x site ID
@@ -227,6 +260,14 @@ public:
      */
     int getIndexS(int xIndex, int yIndex, int zIndex = 0);
 
+    /**
+     * @brief Get the site at an offset from (x, y, z), wrapping along periodic directions
+     * @return the "s-site ID", or -1 if it is outside of the Grid
+     *
+     * The offsets must be smaller than the size of the Grid.
+     */
+    int offsetSite(int x, int y, int z, int dx, int dy, int dz);
+
     /**
      * @brief Get the "y-site ID" from the "s-site ID"
      * @param site the "s-site ID"
@@ -254,6 +295,19 @@ public:
      */
     int getIndexZ(int site);
 
+    /**
+     * @brief Get the x, y, and z-site IDs from the "s-site ID" at once
+     * @param site the "s-site ID"
+     * @param xIndex the x-site ID (output)
+     * @param yIndex the y-site ID (output)
+     * @param zIndex the z-site ID (output)
+     *
+     * Cheaper than calling getIndexX(), getIndexY(), and getIndexZ().  None
+     * of them divide; see FastDivider.
+     * @see getIndexS
+     */
+    void getIndexXYZ(int site, int &xIndex, int &yIndex, int &zIndex);
+
     /**
      * @brief Get the y-position from the "s-site ID"
      * @param site the "s-site ID"
@@ -298,10 +352,22 @@ public:
      */
     Agent::Type agentType(int site);
 
+    /**
+     * @brief Get a pointer to the DrainAgent at a special site
+     * @param site the "s-site ID" of the special Agent
+     * @warning may be NULL if there is no DrainAgent at the site
+     *
+     * Uses a table filled by registerSpecialAgent(), so callers do not have
+     * to cast the result of agentAddress().
+     */
+    DrainAgent * drainAddress(int site);
+
     /**
      * @brief Add some value to the background potential at a site
      * @param site the "s-site ID"
      * @param potential the value to add
+     *
+     * The potential is shared with the other Grid, so only add it once.
      */
     void addToPotential(int site, double potential);
 
@@ -312,12 +378,51 @@ public:
      */
     void setPotential(int site, double potential);
 
+    /**
+     * @brief Set the background potential to zero everywhere
+     */
+    void setPotentialZero();
+
+    /**
+     * @brief Add slope * (x + 0.5) + offset to the background potential of every site
+     * @param slope the change per site along the x-direction
+     * @param offset the value at x = -0.5
+     *
+     * With grid.sparse this only changes two numbers.
+     */
+    void addToPotentialLinear(double slope, double offset);
+
+    /**
+     * @brief Add slope * (z + 0.5) to the background potential of every site
+     * @param slope the change per site along the z-direction
+     *
+     * With grid.sparse this only changes one number.
+     */
+    void addToPotentialGate(double slope);
+
     /**
      * @brief Get the background potential at some site
      * @param site the "s-site ID"
      */
     double potential(int site);
 
+    /**
+     * @brief Get potential(site1) - potential(site2)
+     * @param site1 the "s-site ID" of the first site
+     * @param site2 the "s-site ID" of the second site
+     *
+     * Cheaper than two calls to potential() with potential.analytic.
+     */
+    double potentialDifference(int site1, int site2);
+
+    /**
+     * @brief Copy the background potential of another Grid (of another World)
+     * @param other the Grid to copy from
+     *
+     * Changes the potential of the other Grid of this World too.
+     */
+    void copyPotential(Grid &other);
+
     /**
      * @brief Calculate the neighboring sites of a given site
      * @param site the "s-site ID"
@@ -325,6 +430,95 @@ public:
      */
     QVector<int> neighborsSite(int site, int hoppingRange = 1);
 
+    /**
+     * @brief Calculate the offsets of the neighbors of a site
+     * @param hoppingRange the number of adjacent sites to consider in the calculation
+     * @param dx the x-offsets (output)
+     * @param dy the y-offsets (output)
+     * @param dz the z-offsets (output)
+     *
+     * The offsets are the sites in a sphere (or a cube if hopping.spherical is
+     * off) of radius hoppingRange, in the order used by neighborsSite().
+     * Offsets that do not fit in the Grid (such as z-offsets with one layer)
+     * are left out.
+     */
+    void buildStencil(int hoppingRange, QVector<int> &dx, QVector<int> &dy, QVector<int> &dz);
+
+    /**
+     * @brief Get the number of neighbors of a site (using hopping.range)
+     * @param site the "s-site ID"
+     *
+     * The same as neighborsSite(site, hoppingRange).size(), but nothing is allocated.
+     */
+    int neighborCount(int site);
+
+    /**
+     * @brief Get a neighbor of a site (using hopping.range)
+     * @param site the "s-site ID"
+     * @param index which neighbor, from 0 to neighborCount() - 1
+     *
+     * The same as neighborsSite(site, hoppingRange)[index], but nothing is allocated.
+     * Sites far enough from the edges just add a precomputed offset.
+     */
+    int neighbor(int site, int index);
+
+    /**
+     * @brief Get a neighbor of a site (using hopping.range) and the coupling constant of the hop
+     * @param site the "s-site ID"
+     * @param index which neighbor, from 0 to neighborCount() - 1
+     * @param coupling the coupling constant (output); 0 for drains
+     */
+    int neighbor(int site, int index, double &coupling);
+
+    /**
+     * @brief Get a neighbor of a site, the coupling constant, and the direction of the hop
+     * @param direction the position of the hop in the stencil (output); -1 for drains
+     */
+    int neighbor(int site, int index, double &coupling, int &direction);
+
+    /**
+     * @brief Choose the future site of a charge at a site
+     * @param site the "s-site ID"
+     * @param coupling the probability to accept the move before the Metropolis criterion (output)
+     * @param direction the position of the hop in the stencil (output); -1 for drains and the site itself
+     *
+     * Usually picks a neighbor at random, and coupling is its coupling constant.
+     * If hopping.alias is on, sites away from the edges pick a neighbor with
+     * probability proportional to its coupling constant (or the site itself,
+     * which is then rejected), and coupling is 1.
+     */
+    int proposeNeighbor(int site, double &coupling, int &direction);
+
+    /**
+     * @brief Rebuild the acceptance table if the potential or temperature has changed
+     *
+     * Only used if metropolis.fast is on, coulomb.carriers is off, and grid.sparse is off.
+     * If the table would be larger than metropolis.fast.memory, it is not
+     * built, and hasAcceptanceTable() stays false.
+     * Must not be called while charges are deciding their future.
+     */
+    void updateAcceptance();
+
+    /**
+     * @brief Check if acceptance() can be used
+     */
+    bool hasAcceptanceTable() const;
+
+    /**
+     * @brief Get the Boltzmann factor of a hop, min(1, exp(-dE / kT)), from the table
+     * @param site the "s-site ID"
+     * @param direction the position of the hop in the stencil
+     *
+     * The coupling is not included; hopping.alias has already used it away
+     * from the edges.
+     */
+    double acceptance(int site, int direction) const;
+
+    /**
+     * @brief Update the coupling constants of the neighbors from World::couplingConstants()
+     */
+    void updateCouplingConstants();
+
     /**
      * @brief Calculate the neighboring sites of a given face of the Grid
      * @param cubeFace the face of the Grid to consider
@@ -348,8 +542,8 @@ public:
      * @warning uses Agent::getCurrentSite()
      * @warning site must be Agent::Empty
      *
-     * Makes sure the site is empty first.  After assigning the Agent to the site,
-     * calculates and assigns the neighbors to the Agent.
+     * Makes sure the site is empty first.  The neighbors are not stored in the
+     * Agent, use neighborCount() and neighbor() instead.
      */
     void registerAgent(Agent *agent);
 
@@ -406,30 +600,26 @@ protected:
     World &m_world;
 
     /**
-     * @brief 1D list of Agent pointers, the size of which is the volume of the Grid + the max number of special Agents.
-     * @warning some of these may be NULL
+     * @brief Records of the Agents, Agent types, and potentials, the size of which is the volume of the Grid + the max number of special Agents.
+     * @warning some of the Agents may be NULL, and some of the types Agent::Empty
      *
-     * Each position in the list is mapped to a position in the Grid.  Use getIndexS()
-     * to calculate the serial site ID needed to index this list.
+     * Each record is mapped to a position in the Grid.  Use getIndexS()
+     * to calculate the serial site ID needed to index the records.
      */
-    QVector<Agent *> m_agents;
+    SiteStore &m_sites;
 
     /**
-     * @brief 1D list of site potentials, the size of which is the volume of the Grid + the max number of special Agents.
-     *
-     * Each position in the list is mapped to a position in the Grid.  Use getIndexS()
-     * to calculate the serial site ID needed to index this list.
+     * @brief The part of the records used by this Grid
      */
-    QVector<double> m_potentials;
+    SiteStore::Slot m_slot;
 
     /**
-     * @brief 1D list of Agent types, the size of which is the volume of the Grid + the max number of special Agents.
-     * @warning some of these may be Agent::Empty
+     * @brief 1D list of DrainAgent pointers, the size of which is the max number of special Agents.
+     * @warning some of these may be NULL
      *
-     * Each position in the list is mapped to a position in the Grid.  Use getIndexS()
-     * to calculate the serial site ID needed to index this list.
+     * Index with the serial site ID minus the volume of the Grid.
      */
-    QVector<Agent::Type> m_agentType;
+    QVector<DrainAgent *> m_drainAgents;
 
     /**
      * @brief A list of lists of special agents, where each sub-list is for a different Grid::CubeFace
@@ -461,6 +651,16 @@ protected:
      */
     int m_zSize;
 
+    /**
+     * @brief Whether the Grid wraps around along the y-direction (grid.periodic.y)
+     */
+    bool m_periodicY;
+
+    /**
+     * @brief Whether the Grid wraps around along the z-direction (grid.periodic.z)
+     */
+    bool m_periodicZ;
+
     /**
      * @brief The number of sites in the xy-plane
      */
@@ -480,8 +680,236 @@ protected:
      * @brief The total number of sites
      */
     int m_volume;
+
+    /**
+     * @brief Divides by m_xSize, to find the row (y + z * m_ySize) of a site
+     */
+    FastDivider m_xDivider;
+
+    /**
+     * @brief Divides by m_ySize, to find the layer (z) of a row
+     */
+    FastDivider m_yDivider;
+
+    /**
+     * @brief Offsets of the neighbors (using hopping.range) along the x-direction
+     */
+    QVector<int> m_stencilX;
+
+    /**
+     * @brief Offsets of the neighbors (using hopping.range) along the y-direction
+     */
+    QVector<int> m_stencilY;
+
+    /**
+     * @brief Offsets of the neighbors (using hopping.range) along the z-direction
+     */
+    QVector<int> m_stencilZ;
+
+    /**
+     * @brief Offsets of the neighbors (using hopping.range) as "s-site ID" differences
+     */
+    QVector<int> m_stencilS;
+
+    /**
+     * @brief Coupling constants of the neighbors (using hopping.range)
+     */
+    QVector<double> m_stencilCoupling;
+
+    /**
+     * @brief Alias table probabilities for proposeNeighbor(); the last entry is the site itself
+     */
+    QVector<double> m_aliasProbability;
+
+    /**
+     * @brief Alias table aliases for proposeNeighbor(); the last entry is the site itself
+     */
+    QVector<int> m_aliasIndex;
+
+    /**
+     * @brief The Boltzmann factor of each hop of each site (see acceptance())
+     */
+    QVector<float> m_acceptance;
+
+    /**
+     * @brief SiteStore::potentialVersion() when m_acceptance was built, or -1
+     */
+    int m_acceptanceVersion;
+
+    /**
+     * @brief inverse.kt when m_acceptance was built
+     */
+    double m_acceptanceInverseKT;
+
+    /**
+     * @brief True if the table would be larger than metropolis.fast.memory
+     */
+    bool m_acceptanceTooLarge;
+
+    /**
+     * @brief Sites closer than this to the yz-planes have boundary neighbors (always at least 1, for the drains)
+     */
+    int m_interiorX;
+
+    /**
+     * @brief Sites closer than this to the xz-planes have boundary neighbors
+     */
+    int m_interiorY;
+
+    /**
+     * @brief Sites closer than this to the xy-planes have boundary neighbors
+     */
+    int m_interiorZ;
+
+    /**
+     * @brief Sites of the DrainAgents on the left face, neighbors of sites with x = 0
+     */
+    QVector<int> m_leftDrainSites;
+
+    /**
+     * @brief Sites of the DrainAgents on the right face, neighbors of sites with x = lx - 1
+     */
+    QVector<int> m_rightDrainSites;
+
+    /**
+     * @brief Check if all neighbors of a site are found by adding m_stencilS
+     * @param site the "s-site ID"
+     */
+    bool isInterior(int site);
+
+    /**
+     * @brief Fill m_leftDrainSites and m_rightDrainSites from the special Agents
+     */
+    void updateDrainSites();
 };
 
+inline bool Grid::hasAcceptanceTable() const
+{
+    return !m_acceptance.isEmpty();
+}
+
+inline double Grid::acceptance(int site, int direction) const
+{
+    return m_acceptance.at(qint64(site) * m_stencilS.size() + direction);
+}
+
+inline double Grid::potential(int site)
+{
+    return m_sites.potential(site);
+}
+
+inline double Grid::potentialDifference(int site1, int site2)
+{
+    return m_sites.potentialDifference(site1, site2);
+}
+
+inline int Grid::getIndexS(int xIndex, int yIndex, int zIndex)
+{
+    return(m_xSize *(yIndex + zIndex*m_ySize)+ xIndex);
+}
+
+inline int Grid::getIndexX(int site)
+{
+    return site - m_xDivider.divide(site) * m_xSize;
+}
+
+inline int Grid::getIndexY(int site)
+{
+    int row = m_xDivider.divide(site);
+    return row - m_yDivider.divide(row) * m_ySize;
+}
+
+inline int Grid::getIndexZ(int site)
+{
+    return m_yDivider.divide(m_xDivider.divide(site));
+}
+
+inline void Grid::getIndexXYZ(int site, int &xIndex, int &yIndex, int &zIndex)
+{
+    int row = m_xDivider.divide(site);
+    zIndex = m_yDivider.divide(row);
+    yIndex = row - zIndex * m_ySize;
+    xIndex = site - row * m_xSize;
+}
+
+inline int Grid::xDistancei(int site1, int site2)
+{
+    return abs(getIndexX(site1) - getIndexX(site2));
+}
+
+inline int Grid::yDistancei(int site1, int site2)
+{
+    return yIndexDistance(getIndexY(site1), getIndexY(site2));
+}
+
+inline int Grid::zDistancei(int site1, int site2)
+{
+    return zIndexDistance(getIndexZ(site1), getIndexZ(site2));
+}
+
+inline int Grid::yIndexDistance(int y1, int y2)
+{
+    int d = abs(y1 - y2);
+    if (m_periodicY && 2 * d > m_ySize)
+    {
+        return m_ySize - d;
+    }
+    return d;
+}
+
+inline int Grid::zIndexDistance(int z1, int z2)
+{
+    int d = abs(z1 - z2);
+    if (m_periodicZ && 2 * d > m_zSize)
+    {
+        return m_zSize - d;
+    }
+    return d;
+}
+
+inline int Grid::offsetSite(int x, int y, int z, int dx, int dy, int dz)
+{
+    int nx = x + dx;
+    int ny = y + dy;
+    int nz = z + dz;
+    if (nx < 0 || nx >= m_xSize)
+    {
+        return -1;
+    }
+    if (ny < 0 || ny >= m_ySize)
+    {
+        if (!m_periodicY)
+        {
+            return -1;
+        }
+        ny += (ny < 0) ? m_ySize : -m_ySize;
+    }
+    if (nz < 0 || nz >= m_zSize)
+    {
+        if (!m_periodicZ)
+        {
+            return -1;
+        }
+        nz += (nz < 0) ? m_zSize : -m_zSize;
+    }
+    return getIndexS(nx, ny, nz);
+}
+
+inline int Grid::xImageDistancei(int site1, int site2)
+{
+    return abs(getIndexX(site1) + getIndexX(site2))+1;
+}
+
+inline int Grid::yImageDistancei(int site1, int site2)
+{
+    return abs(getIndexY(site1) + getIndexY(site2))+1;
+}
+
+inline int Grid::zImageDistancei(int site1, int site2)
+{
+    return abs(getIndexZ(site1) + getIndexZ(site2))+1;
+}
+
 /**
  * @brief Overload QTextStream for the Grid::CubeFace Enum
  */
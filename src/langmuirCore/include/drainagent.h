@@ -3,10 +3,34 @@
 
 #include "fluxagent.h"
 
+#include <QVector>
+
 namespace LangmuirCore
 {
 
 class ChargeAgent;
+class RecombinationAgent;
+
+/**
+ * @brief The partner an electron proposes to recombine with during RecombinationAgent::tryToAcceptAll()
+ */
+struct RecombinationCandidate
+{
+    //! the RecombinationAgent doing the work
+    RecombinationAgent *agent;
+
+    //! the electron
+    ChargeAgent *electron;
+
+    //! position of the electron in World::electrons(), used to draw random numbers
+    int index;
+
+    //! site of the chosen hole, or -1 if there are no holes in range
+    int site;
+
+    //! true if the recombination should happen (if the hole is still available)
+    bool accept;
+};
 
 /**
  * @brief A class to remove charges
@@ -103,6 +127,21 @@ public:
      */
     virtual bool tryToAccept(ChargeAgent *charge);
 
+    /**
+     * @brief try to recombine every electron, in parallel
+     * @param electrons the electrons (World::electrons())
+     *
+     * Used if recombination.parallel is on.  Each electron picks a hole within
+     * recombination.range using a bitmap of hole sites and a precomputed list
+     * of offsets.  One key is drawn from the random number generator per
+     * step, in serial, and the random numbers of an electron depend only on
+     * the key and its position in the list, so the result does not depend on
+     * the number of threads.  Electrons that pick the same hole are resolved
+     * in list order: the first one gets the attempt, the others do nothing,
+     * just like the serial tryToAccept().
+     */
+    void tryToAcceptAll(QList<ChargeAgent *> &electrons);
+
     /**
      * @brief calculate an acceptance probability based upon the desired rate and encounter frequency
      */
@@ -113,6 +152,57 @@ private:
      * @brief currently implemented as zero and not really used
      */
     virtual double energyChange(int fSite);
+
+    /**
+     * @brief choose a hole for one electron (safe to call from many threads)
+     */
+    void propose(RecombinationCandidate &candidate) const;
+
+    /**
+     * @brief A method needed to call propose() in parallel
+     */
+    static void proposeQtConcurrent(RecombinationCandidate &candidate);
+
+    /**
+     * @brief a uniform random number in [0, 1) for an electron at the current step
+     * @param index position of the electron in World::electrons()
+     * @param stream which of the electron's numbers to generate
+     */
+    double uniform(int index, int stream) const;
+
+    /**
+     * @brief the key of uniform(), drawn from the random number generator every step
+     */
+    quint64 m_key;
+
+    /**
+     * @brief offsets (x, y, z) of the sites within recombination.range, including the site itself
+     */
+    QVector<int> m_stencilX;
+    QVector<int> m_stencilY;
+    QVector<int> m_stencilZ;
+
+    /**
+     * @brief the offsets in m_stencilX, m_stencilY, m_stencilZ as site index differences
+     */
+    QVector<int> m_stencilS;
+
+    /**
+     * @brief the largest offsets in m_stencilX, m_stencilY, m_stencilZ
+     */
+    int m_reachX;
+    int m_reachY;
+    int m_reachZ;
+
+    /**
+     * @brief one bit per site, set if a hole is there
+     */
+    QVector<quint32> m_holeBitmap;
+
+    /**
+     * @brief one candidate per electron, reused every step
+     */
+    QVector<RecombinationCandidate> m_candidates;
 };
 
 }
@@ -0,0 +1,158 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QObject>
+#include <QList>
+
+namespace LangmuirCore
+{
+
+class World;
+class Sweep;
+class Simulation;
+
+/**
+ * @brief A class to run independent replicas of a simulation in one process
+ *
+ * The first World is created from the input file as usual.  The other Worlds
+ * are replicas of it (see World::World(World&, int, int, QObject*)); they share
+ * the precomputed arrays, the background potential and the morphology, but own
+ * their carriers and random number generator.  Each replica writes to its own
+ * output stub, SimulationParameters::outputStub + "_r" + index.
+ *
+ * The replicas are stepped concurrently on a dedicated thread pool, while the
+ * Coulomb calculations of all replicas share the global QThreadPool.  With
+ * threads.affinity, the thread that steps a replica is pinned to the CPU given
+ * by Affinity::replicaCPU(), on whose NUMA node the replica's records are.
+ *
+ * Every replica also has a Sweep, which moves it through the points listed in
+ * the input file (see setSweepPoint()).
+ */
+class Ensemble : public QObject
+{
+private:
+    Q_OBJECT
+    Q_DISABLE_COPY(Ensemble)
+
+public:
+    /**
+     * @brief Create an Ensemble
+     * @param fileName the input file name
+     * @param replicas the number of replicas (1 means a single, normal simulation)
+     * @param cores number of CPU cores
+     * @param gpuID OpenCL GPU id
+     * @param parent QObject this belongs to
+     */
+    Ensemble(const QString &fileName, int replicas = 1, int cores = -1, int gpuID = -1, QObject *parent = 0);
+
+    /**
+     * @brief Destroy the Ensemble, replicas first
+     */
+    ~Ensemble();
+
+    /**
+     * @brief get the number of replicas
+     */
+    int size();
+
+    /**
+     * @brief get the World of a replica
+     * @param replica the replica index
+     */
+    World& world(int replica = 0);
+
+    /**
+     * @brief get the Simulation of a replica
+     * @param replica the replica index
+     */
+    Simulation& simulation(int replica = 0);
+
+    /**
+     * @brief get the number of sweep points (1 if there is no sweep)
+     */
+    int sweepSize();
+
+    /**
+     * @brief move every replica to a sweep point
+     * @param point the index of the point
+     */
+    void setSweepPoint(int point);
+
+    /**
+     * @brief simulate every replica for a set number of steps
+     * @param nIterations the number of steps to simulate
+     */
+    void performIterations(int nIterations);
+
+    /**
+     * @brief check if every replica has converged (see Simulation::isConverged())
+     */
+    bool isConverged();
+
+protected:
+    /**
+     * @brief A QRunnable that steps one replica
+     */
+    class Runner : public QRunnable
+    {
+    public:
+        /**
+         * @brief create a Runner
+         * @param simulation the Simulation of the replica
+         * @param nIterations the number of steps to simulate
+         * @param cpu the CPU to step on (-1 to not pin the thread)
+         */
+        Runner(Simulation &simulation, int nIterations, int cpu = -1);
+
+        /**
+         * @brief call Simulation::performIterations
+         */
+        virtual void run();
+
+    protected:
+        //! the Simulation of the replica
+        Simulation &m_simulation;
+
+        //! the number of steps to simulate
+        int m_nIterations;
+
+        //! the CPU to step on (-1 to not pin the thread)
+        int m_cpu;
+    };
+
+    /**
+     * @brief list of Worlds, the first one is the primary
+     */
+    QList<World*> m_worlds;
+
+    /**
+     * @brief list of Simulations, one per World
+     */
+    QList<Simulation*> m_simulations;
+
+    /**
+     * @brief list of Sweeps, one per World
+     */
+    QList<Sweep*> m_sweeps;
+
+    /**
+     * @brief thread pool used to step the replicas
+     */
+    QThreadPool *m_threadPool;
+
+    /**
+     * @brief the CPU each replica is stepped on (empty without threads.affinity)
+     */
+    QList<int> m_cpus;
+
+    /**
+     * @brief the CPUs the process could run on, before any stepping thread was pinned
+     */
+    QList<int> m_allowedCPUs;
+};
+
+}
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,89 @@
+#ifndef FASTDIVIDER_H
+#define FASTDIVIDER_H
+
+#include <QtGlobal>
+
+namespace LangmuirCore
+{
+
+/**
+ * @brief Divide non-negative ints by a fixed divisor with a multiply and a shift
+ *
+ * Uses the round-up method of Granlund and Montgomery: with 2^(l-1) < d <= 2^l,
+ * n / d == (n * ceil(2^(32 + l) / d)) >> (32 + l) for every 0 <= n < 2^31, and
+ * the product fits in 64 bits.  Used to turn "s-site IDs" into (x, y, z)
+ * without integer division.
+ */
+class FastDivider
+{
+public:
+    /**
+     * @brief create a FastDivider that divides by 1
+     */
+    FastDivider()
+    {
+        setDivisor(1);
+    }
+
+    /**
+     * @brief create a FastDivider
+     * @param divisor the divisor (> 0)
+     */
+    explicit FastDivider(int divisor)
+    {
+        setDivisor(divisor);
+    }
+
+    /**
+     * @brief change the divisor
+     * @param divisor the divisor (> 0)
+     */
+    void setDivisor(int divisor)
+    {
+        if (divisor <= 0)
+        {
+            qFatal("langmuir: can not divide by %d", divisor);
+        }
+
+        int l = 0;
+        while ((Q_INT64_C(1) << l) < divisor)
+        {
+            l++;
+        }
+
+        m_divisor = divisor;
+        m_shift = 32 + l;
+        m_multiplier = ((Q_UINT64_C(1) << m_shift) + quint64(divisor) - 1) / quint64(divisor);
+    }
+
+    /**
+     * @brief get the divisor
+     */
+    int divisor() const
+    {
+        return m_divisor;
+    }
+
+    /**
+     * @brief get n / divisor
+     * @param n the dividend (>= 0)
+     */
+    int divide(int n) const
+    {
+        return int((quint64(quint32(n)) * m_multiplier) >> m_shift);
+    }
+
+private:
+    //! the magic number
+    quint64 m_multiplier;
+
+    //! the shift
+    int m_shift;
+
+    //! the divisor
+    int m_divisor;
+};
+
+}
+
+#endif
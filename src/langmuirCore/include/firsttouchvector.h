@@ -0,0 +1,169 @@
+#ifndef FIRSTTOUCHVECTOR_H
+#define FIRSTTOUCHVECTOR_H
+
+#include <QSharedDataPointer>
+#include <QSharedData>
+#include <QtGlobal>
+
+#include <algorithm>
+
+#include "affinity.h"
+
+namespace LangmuirCore
+{
+
+/**
+ * @brief An implicitly shared array of plain values for large Grid arrays
+ *
+ * Works like a QVector, except that memory is always allocated by fill(),
+ * and, if asked, the new pages are first touched by all workers of the global
+ * QThreadPool, or by a thread on one CPU (see Affinity::firstTouch()), instead
+ * of the thread calling fill().
+ * A QVector writes its memory from the calling thread, which places all of it
+ * on one NUMA node.
+ *
+ * @warning T must be safe to copy with memcpy and to zero with memset
+ */
+template <class T>
+class FirstTouchVector
+{
+public:
+    /**
+     * @brief create an empty FirstTouchVector
+     */
+    FirstTouchVector() : d(new Data)
+    {
+    }
+
+    /**
+     * @brief allocate memory and set every value
+     * @param value the value
+     * @param size the number of values
+     * @param parallel first touch the memory from all workers
+     * @param cpu if >= 0, first touch the memory from this CPU instead
+     */
+    void fill(const T &value, int size, bool parallel = false, int cpu = -1)
+    {
+        d = new Data;
+        d->allocate(size, parallel, cpu);
+        std::fill(d->data, d->data + size, value);
+    }
+
+    /**
+     * @brief get the number of values
+     */
+    int size() const
+    {
+        return d->size;
+    }
+
+    /**
+     * @brief get a value
+     */
+    const T& at(int i) const
+    {
+        Q_ASSERT(i >= 0 && i < d->size);
+        return d->data[i];
+    }
+
+    /**
+     * @brief get a value
+     */
+    const T& operator[](int i) const
+    {
+        Q_ASSERT(i >= 0 && i < d->size);
+        return d->data[i];
+    }
+
+    /**
+     * @brief get a value that can be changed (copies the data if shared)
+     */
+    T& operator[](int i)
+    {
+        Q_ASSERT(i >= 0 && i < d->size);
+        return d->data[i];
+    }
+
+    /**
+     * @brief get a pointer to the values
+     */
+    const T* constData() const
+    {
+        return d->data;
+    }
+
+private:
+    /**
+     * @brief The shared memory
+     */
+    struct Data : public QSharedData
+    {
+        Data() : QSharedData(), data(0), size(0), parallel(false), cpu(-1)
+        {
+        }
+
+        Data(const Data &other) : QSharedData(other), data(0), size(0), parallel(false), cpu(-1)
+        {
+            allocate(other.size, other.parallel, other.cpu);
+            std::copy(other.data, other.data + other.size, data);
+        }
+
+        ~Data()
+        {
+            qFreeAligned(data);
+        }
+
+        void allocate(int n, bool p, int c)
+        {
+            qFreeAligned(data);
+            data = 0;
+            size = n;
+            parallel = p;
+            cpu = c;
+            if (n <= 0)
+            {
+                return;
+            }
+
+            // Aligned to a cache line, so small records do not straddle lines
+            data = static_cast<T *>(qMallocAligned(sizeof(T) * n, 64));
+            if (data == 0)
+            {
+                qFatal("langmuir: can not allocate %d values", n);
+            }
+
+            if (cpu >= 0)
+            {
+                Affinity::firstTouch(data, sizeof(T) * n, cpu);
+            }
+            else if (parallel)
+            {
+                Affinity::firstTouch(data, sizeof(T) * n);
+            }
+        }
+
+        //! the values
+        T *data;
+
+        //! the number of values
+        int size;
+
+        //! true if the memory is first touched by all workers
+        bool parallel;
+
+        //! the CPU that first touches the memory (-1 if none)
+        int cpu;
+
+    private:
+        Data& operator=(const Data &);
+    };
+
+    /**
+     * @brief Pointer to the shared memory
+     */
+    QSharedDataPointer<Data> d;
+};
+
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef FREESITEINDEX_H
+#define FREESITEINDEX_H
+
+#include "fastdivider.h"
+
+#include <QVector>
+
+namespace LangmuirCore
+{
+
+/**
+ * @brief The empty sites of a slab of the Grid (x0 <= x < x1), in a list that can be indexed
+ *
+ * A site is free if it is empty in every Grid of the slot mask (see SiteStore::Slot).
+ * Picking a random free site, adding a site, and removing a site are all O(1).
+ * Made and kept up to date by the SiteStore (see SiteStore::acquireFreeSites()).
+ */
+class FreeSiteIndex
+{
+public:
+    /**
+     * @brief Create an empty index
+     * @param xSize the number of sites along the x-direction of the Grid
+     * @param ySize the number of sites along the y-direction of the Grid
+     * @param zSize the number of sites along the z-direction of the Grid
+     * @param x0 the first x index of the slab
+     * @param x1 one past the last x index of the slab
+     * @param slotMask the slot mask; bit SiteStore::Electron and / or bit SiteStore::Hole
+     */
+    FreeSiteIndex(int xSize, int ySize, int zSize, int x0, int x1, int slotMask);
+
+    /**
+     * @brief Get the first x index of the slab
+     */
+    int x0() const;
+
+    /**
+     * @brief Get one past the last x index of the slab
+     */
+    int x1() const;
+
+    /**
+     * @brief Get the slot mask
+     */
+    int slotMask() const;
+
+    /**
+     * @brief Get the number of free sites
+     */
+    int size() const;
+
+    /**
+     * @brief Get the number of sites in the slab
+     */
+    int capacity() const;
+
+    /**
+     * @brief Get a free site
+     * @param i the position in the list, 0 <= i < size()
+     */
+    int at(int i) const;
+
+    /**
+     * @brief Check if a site is in the slab
+     * @param site the "s-site ID"
+     */
+    bool contains(int site) const;
+
+    /**
+     * @brief Add or remove a site of the slab
+     * @param site the "s-site ID"
+     * @param free true if the site is now free
+     */
+    void update(int site, bool free);
+
+    /**
+     * @brief Count the number of users (see SiteStore::releaseFreeSites())
+     */
+    int &users();
+
+private:
+    /**
+     * @brief Get the position of a site in m_positions
+     */
+    int localIndex(int site) const;
+
+    /**
+     * @brief The free sites, in no order
+     */
+    QVector<int> m_sites;
+
+    /**
+     * @brief The position of each site of the slab in m_sites, or -1
+     */
+    QVector<int> m_positions;
+
+    /**
+     * @brief Divides by the size of the Grid along x
+     */
+    FastDivider m_xDivider;
+
+    /**
+     * @brief The number of sites along the x-direction of the Grid
+     */
+    int m_xSize;
+
+    /**
+     * @brief The first x index of the slab
+     */
+    int m_x0;
+
+    /**
+     * @brief One past the last x index of the slab
+     */
+    int m_x1;
+
+    /**
+     * @brief The number of sites in the Grid
+     */
+    int m_volume;
+
+    /**
+     * @brief The slot mask
+     */
+    int m_slotMask;
+
+    /**
+     * @brief The number of users
+     */
+    int m_users;
+};
+
+inline int FreeSiteIndex::size() const
+{
+    return m_sites.size();
+}
+
+inline int FreeSiteIndex::capacity() const
+{
+    return m_positions.size();
+}
+
+inline int FreeSiteIndex::at(int i) const
+{
+    return m_sites.at(i);
+}
+
+inline bool FreeSiteIndex::contains(int site) const
+{
+    if (site < 0 || site >= m_volume)
+    {
+        return false;
+    }
+    int x = site - m_xDivider.divide(site) * m_xSize;
+    return x >= m_x0 && x < m_x1;
+}
+
+}
+
+#endif
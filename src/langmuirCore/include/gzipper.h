@@ -1,21 +1,115 @@
 #ifndef GZIPPER_H
 #define GZIPPER_H
 
-#include <QString>
+#include <QByteArray>
+#include <QIODevice>
 
 /**
- * @brief gunzip a file using QProcess
- * @param fileName name of file to gunzip
- * @param wasZipped set to true if file was zipped
- * @return altered file name
+ * @brief check if data starts with the gzip magic number
+ * @param data the data
  */
-QString gunzip(QString fileName, bool *wasZipped = NULL);
+bool isGzipped(const QByteArray &data);
 
 /**
- * @brief gzip a file using QProcess
- * @param fileName name of file to gzip
- * @return altered file name
+ * @brief gunzip data in memory using zlib
+ * @param data gzipped data; every member is decompressed (files that were appended to have many)
+ * @return the decompressed data
  */
-QString gzip (QString fileName);
+QByteArray gunzip(const QByteArray &data);
+
+/**
+ * @brief gzip data in memory using zlib
+ * @param data the data
+ * @param level the zlib compression level (1 is fastest, 9 is smallest)
+ * @return the data as one gzip member
+ */
+QByteArray gzip(const QByteArray &data, int level = 6);
+
+/**
+ * @brief A write only QIODevice that gzips data on its way to another device
+ *
+ * The data is compressed as it is written, on the thread that writes it.  Each
+ * time the device is opened it starts a new gzip member, which is finished when
+ * it is closed, so a file opened with QIODevice::Append stays a valid gzip
+ * file.  The other device must already be open, and is not closed.
+ */
+class GzipDevice : public QIODevice
+{
+public:
+    /**
+     * @brief Create the device
+     * @param device the device the compressed data is written to
+     * @param level the zlib compression level (1 is fastest, 9 is smallest)
+     * @param parent parent QObject
+     */
+    GzipDevice(QIODevice *device, int level = 6, QObject *parent = 0);
+
+    /**
+     * @brief Finish the gzip member
+     */
+   ~GzipDevice();
+
+    /**
+     * @brief Start a new gzip member
+     * @param mode must be QIODevice::WriteOnly (QIODevice::Text is ignored)
+     */
+    bool open(OpenMode mode);
+
+    /**
+     * @brief Finish the gzip member and write it to the device
+     */
+    void close();
+
+    /**
+     * @brief Write everything compressed so far to the device (a zlib sync flush)
+     *
+     * The data written so far can then be decompressed, even if the program
+     * is killed before close().  Each flush costs a few bytes.
+     */
+    bool flush();
+
+    /**
+     * @brief The device is sequential
+     */
+    bool isSequential() const;
+
+protected:
+    /**
+     * @brief Reading is not supported
+     */
+    qint64 readData(char *data, qint64 maxSize);
+
+    /**
+     * @brief Compress data and write what zlib outputs to the device
+     */
+    qint64 writeData(const char *data, qint64 size);
+
+private:
+    /**
+     * @brief Run deflate until the input is used, writing the output to the device
+     * @param flush the zlib flush mode
+     */
+    bool deflateToDevice(int flush);
+
+    /**
+     * @brief The device the compressed data is written to
+     */
+    QIODevice *m_device;
+
+    /**
+     * @brief The compression level
+     */
+    int m_level;
+
+    /**
+     * @brief The zlib stream (a z_stream; zlib.h is only included in gzipper.cpp)
+     */
+    void *m_stream;
+
+    /**
+     * @brief Storage for the output of deflate
+     */
+    QByteArray m_buffer;
+};
 
 #endif // GZIPPER_H
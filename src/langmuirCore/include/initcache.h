@@ -0,0 +1,192 @@
+#ifndef INITCACHE_H
+#define INITCACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+
+namespace LangmuirCore
+{
+
+class World;
+struct ConfigurationInfo;
+
+/**
+ * @brief A class to reuse the slow parts of World::initialize between runs
+ *
+ * If cache.directory is set, the defects, carriers, traps, background potential,
+ * coulomb tables and coupling constants made by World::initialize are written
+ * to a binary file in the directory.  The name of the file is a hash of
+ * everything they depend upon: the parameters for the morphology and the
+ * tables, the state of the random number generator, and the sites read from
+ * the input file.  A later run with the same hash memory-maps the file instead
+ * of placing and growing the sites again.
+ *
+ * The run is the same as without the cache: the sites are placed in the same
+ * order, and the random number generator continues from the saved state.
+ *
+ * The background potential is only reused if it was stored for every site
+ * (potential.analytic is off) with the same voltage.left, voltage.right and
+ * slope.z; otherwise it is found again from the cached traps, which is fast.
+ * So a sweep over voltages shares one file.
+ */
+class InitCache
+{
+public:
+    /**
+     * @brief The sections of the file
+     */
+    enum Section
+    {
+        //! defect site IDs (qint32)
+        Defects        = 0,
+
+        //! electron site IDs (qint32)
+        Electrons      = 1,
+
+        //! hole site IDs (qint32)
+        Holes          = 2,
+
+        //! trap site IDs (qint32)
+        Traps          = 3,
+
+        //! trap potentials (double)
+        TrapPotentials = 4,
+
+        //! the random number generator, as written by QDataStream (bytes)
+        RandomState    = 5,
+
+        //! the background potential of every site in the Grid (double)
+        Potential      = 6,
+
+        //! World::R1 (double)
+        R1             = 7,
+
+        //! World::R2 (double)
+        R2             = 8,
+
+        //! World::iR (double)
+        IR             = 9,
+
+        //! World::eR (double)
+        ER             = 10,
+
+        //! World::sI (double)
+        SI             = 11,
+
+        //! World::couplingConstants (double)
+        Coupling       = 12,
+
+        //! the number of sections
+        SectionCount   = 13
+    };
+
+    /**
+     * @brief The version of the file format; files of other versions are ignored
+     */
+    static const quint32 Version = 1;
+
+    /**
+     * @brief Find the name of the cache file
+     * @param world reference to the World, after the parameters are checked and the random number generator is seeded
+     * @param configInfo the sites read from the input file
+     *
+     * Call this before anything is placed.
+     */
+    InitCache(World &world, const ConfigurationInfo &configInfo);
+
+    /**
+     * @brief Unmap the file
+     */
+   ~InitCache();
+
+    /**
+     * @brief Check if cache.directory is set
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Get the name of the cache file, or an empty string
+     */
+    const QString& fileName() const;
+
+    /**
+     * @brief Map the cache file, if there is a valid one
+     * @param configInfo replaced with the sites in the file
+     * @return true if the file was found
+     *
+     * The random number generator is set to its state after the initialization.
+     * Placing the sites in configInfo then uses no random numbers.
+     */
+    bool load(ConfigurationInfo &configInfo);
+
+    /**
+     * @brief Check if the mapped file has the background potential for the current voltages
+     */
+    bool hasPotential() const;
+
+    /**
+     * @brief Copy the background potential and the traps from the mapped file
+     */
+    void loadPotential();
+
+    /**
+     * @brief Copy the coulomb tables and coupling constants from the mapped file
+     */
+    void loadArrays();
+
+    /**
+     * @brief Write the cache file, after the initialization
+     *
+     * The file is written under a temporary name and renamed, so runs sharing
+     * the directory never see a partial file.
+     */
+    void save();
+
+private:
+    /**
+     * @brief Find the section of the mapped file, or return NULL
+     * @param section the section
+     * @param size the number of bytes, set if found
+     */
+    const uchar *section(Section section, quint64 &size) const;
+
+    /**
+     * @brief Copy a section of doubles into an array of a known size
+     */
+    bool copySection(Section section, double *data, quint64 count) const;
+
+    /**
+     * @brief Reference to the World
+     */
+    World &m_world;
+
+    /**
+     * @brief The name of the cache file, or empty if cache.directory is not set
+     */
+    QString m_fileName;
+
+    /**
+     * @brief The hash of the inputs
+     */
+    QByteArray m_key;
+
+    /**
+     * @brief The mapped file
+     */
+    QFile m_file;
+
+    /**
+     * @brief The start of the mapped file, or NULL
+     */
+    uchar *m_data;
+
+    /**
+     * @brief The size of the mapped file
+     */
+    quint64 m_size;
+};
+
+}
+
+#endif // INITCACHE_H
@@ -0,0 +1,151 @@
+#ifndef JOBPACKER_H
+#define JOBPACKER_H
+
+#include <QStringList>
+#include <QProcess>
+#include <QString>
+#include <QObject>
+#include <QList>
+
+class QEventLoop;
+
+namespace LangmuirCore
+{
+
+/**
+ * @brief A class to run many input files at once on one node
+ *
+ * The manifest lists one input file per line, optionally followed by the
+ * number of threads to give each of its replicas.  Blank lines and text after
+ * # are ignored.
+ *
+ * @code
+ * # input          threads
+ * run1/sim.inp
+ * run2/sim.inp     4
+ * @endcode
+ *
+ * Each input is run by a child langmuir process, in the directory of the
+ * input file, with its output written to the input file name + ".log".
+ * The cost of a job is estimated as the grid volume times the max number of
+ * carriers (from the [Parameters] of the input, read by a KeyValueParser),
+ * times the number of replicas.  Jobs without a thread count get a share of
+ * the cores proportional to their cost, but at least one per replica if the
+ * node has enough.  The most costly job
+ * that fits in the free cores is started first, and jobs with use.opencl get
+ * a GPU from the node file to themselves.  New jobs are started as others
+ * finish.
+ */
+class JobPacker : public QObject
+{
+private:
+    Q_OBJECT
+    Q_DISABLE_COPY(JobPacker)
+
+public:
+    /**
+     * @brief create the JobPacker
+     * @param manifest path to the manifest
+     * @param cores the number of cores to fill (if < 0, use the node file)
+     * @param replicas passed to every job (see Ensemble)
+     * @param parent QObject this belongs to
+     */
+    JobPacker(const QString &manifest, int cores = -1, int replicas = 1, QObject *parent = 0);
+
+    /**
+     * @brief destroy the JobPacker
+     */
+    virtual ~JobPacker();
+
+    /**
+     * @brief run every job and wait for them to finish
+     * @return the number of jobs that failed
+     */
+    int run();
+
+    /**
+     * @brief estimate the cost of an input file
+     * @param fileName the input file
+     * @param replicas the number of replicas the input is run with
+     * @param useOpenCL set to true if the input asks for OpenCL
+     * @return grid volume times the max number of carriers (at least the volume), times replicas
+     */
+    static double estimateCost(const QString &fileName, int replicas = 1, bool *useOpenCL = 0);
+
+private slots:
+    /**
+     * @brief free the resources of a finished job and start more
+     */
+    void jobFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private:
+    /**
+     * @brief One input file
+     */
+    struct Job
+    {
+        //! path to the input file
+        QString fileName;
+
+        //! estimated cost
+        double cost;
+
+        //! number of threads
+        int threads;
+
+        //! true if the job needs a GPU
+        bool useOpenCL;
+
+        //! the GPU given to the job (-1 if none)
+        int gpuID;
+
+        //! the child process (0 if not started)
+        QProcess *process;
+    };
+
+    /**
+     * @brief read the manifest and work out the thread counts
+     */
+    void parseManifest(const QString &manifest);
+
+    /**
+     * @brief start pending jobs while there are free cores and GPUs
+     */
+    void startJobs();
+
+    /**
+     * @brief start one job
+     */
+    void startJob(Job &job);
+
+    //! the jobs, most costly first
+    QList<Job> m_jobs;
+
+    //! indices of jobs not yet started
+    QList<int> m_pending;
+
+    //! GPUs not given to a job
+    QList<int> m_freeGPUs;
+
+    //! the number of cores to fill
+    int m_cores;
+
+    //! the number of cores not given to a job
+    int m_freeCores;
+
+    //! the number of running jobs
+    int m_running;
+
+    //! the number of failed jobs
+    int m_failed;
+
+    //! passed to every job
+    int m_replicas;
+
+    //! runs until all jobs are done
+    QEventLoop *m_loop;
+};
+
+}
+
+#endif
@@ -30,12 +30,13 @@ class KeyValueParser : public QObject
 public:
     /**
      * @brief Create a KeyValueParser
-     * @param world reference to World Object
      * @param parent QObject this belongs to
      *
      * Add calls to registerVariable() to add new variables to the simulation.
+     * The parser needs no World, so it can also read the parameters of an
+     * input file without creating one (see JobPacker).
      */
-    KeyValueParser(World& world, QObject *parent = 0);
+    KeyValueParser(QObject *parent = 0);
 
     /**
      * @brief Destroy the KeyValueParser
@@ -104,11 +105,6 @@ private:
      */
     SimulationParameters m_parameters;
 
-    /**
-     * @brief Reference to World object
-     */
-    World& m_world;
-
     /**
      * @brief Register an allowed variable with the parser
      */
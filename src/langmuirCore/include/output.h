@@ -6,6 +6,8 @@
 #include <QObject>
 #include <QFile>
 
+class GzipDevice;
+
 /**
  * @brief put a newline character in the stream that ignores the streams current FieldWidth
  * @param s stream
@@ -64,7 +66,8 @@ public:
  * @brief A class to combine QFile, QTextStream and OutputInfo (QFileInfo).
  *
  * Only for used for output.  Derived from QObject so destruction
- * ensures streams are flushed and files are closed.
+ * ensures streams are flushed and files are closed.  Files named
+ * *.gz are compressed as they are written (see GzipDevice).
  */
 class OutputStream : public QObject, public QTextStream
 {
@@ -98,6 +101,11 @@ public:
       */
    ~OutputStream();
 
+    /**
+     * @brief write what is buffered to the file, compressing it first if the file is gzipped
+     */
+    void flush();
+
     /**
      * @brief Get the info object to get things like file name and path
      * @return file info object
@@ -116,6 +124,9 @@ private:
 
     //!< QFile object, the device of this QTextStream
     QFile m_file;
+
+    //!< GzipDevice writing to m_file, the device of this QTextStream if the file name ends in .gz
+    GzipDevice *m_gzip;
 };
 
 }
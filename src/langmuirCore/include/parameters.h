@@ -51,6 +51,9 @@ struct SimulationParameters
     //! seed the random number generator, if negative, uses the current time (making seperate runs random)
     quint64 randomSeed;
 
+    //! the random number generator: mt19937, xoshiro256**, pcg64, or philox
+    QString randomEngine;
+
     //! the number of sites per layer, at least one
     qint32 gridZ;
 
@@ -60,6 +63,21 @@ struct SimulationParameters
     //! the number of sites along the device length, at least one
     qint32 gridX;
 
+    //! store the sites in small 3D tiles instead of rows, to keep neighbors close in memory
+    bool gridTiled;
+
+    //! allocate the tiles of the grid only while they hold agents, and find the background potential from its linear, gate and trap terms; for large, dilute grids
+    bool gridSparse;
+
+    //! wrap the grid around along the y-direction, with minimum-image electrostatics
+    bool gridPeriodicY;
+
+    //! wrap the grid around along the z-direction, with minimum-image electrostatics
+    bool gridPeriodicZ;
+
+    //! find the background potential from its linear, gate and trap terms instead of storing it for every site; changing voltages is then O(1)
+    bool potentialAnalytic;
+
     //! turn on Coulomb interactions between ChargeAgents
     bool coulombCarriers;
 
@@ -87,6 +105,12 @@ struct SimulationParameters
     //! output mode for xyz file (if 0, particle count varies; if 1, particle count is constant using "phantom particles")
     qint32 outputXyzMode;
 
+    //! format of the trajectory: text (an xyz file) or binary (a compressed, indexed file of hop deltas)
+    QString outputXyzFormat;
+
+    //! frames in each chunk of the binary trajectory; the first frame of a chunk has every carrier
+    qint32 outputXyzKeyframe;
+
     //! output carrier lifetime and pathlength when they are deleted
     bool outputIdsOnDelete;
 
@@ -99,12 +123,24 @@ struct SimulationParameters
     //! output trap potentials in checkpoint files
     bool outputChkTrapPotential;
 
+    //! the format of checkpoint files: text or binary (input files of either format are read)
+    QString outputChkFormat;
+
+    //! gzip the stream output and checkpoint files as they are written (appends .gz to their names)
+    bool outputGzip;
+
     //! output grid potential at the start of the simulation, includes the trap potential
     bool outputPotential;
 
     //! if false, produce no output (useful for LangmuirView)
     bool outputIsOn;
 
+    //! format and write the stream output and images on a background thread
+    bool outputAsync;
+
+    //! number of output snapshots that may wait for the background thread before the simulation blocks
+    qint32 outputQueueSize;
+
     //! output images of defects
     bool imageDefects;
 
@@ -120,6 +156,15 @@ struct SimulationParameters
     //! number of simulation steps after equilibration
     qint32 iterationsReal;
 
+    //! stop once the relative standard error of the drain and source rates is below this (0 means never stop early)
+    qreal convergenceError;
+
+    //! do not sample the drain and source rates before this step
+    qint32 convergenceMinSteps;
+
+    //! number of batches used to estimate the standard error of the drain and source rates
+    qint32 convergenceBatches;
+
     //! number of significant figures used for doubles in output
     qint32 outputPrecision;
 
@@ -153,6 +198,12 @@ struct SimulationParameters
     //! the percent of the traps to be placed and grown upon to form islands
     qreal seedPercentage;
 
+    //! how random traps and defects are placed: legacy, frontier, or parallel (see SitePlacer)
+    QString placementAlgorithm;
+
+    //! a directory to keep the sites and tables made at startup, reused by later runs with the same input (see InitCache); empty to turn off
+    QString cacheDirectory;
+
     //! the potential on the right side of the grid, used in setting up an electric field
     qreal voltageRight;
 
@@ -165,6 +216,12 @@ struct SimulationParameters
     //! the temperature used in the boltzmann factor
     qreal temperatureKelvin;
 
+    //! list of voltage.right values (separated by spaces or commas) to sweep over in one run; if empty, voltage.right is used
+    QString sweepVoltageRight;
+
+    //! list of temperature.kelvin values (separated by spaces or commas) to sweep over in one run; if empty, temperature.kelvin is used
+    QString sweepTemperatureKelvin;
+
     //! the rate at which all sources inject charges
     qreal sourceRate;
 
@@ -186,6 +243,9 @@ struct SimulationParameters
     //! if true, try to keep the number of charges in the simulation balanced
     bool balanceCharges;
 
+    //! keep lists of the empty sites, so sources and charge seeding pick an empty site with one random number
+    bool freeSiteIndex;
+
     //! the rate at which all drains accept charges (default, used when eDrainL, etc. are < 0)
     qreal drainRate;
 
@@ -216,9 +276,18 @@ struct SimulationParameters
     //! the size of OpenCL 1DRange kernel work groups
     qint32 workSize;
 
-    //! the minimum number of charges that must be present to use OpenCL
+    //! the minimum number of charges that must be present to use OpenCL (only used if coulomb.tuner.interval is 0)
     qint32 openclThreshold;
 
+    //! time the ways of computing Coulomb interactions every this many steps and use the fastest; if 0, use opencl.threshold
+    qint32 coulombTunerInterval;
+
+    //! the number of steps each way of computing Coulomb interactions is timed over
+    qint32 coulombTunerSamples;
+
+    //! fraction by which a Coulomb backend must be faster than the current one before the tuner switches to it
+    qreal coulombTunerHysteresis;
+
     //! the device to choose if there are multiple
     qint32 openclDeviceID;
 
@@ -258,6 +327,18 @@ struct SimulationParameters
     //! the number of sites away from a given site used when calculating neighboring sites
     qint32 hoppingRange;
 
+    //! only hop to sites within a sphere of radius hoppingRange (otherwise, a cube)
+    bool hoppingSpherical;
+
+    //! propose hops with probability proportional to the coupling constant (alias sampling), instead of uniformly
+    bool hoppingAlias;
+
+    //! make the Metropolis criterion cheaper: a table of Boltzmann factors without Coulomb interactions, bounds on exp with them
+    bool metropolisFast;
+
+    //! the largest table of Boltzmann factors kept by each grid (metropolis.fast), in megabytes
+    qint32 metropolisFastMemory;
+
     //! slope of potential along z direction when there are multiple layers (as if there were a gate electrode)
     qreal slopeZ;
 
@@ -273,6 +354,9 @@ struct SimulationParameters
     //! the number of sites to consider when performing recombinations (0 means same-site, 1 means one-site away and same-site)
     qint32 recombinationRange;
 
+    //! find recombination partners for all electrons in parallel (uses its own random numbers, so results differ from the serial version)
+    bool recombinationParallel;
+
     //! output carrier lifetime and pathlength when holes and electrons encounter one another
     bool outputIdsOnEncounter;
 
@@ -282,14 +366,23 @@ struct SimulationParameters
     //! max threads allowed for QThreadPool - if its <= 0 then the QThread::idealThreadCount is used; note that Qt ignores PBS and SGE so when this isn't set Qt will use all the cores on a node
     qint32 maxThreads;
 
+    //! pin threads to the CPUs allowed by the cpuset and cgroup of the job, and spread the Grid arrays over the NUMA nodes
+    bool threadsAffinity;
+
     SimulationParameters() :
 
         simulationType         ("transistor"),
         randomSeed             (0),
+        randomEngine           ("mt19937"),
 
         gridZ                  (1),
         gridY                  (128),
         gridX                  (128),
+        gridTiled              (false),
+        gridSparse             (false),
+        gridPeriodicY          (false),
+        gridPeriodicZ          (false),
+        potentialAnalytic      (false),
 
         coulombCarriers        (false),
         coulombGaussianSigma   (0.0),
@@ -301,13 +394,19 @@ struct SimulationParameters
         outputXyzD             (true),
         outputXyzT             (true),
         outputXyzMode          (0),
+        outputXyzFormat        ("text"),
+        outputXyzKeyframe      (100),
 
         outputIdsOnDelete      (false),
         outputCoulomb          (0),
         outputStepChk          (1),
         outputChkTrapPotential (false),
+        outputChkFormat        ("text"),
+        outputGzip             (false),
         outputPotential        (false),
         outputIsOn             (true),
+        outputAsync            (false),
+        outputQueueSize        (2),
 
         imageDefects           (false),
         imageTraps             (false),
@@ -315,6 +414,9 @@ struct SimulationParameters
 
         iterationsPrint        (10),
         iterationsReal         (1000),
+        convergenceError       (0),
+        convergenceMinSteps    (0),
+        convergenceBatches     (10),
         outputPrecision        (15),
         outputWidth            (23),
         outputStub             ("out"),
@@ -327,11 +429,15 @@ struct SimulationParameters
         trapPotential          (0.10),
         gaussianStdev          (0.00),
         seedPercentage         (1.0),
+        placementAlgorithm     ("legacy"),
+        cacheDirectory         (""),
 
         voltageRight           (0.00),
         voltageLeft            (0.00),
         excitonBinding         (0.00),
         temperatureKelvin      (300.0),
+        sweepVoltageRight      (""),
+        sweepTemperatureKelvin (""),
 
         sourceRate             (0.90),
         eSourceLRate           (-1.0),
@@ -340,6 +446,7 @@ struct SimulationParameters
         hSourceRRate           (-1.0),
         generationRate         (0.001),
         balanceCharges         (false),
+        freeSiteIndex          (false),
 
         drainRate              (0.90),
         eDrainLRate            (-1.0),
@@ -353,6 +460,9 @@ struct SimulationParameters
         workZ                  (4),
         workSize               (256),
         openclThreshold        (256),
+        coulombTunerInterval   (0),
+        coulombTunerSamples    (5),
+        coulombTunerHysteresis (0.1),
         openclDeviceID         (0),
 
         boltzmannConstant      (1.3806504e-23),
@@ -367,19 +477,39 @@ struct SimulationParameters
         currentStep            (0),
         simulationStart        (QDateTime::currentDateTime()),
         hoppingRange           (1),
+        hoppingSpherical       (true),
+        hoppingAlias           (false),
+        metropolisFast         (false),
+        metropolisFastMemory   (512),
         slopeZ                 (0.00),
         sourceMetropolis       (false),
         sourceCoulomb          (false),
         recombinationRate      (0.00),
         recombinationRange     (0),
+        recombinationParallel  (false),
         outputIdsOnEncounter   (false),
         sourceScaleArea        (65536),
-        maxThreads             (-1)
+        maxThreads             (-1),
+        threadsAffinity        (false)
     {
     }
 
 };
 
+//! converts a list of numbers separated by spaces or commas
+inline QList<double> toDoubleList(const QString& values, bool *ok = NULL)
+{
+    QList<double> result;
+    if (ok != NULL) { *ok = true; }
+    foreach (QString token, values.split(QRegExp("[\\s,]+"), QString::SkipEmptyParts))
+    {
+        bool converted = false;
+        result.push_back(token.toDouble(&converted));
+        if (!converted && ok != NULL) { *ok = false; }
+    }
+    return result;
+}
+
 //! sets parameters that depend upon other parameters
 inline void setCalculatedValues(SimulationParameters& par)
 {
@@ -413,6 +543,29 @@ inline void checkSimulationParameters(SimulationParameters& par)
         qFatal("langmuir: grid.z(%d) >= 1",par.gridZ);
     }
 
+    // periodic boundaries
+    if (par.gridPeriodicY && par.gridY <= 2 * par.hoppingRange)
+    {
+        qFatal("langmuir: grid.periodic.y = true, yet grid.y(%d) <= 2 * hopping.range(%d)",
+               par.gridY, par.hoppingRange);
+    }
+    if (par.gridPeriodicZ && par.gridZ <= 2 * par.hoppingRange)
+    {
+        qFatal("langmuir: grid.periodic.z = true, yet grid.z(%d) <= 2 * hopping.range(%d)",
+               par.gridZ, par.hoppingRange);
+    }
+    if (par.gridPeriodicZ && par.slopeZ != 0)
+    {
+        qFatal("langmuir: grid.periodic.z = true, yet slope.z(%g) != 0", par.slopeZ);
+    }
+    if (par.coulombCarriers &&
+       ((par.gridPeriodicY && 2 * par.electrostaticCutoff > par.gridY) ||
+        (par.gridPeriodicZ && 2 * par.electrostaticCutoff > par.gridZ)))
+    {
+        qDebug("langmuir: electrostatic.cutoff(%d) > half of a periodic grid size; "
+               "only the nearest image of each charge is included", par.electrostaticCutoff);
+    }
+
     // output
     if (par.iterationsPrint <= 0 )
     {
@@ -426,6 +579,18 @@ inline void checkSimulationParameters(SimulationParameters& par)
     {
         qFatal("langmuir: iterations.real(%d) %% iterations.print(%d) != 0",par.iterationsReal,par.iterationsPrint);
     }
+    if (par.convergenceError < 0)
+    {
+        qFatal("langmuir: convergence.error(%g) < 0",par.convergenceError);
+    }
+    if (par.convergenceMinSteps < 0)
+    {
+        qFatal("langmuir: convergence.min.steps(%d) < 0",par.convergenceMinSteps);
+    }
+    if (par.convergenceBatches < 2)
+    {
+        qFatal("langmuir: convergence.batches(%d) < 2",par.convergenceBatches);
+    }
 
     // percentages
     if (par.electronPercentage < 0.0 || par.electronPercentage > 1.0 )
@@ -453,6 +618,21 @@ inline void checkSimulationParameters(SimulationParameters& par)
         qFatal("langmuir: seed.pecentage(%f) < 0 || > 1.0",par.seedPercentage);
     }
 
+    if (!(QStringList()<<"mt19937"<<"xoshiro256**"<<"pcg64"<<"philox").contains(par.randomEngine))
+    {
+        qFatal("langmuir: random.engine(%s) must be mt19937, xoshiro256**, pcg64 or philox",qPrintable(par.randomEngine));
+    }
+
+    if (!(QStringList()<<"text"<<"binary").contains(par.outputChkFormat))
+    {
+        qFatal("langmuir: output.chk.format(%s) must be text or binary",qPrintable(par.outputChkFormat));
+    }
+
+    if (!(QStringList()<<"legacy"<<"frontier"<<"parallel").contains(par.placementAlgorithm))
+    {
+        qFatal("langmuir: placement.algorithm(%s) must be legacy, frontier or parallel",qPrintable(par.placementAlgorithm));
+    }
+
     if (par.defectPercentage > 1.00 - par.trapPercentage)
     {
         qFatal("langmuir: trap.percentage(%f) > 1.0 - trap.percentage(%f)",par.defectPercentage,par.trapPercentage);
@@ -560,9 +740,9 @@ inline void checkSimulationParameters(SimulationParameters& par)
         qFatal("langmuir: defects.charge != 0 && coulomb.carriers = false");
     }
 
-    if (par.hoppingRange < 0 || par.hoppingRange > 2)
+    if (par.hoppingRange < 1)
     {
-        qFatal("langmuir: hopping.range(%d) < 0 || > 2",par.hoppingRange);
+        qFatal("langmuir: hopping.range(%d) < 1",par.hoppingRange);
     }
 
     if (!par.sourceMetropolis)
@@ -578,6 +758,11 @@ inline void checkSimulationParameters(SimulationParameters& par)
         qFatal("langmuir: recombination.rate(%f) < 0 || > 1.0",par.recombinationRate);
     }
 
+    if (par.recombinationRange < 0)
+    {
+        qFatal("langmuir: recombination.range(%d) < 0",par.recombinationRange);
+    }
+
     if (par.recombinationRate > 0 && par.simulationType != "solarcell")
     {
         qFatal("langmuir: recombination.rate(%f) > 0, yet simulation.type != solarcell",par.recombinationRate);
@@ -606,16 +791,51 @@ inline void checkSimulationParameters(SimulationParameters& par)
 
     }
 
+    if (par.metropolisFastMemory < 0)
+    {
+        qFatal("langmuir: metropolis.fast.memory < 0");
+    }
+
+    if (par.outputQueueSize < 1)
+    {
+        qFatal("langmuir: output.queue.size < 1");
+    }
+
     if (par.outputXyzMode < 0 || par.outputXyzMode > 1)
     {
         qFatal("langmuir: output.xyz.mode must be 0 or 1");
     }
 
+    if (!(QStringList()<<"text"<<"binary").contains(par.outputXyzFormat))
+    {
+        qFatal("langmuir: output.xyz.format(%s) must be text or binary",qPrintable(par.outputXyzFormat));
+    }
+
+    if (par.outputXyzKeyframe < 1)
+    {
+        qFatal("langmuir: output.xyz.keyframe must be >= 1");
+    }
+
     if (par.openclThreshold <= 0)
     {
         qFatal("langmuir: opencl.threshold must be >= 0");
     }
 
+    if (par.coulombTunerInterval < 0)
+    {
+        qFatal("langmuir: coulomb.tuner.interval must be >= 0");
+    }
+
+    if (par.coulombTunerSamples <= 0)
+    {
+        qFatal("langmuir: coulomb.tuner.samples must be > 0");
+    }
+
+    if (par.coulombTunerHysteresis < 0 || par.coulombTunerHysteresis >= 1)
+    {
+        qFatal("langmuir: coulomb.tuner.hysteresis must be >= 0 and < 1");
+    }
+
     if (par.openclDeviceID < 0)
     {
         qFatal("langmuir: opencl.device.id must be >= 0");
@@ -643,6 +863,37 @@ inline void checkSimulationParameters(SimulationParameters& par)
     {
         qFatal("langmuir: output.ids.on.encouter is deprecated");
     }
+
+    // sweeps
+    bool ok = false;
+    QList<double> sweepVoltageRight = toDoubleList(par.sweepVoltageRight, &ok);
+    if (!ok)
+    {
+        qFatal("langmuir: can not convert sweep.voltage.right(%s) to numbers",
+               qPrintable(par.sweepVoltageRight));
+    }
+
+    QList<double> sweepTemperatureKelvin = toDoubleList(par.sweepTemperatureKelvin, &ok);
+    if (!ok)
+    {
+        qFatal("langmuir: can not convert sweep.temperature.kelvin(%s) to numbers",
+               qPrintable(par.sweepTemperatureKelvin));
+    }
+
+    if (!sweepVoltageRight.isEmpty() && !sweepTemperatureKelvin.isEmpty() &&
+         sweepVoltageRight.size() != sweepTemperatureKelvin.size())
+    {
+        qFatal("langmuir: sweep.voltage.right(%d values) and sweep.temperature.kelvin(%d values) differ in length",
+               sweepVoltageRight.size(), sweepTemperatureKelvin.size());
+    }
+
+    foreach (double temperature, sweepTemperatureKelvin)
+    {
+        if (temperature <= 0)
+        {
+            qFatal("langmuir: sweep.temperature.kelvin must be > 0");
+        }
+    }
 }
 
 }
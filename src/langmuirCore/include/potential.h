@@ -27,6 +27,9 @@ class Grid;
 
 /**
  * @brief A class to calculate the potential
+ *
+ * The electron and hole Grids share one background potential (see SiteStore),
+ * so it is only written through the electron Grid.
  */
 class Potential : public QObject
 {
@@ -52,6 +55,16 @@ public:
      */
     void setPotentialLinear();
 
+    /**
+     * @brief Adds the change in the linear potential since the voltages were voltageLeft and voltageRight
+     * @param voltageLeft the previous value of voltage.left
+     * @param voltageRight the previous value of voltage.right
+     *
+     * The linear potential is linear in both voltages, so only the difference
+     * needs to be added; the gate and trap potentials are left untouched.
+     */
+    void updatePotentialLinear(double voltageLeft, double voltageRight);
+
     /**
      * @brief Adds a linear potential calculated from slope.z along the z-direction
      */
@@ -150,6 +163,13 @@ public:
     double gaussImageD(int site_i);
 
 private:
+    /**
+     * @brief Adds a linear potential between VL and VR along the x-direction to both grids
+     * @param VL the potential at the left side
+     * @param VR the potential at the right side
+     */
+    void addPotentialLinear(double VL, double VR);
+
     /**
      * @brief reference to the World
      */
@@ -1,6 +1,8 @@
 #ifndef _RAND_H
 #define _RAND_H
 
+#include "randomengine.h"
+
 #include <QObject>
 #include <QDataStream>
 #include <QTextStream>
@@ -27,6 +29,11 @@ namespace LangmuirCore
 
 /**
  * @brief A class to generate random numbers
+ *
+ * The output of the RandomEngine is made in blocks of BufferSize numbers,
+ * and the distributions read from the block, so the common calls (random(),
+ * integer()) are inlined and construct nothing.  The numbers from random(),
+ * range(), and normal() are the same as boost's distributions on the engine.
  */
 class Random : public QObject
 {
@@ -61,6 +68,24 @@ public:
      */
     void seed(quint64 seed);
 
+    /**
+     * @brief Change the engine, and seed it with seed()
+     */
+    void setEngine(RandomEngine::Type type);
+
+    /**
+     * @brief Get the engine
+     */
+    RandomEngine::Type engine() const;
+
+    /**
+     * @brief Move to an independent stream of seed(), for threads and replicas
+     *
+     * The twister has no streams, and is seeded with seed() + stream instead;
+     * seed() then returns the new seed.
+     */
+    void setStream(quint64 stream);
+
     /**
      * @brief Generate a random double from the uniform distribution [0, 1]
      */
@@ -83,6 +108,11 @@ public:
      */
     int integer(const int low=0, const int high=1);
 
+    /**
+     * @brief Generate a random 64-bit integer from the uniform distribution
+     */
+    quint64 word();
+
     /**
      * @brief Randomly choose yes using a Boltzmann factor
      * @param energyChange change in energy when going from initial to final state
@@ -100,6 +130,14 @@ public:
      */
     bool metropolisWithCoupling(double energyChange, double inversekT, double coupling);
 
+    /**
+     * @brief The same as metropolisWithCoupling(), but mostly without exp
+     *
+     * The Boltzmann factor is bounded above and below by polynomials, and
+     * exp is only called if the random number falls between the bounds.
+     */
+    bool metropolisWithCouplingFast(double energyChange, double inversekT, double coupling);
+
     /**
      * @brief Randomly choose yes a percent of the time
      */
@@ -145,15 +183,89 @@ public:
     friend std::istream& operator>>(std::istream& stream, Random& random);
 
 private:
+    /**
+     * @brief The number of 32-bit values made at once
+     */
+    enum { BufferSize = 1024 };
+
+    /**
+     * @brief Adapts Random to the engine interface of boost's distributions
+     */
+    struct Adapter
+    {
+        typedef quint32 result_type;
+        static quint32 min() { return 0; }
+        static quint32 max() { return 0xffffffffu; }
+        quint32 operator()() { return random.next(); }
+        Random &random;
+    };
+
+    /**
+     * @brief Get the next 32-bit value of the engine
+     */
+    quint32 next();
+
+    /**
+     * @brief Fill the buffer with the next BufferSize values of the engine
+     */
+    void refill();
+
+    /**
+     * @brief Forget the buffered values, after the engine has been set
+     */
+    void resetBuffer();
+
+    /**
+     * @brief Replace the engine (not seeded)
+     */
+    void createEngine(RandomEngine::Type type);
+
+    /**
+     * @brief Get the state of the engine, as of the next value to be used
+     *
+     * The engine itself is ahead by the unused part of the buffer.
+     */
+    QList<quint64> engineState();
+
+    /**
+     * @brief Get the state of the engine, with a tag for the engine unless it is the twister
+     */
+    QList<quint64> saveState();
+
+    /**
+     * @brief Set the state written by saveState(), changing the engine if needed
+     */
+    void loadState(const QList<quint64> &state);
+
+    /**
+     * @brief Set the state written by engineState(), changing the engine if needed
+     */
+    void loadEngineState(RandomEngine::Type type, const QList<quint64> &state);
+
     /**
      * @brief The underlying random number generator
      */
-    boost::mt19937 *twister;
+    RandomEngine *m_engine;
 
     /**
-     * @brief The underlying generator coupled to the uniform distribution on [0,1]
+     * @brief The state of the engine before the buffer was filled
      */
-    boost::variate_generator<boost::mt19937&, boost::uniform_01<double> >* generator01;
+    RandomEngine *m_blockStart;
+
+    /**
+     * @brief The buffered values of the engine (aligned to a cache line)
+     */
+    quint32 *m_buffer;
+
+    /**
+     * @brief The position of the next value in the buffer
+     */
+    int m_position;
+
+    /**
+     * @brief The number of values in the buffer
+     */
+    int m_available;
 
     /**
      * @brief The seed used to start the generator
@@ -161,5 +273,47 @@ private:
     quint64 m_seed;
 };
 
+inline quint32 Random::next()
+{
+    if (m_position == m_available)
+    {
+        refill();
+    }
+    return m_buffer[m_position++];
+}
+
+inline double Random::random()
+{
+    // Same as boost::uniform_01 on a 32-bit engine
+    return next() * (1.0 / 4294967296.0);
+}
+
+inline int Random::integer(const int low, const int high)
+{
+    // Multiply-shift; the few values that would bias the result are rejected
+    quint32 n = quint32(high) - quint32(low) + 1u;
+    if (n == 0)
+    {
+        return int(quint32(low) + next());
+    }
+    quint64 m = quint64(next()) * n;
+    if (quint32(m) < n)
+    {
+        quint32 threshold = (0u - n) % n;
+        while (quint32(m) < threshold)
+        {
+            m = quint64(next()) * n;
+        }
+    }
+    return int(quint32(low) + quint32(m >> 32));
+}
+
+inline quint64 Random::word()
+{
+    quint64 high = next();
+    quint64 low = next();
+    return (high << 32) | low;
+}
+
 }
 #endif
@@ -0,0 +1,126 @@
+#ifndef RANDOMENGINE_H
+#define RANDOMENGINE_H
+
+#include <QString>
+#include <QList>
+
+namespace LangmuirCore
+{
+
+/**
+ * @brief The source of 32-bit random values used by Random
+ *
+ * The engine is chosen by random.engine:
+ *  - mt19937: the Mersenne twister (the same numbers as older versions)
+ *  - xoshiro256**: 256 bits of state; streams are 2^128 values apart (jump)
+ *  - pcg64: a 128-bit LCG with a permuted output; each stream has its own increment
+ *  - philox: Philox4x32-10, counter based; the stream is part of the counter,
+ *    and skipping ahead is free
+ *
+ * The state is a list of 64-bit words, so it can be written as text or binary.
+ */
+class RandomEngine
+{
+public:
+    /**
+     * @brief The kind of engine
+     */
+    enum Type
+    {
+        //! boost::mt19937
+        MT19937    = 0,
+
+        //! xoshiro256**
+        Xoshiro256 = 1,
+
+        //! PCG64 (XSL-RR 128/64)
+        PCG64      = 2,
+
+        //! Philox4x32-10
+        Philox     = 3
+    };
+
+    /**
+     * @brief Get the Type from the value of random.engine
+     * @param name mt19937, xoshiro256**, pcg64, or philox
+     */
+    static Type toType(const QString &name);
+
+    /**
+     * @brief Get the value of random.engine for a Type
+     */
+    static QString name(Type type);
+
+    /**
+     * @brief Check if name is a valid value of random.engine
+     */
+    static bool isValidName(const QString &name);
+
+    /**
+     * @brief Create an engine, seeded with 5489 (the default of the twister)
+     */
+    static RandomEngine *create(Type type);
+
+    /**
+     * @brief Destroy the engine
+     */
+    virtual ~RandomEngine();
+
+    /**
+     * @brief Get the kind of engine
+     */
+    virtual Type type() const = 0;
+
+    /**
+     * @brief Create a copy of the engine, in the same state
+     */
+    virtual RandomEngine *clone() const = 0;
+
+    /**
+     * @brief Copy the state of another engine of the same Type
+     */
+    virtual void assign(const RandomEngine &other) = 0;
+
+    /**
+     * @brief Seed the engine (stream 0)
+     */
+    virtual void seed(quint64 seed) = 0;
+
+    /**
+     * @brief Seed the engine, and move to an independent stream of the seed
+     *
+     * The twister has no streams, and is seeded with seed + stream.
+     */
+    virtual void setStream(quint64 seed, quint64 stream) = 0;
+
+    /**
+     * @brief Write the next values of the engine
+     * @param buffer where the values are written
+     * @param size the number of values
+     */
+    virtual void generate(quint32 *buffer, int size) = 0;
+
+    /**
+     * @brief Skip the next values of the engine
+     */
+    virtual void discard(quint64 count);
+
+    /**
+     * @brief Get the number of words in the state
+     */
+    virtual int stateSize() const = 0;
+
+    /**
+     * @brief Get the state
+     */
+    virtual QList<quint64> state() const = 0;
+
+    /**
+     * @brief Set the state; returns false if the state is invalid
+     */
+    virtual bool setState(const QList<quint64> &state) = 0;
+};
+
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <QObject>
 
+#include "coulombtuner.h"
+
 namespace LangmuirCore
 {
 
@@ -13,7 +15,9 @@ class Potential;
 class DrainAgent;
 class SourceAgent;
 class ChargeAgent;
+class ConvergenceMonitor;
 struct SimulationParameters;
+template <int Index> struct StepKernelTable;
 
 /**
  * @brief A class to orchestrate the calculation
@@ -43,17 +47,67 @@ public:
      */
     virtual void performIterations(int nIterations);
 
+    /**
+     * @brief check if the drain and source rates have reached a steady state (see ConvergenceMonitor)
+     */
+    bool isConverged() const;
+
+    /**
+     * @brief Choose the step kernel that matches the current SimulationParameters
+     *
+     * Called by the constructor.  Call it again if any of the parameters that
+     * select the kernel (see performIterationsKernel()) are changed afterwards.
+     */
+    void selectStepKernel();
+
+    /**
+     * @brief A pointer to a step kernel
+     */
+    typedef void (Simulation::*StepKernel)(int nIterations);
+
 protected:
 
+    /**
+     * @brief simulate for a set number of steps using a fixed configuration
+     * @param nIterations the number of steps to simulate
+     *
+     * The runtime switches of the step loop are resolved at compile time, so
+     * the inner loops do not branch on SimulationParameters.
+     * @tparam Coulomb SimulationParameters::coulombCarriers
+     * @tparam Gauss SimulationParameters::coulombGaussianSigma > 0
+     * @tparam Defects SimulationParameters::defectsCharge != 0
+     * @tparam OpenCL SimulationParameters::useOpenCL
+     * @tparam SolarCell SimulationParameters::simulationType == "solarcell"
+     * @tparam IdsOnDelete SimulationParameters::outputIdsOnDelete
+     */
+    template <bool Coulomb, bool Gauss, bool Defects, bool OpenCL, bool SolarCell, bool IdsOnDelete>
+    void performIterationsKernel(int nIterations);
+
+    /**
+     * @brief Compute the Coulomb interactions of every ChargeAgent
+     * @param backend the way to compute them
+     */
+    template <bool Gauss, bool Defects>
+    void performCoulombInteractions(CoulombTuner::Backend backend);
+
+    /**
+     * @brief Compute the Coulomb interactions with the backend the CoulombTuner is timing
+     *
+     * The backends are timed in turn, one per step, and the CoulombTuner picks
+     * one once each was timed over coulomb.tuner.samples steps.
+     */
+    template <bool Gauss, bool Defects, bool OpenCL>
+    void tuneCoulombInteractions();
+
     /**
      * @brief Recombine holes and electrons (in solarcell simulations only)
      */
-    void performRecombinations();
+    template <bool SolarCell> void performRecombinations();
 
     /**
      * @brief Tell sources to inject charges
      */
-    void performInjections();
+    template <bool SolarCell> void performInjections();
 
     /**
      * @brief \b Try to use the sources to keep the number of ChargeAgents balanced
@@ -67,11 +121,12 @@ protected:
      * This function will also output carrier statistics if output.id.on.delete
      * is set.
      */
-    void nextTick();
+    template <bool IdsOnDelete> void nextTick();
 
     /**
      * @brief A method needed to call ChargeAgent::coulombCPU() in parallel
      */
+    template <bool Gauss, bool Defects>
     static void chargeAgentCoulombInteractionQtConcurrentCPU(ChargeAgent * chargeAgent);
 
     /**
@@ -87,6 +142,23 @@ protected:
      * @brief Reference to World object
      */
     World &m_world;
+
+    /**
+     * @brief The step kernel chosen by selectStepKernel()
+     */
+    StepKernel m_stepKernel;
+
+    /**
+     * @brief Chooses the way Coulomb interactions are computed
+     */
+    CoulombTuner *m_coulombTuner;
+
+    /**
+     * @brief Decides when the run can stop early
+     */
+    ConvergenceMonitor *m_convergenceMonitor;
+
+    template <int Index> friend struct StepKernelTable;
 };
 
 }
@@ -0,0 +1,235 @@
+#ifndef SITEPLACER_H
+#define SITEPLACER_H
+
+#include "randomengine.h"
+
+#include <QVector>
+#include <QString>
+#include <QList>
+
+namespace LangmuirCore
+{
+
+class World;
+class Grid;
+class Random;
+
+/**
+ * @brief A class to pick random sites for traps and defects
+ *
+ * Sites already picked are marked in a bitset, so checking a site is O(1),
+ * however many sites are picked.  The algorithm is chosen by placement.algorithm:
+ *  - legacy: try random sites until a free one is found, and grow clusters by
+ *    picking a random neighbor of a random cluster site (the same sites as
+ *    older versions for the same random.seed)
+ *  - frontier: pick seeds by a partial Fisher-Yates shuffle (never tries a site
+ *    twice), and grow clusters from a list of the free neighbors of cluster sites
+ *  - parallel: split the grid into slabs along x, and run frontier in each slab
+ *    at the same time; each slab has its own random numbers (a stream of a seed
+ *    taken from the World's generator), so the sites do not depend on the number of threads.
+ *    Each seed goes to a random slab (weighted by volume), and each slab grows
+ *    in proportion to its seeds, so a slab without seeds grows nothing of its own.
+ *    Clusters do not cross the slab edges, except for the sites a full slab could
+ *    not grow, which are grown afterwards in serial from all of the clusters
+ */
+class SitePlacer
+{
+public:
+    /**
+     * @brief The placement algorithm
+     */
+    enum Algorithm
+    {
+        //! rejection sampling and random growth
+        Legacy   = 0,
+
+        //! Fisher-Yates and frontier growth
+        Frontier = 1,
+
+        //! Frontier in slabs, in parallel
+        Parallel = 2
+    };
+
+    /**
+     * @brief Get the Algorithm from the value of placement.algorithm
+     * @param name legacy, frontier, or parallel
+     */
+    static Algorithm toAlgorithm(const QString &name);
+
+    /**
+     * @brief Create a SitePlacer with no sites picked
+     * @param world reference to the World object
+     * @param grid the Grid whose sites are picked
+     * @param algorithm the placement algorithm
+     */
+    SitePlacer(World &world, Grid &grid, Algorithm algorithm);
+
+    /**
+     * @brief Check if a site has been picked
+     * @param site the "s-site ID"
+     */
+    bool isTaken(int site) const;
+
+    /**
+     * @brief Mark a site as picked (for example, sites read from a checkpoint)
+     * @param site the "s-site ID"
+     */
+    void take(int site);
+
+    /**
+     * @brief Pick free sites at random, anywhere in the Grid
+     * @param random the random number generator
+     * @param count the number of sites
+     */
+    QList<int> seed(Random &random, int count);
+
+    /**
+     * @brief Pick free sites at random, next to a list of sites, adding them to the list
+     * @param random the random number generator
+     * @param sites the sites to grow from; the new sites are appended
+     * @param count the number of new sites
+     */
+    void grow(Random &random, QList<int> &sites, int count);
+
+    /**
+     * @brief Pick seeds, then grow clusters from them
+     * @param random the random number generator
+     * @param seeds the number of seeds
+     * @param grown the number of sites grown from the seeds
+     *
+     * The seeds come first in the list.  With Parallel, the sites are ordered by
+     * slab, followed by the sites grown across the slab edges.
+     */
+    QList<int> seedAndGrow(Random &random, int seeds, int grown);
+
+private:
+    /**
+     * @brief Create a SitePlacer for the slab x0 <= x < x1 (used by Parallel)
+     */
+    SitePlacer(const SitePlacer &parent, int x0, int x1);
+
+    /**
+     * @brief Get the position of a site in m_taken
+     */
+    int localIndex(int site) const;
+
+    /**
+     * @brief Check if a site is in the slab of this SitePlacer
+     */
+    bool contains(int site) const;
+
+    /**
+     * @brief Check if a cluster can grow into a site
+     */
+    bool canGrowInto(int site) const;
+
+    /**
+     * @brief Append the sites a cluster can grow into from a site to the frontier
+     */
+    void addToFrontier(int site, QVector<int> &frontier) const;
+
+    /**
+     * @brief Pick seeds with a partial Fisher-Yates shuffle of the sites in the slab
+     */
+    QList<int> seedFisherYates(Random &random, int count);
+
+    /**
+     * @brief Pick seeds by trying random sites
+     */
+    QList<int> seedRejection(Random &random, int count);
+
+    /**
+     * @brief Grow clusters by picking from the free neighbors of the cluster sites
+     * @return the number of sites that could not be grown (a slab runs out of room; always 0 otherwise)
+     */
+    int growFrontier(Random &random, QList<int> &sites, int count);
+
+    /**
+     * @brief Grow clusters by picking random neighbors of random cluster sites
+     */
+    void growRandom(Random &random, QList<int> &sites, int count);
+
+    /**
+     * @brief Run seedAndGrow in slabs
+     */
+    QList<int> seedAndGrowParallel(Random &random, int seeds, int grown);
+
+    /**
+     * @brief Seeding and growth in one slab, run by QtConcurrent
+     */
+    struct Slab
+    {
+        //! the placer of the slab
+        SitePlacer *placer;
+
+        //! the random number generator of the World
+        RandomEngine::Type engine;
+
+        //! the random seed of the slabs
+        quint64 seed;
+
+        //! the random stream of the slab
+        quint64 stream;
+
+        //! the number of seeds in the slab
+        int seeds;
+
+        //! the number of sites to grow in the slab
+        int grown;
+
+        //! the sites picked
+        QList<int> sites;
+
+        //! the number of sites that did not fit in the slab
+        int missing;
+    };
+
+    /**
+     * @brief Pick the sites of a slab
+     */
+    static void seedAndGrowSlab(Slab &slab);
+
+    /**
+     * @brief Reference to the World object
+     */
+    World &m_world;
+
+    /**
+     * @brief The Grid whose sites are picked
+     */
+    Grid &m_grid;
+
+    /**
+     * @brief The placement algorithm
+     */
+    Algorithm m_algorithm;
+
+    /**
+     * @brief The SitePlacer of the whole Grid, for a slab; its sites count as taken
+     */
+    const SitePlacer *m_parent;
+
+    /**
+     * @brief The first x index of the slab
+     */
+    int m_x0;
+
+    /**
+     * @brief The width of the slab
+     */
+    int m_width;
+
+    /**
+     * @brief The number of sites in the slab
+     */
+    int m_size;
+
+    /**
+     * @brief One bit per site of the slab, set if the site has been picked
+     */
+    QVector<quint32> m_taken;
+};
+
+}
+
+#endif
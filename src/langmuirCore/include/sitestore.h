@@ -0,0 +1,534 @@
+#ifndef SITESTORE_H
+#define SITESTORE_H
+
+#include "firsttouchvector.h"
+#include "fastdivider.h"
+#include "freesiteindex.h"
+#include "agent.h"
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QList>
+
+namespace LangmuirCore
+{
+
+class World;
+
+/**
+ * @brief Everything stored for one site, for both the electron and the hole Grid
+ *
+ * 32 bytes (on 64-bit systems), so two sites share a cache line, and checking
+ * the other Grid at a site reads the same line.
+ */
+struct SiteRecord
+{
+    //! the Agent in each Grid (see SiteStore::Slot), or NULL
+    Agent *agent[2];
+
+    //! the background potential, the same for both Grids
+    double potential;
+
+    //! the Agent::Type in each Grid (see SiteStore::Slot)
+    quint8 type[2];
+};
+
+/**
+ * @brief A class to hold the sites of the electron and hole Grids in one array
+ *
+ * Each Grid is a view of one Slot of the records.  The background potential
+ * is stored once, so writing it through either Grid changes both.
+ *
+ * Records are found by "s-site ID".  If grid.tiled is on, they are stored in
+ * tiles of 4 x 4 x 4 sites (8 x 8 x 1 if grid.z < 4), so sites that are close
+ * in all directions are close in memory.  The order in memory is hidden here;
+ * everything else (including checkpoints and output) uses "s-site IDs".
+ *
+ * If potential.analytic is on, the background potential is not stored per
+ * site.  It is found from the linear and gate terms (which are known for every
+ * site) plus an overlay of the sites that differ (the traps), so changing the
+ * voltages does not touch the records.
+ *
+ * If grid.sparse is on, the tiles are only allocated while an Agent is in
+ * them.  Empty tiles cost one pointer.  Implies potential.analytic.
+ */
+class SiteStore : public QObject
+{
+private:
+    Q_OBJECT
+    Q_DISABLE_COPY(SiteStore)
+
+public:
+    /**
+     * @brief Which Grid a part of a SiteRecord belongs to
+     */
+    enum Slot
+    {
+        //! the electron Grid
+        Electron = 0,
+
+        //! the hole Grid
+        Hole     = 1
+    };
+
+    /**
+     * @brief Create the records
+     * @param world reference to the World object
+     * @param parent QObject this belongs to
+     *
+     * There is a record for every site of the Grid, and for every special Agent
+     * (see Grid::specialAgentReserve()).  All records start empty, with a
+     * potential of 0.  With threads.affinity they are spread over the NUMA
+     * nodes (see FirstTouchVector), except those of a replica, which are put
+     * on the node of the CPU that steps it (see Affinity::replicaCPU()).  With grid.sparse no records are
+     * allocated until Agents are placed.
+     */
+    SiteStore(World &world, QObject *parent = 0);
+
+    /**
+     * @brief Destroy the records
+     */
+    ~SiteStore();
+
+    /**
+     * @brief Get the number of sites (the volume of the Grid + the special Agents)
+     */
+    int size() const;
+
+    /**
+     * @brief Get the record of a site
+     * @param site the "s-site ID"
+     */
+    SiteRecord& record(int site);
+
+    /**
+     * @brief Get the record of a site
+     * @param site the "s-site ID"
+     */
+    const SiteRecord& at(int site) const;
+
+    /**
+     * @brief Record that an Agent was put at a site
+     * @param site the "s-site ID"
+     *
+     * Call after filling a slot of record(site).  Keeps the tiles (grid.sparse)
+     * and the FreeSiteIndexes up to date.
+     */
+    void occupy(int site);
+
+    /**
+     * @brief Record that an Agent was taken from a site
+     * @param site the "s-site ID"
+     *
+     * Call after emptying a slot of record(site).  If grid.sparse is on, and
+     * the tile is now empty, the tile is released.
+     */
+    void vacate(int site);
+
+    /**
+     * @brief Get an index of the free sites of a slab of the Grid
+     * @param slotMask the slot mask; bit Electron and / or bit Hole
+     * @param x0 the first x index of the slab
+     * @param x1 one past the last x index of the slab
+     *
+     * The index is made on first use (which visits every site of the slab), and
+     * shared by all users asking for the same one.  It is kept up to date until
+     * every user calls releaseFreeSites().
+     */
+    FreeSiteIndex *acquireFreeSites(int slotMask, int x0, int x1);
+
+    /**
+     * @brief Stop using an index made by acquireFreeSites()
+     * @param index the index
+     */
+    void releaseFreeSites(FreeSiteIndex *index);
+
+    /**
+     * @brief Get the background potential at a site
+     * @param site the "s-site ID"
+     */
+    double potential(int site) const;
+
+    /**
+     * @brief Get potential(site1) - potential(site2)
+     * @param site1 the "s-site ID" of the first site
+     * @param site2 the "s-site ID" of the second site
+     *
+     * With potential.analytic, for sites in the Grid, only the differences in
+     * x and z are needed; the overlay is only searched at traps.
+     */
+    double potentialDifference(int site1, int site2) const;
+
+    /**
+     * @brief Set the background potential at a site
+     * @param site the "s-site ID"
+     * @param potential the value to set
+     */
+    void setPotential(int site, double potential);
+
+    /**
+     * @brief Add to the background potential at a site
+     * @param site the "s-site ID"
+     * @param potential the value to add
+     */
+    void addToPotential(int site, double potential);
+
+    /**
+     * @brief Set the background potential to zero everywhere
+     */
+    void setPotentialZero();
+
+    /**
+     * @brief Add slope * (x + 0.5) + offset to the background potential of every site in the Grid
+     * @param slope the change per site along the x-direction
+     * @param offset the value at x = -0.5
+     */
+    void addToPotentialLinear(double slope, double offset);
+
+    /**
+     * @brief Add slope * (z + 0.5) to the background potential of every site in the Grid
+     * @param slope the change per site along the z-direction
+     */
+    void addToPotentialGate(double slope);
+
+    /**
+     * @brief Copy the background potential of another SiteStore, leaving the Agents alone
+     * @param other the SiteStore to copy from
+     */
+    void copyPotential(const SiteStore &other);
+
+    /**
+     * @brief Get a number that changes whenever the background potential changes
+     */
+    int potentialVersion() const;
+
+protected:
+    enum
+    {
+        //! log2 of the number of sites in a tile
+        BlockShift = 6,
+
+        //! the number of sites in a tile
+        BlockSize  = 1 << BlockShift
+    };
+
+    /**
+     * @brief A tile of records, allocated when grid.sparse is on
+     */
+    struct Block
+    {
+        //! the records
+        SiteRecord records[BlockSize];
+
+        //! the number of filled slots
+        int occupied;
+    };
+
+    /**
+     * @brief Allocate a tile (or reuse a released one)
+     */
+    Block *allocateBlock();
+
+    /**
+     * @brief Add or remove a site from the FreeSiteIndexes
+     */
+    void updateFreeSites(int site);
+
+    /**
+     * @brief Check if a site is empty in every Grid of a slot mask
+     */
+    bool isFree(int site, int slotMask) const;
+
+    /**
+     * @brief Get the x and z index of a site in the Grid
+     */
+    void getIndexXZ(int site, int &xIndex, int &zIndex) const;
+
+    /**
+     * @brief Get the part of the background potential in the overlay (potential.analytic)
+     * @param site the "s-site ID"
+     */
+    double overlay(int site) const;
+
+    /**
+     * @brief Set the part of the background potential in the overlay (potential.analytic)
+     * @param site the "s-site ID"
+     * @param potential the value to set
+     */
+    void setOverlay(int site, double potential);
+
+    /**
+     * @brief Get the position of the record of a site in m_records
+     * @param site the "s-site ID"
+     */
+    int index(int site) const;
+
+    /**
+     * @brief Reference to the World object
+     */
+    World &m_world;
+
+    /**
+     * @brief The records, in memory order (empty if grid.sparse is on)
+     */
+    FirstTouchVector<SiteRecord> m_records;
+
+    /**
+     * @brief The tiles, in memory order, or NULL if empty (grid.sparse)
+     */
+    QVector<Block *> m_blocks;
+
+    /**
+     * @brief Released tiles, kept so Agents moving in and out of a tile do not allocate memory (grid.sparse)
+     */
+    QVector<Block *> m_spareBlocks;
+
+    /**
+     * @brief The indexes of free sites in use
+     */
+    QList<FreeSiteIndex *> m_freeSites;
+
+    /**
+     * @brief An empty record, returned for sites in empty tiles (grid.sparse)
+     */
+    SiteRecord m_empty;
+
+    /**
+     * @brief The change in the linear potential per site along the x-direction (potential.analytic)
+     */
+    double m_linearSlope;
+
+    /**
+     * @brief The linear potential at x = -0.5 (potential.analytic)
+     */
+    double m_linearOffset;
+
+    /**
+     * @brief The change in the gate potential per site along the z-direction (potential.analytic)
+     */
+    double m_gateSlope;
+
+    /**
+     * @brief Counts the changes of the background potential
+     */
+    int m_potentialVersion;
+
+    /**
+     * @brief The background potential of each site minus the linear and gate terms, if not zero (potential.analytic)
+     */
+    QHash<int, double> m_overlay;
+
+    /**
+     * @brief One bit per site, set if the site is in m_overlay (potential.analytic)
+     *
+     * Most sites are not traps, and testing a bit is much cheaper than searching the hash.
+     */
+    QVector<quint32> m_overlayMask;
+
+    /**
+     * @brief The number of sites
+     */
+    int m_size;
+
+    /**
+     * @brief The number of sites in the Grid
+     */
+    int m_volume;
+
+    /**
+     * @brief True if the records are stored in tiles
+     */
+    bool m_tiled;
+
+    /**
+     * @brief True if the tiles are only allocated while they hold Agents
+     */
+    bool m_sparse;
+
+    /**
+     * @brief True if the background potential is found from the linear and gate terms and the overlay
+     */
+    bool m_analytic;
+
+    /**
+     * @brief The number of records used by the tiles (the volume rounded up to whole tiles)
+     */
+    int m_tiledVolume;
+
+    /**
+     * @brief The number of sites along the x-direction
+     */
+    int m_xSize;
+
+    /**
+     * @brief The number of sites along the y-direction
+     */
+    int m_ySize;
+
+    /**
+     * @brief Divides by m_xSize
+     */
+    FastDivider m_xDivider;
+
+    /**
+     * @brief Divides by m_ySize
+     */
+    FastDivider m_yDivider;
+
+    /**
+     * @brief The number of tiles along the x-direction
+     */
+    int m_xTiles;
+
+    /**
+     * @brief The number of tiles along the y-direction
+     */
+    int m_yTiles;
+
+    /**
+     * @brief log2 of the tile size along the x-direction
+     */
+    int m_xShift;
+
+    /**
+     * @brief log2 of the tile size along the y-direction
+     */
+    int m_yShift;
+
+    /**
+     * @brief log2 of the tile size along the z-direction
+     */
+    int m_zShift;
+};
+
+inline int SiteStore::size() const
+{
+    return m_size;
+}
+
+inline int SiteStore::index(int site) const
+{
+    if (!m_tiled)
+    {
+        return site;
+    }
+
+    // The special Agents come after the tiles
+    if (site >= m_volume)
+    {
+        return m_tiledVolume + (site - m_volume);
+    }
+
+    int row = m_xDivider.divide(site);
+    int z = m_yDivider.divide(row);
+    int y = row - z * m_ySize;
+    int x = site - row * m_xSize;
+
+    int tile = ((z >> m_zShift) * m_yTiles + (y >> m_yShift)) * m_xTiles + (x >> m_xShift);
+    int local = ((((z & ((1 << m_zShift) - 1)) << m_yShift) |
+                   (y & ((1 << m_yShift) - 1))) << m_xShift) |
+                   (x & ((1 << m_xShift) - 1));
+
+    return (tile << (m_xShift + m_yShift + m_zShift)) | local;
+}
+
+inline SiteRecord& SiteStore::record(int site)
+{
+    if (!m_sparse)
+    {
+        return m_records[index(site)];
+    }
+
+    int i = index(site);
+    Block *&block = m_blocks[i >> BlockShift];
+    if (block == 0)
+    {
+        block = allocateBlock();
+    }
+    return block->records[i & (BlockSize - 1)];
+}
+
+inline const SiteRecord& SiteStore::at(int site) const
+{
+    if (!m_sparse)
+    {
+        return m_records.at(index(site));
+    }
+
+    int i = index(site);
+    const Block *block = m_blocks.at(i >> BlockShift);
+    if (block == 0)
+    {
+        return m_empty;
+    }
+    return block->records[i & (BlockSize - 1)];
+}
+
+inline void SiteStore::occupy(int site)
+{
+    if (m_sparse)
+    {
+        m_blocks[index(site) >> BlockShift]->occupied++;
+    }
+
+    if (!m_freeSites.isEmpty())
+    {
+        updateFreeSites(site);
+    }
+}
+
+inline void SiteStore::getIndexXZ(int site, int &xIndex, int &zIndex) const
+{
+    int row = m_xDivider.divide(site);
+    xIndex = site - row * m_xSize;
+    zIndex = m_yDivider.divide(row);
+}
+
+inline double SiteStore::overlay(int site) const
+{
+    if (m_overlayMask.at(site >> 5) & (1u << (site & 31)))
+    {
+        return m_overlay.value(site, 0.0);
+    }
+    return 0.0;
+}
+
+inline double SiteStore::potential(int site) const
+{
+    if (!m_analytic)
+    {
+        return m_records.at(index(site)).potential;
+    }
+
+    double v = overlay(site);
+    if (site < m_volume)
+    {
+        int x, z;
+        getIndexXZ(site, x, z);
+        v += m_linearSlope * (x + 0.5) + m_linearOffset + m_gateSlope * (z + 0.5);
+    }
+    return v;
+}
+
+inline double SiteStore::potentialDifference(int site1, int site2) const
+{
+    if (!m_analytic || site1 >= m_volume || site2 >= m_volume)
+    {
+        return potential(site1) - potential(site2);
+    }
+
+    int x1, z1, x2, z2;
+    getIndexXZ(site1, x1, z1);
+    getIndexXZ(site2, x2, z2);
+    return m_linearSlope * (x1 - x2) + m_gateSlope * (z1 - z2) + overlay(site1) - overlay(site2);
+}
+
+inline int SiteStore::potentialVersion() const
+{
+    return m_potentialVersion;
+}
+
+}
+
+#endif
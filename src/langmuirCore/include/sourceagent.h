@@ -6,6 +6,8 @@
 namespace LangmuirCore
 {
 
+class FreeSiteIndex;
+
 /**
  * @brief A class to inject charges
  */
@@ -17,6 +19,11 @@ public:
      */
     SourceAgent(World &world, Grid &grid, QObject *parent = 0);
 
+    /**
+     * @brief destroy the SourceAgent
+     */
+    ~SourceAgent();
+
     /**
      * @brief seed a charge at a random site
      * @warning does not call shouldTransport()
@@ -44,8 +51,12 @@ public:
      * This is the main transport method of a SourceAgent.  This function uses
      * chooseSite(), shouldTransport() and validToInject() to inject the charge.
      * It is not garunteed that a charge will be injected.
+     *
+     * If freeSitesOnly is true, and free.site.index is on, only free sites are
+     * chosen.  Used by Simulation::balanceCharges(), so it does not have to keep
+     * trying.
      */
-    bool tryToInject();
+    bool tryToInject(bool freeSitesOnly = false);
 
 protected:
     /**
@@ -94,6 +105,38 @@ protected:
      * @brief choose a random site ID from the neighborlist.
      */
     int randomNeighborSiteID();
+
+    /**
+     * @brief choose a site with a FreeSiteIndex (free.site.index)
+     * @param wholeGrid use the whole grid, instead of the Grid::CubeFace of the SourceAgent
+     * @param freeSitesOnly only choose free sites
+     *
+     * Otherwise, one random number picks any site of the slab, and -1 is
+     * returned if it is not free, so injection happens as often as without
+     * the index.
+     */
+    int chooseFreeSite(bool wholeGrid, bool freeSitesOnly);
+
+    /**
+     * @brief check if free sites can be chosen with a FreeSiteIndex
+     * @param wholeGrid use the whole grid, instead of the Grid::CubeFace of the SourceAgent
+     */
+    bool hasFreeSiteIndex(bool wholeGrid);
+
+    /**
+     * @brief the Grids a site must be empty in to inject; see SiteStore::Slot
+     */
+    virtual int freeSiteSlots() = 0;
+
+    /**
+     * @brief the free sites of the whole grid, or 0 (made when first used)
+     */
+    FreeSiteIndex *m_gridSites;
+
+    /**
+     * @brief the free sites of the Grid::CubeFace, or 0 (made when first used)
+     */
+    FreeSiteIndex *m_faceSites;
 };
 
 /**
@@ -126,6 +169,11 @@ protected:
      * @brief same as SourceAgent::inject(), but specialized for ElectronAgents.
      */
     virtual void inject(int site);
+
+    /**
+     * @brief the electron Grid
+     */
+    virtual int freeSiteSlots();
 };
 
 /**
@@ -158,6 +206,11 @@ protected:
      * @brief same as SourceAgent::inject(), but specialized for HoleAgents.
      */
     virtual void inject(int site);
+
+    /**
+     * @brief the hole Grid
+     */
+    virtual int freeSiteSlots();
 };
 
 /**
@@ -197,6 +250,11 @@ protected:
      * @brief similar to SourceAgent::inject(), but injects both a HoleAgent and an ElectronAgent
      */
     virtual void inject(int site);
+
+    /**
+     * @brief both Grids
+     */
+    virtual int freeSiteSlots();
 };
 
 }
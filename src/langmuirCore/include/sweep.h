@@ -0,0 +1,80 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+
+namespace LangmuirCore
+{
+
+class World;
+
+/**
+ * @brief A class to step a World through a list of voltages and temperatures
+ *
+ * The points are read from SimulationParameters::sweepVoltageRight and
+ * SimulationParameters::sweepTemperatureKelvin.  Moving to a new point keeps
+ * the morphology and the carriers, so each point starts from the state the
+ * previous one ended in.  Only the linear part of the potential is updated
+ * when voltage.right changes; the gate and trap potentials and the
+ * precomputed arrays are reused as they are.
+ *
+ * When there is more than one point, each point writes to its own output
+ * stub, SimulationParameters::outputStub + "_s" + index.
+ */
+class Sweep : public QObject
+{
+private:
+    Q_OBJECT
+    Q_DISABLE_COPY(Sweep)
+
+public:
+    /**
+     * @brief Create a Sweep
+     * @param world reference to World Object
+     * @param parent QObject this belongs to
+     */
+    Sweep(World &world, QObject *parent = 0);
+
+    /**
+     * @brief get the number of points (1 if there is no sweep)
+     */
+    int size();
+
+    /**
+     * @brief move the World to a point
+     * @param point the index of the point
+     *
+     * For every point but the first, SimulationParameters::currentStep and
+     * the FluxAgent counters are reset.  If the World is a replica, the
+     * primary World must be moved to the point first, so that the updated
+     * potential can be shared.
+     */
+    void setPoint(int point);
+
+protected:
+    /**
+     * @brief Reference to World object
+     */
+    World &m_world;
+
+    /**
+     * @brief values of voltage.right (empty if not swept)
+     */
+    QList<double> m_voltageRight;
+
+    /**
+     * @brief values of temperature.kelvin (empty if not swept)
+     */
+    QList<double> m_temperatureKelvin;
+
+    /**
+     * @brief the output stub before the sweep started
+     */
+    QString m_outputStub;
+};
+
+}
+
+#endif // SWEEP_H
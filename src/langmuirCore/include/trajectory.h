@@ -0,0 +1,161 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QVector>
+#include <QFile>
+#include <QList>
+
+#include "writer.h"
+
+namespace LangmuirCore
+{
+
+class World;
+
+/**
+ * @brief A class to write the trajectory in a compact binary format
+ *
+ * Used instead of XYZWriter if output.xyz.format is binary.  The frames are
+ * grouped in chunks of output.xyz.keyframe frames.  The first frame of a chunk
+ * (a keyframe) stores every carrier; the frames after it store which carriers
+ * survived, how far each one hopped since the last frame, and the carriers that
+ * are new.  Hops are bounded by hopping.range, so a frame written every step
+ * takes a few bits per carrier.  Each chunk is compressed with zlib, and the
+ * file ends with an index of the chunks, so a reader can seek to any frame by
+ * decoding at most one chunk.  See trajectory.cpp for the layout, and
+ * LangmuirPython/langmuir/trajectory.py for a reader.
+ *
+ * If the file exists, new chunks are added to it (after its index, which is
+ * rewritten).  A file left without an index, by a run that was killed, is
+ * recovered up to its last complete chunk.
+ */
+class TrajectoryWriter : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief The version of the format
+     */
+    static const quint32 Version = 1;
+
+    /**
+     * @brief Open the file, has the same parameters as OutputInfo
+     * @param world reference to the World
+     * @param name file name
+     * @param parent parent QObject
+     */
+    TrajectoryWriter(World &world, const QString& name, QObject *parent = 0);
+
+    /**
+     * @brief Write the last chunk and the index
+     */
+   ~TrajectoryWriter();
+
+    /**
+     * @brief Add the carriers, defects and traps of the snapshot as a frame
+     * @param snapshot the snapshot
+     */
+    void write(const OutputSnapshot &snapshot);
+
+    /**
+     * @brief The position and statistics of a carrier in the last frame
+     */
+    struct Carrier
+    {
+        quint64 id;
+        qint32 x;
+        qint32 y;
+        qint32 z;
+        qint32 lifetime;
+        qint32 pathlength;
+    };
+
+    /**
+     * @brief An entry of the index: where a chunk starts
+     */
+    struct Chunk
+    {
+        quint64 firstStep;
+        quint32 frames;
+        quint64 offset;
+    };
+
+private:
+    /**
+     * @brief Read the chunks of an existing file, and cut off what follows them
+     */
+    void recover();
+
+    /**
+     * @brief Compress the frames of the current chunk and write them to the file
+     */
+    void writeChunk();
+
+    /**
+     * @brief Write the index at the end of the file
+     */
+    void writeIndex();
+
+    /**
+     * @brief Encode the carriers of a frame relative to the last frame
+     * @param carriers the carriers of the snapshot
+     * @param previous the carriers of the last frame, replaced by those of this frame
+     */
+    void encodeCarriers(const QVector<OutputSnapshot::Carrier> &carriers, QVector<Carrier> &previous);
+
+    /**
+     * @brief Encode a list of sites (defects or traps)
+     */
+    void encodeSites(const QList<int> &sites);
+
+    /**
+     * @brief Reference to the World
+     */
+    World &m_world;
+
+    /**
+     * @brief The file
+     */
+    QFile m_file;
+
+    /**
+     * @brief What is written (bitwise or of the species flags in trajectory.cpp)
+     */
+    quint32 m_species;
+
+    /**
+     * @brief The number of frames in a chunk
+     */
+    int m_keyframe;
+
+    /**
+     * @brief The index of the chunks in the file
+     */
+    QVector<Chunk> m_chunks;
+
+    /**
+     * @brief The uncompressed frames of the current chunk
+     */
+    QByteArray m_buffer;
+
+    /**
+     * @brief The first step and number of frames of the current chunk
+     */
+    Chunk m_current;
+
+    /**
+     * @brief The electrons of the last frame
+     */
+    QVector<Carrier> m_electrons;
+
+    /**
+     * @brief The holes of the last frame
+     */
+    QVector<Carrier> m_holes;
+};
+
+}
+
+#endif // TRAJECTORY_H
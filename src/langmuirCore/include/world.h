@@ -24,6 +24,7 @@ namespace LangmuirCore
 {
 
 class Grid;
+class SiteStore;
 class Agent;
 class Random;
 class Logger;
@@ -68,6 +69,17 @@ public:
     World(SimulationParameters &parameters, int cores=-1, int gpuID=-1, QObject *parent = 0);
     World(SimulationParameters &parameters, ConfigurationInfo &configInfo, int cores=-1, int gpuID=-1, QObject *parent = 0);
 
+    /**
+     * @brief create a replica of a world that shares its read-only state
+     * @param primary the World that owns the shared state
+     * @param replica the index of the replica, used to offset the random seed
+     * @param gpuID OpenCL GPU id
+     * @param parent QObject this belongs to
+     *
+     * Calls the initializeReplica() function.
+     */
+    World(World &primary, int replica, int gpuID=-1, QObject *parent = 0);
+
     /**
      * @brief destroys the entire World, and everything in it...including you.
      */
@@ -93,6 +105,11 @@ public:
      */
     Grid& holeGrid();
 
+    /**
+     * @brief get the site records shared by the electron and hole Grids
+     */
+    SiteStore& sites();
+
     /**
      * @brief get the Potential, a calculator used for...calculating the potential.
      */
@@ -268,6 +285,23 @@ public:
      */
     boost::multi_array<double,3>& couplingConstants();
 
+    /**
+     * @brief get the World that owns the precomputed arrays
+     *
+     * This is the World itself, unless it was created as a replica.
+     */
+    World& primaryWorld();
+
+    /**
+     * @brief get the replica index (0 unless created as a replica)
+     */
+    int replica();
+
+    /**
+     * @brief true if this World shares its read-only state with a primary World
+     */
+    bool isReplica();
+
     /**
      * @brief get the max number of ElectronAgents allowed
      */
@@ -298,6 +332,11 @@ public:
      */
     int maxTraps();
 
+    /**
+     * @brief get a new identifier for a ChargeAgent (0, 1, 2, ... in the order they are made)
+     */
+    quint64 nextChargeAgentID();
+
     /**
      * @brief get the current number of ElectronAgents
      */
@@ -489,6 +528,11 @@ private:
      */
     RecombinationAgent *m_recombinationAgent;
 
+    /**
+     * @brief pointer to the site records, shared by the electron and hole Grids
+     */
+    SiteStore *m_sites;
+
     /**
      * @brief pointer to electron Grid, used for keeping track of ElectronAgents
      */
@@ -592,6 +636,18 @@ private:
      */
     boost::multi_array<double,3> m_couplingConstants;
 
+    /**
+     * @brief pointer to the World that owns the precomputed arrays
+     *
+     * Points to this World, unless it was created as a replica.
+     */
+    World *m_primary;
+
+    /**
+     * @brief the replica index
+     */
+    int m_replica;
+
     /**
      * @brief max number of electrons
      */
@@ -612,6 +668,11 @@ private:
      */
     int m_maxTraps;
 
+    /**
+     * @brief number of ChargeAgents made, see nextChargeAgentID()
+     */
+    quint64 m_chargeAgentCount;
+
     /**
      * @brief places defects
      * @param siteIDs a list of defect site ids
@@ -677,6 +738,20 @@ private:
      */
     void initialize(const QString& fileName = "", SimulationParameters *pparameters = NULL, ConfigurationInfo *pconfigInfo = NULL,
         int cores = -1, int gpuID = -1);
+
+    /**
+     * @brief initialize all objects of a replica
+     * @param primary the World that owns the shared state
+     * @param replica the index of the replica
+     * @param gpuID OpenCL GPU id
+     *
+     * Like initialize(), but the parameters, defects, traps, grid potentials
+     * and carrier sites are taken from the primary World.  The grid potentials
+     * and site lists are implicitly shared, and the precomputed arrays are
+     * read through primaryWorld(), so they are never recomputed.  The random
+     * number generator is seeded with SimulationParameters::randomSeed + replica.
+     */
+    void initializeReplica(World &primary, int replica, int gpuID = -1);
 };
 
 }
@@ -5,8 +5,13 @@
 #include <QPainter>
 #include <QColor>
 #include <QImage>
+#include <QVector>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
 
 #include "output.h"
+#include "checkpointer.h"
 
 namespace LangmuirCore
 {
@@ -15,6 +20,143 @@ class ChargeAgent;
 class FluxAgent;
 class World;
 class Grid;
+class Logger;
+class TrajectoryWriter;
+
+//! A compact copy of the simulation state needed by the writers at an output step
+struct OutputSnapshot
+{
+    //! what should be written from the snapshot
+    enum Task
+    {
+        Flux       = 0x1,
+        XYZ        = 0x2,
+        Images     = 0x4,
+        CheckPoint = 0x8
+    };
+
+    //! the position and statistics of a single carrier
+    struct Carrier
+    {
+        int site;
+        quint64 id;
+        const void *address;
+        int lifetime;
+        int pathlength;
+    };
+
+    //! bitwise or of Task values
+    int tasks;
+
+    //! the step the snapshot was taken at
+    quint32 currentStep;
+
+    //! milliseconds since the simulation started
+    qint64 elapsed;
+
+    //! attempts of every FluxAgent
+    QVector<unsigned long int> attempts;
+
+    //! successes of every FluxAgent
+    QVector<unsigned long int> successes;
+
+    //! number of electrons
+    int electronCount;
+
+    //! number of holes
+    int holeCount;
+
+    //! carriers on the electron grid (only for the XYZ and Images tasks)
+    QVector<Carrier> electrons;
+
+    //! carriers on the hole grid (only for the XYZ and Images tasks)
+    QVector<Carrier> holes;
+
+    //! defect sites, implicitly shared with the World (only for the XYZ task)
+    QList<int> defects;
+
+    //! trap sites, implicitly shared with the World (only for the XYZ task)
+    QList<int> traps;
+
+    //! maximum number of electrons, used for phantom particles
+    int maxElectrons;
+
+    //! maximum number of holes, used for phantom particles
+    int maxHoles;
+
+    //! maximum number of defects, used for phantom particles
+    int maxDefects;
+
+    //! maximum number of traps, used for phantom particles
+    int maxTraps;
+
+    //! file name of the carriers image, resolved when the snapshot was taken
+    QString carriersImage;
+
+    //! file name of the electron image, resolved when the snapshot was taken
+    QString electronImage;
+
+    //! file name of the hole image, resolved when the snapshot was taken
+    QString holeImage;
+
+    //! everything the checkpoint file holds
+    CheckPointState checkPoint;
+};
+
+//! A thread that writes OutputSnapshots in the order they are submitted
+/*!
+  The queue owns a fixed number of snapshots (two by default, so the simulation
+  fills one while the thread writes the other).  When they are all waiting to be
+  written, acquire() blocks the simulation until the thread catches up.
+  */
+class OutputQueue : public QThread
+{
+    Q_OBJECT
+public:
+    //! create the queue and its snapshots, the thread is not started
+    OutputQueue(Logger &logger, int size, QObject *parent = 0);
+
+    //! stop the thread after writing the remaining snapshots
+    ~OutputQueue();
+
+    //! get an unused snapshot, blocks while every snapshot is waiting to be written
+    OutputSnapshot *acquire();
+
+    //! hand a snapshot (obtained from acquire()) to the thread
+    void submit(OutputSnapshot *snapshot);
+
+    //! block until every submitted snapshot has been written
+    void flush();
+
+protected:
+    //! write snapshots until the queue is destroyed
+    void run();
+
+private:
+    //! the Logger that writes the snapshots
+    Logger &m_logger;
+
+    //! snapshots that may be filled
+    QList<OutputSnapshot *> m_free;
+
+    //! snapshots waiting to be written
+    QList<OutputSnapshot *> m_pending;
+
+    //! number of snapshots being written by the thread
+    int m_writing;
+
+    //! true when the thread should exit
+    bool m_stop;
+
+    //! protects the lists
+    QMutex m_mutex;
+
+    //! signals that a snapshot was submitted or the thread should stop
+    QWaitCondition m_submitted;
+
+    //! signals that a snapshot was written
+    QWaitCondition m_written;
+};
 
 //! A class to output xyz files
 class XYZWriter : public QObject
@@ -26,8 +168,8 @@ public:
               const QString& name,
               QObject *parent = 0);
 
-    //! Write XYZ of the current step to the stream
-    void write();
+    //! Write XYZ of the snapshot to the stream
+    void write(const OutputSnapshot &snapshot);
 protected:
     //! reference to the world object
     World &m_world;
@@ -49,8 +191,8 @@ public:
                const QString& name,
                QObject *parent = 0);
 
-    //! write the flux statistics of the current step to the stream
-    void write();
+    //! write the flux statistics of the snapshot to the stream
+    void write(const OutputSnapshot &snapshot);
 protected:
     //! reference to the world object
     World &m_world;
@@ -132,6 +274,14 @@ public:
       */
     void drawCharges(QList<ChargeAgent *> &charges, QColor color, int layer);
 
+    //! draw some carriers stored in an OutputSnapshot
+    /*!
+      \param carriers The carriers of a snapshot, which have site ids
+      \param color The color of the points
+      \param layer Which layer are we drawing? its a 2D image
+      */
+    void drawCarriers(const QVector<OutputSnapshot::Carrier> &carriers, QColor color, int layer);
+
     //! save the image to a file
     /*!
       \param name A file name that is passed to a OutputInfo object, the output is assummed png
@@ -160,6 +310,9 @@ public:
     //! create Logger
     Logger(World &world, QObject *parent = 0);
 
+    //! write the remaining snapshots and stop the background thread
+    ~Logger();
+
     //! save an image of trap sites as png
     virtual void saveTrapImage(const QString& name = "%stub-traps.png");
 
@@ -190,6 +343,19 @@ public:
     //! output xyz information (at the current step) to the xyz file
     virtual void reportXYZStream();
 
+    //! output everything requested by tasks (a combination of OutputSnapshot::Task) at the current step
+    /*!
+      The state is copied into an OutputSnapshot; if output.async is on, the
+      snapshot is formatted and written on a background thread.
+      */
+    virtual void report(int tasks);
+
+    //! write a snapshot to the streams and images; called on the background thread if output.async is on
+    virtual void writeSnapshot(const OutputSnapshot &snapshot);
+
+    //! block until every snapshot has been written to disk
+    virtual void waitForOutput();
+
     //! output carrier information (for example pathlength) to the carrier file
     virtual void reportCarrier(ChargeAgent &charge);
 
@@ -206,6 +372,9 @@ protected:
     //! writer in charge of writing xyz files
     XYZWriter *m_xyzWriter;
 
+    //! writer in charge of writing binary trajectory files (used instead of m_xyzWriter)
+    TrajectoryWriter *m_trajectoryWriter;
+
     //! writer in charge of writing source & drain information
     FluxWriter *m_fluxWriter;
 
@@ -214,6 +383,12 @@ protected:
 
     //! writer in charge of writing multiple carrier's information (excitons)
     ExcitonWriter *m_excitonWriter;
+
+    //! background thread writing snapshots (0 if output.async is off)
+    OutputQueue *m_outputQueue;
+
+    //! copy the state needed by tasks into a snapshot
+    void takeSnapshot(OutputSnapshot &snapshot, int tasks);
 };
 
 }
@@ -0,0 +1,534 @@
+#include "initcache.h"
+#include "keyvalueparser.h"
+#include "chargeagent.h"
+#include "parameters.h"
+#include "cubicgrid.h"
+#include "world.h"
+#include "rand.h"
+
+#include <QCryptographicHash>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+
+#include <cstring>
+
+namespace LangmuirCore
+{
+
+namespace
+{
+
+//! The start of the file
+struct Header
+{
+    //! "LANGINIT"
+    char magic[8];
+
+    //! InitCache::Version
+    quint32 version;
+
+    //! 0x01020304, written in the byte order of the machine
+    quint32 byteOrder;
+
+    //! InitCache::m_key
+    char key[20];
+
+    //! the number of Entry after the Header
+    quint32 count;
+
+    //! voltage.left when the background potential was saved
+    double voltageLeft;
+
+    //! voltage.right when the background potential was saved
+    double voltageRight;
+
+    //! slope.z when the background potential was saved
+    double slopeZ;
+};
+
+//! Where a section is in the file
+struct Entry
+{
+    //! the InitCache::Section
+    quint32 section;
+
+    //! unused, zero
+    quint32 reserved;
+
+    //! the position of the section from the start of the file, a multiple of 8
+    quint64 offset;
+
+    //! the number of bytes in the section
+    quint64 size;
+};
+
+const char magic[8] = {'L', 'A', 'N', 'G', 'I', 'N', 'I', 'T'};
+const quint32 byteOrder = 0x01020304;
+
+//! The parameters the defects, carriers, traps and tables depend upon
+const char *keys[] =
+{
+    "simulation.type",
+    "random.engine",
+    "random.seed",
+    "grid.z",
+    "grid.y",
+    "grid.x",
+    "grid.tiled",
+    "grid.sparse",
+    "grid.periodic.y",
+    "grid.periodic.z",
+    "potential.analytic",
+    "hopping.range",
+    "hopping.spherical",
+    "electron.percentage",
+    "hole.percentage",
+    "seed.charges",
+    "defect.percentage",
+    "trap.percentage",
+    "trap.potential",
+    "gaussian.stdev",
+    "seed.percentage",
+    "placement.algorithm",
+    "free.site.index",
+    "coulomb.gaussian.sigma",
+    "electrostatic.cutoff",
+    "electrostatic.prefactor",
+    0
+};
+
+quint64 align(quint64 offset)
+{
+    return (offset + 7) & ~quint64(7);
+}
+
+QByteArray fromInts(const QList<int> &values)
+{
+    QByteArray result(values.size() * int(sizeof(qint32)), '\0');
+    qint32 *data = reinterpret_cast<qint32*>(result.data());
+    for (int i = 0; i < values.size(); i++)
+    {
+        data[i] = values.at(i);
+    }
+    return result;
+}
+
+QByteArray fromDoubles(const QList<double> &values)
+{
+    QByteArray result(values.size() * int(sizeof(double)), '\0');
+    double *data = reinterpret_cast<double*>(result.data());
+    for (int i = 0; i < values.size(); i++)
+    {
+        data[i] = values.at(i);
+    }
+    return result;
+}
+
+QByteArray fromArray(const boost::multi_array<double, 3> &array)
+{
+    return QByteArray(reinterpret_cast<const char*>(array.data()),
+                      int(array.num_elements() * sizeof(double)));
+}
+
+QList<int> fromAgents(const QList<ChargeAgent*> &charges)
+{
+    QList<int> result;
+    for (int i = 0; i < charges.size(); i++)
+    {
+        result.push_back(charges.at(i)->getCurrentSite());
+    }
+    return result;
+}
+
+QList<int> toInts(const uchar *data, quint64 size)
+{
+    QList<int> result;
+    const qint32 *values = reinterpret_cast<const qint32*>(data);
+    for (quint64 i = 0; i < size / sizeof(qint32); i++)
+    {
+        result.push_back(values[i]);
+    }
+    return result;
+}
+
+QList<double> toDoubles(const uchar *data, quint64 size)
+{
+    QList<double> result;
+    const double *values = reinterpret_cast<const double*>(data);
+    for (quint64 i = 0; i < size / sizeof(double); i++)
+    {
+        result.push_back(values[i]);
+    }
+    return result;
+}
+
+quint64 cube(int size)
+{
+    return quint64(size) * quint64(size) * quint64(size);
+}
+
+}
+
+InitCache::InitCache(World &world, const ConfigurationInfo &configInfo)
+    : m_world(world), m_data(NULL), m_size(0)
+{
+    const SimulationParameters &par = m_world.parameters();
+    if (par.cacheDirectory.isEmpty())
+    {
+        return;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QString("langmuir init cache %1").arg(Version).toLatin1());
+
+    // The parameters
+    for (int i = 0; keys[i] != 0; i++)
+    {
+        Variable &variable = m_world.keyValueParser().getVariable(keys[i]);
+        hash.addData(QString("\n%1=%2").arg(variable.key()).arg(variable.value()).toLatin1());
+    }
+
+    // The random number generator and the sites of the input file
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream << m_world.randomNumberGenerator();
+    stream << configInfo.defects;
+    stream << configInfo.electrons;
+    stream << configInfo.holes;
+    stream << configInfo.traps;
+    stream << configInfo.trapPotentials;
+    hash.addData(bytes);
+
+    m_key = hash.result();
+    m_fileName = QDir(par.cacheDirectory).filePath(QString::fromLatin1(m_key.toHex()) + ".init");
+}
+
+InitCache::~InitCache()
+{
+    if (m_data != NULL)
+    {
+        m_file.unmap(m_data);
+    }
+}
+
+bool InitCache::isEnabled() const
+{
+    return !m_fileName.isEmpty();
+}
+
+const QString& InitCache::fileName() const
+{
+    return m_fileName;
+}
+
+bool InitCache::load(ConfigurationInfo &configInfo)
+{
+    if (!isEnabled() || !QFile::exists(m_fileName))
+    {
+        return false;
+    }
+
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        qDebug("langmuir: can not open cache file %s", qPrintable(m_fileName));
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size >= sizeof(Header))
+    {
+        m_data = m_file.map(0, m_size);
+    }
+    if (m_data == NULL)
+    {
+        qDebug("langmuir: can not map cache file %s", qPrintable(m_fileName));
+        m_file.close();
+        return false;
+    }
+
+    // Check everything before changing anything
+    const Header &header = *reinterpret_cast<const Header*>(m_data);
+    bool valid = (memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+                  header.version == Version &&
+                  header.byteOrder == byteOrder &&
+                  memcmp(header.key, m_key.constData(), sizeof(header.key)) == 0 &&
+                  sizeof(Header) + header.count * sizeof(Entry) <= m_size);
+
+    const SimulationParameters &par = m_world.parameters();
+    quint64 tables = cube(par.electrostaticCutoff + 1) * sizeof(double);
+    quint64 stencil = cube(par.hoppingRange + 1) * sizeof(double);
+    quint64 traps = 0;
+    quint64 potentials = 0;
+    quint64 size = 0;
+    valid = valid &&
+            section(Defects, size) != NULL && size % sizeof(qint32) == 0 &&
+            section(Electrons, size) != NULL && size % sizeof(qint32) == 0 &&
+            section(Holes, size) != NULL && size % sizeof(qint32) == 0 &&
+            section(Traps, traps) != NULL && traps % sizeof(qint32) == 0 &&
+            section(TrapPotentials, potentials) != NULL &&
+            potentials == traps / sizeof(qint32) * sizeof(double) &&
+            section(RandomState, size) != NULL &&
+            section(R1, size) != NULL && size == tables &&
+            section(R2, size) != NULL && size == tables &&
+            section(IR, size) != NULL && size == tables &&
+            section(ER, size) != NULL && size == tables &&
+            section(SI, size) != NULL && size == stencil &&
+            section(Coupling, size) != NULL && size == stencil;
+
+    if (!valid)
+    {
+        qDebug("langmuir: ignoring invalid cache file %s", qPrintable(m_fileName));
+        m_file.unmap(m_data);
+        m_file.close();
+        m_data = NULL;
+        return false;
+    }
+
+    qDebug("langmuir: reading cache file %s", qPrintable(m_fileName));
+
+    // The sites, in the order they were placed
+    const uchar *data = section(Defects, size);
+    configInfo.defects = toInts(data, size);
+    data = section(Electrons, size);
+    configInfo.electrons = toInts(data, size);
+    data = section(Holes, size);
+    configInfo.holes = toInts(data, size);
+    data = section(Traps, size);
+    configInfo.traps = toInts(data, size);
+    data = section(TrapPotentials, size);
+    configInfo.trapPotentials = toDoubles(data, size);
+
+    // The random number generator after the sites were placed
+    data = section(RandomState, size);
+    QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(size));
+    QDataStream stream(bytes);
+    stream >> m_world.randomNumberGenerator();
+
+    return true;
+}
+
+bool InitCache::hasPotential() const
+{
+    if (m_data == NULL)
+    {
+        return false;
+    }
+
+    const SimulationParameters &par = m_world.parameters();
+    const Header &header = *reinterpret_cast<const Header*>(m_data);
+    quint64 size = 0;
+    return (!par.potentialAnalytic &&
+            header.voltageLeft == par.voltageLeft &&
+            header.voltageRight == par.voltageRight &&
+            header.slopeZ == par.slopeZ &&
+            section(Potential, size) != NULL &&
+            size == quint64(m_world.electronGrid().volume()) * sizeof(double));
+}
+
+void InitCache::loadPotential()
+{
+    if (!hasPotential())
+    {
+        qFatal("langmuir: cache file %s has no background potential", qPrintable(m_fileName));
+    }
+
+    quint64 size = 0;
+    const double *potential = reinterpret_cast<const double*>(section(Potential, size));
+
+    Grid &grid = m_world.electronGrid();
+    grid.setPotentialZero();
+    for (int site = 0; site < grid.volume(); site++)
+    {
+        grid.setPotential(site, potential[site]);
+    }
+
+    const uchar *data = section(Traps, size);
+    m_world.trapSiteIDs() = toInts(data, size);
+    data = section(TrapPotentials, size);
+    m_world.trapSitePotentials() = toDoubles(data, size);
+}
+
+void InitCache::loadArrays()
+{
+    if (m_data == NULL)
+    {
+        qFatal("langmuir: cache file %s is not loaded", qPrintable(m_fileName));
+    }
+
+    int max_x = m_world.parameters().electrostaticCutoff + 1;
+    int max_h = m_world.parameters().hoppingRange + 1;
+
+    m_world.R1().resize(boost::extents[max_x][max_x][max_x]);
+    m_world.R2().resize(boost::extents[max_x][max_x][max_x]);
+    m_world.iR().resize(boost::extents[max_x][max_x][max_x]);
+    m_world.eR().resize(boost::extents[max_x][max_x][max_x]);
+    m_world.sI().resize(boost::extents[max_h][max_h][max_h]);
+    m_world.couplingConstants().resize(boost::extents[max_h][max_h][max_h]);
+
+    copySection(R1, m_world.R1().data(), cube(max_x));
+    copySection(R2, m_world.R2().data(), cube(max_x));
+    copySection(IR, m_world.iR().data(), cube(max_x));
+    copySection(ER, m_world.eR().data(), cube(max_x));
+    copySection(SI, m_world.sI().data(), cube(max_h));
+    copySection(Coupling, m_world.couplingConstants().data(), cube(max_h));
+
+    // Flat copies for the neighbors of each site
+    m_world.electronGrid().updateCouplingConstants();
+    m_world.holeGrid().updateCouplingConstants();
+}
+
+void InitCache::save()
+{
+    if (!isEnabled() || QFile::exists(m_fileName))
+    {
+        return;
+    }
+
+    const SimulationParameters &par = m_world.parameters();
+
+    QByteArray sections[SectionCount];
+    bool present[SectionCount];
+    for (int i = 0; i < SectionCount; i++)
+    {
+        present[i] = true;
+    }
+
+    sections[Defects] = fromInts(m_world.defectSiteIDs());
+    sections[Electrons] = fromInts(fromAgents(m_world.electrons()));
+    sections[Holes] = fromInts(fromAgents(m_world.holes()));
+    sections[Traps] = fromInts(m_world.trapSiteIDs());
+    sections[TrapPotentials] = fromDoubles(m_world.trapSitePotentials());
+
+    QDataStream stream(&sections[RandomState], QIODevice::WriteOnly);
+    stream << m_world.randomNumberGenerator();
+
+    // The background potential is only stored for every site without potential.analytic
+    present[Potential] = !par.potentialAnalytic;
+    if (present[Potential])
+    {
+        Grid &grid = m_world.electronGrid();
+        sections[Potential] = QByteArray(grid.volume() * int(sizeof(double)), '\0');
+        double *potential = reinterpret_cast<double*>(sections[Potential].data());
+        for (int site = 0; site < grid.volume(); site++)
+        {
+            potential[site] = grid.potential(site);
+        }
+    }
+
+    sections[R1] = fromArray(m_world.R1());
+    sections[R2] = fromArray(m_world.R2());
+    sections[IR] = fromArray(m_world.iR());
+    sections[ER] = fromArray(m_world.eR());
+    sections[SI] = fromArray(m_world.sI());
+    sections[Coupling] = fromArray(m_world.couplingConstants());
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = Version;
+    header.byteOrder = byteOrder;
+    memcpy(header.key, m_key.constData(), sizeof(header.key));
+    header.voltageLeft = par.voltageLeft;
+    header.voltageRight = par.voltageRight;
+    header.slopeZ = par.slopeZ;
+
+    QList<Entry> entries;
+    for (int i = 0; i < SectionCount; i++)
+    {
+        if (present[i])
+        {
+            Entry entry;
+            entry.section = i;
+            entry.reserved = 0;
+            entry.offset = 0;
+            entry.size = sections[i].size();
+            entries.push_back(entry);
+        }
+    }
+    header.count = entries.size();
+
+    quint64 offset = align(sizeof(Header) + entries.size() * sizeof(Entry));
+    for (int i = 0; i < entries.size(); i++)
+    {
+        entries[i].offset = offset;
+        offset = align(offset + entries[i].size);
+    }
+
+    QDir dir(par.cacheDirectory);
+    if (!dir.exists() && !dir.mkpath("."))
+    {
+        qDebug("langmuir: can not create cache directory %s", qPrintable(par.cacheDirectory));
+        return;
+    }
+
+    // Other runs may be writing the same file
+    QString temporary = QString("%1.%2").arg(m_fileName).arg(QCoreApplication::applicationPid());
+    QFile file(temporary);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qDebug("langmuir: can not write cache file %s", qPrintable(temporary));
+        return;
+    }
+
+    const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == qint64(sizeof(header));
+    for (int i = 0; i < entries.size(); i++)
+    {
+        ok = ok && file.write(reinterpret_cast<const char*>(&entries[i]), sizeof(Entry)) == qint64(sizeof(Entry));
+    }
+    for (int i = 0; i < entries.size(); i++)
+    {
+        ok = ok && file.write(padding, entries[i].offset - file.pos()) >= 0;
+        ok = ok && file.write(sections[entries[i].section]) == sections[entries[i].section].size();
+    }
+    file.close();
+
+    if (!ok || QFile::exists(m_fileName) || !QFile::rename(temporary, m_fileName))
+    {
+        QFile::remove(temporary);
+        if (!ok)
+        {
+            qDebug("langmuir: can not write cache file %s", qPrintable(temporary));
+        }
+        return;
+    }
+
+    qDebug("langmuir: wrote cache file %s", qPrintable(m_fileName));
+}
+
+const uchar *InitCache::section(Section section, quint64 &size) const
+{
+    const Header &header = *reinterpret_cast<const Header*>(m_data);
+    const Entry *entries = reinterpret_cast<const Entry*>(m_data + sizeof(Header));
+    for (quint32 i = 0; i < header.count; i++)
+    {
+        const Entry &entry = entries[i];
+        if (entry.section == quint32(section))
+        {
+            if (entry.offset % 8 != 0 || entry.offset > m_size || entry.size > m_size - entry.offset)
+            {
+                return NULL;
+            }
+            size = entry.size;
+            return m_data + entry.offset;
+        }
+    }
+    return NULL;
+}
+
+bool InitCache::copySection(Section section, double *data, quint64 count) const
+{
+    quint64 size = 0;
+    const uchar *source = InitCache::section(section, size);
+    if (source == NULL || size != count * sizeof(double))
+    {
+        qFatal("langmuir: cache file %s has an invalid section %d", qPrintable(m_fileName), int(section));
+        return false;
+    }
+    memcpy(data, source, size);
+    return true;
+}
+
+}
@@ -0,0 +1,336 @@
+#include "jobpacker.h"
+#include "nodefileparser.h"
+#include "keyvalueparser.h"
+#include "checkpointer.h"
+#include "parameters.h"
+#include "gzipper.h"
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QFile>
+#include <QDir>
+
+#include <algorithm>
+
+namespace LangmuirCore
+{
+
+namespace
+{
+
+/**
+ * @brief sort jobs by cost, most costly first
+ */
+template <class T>
+bool moreCostly(const T &a, const T &b)
+{
+    return a.cost > b.cost;
+}
+
+}
+
+JobPacker::JobPacker(const QString &manifest, int cores, int replicas, QObject *parent)
+    : QObject(parent), m_cores(cores), m_freeCores(0), m_running(0), m_failed(0), m_replicas(replicas),
+      m_loop(0)
+{
+    NodeFileParser nfparser;
+    QString hostName = nfparser.hostName();
+
+    // Use nodefile if cores wasn't given
+    if (m_cores < 0)
+    {
+        m_cores = nfparser.numProc(hostName);
+    }
+    if (m_cores < 1)
+    {
+        qFatal("langmuir: job packer needs at least 1 core");
+    }
+    m_freeCores = m_cores;
+
+    m_freeGPUs = nfparser.gpus(hostName);
+
+    parseManifest(manifest);
+}
+
+JobPacker::~JobPacker()
+{
+}
+
+void JobPacker::parseManifest(const QString &manifest)
+{
+    QFile file(manifest);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qFatal("langmuir: can not open manifest: %s", qPrintable(manifest));
+    }
+
+    // Inputs are relative to the manifest
+    QDir dir = QFileInfo(manifest).absoluteDir();
+
+    QTextStream stream(&file);
+    while (!stream.atEnd())
+    {
+        QString line = stream.readLine();
+        line = line.left(line.indexOf('#')).trimmed();
+        if (line.isEmpty())
+        {
+            continue;
+        }
+
+        QStringList tokens = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if (tokens.size() > 2)
+        {
+            qFatal("langmuir: can not parse manifest line: %s", qPrintable(line));
+        }
+
+        Job job;
+        job.fileName = QFileInfo(dir, tokens.at(0)).absoluteFilePath();
+        job.threads = 0;
+        job.useOpenCL = false;
+        job.gpuID = -1;
+        job.process = 0;
+
+        if (!QFileInfo(job.fileName).exists())
+        {
+            qFatal("langmuir: manifest input does not exist: %s", qPrintable(job.fileName));
+        }
+
+        if (tokens.size() == 2)
+        {
+            bool ok = false;
+            job.threads = tokens.at(1).toInt(&ok);
+            if (!ok || job.threads < 1)
+            {
+                qFatal("langmuir: can not parse threads in manifest line: %s", qPrintable(line));
+            }
+
+            // The manifest gives the threads of one replica
+            job.threads *= m_replicas;
+        }
+
+        job.cost = estimateCost(job.fileName, m_replicas, &job.useOpenCL);
+        m_jobs.push_back(job);
+    }
+
+    if (m_jobs.isEmpty())
+    {
+        qFatal("langmuir: manifest has no inputs: %s", qPrintable(manifest));
+    }
+
+    std::stable_sort(m_jobs.begin(), m_jobs.end(), moreCostly<Job>);
+
+    double totalCost = 0;
+    for (int i = 0; i < m_jobs.size(); i++)
+    {
+        totalCost += m_jobs[i].cost;
+    }
+
+    // Share the cores by cost, give each replica a core if possible, and
+    // never ask for more than the node has
+    int minThreads = qBound(1, m_replicas, m_cores);
+    for (int i = 0; i < m_jobs.size(); i++)
+    {
+        Job &job = m_jobs[i];
+        if (job.threads == 0)
+        {
+            job.threads = int(m_cores * job.cost / totalCost);
+        }
+        job.threads = qBound(minThreads, job.threads, m_cores);
+        m_pending.push_back(i);
+
+        qDebug("langmuir: job %d: %s (cost = %g, threads = %d%s)", i, qPrintable(job.fileName),
+               job.cost, job.threads, job.useOpenCL ? ", gpu" : "");
+    }
+}
+
+double JobPacker::estimateCost(const QString &fileName, int replicas, bool *useOpenCL)
+{
+    KeyValueParser parser;
+    SimulationParameters &par = parser.parameters();
+
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QByteArray contents = file.readAll();
+        if (isGzipped(contents))
+        {
+            contents = gunzip(contents);
+        }
+
+        // Binary checkpoints are not read, the default parameters are used
+        if (CheckPointer::isBinary(contents))
+        {
+            qDebug("langmuir: can not estimate cost of binary input %s", qPrintable(fileName));
+        }
+        else
+        {
+            // Only the [Parameters] section matters, it ends at "end" or another section
+            QTextStream stream(contents);
+            bool inParameters = false;
+            while (!stream.atEnd())
+            {
+                QString line = stream.readLine().trimmed();
+                if (line.startsWith('['))
+                {
+                    inParameters = line.startsWith("[Parameters]");
+                }
+                else if (inParameters)
+                {
+                    if (line.toLower() == "end")
+                    {
+                        inParameters = false;
+                        continue;
+                    }
+                    parser.parse(line);
+                }
+            }
+        }
+    }
+    else
+    {
+        qDebug("langmuir: can not estimate cost of %s", qPrintable(fileName));
+    }
+
+    if (useOpenCL)
+    {
+        *useOpenCL = par.useOpenCL;
+    }
+
+    double volume = double(par.gridX) * par.gridY * par.gridZ;
+    double carriers = (par.electronPercentage + par.holePercentage) * volume;
+    return qMax(1, replicas) * qMax(volume, volume * carriers);
+}
+
+int JobPacker::run()
+{
+    QEventLoop loop;
+    m_loop = &loop;
+
+    startJobs();
+    if (m_running > 0)
+    {
+        loop.exec();
+    }
+    m_loop = 0;
+
+    qDebug("langmuir: job packer finished %d jobs (%d failed)", m_jobs.size(), m_failed);
+    return m_failed;
+}
+
+void JobPacker::startJobs()
+{
+    // The most costly job that fits goes first; smaller jobs fill the gaps
+    int i = 0;
+    while (i < m_pending.size())
+    {
+        Job &job = m_jobs[m_pending.at(i)];
+
+        bool fitsCores = job.threads <= m_freeCores;
+        bool fitsGPUs = !job.useOpenCL || !m_freeGPUs.isEmpty();
+
+        if (fitsCores && fitsGPUs)
+        {
+            startJob(job);
+            m_pending.removeAt(i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    // A GPU job can not start if the node file lists no GPUs at all
+    if (m_running == 0 && !m_pending.isEmpty())
+    {
+        qFatal("langmuir: job packer can not start %s; no free GPU",
+               qPrintable(m_jobs[m_pending.first()].fileName));
+    }
+}
+
+void JobPacker::startJob(Job &job)
+{
+    if (job.useOpenCL)
+    {
+        job.gpuID = m_freeGPUs.takeFirst();
+    }
+    m_freeCores -= job.threads;
+    m_running++;
+
+    QStringList args;
+    args << "-n" << QString::number(job.threads);
+    if (job.gpuID >= 0)
+    {
+        args << "--gpu" << QString::number(job.gpuID);
+    }
+    if (m_replicas > 1)
+    {
+        args << "--replicas" << QString::number(m_replicas);
+    }
+    args << job.fileName;
+
+    job.process = new QProcess(this);
+    job.process->setWorkingDirectory(QFileInfo(job.fileName).absolutePath());
+    job.process->setProcessChannelMode(QProcess::MergedChannels);
+    job.process->setStandardOutputFile(job.fileName + ".log");
+    connect(job.process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(jobFinished(int, QProcess::ExitStatus)));
+
+    qDebug("langmuir: starting %s (threads = %d, gpu = %d)", qPrintable(job.fileName), job.threads, job.gpuID);
+    job.process->start(QCoreApplication::applicationFilePath(), args);
+    if (!job.process->waitForStarted())
+    {
+        qFatal("langmuir: can not start job %s: %s", qPrintable(job.fileName),
+               qPrintable(job.process->errorString()));
+    }
+}
+
+void JobPacker::jobFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+
+    for (int i = 0; i < m_jobs.size(); i++)
+    {
+        Job &job = m_jobs[i];
+        if (job.process == 0 || job.process != process)
+        {
+            continue;
+        }
+
+        if (exitStatus != QProcess::NormalExit || exitCode != 0)
+        {
+            qDebug("langmuir: job %s failed (%d); see %s.log", qPrintable(job.fileName), exitCode,
+                   qPrintable(job.fileName));
+            m_failed++;
+        }
+        else
+        {
+            qDebug("langmuir: job %s finished", qPrintable(job.fileName));
+        }
+
+        m_freeCores += job.threads;
+        if (job.gpuID >= 0)
+        {
+            m_freeGPUs.push_back(job.gpuID);
+        }
+        m_running--;
+
+        job.process->deleteLater();
+        job.process = 0;
+        break;
+    }
+
+    if (!m_pending.isEmpty())
+    {
+        startJobs();
+    }
+
+    if (m_running == 0 && m_loop)
+    {
+        m_loop->quit();
+    }
+}
+
+}
@@ -52,8 +52,20 @@
 // item in the work group sums up q / r terms ( only the ones its responsible for ).  Finally, the first work item in each group
 // sums up all the other work items q / r sums for the given work group and writes the answer to the global memory 'o'.
 
+// Periodic boundaries (grid.periodic.y, grid.periodic.z): the kernels take the size of the grid along y and z as ly and lz,
+// which are 0 along directions that do not wrap around.  The distance is then to the nearest image of the charge.
+int image_distance( int d, int l )
+{
+    d = abs( d );
+    if ( l > 0 && 2 * d > l )
+    {
+        d = l - d;
+    }
+    return d;
+}
+
 // coulomb1 calcules the coulomb interaction EVERYWHERE
-__kernel void coulomb1( __global double *o, __global int *s, __global int *q, int n, int c2, double prefactor )
+__kernel void coulomb1( __global double *o, __global int *s, __global int *q, int n, int c2, double prefactor, int ly, int lz )
 {
     // map 3D local work item indecies to 1D index j
     int j = get_local_id(0) +
@@ -109,9 +121,10 @@ __kernel void coulomb1( __global double *o, __global int *s, __global int *q, in
             // calcualte the distance between x,y,z and 'this work group' - remember each point in the 3D space we are calculating
             // the coulomb potential in got assigned to a work group; The assignment was done in such a way so that the work group
             // ids corresponded to the position of the point the work group is assigned to.
-            double r = ( get_group_id(0) - x ) * ( get_group_id(0) - x ) +
-                       ( get_group_id(1) - y ) * ( get_group_id(1) - y ) +
-                       ( get_group_id(2) - z ) * ( get_group_id(2) - z );
+            int dx = abs( (int) get_group_id(0) - x );
+            int dy = image_distance( (int) get_group_id(1) - y, ly );
+            int dz = image_distance( (int) get_group_id(2) - z, lz );
+            double r = dx * dx + dy * dy + dz * dz;
             // Check for cutoff and make sure r != 0 ( which happens when a charge is present at the work groups position )
             if ( r > 0 && r < c2 )
             {
@@ -136,7 +149,7 @@ __kernel void coulomb1( __global double *o, __global int *s, __global int *q, in
 }
 
 //gauss1 calcualtes the coulomb interaction with erf EVERYWHERE
-__kernel void gauss1( __global double *o, __global int *s, __global int *q, int n, int c2, double prefactor, double erffactor )
+__kernel void gauss1( __global double *o, __global int *s, __global int *q, int n, int c2, double prefactor, double erffactor, int ly, int lz )
 {
     // map 3D local work item indecies to 1D index j
     int j = get_local_id(0) +
@@ -192,9 +205,10 @@ __kernel void gauss1( __global double *o, __global int *s, __global int *q, int
             // calcualte the distance between x,y,z and 'this work group' - remember each point in the 3D space we are calculating
             // the coulomb potential in got assigned to a work group; The assignment was done in such a way so that the work group
             // ids corresponded to the position of the point the work group is assigned to.
-            double r = ( get_group_id(0) - x ) * ( get_group_id(0) - x ) +
-                       ( get_group_id(1) - y ) * ( get_group_id(1) - y ) +
-                       ( get_group_id(2) - z ) * ( get_group_id(2) - z );
+            int dx = abs( (int) get_group_id(0) - x );
+            int dy = image_distance( (int) get_group_id(1) - y, ly );
+            int dz = image_distance( (int) get_group_id(2) - z, lz );
+            double r = dx * dx + dy * dy + dz * dz;
             // Check for cutoff and make sure r != 0 ( which happens when a charge is present at the work groups position )
             if ( r > 0 && r < c2 )
             {
@@ -219,7 +233,7 @@ __kernel void gauss1( __global double *o, __global int *s, __global int *q, int
     }
 }
 
-__kernel void coulomb2( __global double *o, __global int *s, __global int *q, int n, int c2, __global int *w, int xsize, int ysize, double prefactor )
+__kernel void coulomb2( __global double *o, __global int *s, __global int *q, int n, int c2, __global int *w, int xsize, int ysize, double prefactor, int ly, int lz )
 {
     // each worker of work group loads the same charge and site, using the "work group id"
     int qi = q[ get_group_id(0) ];
@@ -266,9 +280,10 @@ __kernel void coulomb2( __global double *o, __global int *s, __global int *q, in
         int   zj = ( sj ) / ( xsize * ysize );
         int   yj = ( sj ) / ( xsize ) - ( zj * ysize );
         int   xj = ( sj ) % ( xsize );
-        double r = ( xi - xj ) * ( xi - xj ) +
-                   ( yi - yj ) * ( yi - yj ) +
-                   ( zi - zj ) * ( zi - zj );
+        int dx = abs( xi - xj );
+        int dy = image_distance( yi - yj, ly );
+        int dz = image_distance( zi - zj, lz );
+        double r = dx * dx + dy * dy + dz * dz;
 
         // compute the interaction
         if ( r > 0 && r < c2 )
@@ -293,7 +308,7 @@ __kernel void coulomb2( __global double *o, __global int *s, __global int *q, in
     }
 }
 
-__kernel void gauss2( __global double *o, __global int *s, __global int *q, int n, int c2, __global int *w, int xsize, int ysize, double prefactor, double erffactor )
+__kernel void gauss2( __global double *o, __global int *s, __global int *q, int n, int c2, __global int *w, int xsize, int ysize, double prefactor, double erffactor, int ly, int lz )
 {
     // each worker of work group loads the same charge and site, using the "work group id"
     int qi = q[ get_group_id(0) ];
@@ -340,9 +355,10 @@ __kernel void gauss2( __global double *o, __global int *s, __global int *q, int
         int   zj = ( sj ) / ( xsize * ysize );
         int   yj = ( sj ) / ( xsize ) - ( zj * ysize );
         int   xj = ( sj ) % ( xsize );
-        double r = ( xi - xj ) * ( xi - xj ) +
-                   ( yi - yj ) * ( yi - yj ) +
-                   ( zi - zj ) * ( zi - zj );
+        int dx = abs( xi - xj );
+        int dy = image_distance( yi - yj, ly );
+        int dz = image_distance( zi - zj, lz );
+        double r = dx * dx + dy * dy + dz * dz;
 
         // compute the interaction
         if ( r > 0 && r < c2 )
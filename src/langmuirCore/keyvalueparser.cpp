@@ -9,21 +9,36 @@
 namespace LangmuirCore
 {
 
-KeyValueParser::KeyValueParser(World &world, QObject *parent) :
-    QObject(parent), m_world(world)
+KeyValueParser::KeyValueParser(QObject *parent) :
+    QObject(parent)
 {
     registerVariable("simulation.type", m_parameters.simulationType);
     registerVariable("current.step", m_parameters.currentStep);
     registerVariable("iterations.real", m_parameters.iterationsReal);
     registerVariable("random.seed", m_parameters.randomSeed);
+    registerVariable("random.engine", m_parameters.randomEngine);
 
     registerVariable("grid.z", m_parameters.gridZ);
     registerVariable("grid.y", m_parameters.gridY);
     registerVariable("grid.x", m_parameters.gridX);
+    registerVariable("grid.tiled", m_parameters.gridTiled);
+    registerVariable("grid.sparse", m_parameters.gridSparse);
+    registerVariable("grid.periodic.y", m_parameters.gridPeriodicY);
+    registerVariable("grid.periodic.z", m_parameters.gridPeriodicZ);
+    registerVariable("potential.analytic", m_parameters.potentialAnalytic);
     registerVariable("hopping.range", m_parameters.hoppingRange);
+    registerVariable("hopping.spherical", m_parameters.hoppingSpherical);
+    registerVariable("hopping.alias", m_parameters.hoppingAlias);
+    registerVariable("metropolis.fast", m_parameters.metropolisFast);
+    registerVariable("metropolis.fast.memory", m_parameters.metropolisFastMemory);
 
     registerVariable("output.is.on", m_parameters.outputIsOn);
+    registerVariable("output.async", m_parameters.outputAsync);
+    registerVariable("output.queue.size", m_parameters.outputQueueSize);
     registerVariable("iterations.print", m_parameters.iterationsPrint);
+    registerVariable("convergence.error", m_parameters.convergenceError);
+    registerVariable("convergence.min.steps", m_parameters.convergenceMinSteps);
+    registerVariable("convergence.batches", m_parameters.convergenceBatches);
     registerVariable("output.precision", m_parameters.outputPrecision);
     registerVariable("output.width", m_parameters.outputWidth);
     registerVariable("output.stub", m_parameters.outputStub);
@@ -33,6 +48,8 @@ KeyValueParser::KeyValueParser(World &world, QObject *parent) :
     registerVariable("output.coulomb", m_parameters.outputCoulomb);
     registerVariable("output.step.chk", m_parameters.outputStepChk);
     registerVariable("output.chk.trap.potential", m_parameters.outputChkTrapPotential);
+    registerVariable("output.chk.format", m_parameters.outputChkFormat);
+    registerVariable("output.gzip", m_parameters.outputGzip);
     registerVariable("output.potential", m_parameters.outputPotential);
 
     registerVariable("output.xyz", m_parameters.outputXyz);
@@ -41,6 +58,8 @@ KeyValueParser::KeyValueParser(World &world, QObject *parent) :
     registerVariable("output.xyz.d", m_parameters.outputXyzD);
     registerVariable("output.xyz.t", m_parameters.outputXyzT);
     registerVariable("output.xyz.mode", m_parameters.outputXyzMode);
+    registerVariable("output.xyz.format", m_parameters.outputXyzFormat);
+    registerVariable("output.xyz.keyframe", m_parameters.outputXyzKeyframe);
 
     registerVariable("image.traps", m_parameters.imageTraps);
     registerVariable("image.defects", m_parameters.imageDefects);
@@ -54,6 +73,8 @@ KeyValueParser::KeyValueParser(World &world, QObject *parent) :
     registerVariable("trap.potential", m_parameters.trapPotential);
     registerVariable("gaussian.stdev", m_parameters.gaussianStdev);
     registerVariable("seed.percentage", m_parameters.seedPercentage);
+    registerVariable("placement.algorithm", m_parameters.placementAlgorithm);
+    registerVariable("cache.directory", m_parameters.cacheDirectory);
 
     registerVariable("voltage.right", m_parameters.voltageRight);
     registerVariable("voltage.left", m_parameters.voltageLeft);
@@ -63,6 +84,8 @@ KeyValueParser::KeyValueParser(World &world, QObject *parent) :
     registerVariable("defects.charge", m_parameters.defectsCharge);
     registerVariable("exciton.binding", m_parameters.excitonBinding);
     registerVariable("temperature.kelvin", m_parameters.temperatureKelvin);
+    registerVariable("sweep.voltage.right", m_parameters.sweepVoltageRight);
+    registerVariable("sweep.temperature.kelvin", m_parameters.sweepTemperatureKelvin);
 
     registerVariable("source.rate", m_parameters.sourceRate);
     registerVariable("e.source.l.rate", m_parameters.eSourceLRate);
@@ -74,6 +97,7 @@ KeyValueParser::KeyValueParser(World &world, QObject *parent) :
     registerVariable("source.coulomb", m_parameters.sourceCoulomb);
     registerVariable("source.scale.area", m_parameters.sourceScaleArea);
     registerVariable("balance.charges", m_parameters.balanceCharges);
+    registerVariable("free.site.index", m_parameters.freeSiteIndex);
 
     registerVariable("drain.rate", m_parameters.drainRate);
     registerVariable("e.drain.l.rate", m_parameters.eDrainLRate);
@@ -83,6 +107,7 @@ KeyValueParser::KeyValueParser(World &world, QObject *parent) :
 
     registerVariable("recombination.rate", m_parameters.recombinationRate);
     registerVariable("recombination.range", m_parameters.recombinationRange);
+    registerVariable("recombination.parallel", m_parameters.recombinationParallel);
 
     registerVariable("use.opencl", m_parameters.useOpenCL);
     registerVariable("work.x", m_parameters.workX);
@@ -90,8 +115,12 @@ KeyValueParser::KeyValueParser(World &world, QObject *parent) :
     registerVariable("work.z", m_parameters.workZ);
     registerVariable("work.size", m_parameters.workSize);
     registerVariable("opencl.threshold", m_parameters.openclThreshold);
+    registerVariable("coulomb.tuner.interval", m_parameters.coulombTunerInterval);
+    registerVariable("coulomb.tuner.samples", m_parameters.coulombTunerSamples);
+    registerVariable("coulomb.tuner.hysteresis", m_parameters.coulombTunerHysteresis);
     registerVariable("opencl.device.id", m_parameters.openclDeviceID);
     registerVariable("max.threads", m_parameters.maxThreads);
+    registerVariable("threads.affinity", m_parameters.threadsAffinity);
 
     registerVariable("boltzmann.constant", m_parameters.boltzmannConstant, Variable::Constant);
     registerVariable("dielectric.constant", m_parameters.dielectricConstant, Variable::Constant);
@@ -174,8 +203,8 @@ void KeyValueParser::parse(const QString &line)
 
 void KeyValueParser::save(const QString& fileName)
 {
-    if (!m_world.parameters().outputIsOn) return;
-    OutputInfo info(fileName, &m_world.parameters());
+    if (!m_parameters.outputIsOn) return;
+    OutputInfo info(fileName, &m_parameters);
     QFile handle(info.absoluteFilePath());
     if (!handle.open(QIODevice::WriteOnly|QIODevice::Text))
     {
@@ -131,12 +131,18 @@ void OpenClHelper::initializeOpenCL(int gpuID)
             erffactor = 1.0 / erffactor;
         }
 
+        // the grid size along periodic directions, 0 otherwise
+        int ly = m_world.parameters().gridPeriodicY ? m_world.parameters().gridY : 0;
+        int lz = m_world.parameters().gridPeriodicZ ? m_world.parameters().gridZ : 0;
+
         // coulomb kernel 1
         m_coulomb1K.setArg(0, m_oDevice);
         m_coulomb1K.setArg(1, m_sDevice);
         m_coulomb1K.setArg(2, m_qDevice);
         m_coulomb1K.setArg(4, cutoff2);
         m_coulomb1K.setArg(5, m_world.parameters().electrostaticPrefactor);
+        m_coulomb1K.setArg(6, ly);
+        m_coulomb1K.setArg(7, lz);
 
         // gauss kernel 1
         m_guass1K.setArg(0, m_oDevice);
@@ -145,6 +151,8 @@ void OpenClHelper::initializeOpenCL(int gpuID)
         m_guass1K.setArg(4, cutoff2);
         m_guass1K.setArg(5, m_world.parameters().electrostaticPrefactor);
         m_guass1K.setArg(6, erffactor);
+        m_guass1K.setArg(7, ly);
+        m_guass1K.setArg(8, lz);
 
         // coulomb kernel 2
         m_coulomb2K.setArg(0, m_oDevice);
@@ -155,6 +163,8 @@ void OpenClHelper::initializeOpenCL(int gpuID)
         m_coulomb2K.setArg(6, m_world.parameters().gridX);
         m_coulomb2K.setArg(7, m_world.parameters().gridY);
         m_coulomb2K.setArg(8, m_world.parameters().electrostaticPrefactor);
+        m_coulomb2K.setArg(9, ly);
+        m_coulomb2K.setArg(10, lz);
 
         // gauss kernel 2
         m_guass2K.setArg(0, m_oDevice);
@@ -166,6 +176,8 @@ void OpenClHelper::initializeOpenCL(int gpuID)
         m_guass2K.setArg(7, m_world.parameters().gridY);
         m_guass2K.setArg(8, m_world.parameters().electrostaticPrefactor);
         m_guass2K.setArg(9, erffactor);
+        m_guass2K.setArg(10, ly);
+        m_guass2K.setArg(11, lz);
 
         //force queues to finish
         m_queue.finish();
@@ -1,4 +1,5 @@
 #include "output.h"
+#include "gzipper.h"
 
 #include <QDateTime>
 #include <QFileInfo>
@@ -62,7 +63,7 @@ OutputInfo::OutputInfo(const QString &name, const SimulationParameters *par)
 OutputStream::OutputStream(const QString &name,
            const SimulationParameters *par,
            QObject *parent)
-    : QObject(parent), m_info(name,par)
+    : QObject(parent), m_info(name,par), m_gzip(0)
 {
     // open as Text and as WriteOnly, it's an OutputStream
     QIODevice::OpenMode mode = QIODevice::Text|QIODevice::WriteOnly|QIODevice::Append;
@@ -80,6 +81,17 @@ OutputStream::OutputStream(const QString &name,
                qPrintable(m_info.absoluteFilePath()));
     }
 
+    // compress files named *.gz (a new gzip member is started if the file is appended to)
+    if (m_info.suffix() == "gz")
+    {
+        m_gzip = new GzipDevice(&m_file, 6, this);
+        m_gzip->open(QIODevice::WriteOnly);
+
+        // set the compressor as our device (this class is derived from QTextStream)
+        setDevice(m_gzip);
+        return;
+    }
+
     // set the file as our device (this class is derived from QTextStream)
     setDevice(&m_file);
 }
@@ -89,9 +101,23 @@ OutputStream::~OutputStream()
     // make sure the stream is flushed and the the file is closed
     // this probabily happens already, just making sure
     flush();
+    if (m_gzip)
+    {
+        m_gzip->close();
+    }
     m_file.close();
 }
 
+void OutputStream::flush()
+{
+    QTextStream::flush();
+    if (m_gzip)
+    {
+        m_gzip->flush();
+    }
+    m_file.flush();
+}
+
 const OutputInfo& OutputStream::info()
 {
     return m_info;
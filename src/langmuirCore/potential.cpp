@@ -2,6 +2,7 @@
 #include "parameters.h"
 #include "chargeagent.h"
 #include "cubicgrid.h"
+#include "siteplacer.h"
 #include "world.h"
 #include "rand.h"
 #include <cmath>
@@ -17,11 +18,7 @@ Potential::Potential(World &world, QObject *parent)
 void Potential::setPotentialZero()
 {
     qDebug("langmuir: setting potential to zero");
-    for(int i = 0; i < m_world.electronGrid().volume(); i++)
-    {
-        m_world.electronGrid().setPotential(i, 0);
-        m_world.holeGrid().setPotential(i, 0);
-    }
+    m_world.electronGrid().setPotentialZero();
 }
 
 void Potential::setPotentialLinear()
@@ -30,22 +27,33 @@ void Potential::setPotentialLinear()
     double VR = m_world.parameters().voltageRight;
     double LX = double(m_world.electronGrid().xSize());
     double m  =(VR - VL) / LX;
-    double b  = VL;
 
     qDebug("langmuir: adding a linear potential with slope %.3g V/nm", m);
-    for(int i = 0; i < m_world.electronGrid().xSize(); i++)
+    addPotentialLinear(VL, VR);
+}
+
+void Potential::updatePotentialLinear(double voltageLeft, double voltageRight)
+{
+    double dVL = m_world.parameters().voltageLeft - voltageLeft;
+    double dVR = m_world.parameters().voltageRight - voltageRight;
+    if (dVL == 0 && dVR == 0)
     {
-        for(int j = 0; j < m_world.electronGrid().ySize(); j++)
-        {
-            for(int k = 0; k < m_world.electronGrid().zSize(); k++)
-            {
-                int s = m_world.electronGrid().getIndexS(i, j, k);
-                double v = m *(i + 0.5)+ b;
-                m_world.electronGrid().addToPotential(s, v);
-                m_world.holeGrid().addToPotential(s, v);
-            }
-        }
+        return;
     }
+
+    qDebug("langmuir: updating the linear potential from (%.3g, %.3g) V to (%.3g, %.3g) V",
+           voltageLeft, voltageRight,
+           m_world.parameters().voltageLeft, m_world.parameters().voltageRight);
+    addPotentialLinear(dVL, dVR);
+}
+
+void Potential::addPotentialLinear(double VL, double VR)
+{
+    double LX = double(m_world.electronGrid().xSize());
+    double m  =(VR - VL) / LX;
+    double b  = VL;
+
+    m_world.electronGrid().addToPotentialLinear(m, b);
 }
 
 void Potential::setPotentialGate()
@@ -56,19 +64,7 @@ void Potential::setPotentialGate()
     }
 
     qDebug("langmuir: adding gate potential with slope %.3g", m_world.parameters().slopeZ);
-    for(int i = 0; i < m_world.electronGrid().xSize(); i++)
-    {
-        for(int j = 0; j < m_world.electronGrid().ySize(); j++)
-        {
-            for(int k = 0; k < m_world.electronGrid().zSize(); k++)
-            {
-                int s = m_world.electronGrid().getIndexS(i, j, k);
-                double v = m_world.parameters().slopeZ *(k + 0.5);
-                m_world.electronGrid().addToPotential(s, v);
-                m_world.holeGrid().addToPotential(s, v);
-            }
-        }
-    }
+    m_world.electronGrid().addToPotentialGate(m_world.parameters().slopeZ);
 }
 
 void Potential::setPotentialTraps(const QList<int> &trapIDs,
@@ -131,23 +127,24 @@ void Potential::setPotentialTraps(const QList<int> &trapIDs,
     QList<double> potentials;
     QList<int>         traps;
 
+    // Sites already used are marked here, so checking a site is cheap
+    SitePlacer placer(m_world, m_world.electronGrid(),
+                      SitePlacer::toAlgorithm(m_world.parameters().placementAlgorithm));
+
     // First, place the forced traps
     if (toBePlacedForced > 0)
     {
         qDebug("langmuir: placing %d traps in checkpoint file", toBePlacedForced);
-        if (trapPotentials.size() != 0)
+        for (int i = 0; i < toBePlacedForced; i++)
         {
-            for (int i = 0; i < toBePlacedForced; i++)
+            traps.push_back(trapIDs.at(i));
+            placer.take(trapIDs.at(i));
+            if (trapPotentials.size() != 0)
             {
-                traps.push_back(trapIDs.at(i));
                 potentials.push_back(trapPotentials.at(i));
             }
-        }
-        else
-        {
-            for (int i = 0; i < toBePlacedForced; i++)
+            else
             {
-                traps.push_back(trapIDs.at(i));
                 potentials.push_back(m_world.parameters().trapPotential);
             }
         }
@@ -160,52 +157,14 @@ void Potential::setPotentialTraps(const QList<int> &trapIDs,
     // Place homogeneous traps
     if (toBePlacedRandomly > 0)
     {
-        // Place the seeds
-        if (toBePlacedSeeds > 0)
-        {
-            qDebug("langmuir: placing %d seeds", toBePlacedSeeds);
-            int progress = 0;
-            while (progress < toBePlacedSeeds)
-            {
-                int s = m_world.randomNumberGenerator().integer(0,
-                            m_world.electronGrid().volume() - 1);
-                if ( ! randomIDs.contains(s) && ! traps.contains(s) )
-                {
-                    randomIDs.push_back(s);
-                    randomPotentials.push_back(m_world.parameters().trapPotential);
-                    ++progress;
-                }
-            }
-        }
-
-        // Place the grown (if 0, does nothing)
-        if (toBePlacedGrown > 0)
+        // Place the seeds, then grow them (if 0, does nothing)
+        qDebug("langmuir: placing %d seeds", toBePlacedSeeds);
+        qDebug("langmuir: growing %d traps", toBePlacedGrown);
+        randomIDs = placer.seedAndGrow(m_world.randomNumberGenerator(),
+                                       toBePlacedSeeds, toBePlacedGrown);
+        for (int i = 0; i < randomIDs.size(); i++)
         {
-            qDebug("langmuir: growing %d traps", toBePlacedGrown);
-            int progress = 0;
-            while (progress < toBePlacedGrown)
-            {
-                int trapSeedIndex = m_world.randomNumberGenerator().integer(0,
-                                        randomIDs.size() - 1);
-                int trapSeedSite = randomIDs.at(trapSeedIndex);
-                QVector<int> trapSeedNeighbors = m_world.electronGrid().neighborsSite(
-                                        trapSeedSite, 1);
-
-                int newTrapIndex = m_world.randomNumberGenerator().integer(0,
-                                        trapSeedNeighbors.size() - 1);
-                int newTrapSite = trapSeedNeighbors[newTrapIndex];
-                if(m_world.electronGrid().agentType(newTrapSite)!= Agent::Source &&
-                   m_world.electronGrid().agentType(newTrapSite)!= Agent::Drain &&
-                   m_world.holeGrid().agentType(newTrapSite)!= Agent::Source &&
-                   m_world.holeGrid().agentType(newTrapSite)!= Agent::Drain &&
-                   !randomIDs.contains(newTrapSite) &&
-                   !traps.contains(newTrapSite))
-                {
-                    randomIDs.push_back(newTrapSite);
-                    randomPotentials.push_back(m_world.parameters().trapPotential);
-                    ++progress;
-                }
-            }
+            randomPotentials.push_back(m_world.parameters().trapPotential);
         }
 
         // Apply a deviation to the trap energies (only the randomly generated ones)
@@ -239,7 +198,6 @@ void Potential::setPotentialTraps(const QList<int> &trapIDs,
         int s = traps.at(i);
         double v = potentials.at(i);
         m_world.electronGrid().addToPotential(s,v);
-        m_world.holeGrid().addToPotential(s,v);
     }
 }
 
@@ -346,6 +304,10 @@ void Potential::updateCouplingConstants()
         }
     }
     constants[0][0][0] = 0;
+
+    // Flat copies for the neighbors of each site
+    m_world.electronGrid().updateCouplingConstants();
+    m_world.holeGrid().updateCouplingConstants();
 }
 
 double Potential::coulombE(int site_i)
@@ -357,6 +319,9 @@ double Potential::coulombE(int site_i)
     QList<ChargeAgent*>& charges = m_world.electrons();
     Grid &grid = m_world.electronGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -365,9 +330,12 @@ double Potential::coulombE(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = abs(xi - xj);
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -390,6 +358,9 @@ double Potential::coulombImageE(int site_i)
     QList<ChargeAgent*>& charges = m_world.electrons();
     Grid &grid = m_world.electronGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -398,9 +369,12 @@ double Potential::coulombImageE(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xImageDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = xi + xj + 1;
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -423,6 +397,9 @@ double Potential::gaussE(int site_i)
     QList<ChargeAgent*>& charges = m_world.electrons();
     Grid &grid = m_world.electronGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -431,9 +408,12 @@ double Potential::gaussE(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = abs(xi - xj);
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -456,6 +436,9 @@ double Potential::gaussImageE(int site_i)
     QList<ChargeAgent*>& charges = m_world.electrons();
     Grid &grid = m_world.electronGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -464,9 +447,12 @@ double Potential::gaussImageE(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xImageDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = xi + xj + 1;
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -489,6 +475,9 @@ double Potential::coulombH(int site_i)
     QList<ChargeAgent*>& charges = m_world.holes();
     Grid &grid = m_world.holeGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -497,9 +486,12 @@ double Potential::coulombH(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = abs(xi - xj);
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -522,6 +514,9 @@ double Potential::coulombImageH(int site_i)
     QList<ChargeAgent*>& charges = m_world.holes();
     Grid &grid = m_world.holeGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -530,9 +525,12 @@ double Potential::coulombImageH(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xImageDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = xi + xj + 1;
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -555,6 +553,9 @@ double Potential::gaussH(int site_i)
     QList<ChargeAgent*>& charges = m_world.holes();
     Grid &grid = m_world.holeGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -563,9 +564,12 @@ double Potential::gaussH(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = abs(xi - xj);
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -588,6 +592,9 @@ double Potential::gaussImageH(int site_i)
     QList<ChargeAgent*>& charges = m_world.holes();
     Grid &grid = m_world.holeGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     for (int i = 0; i < charges.size(); i++)
@@ -596,9 +603,12 @@ double Potential::gaussImageH(int site_i)
         ChargeAgent& charge = *charges[i];
         int site_j = charge.getCurrentSite();
 
-        int dx = grid.xImageDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = xi + xj + 1;
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dy < cutoff) && (dz < cutoff))
         {
@@ -620,6 +630,9 @@ double Potential::coulombD(int site_i)
     boost::multi_array<double, 3>& iR = m_world.iR();
     Grid &grid = m_world.electronGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     if (charge == 0)
@@ -631,9 +644,12 @@ double Potential::coulombD(int site_i)
     {
         int site_j = m_world.defectSiteIDs()[i];
 
-        int dx = grid.xDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = abs(xi - xj);
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dz < cutoff) && (dy < cutoff))
         {
@@ -655,6 +671,9 @@ double Potential::coulombImageD(int site_i)
     boost::multi_array<double, 3>& iR = m_world.iR();
     Grid &grid = m_world.electronGrid();
 
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
+
     double potential = 0.0;
 
     if (charge == 0)
@@ -666,9 +685,12 @@ double Potential::coulombImageD(int site_i)
     {
         int site_j = m_world.defectSiteIDs()[i];
 
-        int dx = grid.xImageDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = xi + xj + 1;
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dz < cutoff) && (dy < cutoff))
         {
@@ -690,6 +712,9 @@ double Potential::gaussD(int site_i)
     boost::multi_array<double, 3>& iR = m_world.iR();
     boost::multi_array<double, 3>& eR = m_world.eR();
     Grid &grid = m_world.electronGrid();
+
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
     double potential = 0.0;
 
     if (charge == 0)
@@ -701,9 +726,12 @@ double Potential::gaussD(int site_i)
     {
         int site_j = m_world.defectSiteIDs()[i];
 
-        int dx = grid.xDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = abs(xi - xj);
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dz < cutoff) && (dy < cutoff))
         {
@@ -725,6 +753,9 @@ double Potential::gaussImageD(int site_i)
     boost::multi_array<double, 3>& iR = m_world.iR();
     boost::multi_array<double, 3>& eR = m_world.eR();
     Grid &grid = m_world.electronGrid();
+
+    int xi, yi, zi;
+    grid.getIndexXYZ(site_i, xi, yi, zi);
     double potential = 0.0;
 
     if (charge == 0)
@@ -736,9 +767,12 @@ double Potential::gaussImageD(int site_i)
     {
         int site_j = m_world.defectSiteIDs()[i];
 
-        int dx = grid.xImageDistancei(site_i, site_j);
-        int dy = grid.yDistancei(site_i, site_j);
-        int dz = grid.zDistancei(site_i, site_j);
+        int xj, yj, zj;
+        grid.getIndexXYZ(site_j, xj, yj, zj);
+
+        int dx = xi + xj + 1;
+        int dy = grid.yIndexDistance(yi, yj);
+        int dz = grid.zIndexDistance(zi, zj);
 
         if ((dx < cutoff) && (dz < cutoff) && (dy < cutoff))
         {
@@ -1,10 +1,14 @@
 #include "rand.h"
 #include <fstream>
 #include <sstream>
+#include <cctype>
 
 namespace LangmuirCore
 {
 
+// Marks the state of an engine other than the twister, whose words are all below 2^32
+static const quint64 stateTag = Q_UINT64_C(0x52414E4400000000);
+
 Random::Random(quint64 seed, QObject *parent) : QObject(parent)
 {
     m_seed = 0;
@@ -16,16 +20,122 @@ Random::Random(quint64 seed, QObject *parent) : QObject(parent)
     {
         m_seed = static_cast < unsigned int >(seed);
     }
-    twister = new boost::mt19937(m_seed);
-
-    boost::uniform_01< double > distribution;
-    generator01 = new boost::variate_generator < boost::mt19937 &, boost::uniform_01 < double > >(*twister, distribution);
+    m_engine = 0;
+    m_blockStart = 0;
+    m_buffer = static_cast<quint32*>(qMallocAligned(BufferSize * sizeof(quint32), 64));
+    createEngine(RandomEngine::MT19937);
+    m_engine->seed(m_seed);
+    resetBuffer();
 }
 
 Random::~Random()
 {
-    delete twister;
-    delete generator01;
+    delete m_engine;
+    delete m_blockStart;
+    qFreeAligned(m_buffer);
+}
+
+void Random::createEngine(RandomEngine::Type type)
+{
+    delete m_engine;
+    delete m_blockStart;
+    m_engine = RandomEngine::create(type);
+    m_blockStart = m_engine->clone();
+}
+
+void Random::refill()
+{
+    m_blockStart->assign(*m_engine);
+    m_engine->generate(m_buffer, BufferSize);
+    m_position = 0;
+    m_available = BufferSize;
+}
+
+void Random::resetBuffer()
+{
+    m_blockStart->assign(*m_engine);
+    m_position = 0;
+    m_available = 0;
+}
+
+QList<quint64> Random::engineState()
+{
+    RandomEngine *engine = m_blockStart->clone();
+    engine->discard(m_position);
+    QList<quint64> state = engine->state();
+    delete engine;
+    return state;
+}
+
+QList<quint64> Random::saveState()
+{
+    QList<quint64> state = engineState();
+    if (m_engine->type() != RandomEngine::MT19937)
+    {
+        state.push_front(stateTag | quint64(m_engine->type()));
+    }
+    return state;
+}
+
+void Random::loadState(const QList<quint64> &state)
+{
+    // A list without a tag is the state of the twister
+    QList<quint64> words = state;
+    RandomEngine::Type type = RandomEngine::MT19937;
+    if (!words.isEmpty() && (words.first() & Q_UINT64_C(0xFFFFFFFF00000000)) == stateTag)
+    {
+        quint64 value = words.first() & Q_UINT64_C(0xFFFFFFFF);
+        if (value > quint64(RandomEngine::Philox))
+        {
+            qFatal("langmuir: can not load state of random number generator; unknown engine %d",
+                   int(value));
+        }
+        type = RandomEngine::Type(value);
+        words.removeFirst();
+    }
+    loadEngineState(type, words);
+}
+
+void Random::loadEngineState(RandomEngine::Type type, const QList<quint64> &state)
+{
+    if (m_engine->type() != type)
+    {
+        createEngine(type);
+    }
+    if (!m_engine->setState(state))
+    {
+        qFatal("langmuir: can not load state of random number generator; "
+               "invalid state for %s", qPrintable(RandomEngine::name(type)));
+    }
+    resetBuffer();
+}
+
+void Random::setEngine(RandomEngine::Type type)
+{
+    if (m_engine->type() == type)
+    {
+        return;
+    }
+    createEngine(type);
+    m_engine->seed(m_seed);
+    resetBuffer();
+}
+
+RandomEngine::Type Random::engine() const
+{
+    return m_engine->type();
+}
+
+void Random::setStream(quint64 stream)
+{
+    if (m_engine->type() == RandomEngine::MT19937)
+    {
+        // The twister has no streams; use the next seeds, as replicas always have
+        seed(m_seed + stream);
+        return;
+    }
+    m_engine->setStream(m_seed, stream);
+    resetBuffer();
 }
 
 quint64 Random::seed()
@@ -43,33 +153,33 @@ void Random::seed(quint64 seed)
     {
         m_seed = static_cast < unsigned int >(seed);
     }
-    twister->seed(m_seed);
-}
-
-double Random::random()
-{
-    return(*generator01)();
+    m_engine->seed(m_seed);
+    resetBuffer();
 }
 
 double Random::range(const double low, const double high)
 {
-    boost::uniform_real < double > distribution(low, high);
-    boost::variate_generator < boost::mt19937 &, boost::uniform_real < double > >generator(*twister, distribution);
-    return generator();
+    if (high <= low)
+    {
+        return low;
+    }
+
+    // Same as boost::uniform_real on a 32-bit engine
+    for (;;)
+    {
+        double result = random() * (high - low) + low;
+        if (result < high)
+        {
+            return result;
+        }
+    }
 }
 
 double Random::normal(const double mean, const double sigma)
 {
+    Adapter adapter = { *this };
     boost::normal_distribution<double> distribution(mean, sigma);
-    boost::variate_generator < boost::mt19937 &, boost::normal_distribution < double > >  generator(*twister, distribution);
-    return generator();
-}
-
-int Random::integer(const int low, const int high)
-{
-    boost::uniform_int < int > distribution(low, high);
-    boost::variate_generator < boost::mt19937 &, boost::uniform_int < int > >generator(*twister, distribution);
-    return generator();
+    return distribution(adapter);
 }
 
 bool Random::metropolis(double energyChange, double inversekT)
@@ -105,6 +215,27 @@ bool Random::metropolisWithCoupling(double energyChange, double inversekT, doubl
     return false;
 }
 
+bool Random::metropolisWithCouplingFast(double energyChange, double inversekT, double coupling)
+{
+    double randNumber = this->random();
+    if(energyChange <= 0.0 || randNumber >= coupling)
+    {
+        return coupling > randNumber;
+    }
+
+    // For x > 0: 1 - x + x^2/2 - x^3/6 <= exp(-x) <= 1 / (1 + x + x^2/2)
+    double x = energyChange * inversekT;
+    if(coupling * (1.0 - x * (1.0 - x * (0.5 - x / 6.0))) > randNumber)
+    {
+        return true;
+    }
+    if(coupling <= randNumber * (1.0 + x * (1.0 + 0.5 * x)))
+    {
+        return false;
+    }
+    return coupling * exp(-x) > randNumber;
+}
+
 bool Random::chooseNo(double percent)
 {
     if(percent < this->random())
@@ -125,28 +256,8 @@ bool Random::chooseYes(double percent)
 
 QDataStream& operator<<(QDataStream& stream, Random& random)
 {
-    std::stringstream sstream;
-    sstream << *random.twister;
-    if (sstream.fail() || sstream.bad())
-    {
-        qFatal("langmuir: can not save state of random number generator to QDataStream; "
-               "std::stringstream has failed on write");
-    }
-    QList<quint64> state;
-    quint64 value;
-    sstream >> value;
-    while(!sstream.eof())
-    {
-        if (sstream.fail() || sstream.bad())
-        {
-            qFatal("langmuir: can not save state of random number generator to QDataStream; "
-                   "std::stringstream has failed on read");
-        }
-        state.push_back(value);
-        sstream >> value;
-    }
     stream << quint64(random.m_seed);
-    stream << state;
+    stream << random.saveState();
     return stream;
 }
 
@@ -205,47 +316,13 @@ QDataStream& operator>>(QDataStream& stream, Random& random)
     break;
     }
     }
-    std::stringstream sstream;
-    for (int i = 0; i < state.size(); i++)
-    {
-        sstream << state.at(i) << " ";
-        if (sstream.fail() || sstream.bad())
-        {
-            qFatal("langmuir: can not load state of random number generator from QDataStream; "
-                   "std::stringstream has failed on write");
-        }
-    }
-    sstream >> *random.twister;
-    if (sstream.fail() || sstream.bad())
-    {
-        qFatal("langmuir: can not load state of random number generator from QDataStream; "
-               "std::stringstream has failed on read");
-    }
+    random.loadState(state);
     return stream;
 }
 
 QTextStream& operator<<(QTextStream& stream, Random& random)
 {
-    std::stringstream sstream;
-    sstream << *random.twister;
-    if (sstream.fail() || sstream.bad())
-    {
-        qFatal("langmuir: can not save state of random number generator to QTextStream; "
-               "std::stringstream has failed on write");
-    }
-    QList<quint64> state;
-    quint64 value;
-    sstream >> value;
-    while(!sstream.eof())
-    {
-        if (sstream.fail() || sstream.bad())
-        {
-            qFatal("langmuir: can not save state of random number generator to QTextStream; "
-                   "std::stringstream has failed on read");
-        }
-        state.push_back(value);
-        sstream >> value;
-    }
+    QList<quint64> state = random.saveState();
     stream << quint64(random.m_seed);
     stream << " " << quint64(state.size());
     for (int i = 0; i < state.size(); i++)
@@ -310,7 +387,7 @@ QTextStream& operator>>(QTextStream& stream, Random& random)
     break;
     }
     }
-    std::stringstream sstream;
+    QList<quint64> state;
     for (int i = 0; i < int(size); i++)
     {
         quint64 value = 0;
@@ -340,26 +417,25 @@ QTextStream& operator>>(QTextStream& stream, Random& random)
         break;
         }
         }
-        sstream << value << " ";
-        if (sstream.fail() || sstream.bad())
-        {
-            qFatal("langmuir: can not load state of random number generator from QTextStream; state.at(%d)"
-                   "std::stringstream has failed on write", i);
-        }
-    }
-    sstream >> *random.twister;
-    if (sstream.fail() || sstream.bad())
-    {
-        qFatal("langmuir: can not load state of random number generator from QTextStream; "
-               "std::stringstream has failed on read");
+        state.push_back(value);
     }
+    random.loadState(state);
     return stream;
 }
 
 std::ostream& operator<<(std::ostream& stream, Random& random)
 {
+    // The twister is written as before, other engines after their name
     stream << random.m_seed << ' ';
-    stream << *random.twister;
+    if (random.engine() != RandomEngine::MT19937)
+    {
+        stream << qPrintable(RandomEngine::name(random.engine())) << ' ';
+    }
+    QList<quint64> state = random.engineState();
+    for (int i = 0; i < state.size(); i++)
+    {
+        stream << state.at(i) << ' ';
+    }
     return stream;
 }
 
@@ -371,12 +447,39 @@ std::istream& operator>>(std::istream& stream, Random& random)
         qFatal("langmuir: can not load state of random number generator; random.m_seed\n"
                "std::ifstream has failed on write");
     }
-    stream >> *random.twister;
-    if (stream.fail() || stream.bad() || stream.eof())
+
+    // Older checkpoints have no name, and are the state of the twister
+    RandomEngine::Type type = RandomEngine::MT19937;
+    stream >> std::ws;
+    if (std::isalpha(stream.peek()))
+    {
+        std::string name;
+        stream >> name;
+        if (!RandomEngine::isValidName(QString::fromStdString(name)))
+        {
+            qFatal("langmuir: can not load state of random number generator; unknown engine %s",
+                   name.c_str());
+        }
+        type = RandomEngine::toType(QString::fromStdString(name));
+    }
+
+    RandomEngine *engine = RandomEngine::create(type);
+    int size = engine->stateSize();
+    delete engine;
+
+    QList<quint64> state;
+    for (int i = 0; i < size; i++)
     {
-        qFatal("langmuir: can not load state of random number generator; twister\n"
-               "std::ifstream has failed on write");
+        quint64 value = 0;
+        stream >> value;
+        if (stream.fail() || stream.bad())
+        {
+            qFatal("langmuir: can not load state of random number generator; state.at(%d)\n"
+                   "std::ifstream has failed on write", i);
+        }
+        state.push_back(value);
     }
+    random.loadEngineState(type, state);
     return stream;
 }
 
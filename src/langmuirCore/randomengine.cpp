@@ -0,0 +1,613 @@
+#include "randomengine.h"
+#include "rand.h"
+
+#include <sstream>
+
+namespace LangmuirCore
+{
+
+static quint64 splitMix64(quint64 &x)
+{
+    quint64 z = (x += Q_UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+static inline quint64 rotateLeft(quint64 x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief boost::mt19937
+ */
+class MT19937Engine : public RandomEngine
+{
+public:
+    MT19937Engine() : m_twister(5489u)
+    {
+    }
+
+    Type type() const
+    {
+        return MT19937;
+    }
+
+    RandomEngine *clone() const
+    {
+        return new MT19937Engine(*this);
+    }
+
+    void assign(const RandomEngine &other)
+    {
+        *this = static_cast<const MT19937Engine&>(other);
+    }
+
+    void seed(quint64 seed)
+    {
+        m_twister.seed(static_cast<unsigned int>(seed));
+    }
+
+    void setStream(quint64 seed, quint64 stream)
+    {
+        MT19937Engine::seed(seed + stream);
+    }
+
+    void generate(quint32 *buffer, int size)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            buffer[i] = m_twister();
+        }
+    }
+
+    void discard(quint64 count)
+    {
+        m_twister.discard(count);
+    }
+
+    int stateSize() const
+    {
+        return 624;
+    }
+
+    QList<quint64> state() const
+    {
+        std::stringstream sstream;
+        sstream << m_twister;
+        if (sstream.fail() || sstream.bad())
+        {
+            qFatal("langmuir: can not save state of random number generator; "
+                   "std::stringstream has failed on write");
+        }
+        QList<quint64> state;
+        quint64 value;
+        while (sstream >> value)
+        {
+            state.push_back(value);
+        }
+        return state;
+    }
+
+    bool setState(const QList<quint64> &state)
+    {
+        if (state.size() != stateSize())
+        {
+            return false;
+        }
+        std::stringstream sstream;
+        for (int i = 0; i < state.size(); i++)
+        {
+            sstream << state.at(i) << " ";
+        }
+        sstream >> m_twister;
+        return !(sstream.fail() || sstream.bad());
+    }
+
+private:
+    boost::mt19937 m_twister;
+};
+
+/**
+ * @brief xoshiro256** by Blackman and Vigna; each 64-bit value gives two 32-bit values
+ */
+class Xoshiro256Engine : public RandomEngine
+{
+public:
+    Xoshiro256Engine()
+    {
+        Xoshiro256Engine::seed(5489u);
+    }
+
+    Type type() const
+    {
+        return Xoshiro256;
+    }
+
+    RandomEngine *clone() const
+    {
+        return new Xoshiro256Engine(*this);
+    }
+
+    void assign(const RandomEngine &other)
+    {
+        *this = static_cast<const Xoshiro256Engine&>(other);
+    }
+
+    void seed(quint64 seed)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            m_s[i] = splitMix64(seed);
+        }
+        m_pending = false;
+        m_half = 0;
+    }
+
+    void setStream(quint64 seed, quint64 stream)
+    {
+        Xoshiro256Engine::seed(seed);
+        for (quint64 i = 0; i < stream; i++)
+        {
+            jump();
+        }
+    }
+
+    void generate(quint32 *buffer, int size)
+    {
+        int i = 0;
+        if (m_pending && size > 0)
+        {
+            buffer[i++] = m_half;
+            m_pending = false;
+        }
+        for (; i + 1 < size; i += 2)
+        {
+            quint64 r = next();
+            buffer[i] = quint32(r);
+            buffer[i + 1] = quint32(r >> 32);
+        }
+        if (i < size)
+        {
+            quint64 r = next();
+            buffer[i] = quint32(r);
+            m_half = quint32(r >> 32);
+            m_pending = true;
+        }
+    }
+
+    int stateSize() const
+    {
+        return 6;
+    }
+
+    QList<quint64> state() const
+    {
+        QList<quint64> state;
+        state << m_s[0] << m_s[1] << m_s[2] << m_s[3] << quint64(m_pending) << quint64(m_half);
+        return state;
+    }
+
+    bool setState(const QList<quint64> &state)
+    {
+        if (state.size() != stateSize() || state.at(4) > 1 || state.at(5) > 0xffffffffu)
+        {
+            return false;
+        }
+        if ((state.at(0) | state.at(1) | state.at(2) | state.at(3)) == 0)
+        {
+            return false;
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            m_s[i] = state.at(i);
+        }
+        m_pending = state.at(4) != 0;
+        m_half = quint32(state.at(5));
+        return true;
+    }
+
+private:
+    quint64 next()
+    {
+        quint64 result = rotateLeft(m_s[1] * 5, 7) * 9;
+        quint64 t = m_s[1] << 17;
+        m_s[2] ^= m_s[0];
+        m_s[3] ^= m_s[1];
+        m_s[1] ^= m_s[2];
+        m_s[0] ^= m_s[3];
+        m_s[2] ^= t;
+        m_s[3] = rotateLeft(m_s[3], 45);
+        return result;
+    }
+
+    // Equivalent to 2^128 calls of next()
+    void jump()
+    {
+        static const quint64 polynomial[4] = {
+            Q_UINT64_C(0x180EC6D33CFD0ABA), Q_UINT64_C(0xD5A61266F0C9392C),
+            Q_UINT64_C(0xA9582618E03FC9AA), Q_UINT64_C(0x39ABDC4529B1661C)
+        };
+        quint64 s[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4; i++)
+        {
+            for (int b = 0; b < 64; b++)
+            {
+                if (polynomial[i] & (Q_UINT64_C(1) << b))
+                {
+                    for (int j = 0; j < 4; j++)
+                    {
+                        s[j] ^= m_s[j];
+                    }
+                }
+                next();
+            }
+        }
+        for (int j = 0; j < 4; j++)
+        {
+            m_s[j] = s[j];
+        }
+    }
+
+    quint64 m_s[4];
+    bool m_pending;
+    quint32 m_half;
+};
+
+/**
+ * @brief PCG64 (XSL-RR 128/64) by O'Neill; each 64-bit value gives two 32-bit values
+ */
+class PCG64Engine : public RandomEngine
+{
+public:
+    PCG64Engine()
+    {
+        PCG64Engine::seed(5489u);
+    }
+
+    Type type() const
+    {
+        return PCG64;
+    }
+
+    RandomEngine *clone() const
+    {
+        return new PCG64Engine(*this);
+    }
+
+    void assign(const RandomEngine &other)
+    {
+        *this = static_cast<const PCG64Engine&>(other);
+    }
+
+    void seed(quint64 seed)
+    {
+        PCG64Engine::setStream(seed, 0);
+    }
+
+    void setStream(quint64 seed, quint64 stream)
+    {
+        UInt128 initialState;
+        initialState.hi = splitMix64(seed);
+        initialState.lo = splitMix64(seed);
+
+        // The increment must be odd
+        quint64 a = splitMix64(stream);
+        quint64 b = splitMix64(stream);
+        m_increment.hi = (a << 1) | (b >> 63);
+        m_increment.lo = (b << 1) | 1u;
+
+        m_state.hi = 0;
+        m_state.lo = 0;
+        step();
+        m_state = add(m_state, initialState);
+        step();
+        m_pending = false;
+        m_half = 0;
+    }
+
+    void generate(quint32 *buffer, int size)
+    {
+        int i = 0;
+        if (m_pending && size > 0)
+        {
+            buffer[i++] = m_half;
+            m_pending = false;
+        }
+        for (; i + 1 < size; i += 2)
+        {
+            quint64 r = next();
+            buffer[i] = quint32(r);
+            buffer[i + 1] = quint32(r >> 32);
+        }
+        if (i < size)
+        {
+            quint64 r = next();
+            buffer[i] = quint32(r);
+            m_half = quint32(r >> 32);
+            m_pending = true;
+        }
+    }
+
+    int stateSize() const
+    {
+        return 6;
+    }
+
+    QList<quint64> state() const
+    {
+        QList<quint64> state;
+        state << m_state.hi << m_state.lo << m_increment.hi << m_increment.lo
+              << quint64(m_pending) << quint64(m_half);
+        return state;
+    }
+
+    bool setState(const QList<quint64> &state)
+    {
+        if (state.size() != stateSize() || (state.at(3) & 1u) == 0 ||
+            state.at(4) > 1 || state.at(5) > 0xffffffffu)
+        {
+            return false;
+        }
+        m_state.hi = state.at(0);
+        m_state.lo = state.at(1);
+        m_increment.hi = state.at(2);
+        m_increment.lo = state.at(3);
+        m_pending = state.at(4) != 0;
+        m_half = quint32(state.at(5));
+        return true;
+    }
+
+private:
+    struct UInt128
+    {
+        quint64 hi;
+        quint64 lo;
+    };
+
+    static UInt128 add(const UInt128 &a, const UInt128 &b)
+    {
+        UInt128 c;
+        c.lo = a.lo + b.lo;
+        c.hi = a.hi + b.hi + (c.lo < a.lo ? 1u : 0u);
+        return c;
+    }
+
+    static UInt128 multiply(quint64 a, quint64 b)
+    {
+        quint64 aLo = a & 0xffffffffu, aHi = a >> 32;
+        quint64 bLo = b & 0xffffffffu, bHi = b >> 32;
+        quint64 ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+        quint64 mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+        UInt128 c;
+        c.lo = (mid << 32) | (ll & 0xffffffffu);
+        c.hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+        return c;
+    }
+
+    // The low 128 bits of a * b
+    static UInt128 multiply(const UInt128 &a, const UInt128 &b)
+    {
+        UInt128 c = multiply(a.lo, b.lo);
+        c.hi += a.hi * b.lo + a.lo * b.hi;
+        return c;
+    }
+
+    void step()
+    {
+        static const UInt128 multiplier = {
+            Q_UINT64_C(0x2360ED051FC65DA4), Q_UINT64_C(0x4385DF649FCCF645)
+        };
+        m_state = add(multiply(m_state, multiplier), m_increment);
+    }
+
+    quint64 next()
+    {
+        step();
+        quint64 x = m_state.hi ^ m_state.lo;
+        int r = int(m_state.hi >> 58);
+        return (x >> r) | (x << ((64 - r) & 63));
+    }
+
+    UInt128 m_state;
+    UInt128 m_increment;
+    bool m_pending;
+    quint32 m_half;
+};
+
+/**
+ * @brief Philox4x32-10 by Salmon et al.; the counter is (value index / 4, stream)
+ */
+class PhiloxEngine : public RandomEngine
+{
+public:
+    PhiloxEngine()
+    {
+        PhiloxEngine::seed(5489u);
+    }
+
+    Type type() const
+    {
+        return Philox;
+    }
+
+    RandomEngine *clone() const
+    {
+        return new PhiloxEngine(*this);
+    }
+
+    void assign(const RandomEngine &other)
+    {
+        *this = static_cast<const PhiloxEngine&>(other);
+    }
+
+    void seed(quint64 seed)
+    {
+        PhiloxEngine::setStream(seed, 0);
+    }
+
+    void setStream(quint64 seed, quint64 stream)
+    {
+        m_key = seed;
+        m_stream = stream;
+        m_index = 0;
+        m_valid = false;
+    }
+
+    void generate(quint32 *buffer, int size)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            int word = int(m_index & 3);
+            if (word == 0 || !m_valid)
+            {
+                compute(m_index >> 2);
+            }
+            buffer[i] = m_output[word];
+            ++m_index;
+        }
+    }
+
+    void discard(quint64 count)
+    {
+        m_index += count;
+        m_valid = false;
+    }
+
+    int stateSize() const
+    {
+        return 3;
+    }
+
+    QList<quint64> state() const
+    {
+        QList<quint64> state;
+        state << m_key << m_stream << m_index;
+        return state;
+    }
+
+    bool setState(const QList<quint64> &state)
+    {
+        if (state.size() != stateSize())
+        {
+            return false;
+        }
+        m_key = state.at(0);
+        m_stream = state.at(1);
+        m_index = state.at(2);
+        m_valid = false;
+        return true;
+    }
+
+private:
+    void compute(quint64 block)
+    {
+        quint32 c0 = quint32(block), c1 = quint32(block >> 32);
+        quint32 c2 = quint32(m_stream), c3 = quint32(m_stream >> 32);
+        quint32 k0 = quint32(m_key), k1 = quint32(m_key >> 32);
+        for (int round = 0; round < 10; round++)
+        {
+            if (round > 0)
+            {
+                k0 += 0x9E3779B9u;
+                k1 += 0xBB67AE85u;
+            }
+            quint64 p0 = quint64(0xD2511F53u) * c0;
+            quint64 p1 = quint64(0xCD9E8D57u) * c2;
+            c0 = quint32(p1 >> 32) ^ c1 ^ k0;
+            c1 = quint32(p1);
+            c2 = quint32(p0 >> 32) ^ c3 ^ k1;
+            c3 = quint32(p0);
+        }
+        m_output[0] = c0;
+        m_output[1] = c1;
+        m_output[2] = c2;
+        m_output[3] = c3;
+        m_valid = true;
+    }
+
+    quint64 m_key;
+    quint64 m_stream;
+    quint64 m_index;
+    quint32 m_output[4];
+    bool m_valid;
+};
+
+RandomEngine::Type RandomEngine::toType(const QString &name)
+{
+    if (name == "mt19937")
+    {
+        return MT19937;
+    }
+    if (name == "xoshiro256**")
+    {
+        return Xoshiro256;
+    }
+    if (name == "pcg64")
+    {
+        return PCG64;
+    }
+    if (name == "philox")
+    {
+        return Philox;
+    }
+    qFatal("langmuir: unknown random.engine: %s", qPrintable(name));
+    return MT19937;
+}
+
+QString RandomEngine::name(Type type)
+{
+    switch (type)
+    {
+    case MT19937:
+        return "mt19937";
+    case Xoshiro256:
+        return "xoshiro256**";
+    case PCG64:
+        return "pcg64";
+    case Philox:
+        return "philox";
+    }
+    qFatal("langmuir: unknown random engine: %d", int(type));
+    return QString();
+}
+
+bool RandomEngine::isValidName(const QString &name)
+{
+    return name == "mt19937" || name == "xoshiro256**" || name == "pcg64" || name == "philox";
+}
+
+RandomEngine *RandomEngine::create(Type type)
+{
+    switch (type)
+    {
+    case MT19937:
+        return new MT19937Engine;
+    case Xoshiro256:
+        return new Xoshiro256Engine;
+    case PCG64:
+        return new PCG64Engine;
+    case Philox:
+        return new PhiloxEngine;
+    }
+    qFatal("langmuir: unknown random engine: %d", int(type));
+    return 0;
+}
+
+RandomEngine::~RandomEngine()
+{
+}
+
+void RandomEngine::discard(quint64 count)
+{
+    quint32 buffer[64];
+    while (count > 0)
+    {
+        int n = int(qMin(count, quint64(64)));
+        generate(buffer, n);
+        count -= n;
+    }
+}
+
+}
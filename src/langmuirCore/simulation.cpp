@@ -1,4 +1,5 @@
 #include "simulation.h"
+#include "convergencemonitor.h"
 #include "openclhelper.h"
 #include "parameters.h"
 #include "chargeagent.h"
@@ -11,6 +12,8 @@
 #include "world.h"
 #include "rand.h"
 
+#include <QElapsedTimer>
+
 #ifdef LANGMUIR_USING_QT5
 #include <QtConcurrent/QtConcurrent>
 #endif
@@ -18,145 +21,78 @@
 namespace LangmuirCore
 {
 
-Simulation::Simulation(World &world, QObject *parent):  QObject(parent), m_world(world)
-{
-}
-
-Simulation::~Simulation()
+/**
+ * @brief Fills a table of step kernels, indexed by the configuration bits
+ *
+ * The bits are, from lowest to highest, Coulomb, Gauss, Defects, OpenCL,
+ * SolarCell and IdsOnDelete.  Gauss, Defects and OpenCL only matter with
+ * Coulomb interactions, so they are dropped otherwise and those entries share
+ * a kernel.
+ */
+template <int Index>
+struct StepKernelTable
 {
-}
+    enum
+    {
+        Coulomb     = (Index >> 0) & 1,
+        Gauss       = Coulomb & (Index >> 1),
+        Defects     = Coulomb & (Index >> 2),
+        OpenCL      = Coulomb & (Index >> 3),
+        SolarCell   = (Index >> 4) & 1,
+        IdsOnDelete = (Index >> 5) & 1
+    };
+
+    static void fill(Simulation::StepKernel *table)
+    {
+        table[Index] = &Simulation::performIterationsKernel<
+                Coulomb != 0, Gauss != 0, Defects != 0, OpenCL != 0, SolarCell != 0, IdsOnDelete != 0>;
+        StepKernelTable<Index - 1>::fill(table);
+    }
+};
 
-void Simulation::performIterations(int nIterations)
+template <>
+struct StepKernelTable<-1>
 {
-    // Do some parallel stuff if using Coulomb interactions
-    if (m_world.parameters().coulombCarriers)
+    static void fill(Simulation::StepKernel *)
     {
-        for(int i = 0; i < nIterations; ++i)
-        {
-            //Store fluxAgent states
-            foreach (FluxAgent* flux, m_world.fluxes())
-            {
-                flux->storeLast();
-            }
-
-            QList<ChargeAgent*> &electrons = m_world.electrons();
-            QList<ChargeAgent*> &holes = m_world.holes();
-
-            // Select future sites in serial (because random number generator is being used)
-            for (int i = 0; i < electrons.size(); i++)
-            {
-                electrons.at(i)->chooseFuture();
-            }
-            for (int i = 0; i < holes.size(); i++)
-            {
-                holes.at(i)->chooseFuture();
-            }
-
-            // Calculate the coulomb interactions in parallel some way or another
-            if (m_world.parameters().useOpenCL && m_world.numChargeAgents() > m_world.parameters().openclThreshold)
-            {
-                // Use OpenCL if there are a lot of charges
-                if (m_world.parameters().coulombGaussianSigma > 0)
-                {
-                    m_world.opencl().launchGaussKernel2();
-                }
-                else
-                {
-                    m_world.opencl().launchCoulombKernel2();
-                }
-
-                // Turn this on to check the GPU vs CPU
-                // TRUST THE GPU - if it gives the wrong answer it is most likely
-                // the information passed to it is wrong some how, or something was
-                // changed in the CPU version. There is like a 99.9999% chance
-                // something is messed up on the CPU side - I have spent days/hours
-                // being tormented by some sublte bug, and it always turns out to
-                // be something wrong with the CPU functions
-                // m_world.opencl().compareHostAndDeviceForAllCarriers();
-
-                QFutureSynchronizer<void> sync;
-                sync.addFuture(QtConcurrent::map(electrons, Simulation::chargeAgentCoulombInteractionQtConcurrentGPU));
-                sync.addFuture(QtConcurrent::map(holes, Simulation::chargeAgentCoulombInteractionQtConcurrentGPU));
-                sync.waitForFinished();
-            }
-            else
-            {
-                // Use multi threaded CPU if there are not many charges or when we can not use OpenCL
-                QFutureSynchronizer<void> sync;
-                sync.addFuture(QtConcurrent::map(electrons, Simulation::chargeAgentCoulombInteractionQtConcurrentCPU));
-                sync.addFuture(QtConcurrent::map(holes, Simulation::chargeAgentCoulombInteractionQtConcurrentCPU));
-                sync.waitForFinished();
-            }
-
-            // Decide future in serial (because random number generator is being used)
-            for (int i = 0; i < electrons.size(); i++)
-            {
-                electrons.at(i)->decideFuture();
-            }
-            for (int i = 0; i < holes.size(); i++)
-            {
-                holes.at(i)->decideFuture();
-            }
-
-            // Recombine holes and electrons
-            performRecombinations();
-
-            // Now we are done with the charge movement, move them to the next tick!
-            nextTick();
-
-            // Perform charge injection at the source
-            performInjections();
-
-            m_world.parameters().currentStep += 1;
-        }
     }
+};
 
-    // Skip the parallel stuff if no Coulomb interactions
-    else
-    {
-        for(int i = 0; i < nIterations; ++i)
-        {
-            //Store fluxAgent states
-            foreach (FluxAgent* flux, m_world.fluxes())
-            {
-                flux->storeLast();
-            }
+Simulation::Simulation(World &world, QObject *parent):  QObject(parent), m_world(world), m_stepKernel(0)
+{
+    m_coulombTuner = new CoulombTuner(m_world, this);
+    m_convergenceMonitor = new ConvergenceMonitor(m_world, this);
+    selectStepKernel();
+}
 
-            QList<ChargeAgent*> &electrons = m_world.electrons();
-            QList<ChargeAgent*> &holes = m_world.holes();
+Simulation::~Simulation()
+{
+}
 
-            // Select future sites in serial (because random number generator is being used)
-            for (int i = 0; i < electrons.size(); i++)
-            {
-                electrons.at(i)->chooseFuture();
-            }
-            for (int i = 0; i < holes.size(); i++)
-            {
-                holes.at(i)->chooseFuture();
-            }
+void Simulation::selectStepKernel()
+{
+    StepKernel table[64];
+    StepKernelTable<63>::fill(table);
 
-            // Decide future in serial (because random number generator is being used)
-            for (int i = 0; i < electrons.size(); i++)
-            {
-                electrons.at(i)->decideFuture();
-            }
-            for (int i = 0; i < holes.size(); i++)
-            {
-                holes.at(i)->decideFuture();
-            }
+    SimulationParameters &par = m_world.parameters();
 
-            // Recombine holes and electrons
-            performRecombinations();
+    int index = 0;
+    index |= (par.coulombCarriers                ? 1 : 0) << 0;
+    index |= (par.coulombGaussianSigma > 0       ? 1 : 0) << 1;
+    index |= (par.defectsCharge != 0             ? 1 : 0) << 2;
+    index |= (par.useOpenCL                      ? 1 : 0) << 3;
+    index |= (par.simulationType == "solarcell"  ? 1 : 0) << 4;
+    index |= (par.outputIdsOnDelete              ? 1 : 0) << 5;
 
-            // Now we are done with the charge movement, move them to the next tick!
-            nextTick();
+    m_stepKernel = table[index];
+}
 
-            // Perform charge injection at the source
-            performInjections();
+void Simulation::performIterations(int nIterations)
+{
+    (this->*m_stepKernel)(nIterations);
 
-            m_world.parameters().currentStep += 1;
-        }
-    }
+    // Sample the drain and source rates
+    m_convergenceMonitor->update();
 
     // Update RecombinationAgent probability
     // if (m_world.parameters().simulationType == "solarcell")
@@ -168,7 +104,7 @@ void Simulation::performIterations(int nIterations)
     if (m_world.parameters().outputIsOn)
     {
         // Output Source and Drain information
-        m_world.logger().reportFluxStream();
+        int tasks = OutputSnapshot::Flux;
 
         // Output Coulomb Energy
         if ( m_world.numChargeAgents() > 0 &&
@@ -189,7 +125,7 @@ void Simulation::performIterations(int nIterations)
              m_world.parameters().outputXyz) == 0
            )
         {
-            m_world.logger().reportXYZStream();
+            tasks |= OutputSnapshot::XYZ;
         }
 
         // Output Image of Carriers
@@ -199,9 +135,7 @@ void Simulation::performIterations(int nIterations)
              m_world.parameters().imageCarriers) == 0
            )
         {
-            m_world.logger().saveCarriersImage();
-            m_world.logger().saveElectronImage();
-            m_world.logger().saveHoleImage();
+            tasks |= OutputSnapshot::Images;
         }
 
         // Output checkpoint file
@@ -211,28 +145,192 @@ void Simulation::performIterations(int nIterations)
              m_world.parameters().outputStepChk) == 0
            )
         {
-            m_world.checkPointer().save();
+            tasks |= OutputSnapshot::CheckPoint;
+        }
+
+        // Copy the state, it is written on the logger's thread if output.async is on
+        m_world.logger().report(tasks);
+    }
+}
+
+bool Simulation::isConverged() const
+{
+    return m_convergenceMonitor->isConverged();
+}
+
+template <bool Coulomb, bool Gauss, bool Defects, bool OpenCL, bool SolarCell, bool IdsOnDelete>
+void Simulation::performIterationsKernel(int nIterations)
+{
+    QList<ChargeAgent*> &electrons = m_world.electrons();
+    QList<ChargeAgent*> &holes = m_world.holes();
+
+    // The potential only changes between calls (metropolis.fast)
+    m_world.electronGrid().updateAcceptance();
+    m_world.holeGrid().updateAcceptance();
+
+    for(int i = 0; i < nIterations; ++i)
+    {
+        //Store fluxAgent states
+        foreach (FluxAgent* flux, m_world.fluxes())
+        {
+            flux->storeLast();
+        }
+
+        // Select future sites in serial (because random number generator is being used)
+        for (int i = 0; i < electrons.size(); i++)
+        {
+            electrons.at(i)->chooseFuture();
+        }
+        for (int i = 0; i < holes.size(); i++)
+        {
+            holes.at(i)->chooseFuture();
         }
+
+        // Calculate the coulomb interactions in parallel some way or another
+        if (Coulomb)
+        {
+            if (m_coulombTuner->isDue())
+            {
+                tuneCoulombInteractions<Gauss, Defects, OpenCL>();
+            }
+            else
+            {
+                performCoulombInteractions<Gauss, Defects>(m_coulombTuner->backend());
+            }
+        }
+
+        // Decide future in serial (because random number generator is being used)
+        for (int i = 0; i < electrons.size(); i++)
+        {
+            electrons.at(i)->decideFuture();
+        }
+        for (int i = 0; i < holes.size(); i++)
+        {
+            holes.at(i)->decideFuture();
+        }
+
+        // Recombine holes and electrons
+        performRecombinations<SolarCell>();
+
+        // Now we are done with the charge movement, move them to the next tick!
+        nextTick<IdsOnDelete>();
+
+        // Perform charge injection at the source
+        performInjections<SolarCell>();
+
+        m_world.parameters().currentStep += 1;
     }
 }
 
+template <bool Gauss, bool Defects>
+void Simulation::performCoulombInteractions(CoulombTuner::Backend backend)
+{
+    QList<ChargeAgent*> &electrons = m_world.electrons();
+    QList<ChargeAgent*> &holes = m_world.holes();
+
+    switch (backend)
+    {
+        case CoulombTuner::OpenCL:
+        {
+            if (Gauss)
+            {
+                m_world.opencl().launchGaussKernel2();
+            }
+            else
+            {
+                m_world.opencl().launchCoulombKernel2();
+            }
+
+            // Turn this on to check the GPU vs CPU
+            // TRUST THE GPU - if it gives the wrong answer it is most likely
+            // the information passed to it is wrong some how, or something was
+            // changed in the CPU version. There is like a 99.9999% chance
+            // something is messed up on the CPU side - I have spent days/hours
+            // being tormented by some sublte bug, and it always turns out to
+            // be something wrong with the CPU functions
+            // m_world.opencl().compareHostAndDeviceForAllCarriers();
+
+            QFutureSynchronizer<void> sync;
+            sync.addFuture(QtConcurrent::map(electrons, Simulation::chargeAgentCoulombInteractionQtConcurrentGPU));
+            sync.addFuture(QtConcurrent::map(holes, Simulation::chargeAgentCoulombInteractionQtConcurrentGPU));
+            sync.waitForFinished();
+            break;
+        }
+        case CoulombTuner::ThreadedCPU:
+        {
+            QFutureSynchronizer<void> sync;
+            sync.addFuture(QtConcurrent::map(electrons, Simulation::chargeAgentCoulombInteractionQtConcurrentCPU<Gauss, Defects>));
+            sync.addFuture(QtConcurrent::map(holes, Simulation::chargeAgentCoulombInteractionQtConcurrentCPU<Gauss, Defects>));
+            sync.waitForFinished();
+            break;
+        }
+        case CoulombTuner::SerialCPU:
+        {
+            // No threading overhead, fastest when there are only a few charges
+            for (int i = 0; i < electrons.size(); i++)
+            {
+                electrons.at(i)->coulombCPU<Gauss, Defects>();
+            }
+            for (int i = 0; i < holes.size(); i++)
+            {
+                holes.at(i)->coulombCPU<Gauss, Defects>();
+            }
+            break;
+        }
+        default:
+        {
+            qFatal("langmuir: invalid coulomb backend");
+            break;
+        }
+    }
+}
+
+template <bool Gauss, bool Defects, bool OpenCL>
+void Simulation::tuneCoulombInteractions()
+{
+    CoulombTuner::Backend backend = m_coulombTuner->nextBackend();
+    if (backend == CoulombTuner::OpenCL && !OpenCL)
+    {
+        backend = CoulombTuner::ThreadedCPU;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    performCoulombInteractions<Gauss, Defects>(backend);
+    m_coulombTuner->record(backend, timer.nsecsElapsed());
+
+    if (m_coulombTuner->isComplete())
+    {
+        m_coulombTuner->decide();
+    }
+}
+
+template <bool SolarCell>
 void Simulation::performRecombinations()
 {
-    if (m_world.parameters().simulationType == "solarcell")
+    if (SolarCell)
     {
         if (m_world.parameters().recombinationRate > 0)
         {
-            foreach (ChargeAgent *charge, m_world.electrons())
+            if (m_world.parameters().recombinationParallel)
+            {
+                m_world.recombinationAgent().tryToAcceptAll(m_world.electrons());
+            }
+            else
             {
-                m_world.recombinationAgent().tryToAccept(charge);
+                foreach (ChargeAgent *charge, m_world.electrons())
+                {
+                    m_world.recombinationAgent().tryToAccept(charge);
+                }
             }
         }
     }
 }
 
+template <bool SolarCell>
 void Simulation::performInjections()
 {
-    if (m_world.parameters().simulationType == "solarcell")
+    if (SolarCell)
     {
         m_world.excitonSourceAgent().tryToInject();
 
@@ -258,23 +356,23 @@ void Simulation::balanceCharges()
         if (m_world.parameters().voltageRight >
             m_world.parameters().voltageLeft)
         {
-            m_world.electronSourceAgentLeft().tryToInject();
+            m_world.electronSourceAgentLeft().tryToInject(true);
         }
         else
         if (m_world.parameters().voltageLeft >
             m_world.parameters().voltageRight)
         {
-            m_world.electronSourceAgentRight().tryToInject();
+            m_world.electronSourceAgentRight().tryToInject(true);
         }
         else
         {
             if (m_world.randomNumberGenerator().random() > 0.5)
             {
-                m_world.electronSourceAgentLeft().tryToInject();
+                m_world.electronSourceAgentLeft().tryToInject(true);
             }
             else
             {
-                m_world.electronSourceAgentRight().tryToInject();
+                m_world.electronSourceAgentRight().tryToInject(true);
             }
         }
         tries += 1;
@@ -290,23 +388,23 @@ void Simulation::balanceCharges()
         if (m_world.parameters().voltageRight >
             m_world.parameters().voltageLeft)
         {
-            m_world.holeSourceAgentRight().tryToInject();
+            m_world.holeSourceAgentRight().tryToInject(true);
         }
         else
         if (m_world.parameters().voltageLeft >
             m_world.parameters().voltageRight)
         {
-            m_world.holeSourceAgentLeft().tryToInject();
+            m_world.holeSourceAgentLeft().tryToInject(true);
         }
         else
         {
             if (m_world.randomNumberGenerator().random() > 0.5)
             {
-                m_world.holeSourceAgentRight().tryToInject();
+                m_world.holeSourceAgentRight().tryToInject(true);
             }
             else
             {
-                m_world.holeSourceAgentLeft().tryToInject();
+                m_world.holeSourceAgentLeft().tryToInject(true);
             }
         }
         tries += 1;
@@ -352,70 +450,49 @@ void Simulation::balanceCharges()
 //    }
 }
 
+template <bool IdsOnDelete>
 void Simulation::nextTick()
 {
     // Iterate over all sites to change their state
     QList<ChargeAgent*> &electrons = m_world.electrons();
     QList<ChargeAgent*> &holes = m_world.holes();
 
-    if ( m_world.parameters().outputIdsOnDelete )
+    for(int i = 0; i < electrons.size(); ++i)
     {
-        for(int i = 0; i < electrons.size(); ++i)
+        electrons[i]->completeTick();
+        // Check if the charge was removed - then we should delete it
+        if(electrons[i]->removed())
         {
-            electrons[i]->completeTick();
-            // Check if the charge was removed - then we should delete it
-            if(electrons[i]->removed())
+            if (IdsOnDelete)
             {
                 m_world.logger().reportCarrier(*electrons[i]);
-                delete electrons[i];
-                electrons.removeAt(i);
-                --i;
-            }
-        }
-        for(int i = 0; i < holes.size(); ++i)
-        {
-            holes[i]->completeTick();
-            // Check if the charge was removed - then we should delete it
-            if(holes[i]->removed())
-            {
-                m_world.logger().reportCarrier(*holes[i]);
-                delete holes[i];
-                holes.removeAt(i);
-                --i;
             }
+            delete electrons[i];
+            electrons.removeAt(i);
+            --i;
         }
-        //m_world.logger().flush();
     }
-    else
+    for(int i = 0; i < holes.size(); ++i)
     {
-        for(int i = 0; i < electrons.size(); ++i)
+        holes[i]->completeTick();
+        // Check if the charge was removed - then we should delete it
+        if(holes[i]->removed())
         {
-            electrons[i]->completeTick();
-            // Check if the charge was removed - then we should delete it
-            if(electrons[i]->removed())
+            if (IdsOnDelete)
             {
-                delete electrons[i];
-                electrons.removeAt(i);
-                --i;
-            }
-        }
-        for(int i = 0; i < holes.size(); ++i)
-        {
-            holes[i]->completeTick();
-            // Check if the charge was removed - then we should delete it
-            if(holes[i]->removed())
-            {
-                delete holes[i];
-                holes.removeAt(i);
-                --i;
+                m_world.logger().reportCarrier(*holes[i]);
             }
+            delete holes[i];
+            holes.removeAt(i);
+            --i;
         }
     }
 }
 
+template <bool Gauss, bool Defects>
 inline void Simulation::chargeAgentCoulombInteractionQtConcurrentCPU(ChargeAgent * chargeAgent)
 {
-    chargeAgent->coulombCPU();
+    chargeAgent->coulombCPU<Gauss, Defects>();
 }
 
 inline void Simulation::chargeAgentCoulombInteractionQtConcurrentGPU(ChargeAgent * chargeAgent)
@@ -0,0 +1,378 @@
+#include "siteplacer.h"
+#include "cubicgrid.h"
+#include "world.h"
+#include "rand.h"
+
+#include <QtConcurrentMap>
+#include <QHash>
+
+#include <climits>
+
+namespace LangmuirCore
+{
+
+// The width of the slabs of Parallel; fixed, so the sites do not depend on the number of threads
+static const int slabWidth = 32;
+
+SitePlacer::Algorithm SitePlacer::toAlgorithm(const QString &name)
+{
+    if (name == "legacy")
+    {
+        return Legacy;
+    }
+    if (name == "frontier")
+    {
+        return Frontier;
+    }
+    if (name == "parallel")
+    {
+        return Parallel;
+    }
+    qFatal("langmuir: unknown placement.algorithm: %s", qPrintable(name));
+    return Legacy;
+}
+
+SitePlacer::SitePlacer(World &world, Grid &grid, Algorithm algorithm)
+    : m_world(world), m_grid(grid), m_algorithm(algorithm), m_parent(0)
+{
+    m_x0 = 0;
+    m_width = m_grid.xSize();
+    m_size = m_grid.volume();
+    m_taken.fill(0, (m_size + 31) / 32);
+}
+
+SitePlacer::SitePlacer(const SitePlacer &parent, int x0, int x1)
+    : m_world(parent.m_world), m_grid(parent.m_grid), m_algorithm(Frontier), m_parent(&parent)
+{
+    m_x0 = x0;
+    m_width = x1 - x0;
+    m_size = m_width * m_grid.ySize() * m_grid.zSize();
+    m_taken.fill(0, (m_size + 31) / 32);
+}
+
+int SitePlacer::localIndex(int site) const
+{
+    if (m_parent == 0)
+    {
+        return site;
+    }
+    int x = m_grid.getIndexX(site);
+    int row = (site - x) / m_grid.xSize();
+    return (x - m_x0) + m_width * row;
+}
+
+bool SitePlacer::contains(int site) const
+{
+    if (site < 0 || site >= m_grid.volume())
+    {
+        return false;
+    }
+    if (m_parent == 0)
+    {
+        return true;
+    }
+    int x = m_grid.getIndexX(site);
+    return x >= m_x0 && x < m_x0 + m_width;
+}
+
+bool SitePlacer::isTaken(int site) const
+{
+    if (m_parent != 0 && m_parent->isTaken(site))
+    {
+        return true;
+    }
+    int i = localIndex(site);
+    return m_taken.at(i >> 5) & (1u << (i & 31));
+}
+
+void SitePlacer::take(int site)
+{
+    if (!contains(site))
+    {
+        qFatal("langmuir: can not place at site %d; it is not in the grid", site);
+    }
+    int i = localIndex(site);
+    m_taken[i >> 5] |= (1u << (i & 31));
+}
+
+bool SitePlacer::canGrowInto(int site) const
+{
+    // The neighbors of the sites at the edge include the drains
+    return contains(site) &&
+           m_world.electronGrid().agentType(site) != Agent::Source &&
+           m_world.electronGrid().agentType(site) != Agent::Drain &&
+           m_world.holeGrid().agentType(site) != Agent::Source &&
+           m_world.holeGrid().agentType(site) != Agent::Drain &&
+           !isTaken(site);
+}
+
+QList<int> SitePlacer::seed(Random &random, int count)
+{
+    if (m_algorithm == Legacy)
+    {
+        return seedRejection(random, count);
+    }
+    return seedFisherYates(random, count);
+}
+
+void SitePlacer::grow(Random &random, QList<int> &sites, int count)
+{
+    if (m_algorithm == Legacy)
+    {
+        growRandom(random, sites, count);
+        return;
+    }
+    growFrontier(random, sites, count);
+}
+
+QList<int> SitePlacer::seedAndGrow(Random &random, int seeds, int grown)
+{
+    if (m_algorithm == Parallel)
+    {
+        return seedAndGrowParallel(random, seeds, grown);
+    }
+
+    QList<int> sites = seed(random, seeds);
+    if (grown > 0)
+    {
+        grow(random, sites, grown);
+    }
+    return sites;
+}
+
+QList<int> SitePlacer::seedRejection(Random &random, int count)
+{
+    QList<int> sites;
+    int tries = 0;
+    int maxTries = 10 * m_grid.volume();
+    while (sites.size() < count)
+    {
+        int site = random.integer(0, m_grid.volume() - 1);
+        if (!isTaken(site))
+        {
+            take(site);
+            sites.push_back(site);
+        }
+
+        if (++tries > maxTries)
+        {
+            qDebug("langmuir: exceeded max tries (%d)", maxTries);
+            qFatal("langmuir: can not seed sites");
+        }
+    }
+    return sites;
+}
+
+QList<int> SitePlacer::seedFisherYates(Random &random, int count)
+{
+    // Shuffle the sites of the slab, only storing the positions that were swapped
+    QHash<int, int> swapped;
+    QList<int> sites;
+    for (int i = 0; sites.size() < count; i++)
+    {
+        if (i >= m_size)
+        {
+            qFatal("langmuir: can not seed %d sites; not enough free sites", count);
+        }
+
+        int j = random.integer(i, m_size - 1);
+        int picked = swapped.value(j, j);
+        swapped.insert(j, swapped.value(i, i));
+        swapped.remove(i);
+
+        // From the position in the slab to the "s-site ID"
+        int x = m_x0 + picked % m_width;
+        int row = picked / m_width;
+        int site = x + m_grid.xSize() * row;
+        if (!isTaken(site))
+        {
+            take(site);
+            sites.push_back(site);
+        }
+    }
+    return sites;
+}
+
+void SitePlacer::addToFrontier(int site, QVector<int> &frontier) const
+{
+    QVector<int> neighbors = m_grid.neighborsSite(site, 1);
+    for (int i = 0; i < neighbors.size(); i++)
+    {
+        if (canGrowInto(neighbors[i]))
+        {
+            frontier.push_back(neighbors[i]);
+        }
+    }
+}
+
+int SitePlacer::growFrontier(Random &random, QList<int> &sites, int count)
+{
+    // A site is in the frontier once for every cluster site next to it, so
+    // sites are picked about as often as by growRandom
+    QVector<int> frontier;
+    for (int i = 0; i < sites.size(); i++)
+    {
+        addToFrontier(sites[i], frontier);
+    }
+
+    int progress = 0;
+    while (progress < count)
+    {
+        if (frontier.isEmpty())
+        {
+            // A slab leaves the rest to seedAndGrowParallel, which grows across the slab edges
+            if (m_parent != 0)
+            {
+                return count - progress;
+            }
+            qFatal("langmuir: can not grow %d sites; no free sites next to the clusters", count);
+        }
+
+        int i = random.integer(0, frontier.size() - 1);
+        int site = frontier[i];
+        frontier[i] = frontier.last();
+        frontier.pop_back();
+
+        // Sites picked since they were added are removed when found
+        if (!canGrowInto(site))
+        {
+            continue;
+        }
+
+        take(site);
+        sites.push_back(site);
+        addToFrontier(site, frontier);
+        ++progress;
+    }
+    return 0;
+}
+
+void SitePlacer::growRandom(Random &random, QList<int> &sites, int count)
+{
+    int progress = 0;
+    while (progress < count)
+    {
+        int seedIndex = random.integer(0, sites.size() - 1);
+        int seedSite = sites.at(seedIndex);
+        QVector<int> neighbors = m_grid.neighborsSite(seedSite, 1);
+
+        int newIndex = random.integer(0, neighbors.size() - 1);
+        int newSite = neighbors[newIndex];
+        if (canGrowInto(newSite))
+        {
+            take(newSite);
+            sites.push_back(newSite);
+            ++progress;
+        }
+    }
+}
+
+QList<int> SitePlacer::seedAndGrowParallel(Random &random, int seeds, int grown)
+{
+    int slabs = (m_grid.xSize() + slabWidth - 1) / slabWidth;
+    qDebug("langmuir: placing sites in %d slabs", slabs);
+
+    // Each seed goes to a slab at random, in proportion to the volume of the
+    // slabs (as if the seeds were picked from the whole grid)
+    if (seeds > m_grid.volume())
+    {
+        qFatal("langmuir: can not seed %d sites; not enough free sites", seeds);
+    }
+    QVector<int> slabSeeds(slabs, 0);
+    int placed = 0;
+    while (placed < seeds)
+    {
+        int x = random.integer(0, m_grid.xSize() - 1);
+        int slab = x / slabWidth;
+        int width = qMin((slab + 1) * slabWidth, m_grid.xSize()) - slab * slabWidth;
+
+        // A full slab is skipped
+        if (slabSeeds.at(slab) < width * m_grid.ySize() * m_grid.zSize())
+        {
+            ++slabSeeds[slab];
+            ++placed;
+        }
+    }
+
+    // Each slab takes its own stream of one seed; the clusters of a slab grow
+    // in proportion to its seeds (the parts add up exactly), so a slab without
+    // seeds grows nothing
+    quint64 seed = quint64(random.integer(1, INT_MAX));
+    QList<Slab> work;
+    qint64 seedsBefore = 0;
+    for (int i = 0; i < slabs; i++)
+    {
+        int x0 = i * slabWidth;
+        int x1 = qMin(x0 + slabWidth, m_grid.xSize());
+
+        Slab slab;
+        slab.placer = new SitePlacer(*this, x0, x1);
+        slab.engine = random.engine();
+        slab.seed = seed;
+        slab.stream = i;
+        slab.seeds = slabSeeds.at(i);
+        slab.grown = 0;
+        if (seeds > 0)
+        {
+            slab.grown = qint64(grown) * (seedsBefore + slab.seeds) / seeds -
+                         qint64(grown) * seedsBefore / seeds;
+        }
+        slab.missing = 0;
+        seedsBefore += slab.seeds;
+        work.push_back(slab);
+    }
+
+    QtConcurrent::blockingMap(work, SitePlacer::seedAndGrowSlab);
+
+    // The seeds of all slabs come first
+    QList<int> sites;
+    for (int i = 0; i < work.size(); i++)
+    {
+        const Slab &slab = work.at(i);
+        for (int j = 0; j < slab.seeds; j++)
+        {
+            take(slab.sites.at(j));
+            sites.push_back(slab.sites.at(j));
+        }
+    }
+    int missing = 0;
+    for (int i = 0; i < work.size(); i++)
+    {
+        const Slab &slab = work.at(i);
+        for (int j = slab.seeds; j < slab.sites.size(); j++)
+        {
+            take(slab.sites.at(j));
+            sites.push_back(slab.sites.at(j));
+        }
+        missing += slab.missing;
+        delete slab.placer;
+    }
+
+    // Clusters that filled their slab grow the rest in serial, across the slab
+    // edges (everything, if there were no seeds; growFrontier then fails as it
+    // does without slabs)
+    if (seeds == 0)
+    {
+        missing = grown;
+    }
+    if (missing > 0)
+    {
+        qDebug("langmuir: growing %d sites across the slab edges", missing);
+        growFrontier(random, sites, missing);
+    }
+    return sites;
+}
+
+void SitePlacer::seedAndGrowSlab(Slab &slab)
+{
+    Random random(slab.seed);
+    random.setEngine(slab.engine);
+    random.setStream(slab.stream);
+    slab.sites = slab.placer->seed(random, slab.seeds);
+    if (slab.grown > 0)
+    {
+        slab.missing = slab.placer->growFrontier(random, slab.sites, slab.grown);
+    }
+}
+
+}
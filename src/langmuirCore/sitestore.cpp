@@ -0,0 +1,333 @@
+#include "sitestore.h"
+#include "parameters.h"
+#include "cubicgrid.h"
+#include "world.h"
+#include "affinity.h"
+
+#include <algorithm>
+
+namespace LangmuirCore
+{
+
+SiteStore::SiteStore(World &world, QObject *parent)
+    : QObject(parent), m_world(world)
+{
+    SimulationParameters &par = m_world.parameters();
+
+    m_xSize = par.gridX;
+    m_ySize = par.gridY;
+    m_volume = par.gridX * par.gridY * par.gridZ;
+    m_size = m_volume + Grid::specialAgentReserve();
+    m_xDivider.setDivisor(m_xSize);
+    m_yDivider.setDivisor(m_ySize);
+
+    // The sparse tiles are the same as the dense ones
+    m_sparse = par.gridSparse;
+    m_tiled = par.gridTiled || m_sparse;
+    m_analytic = par.potentialAnalytic || m_sparse;
+    m_xShift = 0;
+    m_yShift = 0;
+    m_zShift = 0;
+    m_xTiles = m_xSize;
+    m_yTiles = m_ySize;
+    m_tiledVolume = m_volume;
+    m_linearSlope = 0.0;
+    m_linearOffset = 0.0;
+    m_gateSlope = 0.0;
+    m_potentialVersion = 0;
+    if (m_analytic)
+    {
+        m_overlayMask.fill(0, (m_size + 31) / 32);
+    }
+
+    if (m_tiled)
+    {
+        // 64 sites per tile
+        if (par.gridZ >= 4)
+        {
+            m_xShift = 2;
+            m_yShift = 2;
+            m_zShift = 2;
+        }
+        else
+        {
+            m_xShift = 3;
+            m_yShift = 3;
+            m_zShift = 0;
+        }
+
+        m_xTiles = (par.gridX + (1 << m_xShift) - 1) >> m_xShift;
+        m_yTiles = (par.gridY + (1 << m_yShift) - 1) >> m_yShift;
+        int zTiles = (par.gridZ + (1 << m_zShift) - 1) >> m_zShift;
+        m_tiledVolume = (m_xTiles * m_yTiles * zTiles) << (m_xShift + m_yShift + m_zShift);
+
+        qDebug("langmuir: storing sites in %d tiles of %d x %d x %d",
+               m_xTiles * m_yTiles * zTiles, 1 << m_xShift, 1 << m_yShift, 1 << m_zShift);
+    }
+
+    m_empty.agent[Electron] = 0;
+    m_empty.agent[Hole] = 0;
+    m_empty.potential = 0.0;
+    m_empty.type[Electron] = Agent::Empty;
+    m_empty.type[Hole] = Agent::Empty;
+
+    int storage = m_tiledVolume + (m_size - m_volume);
+    if (m_sparse)
+    {
+        m_blocks.fill(0, (storage + BlockSize - 1) >> BlockShift);
+        qDebug("langmuir: allocating tiles of the grid as needed");
+    }
+    else
+    {
+        // With threads.affinity, the pages are spread over the NUMA nodes, or,
+        // for a replica, put on the node of the CPU that steps it
+        int cpu = -1;
+        if (par.threadsAffinity && m_world.isReplica())
+        {
+            cpu = Affinity::replicaCPU(m_world.replica());
+        }
+        m_records.fill(m_empty, storage, par.threadsAffinity, cpu);
+    }
+}
+
+SiteStore::~SiteStore()
+{
+    qDeleteAll(m_blocks);
+    qDeleteAll(m_spareBlocks);
+    qDeleteAll(m_freeSites);
+}
+
+FreeSiteIndex *SiteStore::acquireFreeSites(int slotMask, int x0, int x1)
+{
+    for (int i = 0; i < m_freeSites.size(); i++)
+    {
+        FreeSiteIndex *index = m_freeSites[i];
+        if (index->slotMask() == slotMask && index->x0() == x0 && index->x1() == x1)
+        {
+            ++index->users();
+            return index;
+        }
+    }
+
+    SimulationParameters &par = m_world.parameters();
+    FreeSiteIndex *index = new FreeSiteIndex(par.gridX, par.gridY, par.gridZ, x0, x1, slotMask);
+    m_freeSites.push_back(index);
+    ++index->users();
+
+    int rows = m_volume / m_xSize;
+    for (int row = 0; row < rows; row++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            int site = x + m_xSize * row;
+            index->update(site, isFree(site, slotMask));
+        }
+    }
+    return index;
+}
+
+void SiteStore::releaseFreeSites(FreeSiteIndex *index)
+{
+    if (!m_freeSites.contains(index))
+    {
+        qFatal("langmuir: can not release free sites; unknown index");
+    }
+
+    if (--index->users() <= 0)
+    {
+        m_freeSites.removeOne(index);
+        delete index;
+    }
+}
+
+bool SiteStore::isFree(int site, int slotMask) const
+{
+    const SiteRecord &r = at(site);
+    for (int slot = Electron; slot <= Hole; slot++)
+    {
+        if ((slotMask & (1 << slot)) && (r.type[slot] != Agent::Empty || r.agent[slot] != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SiteStore::updateFreeSites(int site)
+{
+    for (int i = 0; i < m_freeSites.size(); i++)
+    {
+        FreeSiteIndex *index = m_freeSites[i];
+        if (index->contains(site))
+        {
+            index->update(site, isFree(site, index->slotMask()));
+        }
+    }
+}
+
+SiteStore::Block *SiteStore::allocateBlock()
+{
+    Block *block = 0;
+    if (!m_spareBlocks.isEmpty())
+    {
+        block = m_spareBlocks.last();
+        m_spareBlocks.pop_back();
+    }
+    else
+    {
+        block = new Block;
+        std::fill(block->records, block->records + BlockSize, m_empty);
+        block->occupied = 0;
+    }
+    return block;
+}
+
+void SiteStore::vacate(int site)
+{
+    if (!m_freeSites.isEmpty())
+    {
+        updateFreeSites(site);
+    }
+
+    if (!m_sparse)
+    {
+        return;
+    }
+
+    Block *&block = m_blocks[index(site) >> BlockShift];
+    if (--block->occupied > 0)
+    {
+        return;
+    }
+
+    // Keep a few released tiles, for Agents going back and forth across a tile edge
+    if (m_spareBlocks.size() < 64)
+    {
+        m_spareBlocks.push_back(block);
+    }
+    else
+    {
+        delete block;
+    }
+    block = 0;
+}
+
+void SiteStore::setOverlay(int site, double potential)
+{
+    if (potential == 0.0)
+    {
+        m_overlay.remove(site);
+        m_overlayMask[site >> 5] &= ~(1u << (site & 31));
+    }
+    else
+    {
+        m_overlay.insert(site, potential);
+        m_overlayMask[site >> 5] |= (1u << (site & 31));
+    }
+}
+
+void SiteStore::setPotential(int site, double potential)
+{
+    ++m_potentialVersion;
+    if (!m_analytic)
+    {
+        m_records[index(site)].potential = potential;
+        return;
+    }
+
+    setOverlay(site, potential - SiteStore::potential(site) + overlay(site));
+}
+
+void SiteStore::addToPotential(int site, double potential)
+{
+    ++m_potentialVersion;
+    if (!m_analytic)
+    {
+        m_records[index(site)].potential += potential;
+        return;
+    }
+
+    setOverlay(site, overlay(site) + potential);
+}
+
+void SiteStore::setPotentialZero()
+{
+    ++m_potentialVersion;
+    if (!m_analytic)
+    {
+        for (int s = 0; s < m_volume; s++)
+        {
+            m_records[index(s)].potential = 0.0;
+        }
+        return;
+    }
+
+    m_linearSlope = 0.0;
+    m_linearOffset = 0.0;
+    m_gateSlope = 0.0;
+    m_overlay.clear();
+    m_overlayMask.fill(0);
+}
+
+void SiteStore::addToPotentialLinear(double slope, double offset)
+{
+    ++m_potentialVersion;
+    if (!m_analytic)
+    {
+        for (int s = 0; s < m_volume; s++)
+        {
+            int x, z;
+            getIndexXZ(s, x, z);
+            m_records[index(s)].potential += slope * (x + 0.5) + offset;
+        }
+        return;
+    }
+
+    m_linearSlope += slope;
+    m_linearOffset += offset;
+}
+
+void SiteStore::addToPotentialGate(double slope)
+{
+    ++m_potentialVersion;
+    if (!m_analytic)
+    {
+        for (int s = 0; s < m_volume; s++)
+        {
+            int x, z;
+            getIndexXZ(s, x, z);
+            m_records[index(s)].potential += slope * (z + 0.5);
+        }
+        return;
+    }
+
+    m_gateSlope += slope;
+}
+
+void SiteStore::copyPotential(const SiteStore &other)
+{
+    if (other.m_size != m_size || other.m_tiled != m_tiled || other.m_analytic != m_analytic)
+    {
+        qFatal("langmuir: can not copy potential; grid sizes differ");
+    }
+    ++m_potentialVersion;
+
+    // The overlay is implicitly shared, so this is cheap
+    if (m_analytic)
+    {
+        m_linearSlope = other.m_linearSlope;
+        m_linearOffset = other.m_linearOffset;
+        m_gateSlope = other.m_gateSlope;
+        m_overlay = other.m_overlay;
+        m_overlayMask = other.m_overlayMask;
+        return;
+    }
+
+    // Both are in the same order
+    for (int i = 0; i < m_records.size(); i++)
+    {
+        m_records[i].potential = other.m_records.at(i).potential;
+    }
+}
+
+}
@@ -2,6 +2,7 @@
 #include "chargeagent.h"
 #include "parameters.h"
 #include "potential.h"
+#include "sitestore.h"
 #include "world.h"
 #include "rand.h"
 
@@ -9,10 +10,22 @@ namespace LangmuirCore
 {
 
 SourceAgent::SourceAgent(World &world, Grid& grid, QObject *parent)
-    : FluxAgent(Agent::Source, world, grid, parent)
+    : FluxAgent(Agent::Source, world, grid, parent), m_gridSites(0), m_faceSites(0)
 {
 }
 
+SourceAgent::~SourceAgent()
+{
+    if (m_gridSites)
+    {
+        m_world.sites().releaseFreeSites(m_gridSites);
+    }
+    if (m_faceSites)
+    {
+        m_world.sites().releaseFreeSites(m_faceSites);
+    }
+}
+
 ElectronSourceAgent::ElectronSourceAgent(World &world, int site, QObject *parent)
     : SourceAgent(world, world.electronGrid(), parent)
 {
@@ -70,7 +83,7 @@ ExcitonSourceAgent::ExcitonSourceAgent(World &world, QObject *parent)
 
 bool SourceAgent::tryToSeed()
 {
-    int site = randomSiteID();
+    int site = hasFreeSiteIndex(true) ? chooseFreeSite(true, true) : randomSiteID();
     if(validToInject(site))
     {
         inject(site);
@@ -89,10 +102,18 @@ bool SourceAgent::tryToSeed(int site)
     return false;
 }
 
-bool SourceAgent::tryToInject()
+bool SourceAgent::tryToInject(bool freeSitesOnly)
 {
     m_attempts += 1;
-    int site = chooseSite();
+    int site = -1;
+    if (freeSitesOnly && hasFreeSiteIndex(m_face == Grid::NoFace))
+    {
+        site = chooseFreeSite(m_face == Grid::NoFace, true);
+    }
+    else
+    {
+        site = chooseSite();
+    }
     if(validToInject(site)&& shouldTransport(site))
     {
         inject(site);
@@ -112,16 +133,83 @@ int SourceAgent::randomNeighborSiteID()
     return m_neighbors[m_world.randomNumberGenerator().integer(0, m_neighbors.size()-1)];
 }
 
+bool SourceAgent::hasFreeSiteIndex(bool wholeGrid)
+{
+    if (!m_world.parameters().freeSiteIndex)
+    {
+        return false;
+    }
+
+    // Only the faces the sources use are slabs of the Grid
+    if (wholeGrid)
+    {
+        return true;
+    }
+    return m_face == Grid::Left || m_face == Grid::Right;
+}
+
+int SourceAgent::chooseFreeSite(bool wholeGrid, bool freeSitesOnly)
+{
+    FreeSiteIndex *&index = wholeGrid ? m_gridSites : m_faceSites;
+    if (index == 0)
+    {
+        int x0 = 0;
+        int x1 = m_grid.xSize();
+        if (!wholeGrid)
+        {
+            x0 = (m_face == Grid::Left) ? 0 : m_grid.xSize() - 1;
+            x1 = x0 + 1;
+        }
+        index = m_world.sites().acquireFreeSites(freeSiteSlots(), x0, x1);
+    }
+
+    if (index->size() == 0)
+    {
+        return -1;
+    }
+
+    int n = freeSitesOnly ? index->size() : index->capacity();
+    int i = m_world.randomNumberGenerator().integer(0, n - 1);
+    if (i >= index->size())
+    {
+        return -1;
+    }
+    return index->at(i);
+}
+
 int SourceAgent::chooseSite()
 {
+    if (hasFreeSiteIndex(false))
+    {
+        return chooseFreeSite(false, false);
+    }
     return randomNeighborSiteID();
 }
 
 int ExcitonSourceAgent::chooseSite()
 {
+    if (hasFreeSiteIndex(true))
+    {
+        return chooseFreeSite(true, false);
+    }
     return randomSiteID();
 }
 
+int ElectronSourceAgent::freeSiteSlots()
+{
+    return 1 << SiteStore::Electron;
+}
+
+int HoleSourceAgent::freeSiteSlots()
+{
+    return 1 << SiteStore::Hole;
+}
+
+int ExcitonSourceAgent::freeSiteSlots()
+{
+    return (1 << SiteStore::Electron) | (1 << SiteStore::Hole);
+}
+
 double ElectronSourceAgent::energyChange(int site)
 {
     double p1 = m_potential;
@@ -208,8 +296,7 @@ bool ElectronSourceAgent::validToInject(int site)
         site < 0 ||
         site >= m_grid.volume()||
         m_grid.agentType(site)!= Agent::Empty ||
-        m_grid.agentAddress(site)!= 0 ||
-        m_world.defectSiteIDs().contains(site))
+        m_grid.agentAddress(site)!= 0)
     {
         return false;
     }
@@ -223,8 +310,7 @@ bool HoleSourceAgent::validToInject(int site)
         site < 0 ||
         site >= m_grid.volume()||
         m_grid.agentType(site)!= Agent::Empty ||
-        m_grid.agentAddress(site)!= 0 ||
-        m_world.defectSiteIDs().contains(site))
+        m_grid.agentAddress(site)!= 0)
     {
         return false;
     }
@@ -241,8 +327,7 @@ bool ExcitonSourceAgent::validToInject(int site)
         m_world.electronGrid().agentType(site)!= Agent::Empty ||
         m_world.holeGrid().agentType(site)!= Agent::Empty ||
         m_world.electronGrid().agentAddress(site)!= 0 ||
-        m_world.holeGrid().agentAddress(site)!= 0 ||
-        m_world.defectSiteIDs().contains(site))
+        m_world.holeGrid().agentAddress(site)!= 0)
     {
         return false;
     }
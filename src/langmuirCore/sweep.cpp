@@ -0,0 +1,82 @@
+#include "sweep.h"
+#include "parameters.h"
+#include "fluxagent.h"
+#include "potential.h"
+#include "cubicgrid.h"
+#include "world.h"
+
+namespace LangmuirCore
+{
+
+Sweep::Sweep(World &world, QObject *parent) : QObject(parent), m_world(world)
+{
+    SimulationParameters &par = m_world.parameters();
+    m_voltageRight = toDoubleList(par.sweepVoltageRight);
+    m_temperatureKelvin = toDoubleList(par.sweepTemperatureKelvin);
+    m_outputStub = par.outputStub;
+}
+
+int Sweep::size()
+{
+    return qMax(1, qMax(m_voltageRight.size(), m_temperatureKelvin.size()));
+}
+
+void Sweep::setPoint(int point)
+{
+    if (point < 0 || point >= size())
+    {
+        qFatal("langmuir: invalid sweep point: %d", point);
+    }
+
+    // Nothing to do without a sweep
+    if (m_voltageRight.isEmpty() && m_temperatureKelvin.isEmpty())
+    {
+        return;
+    }
+
+    SimulationParameters &par = m_world.parameters();
+
+    double voltageRight = par.voltageRight;
+    if (!m_voltageRight.isEmpty())
+    {
+        par.voltageRight = m_voltageRight.at(point);
+    }
+
+    if (!m_temperatureKelvin.isEmpty())
+    {
+        par.temperatureKelvin = m_temperatureKelvin.at(point);
+    }
+
+    // Update inverseKT
+    setCalculatedValues(par);
+
+    // Update the potential
+    if (par.voltageRight != voltageRight)
+    {
+        if (m_world.isReplica())
+        {
+            m_world.electronGrid().copyPotential(m_world.primaryWorld().electronGrid());
+        }
+        else
+        {
+            m_world.potential().updatePotentialLinear(par.voltageLeft, voltageRight);
+        }
+    }
+
+    par.outputStub = QString("%1_s%2").arg(m_outputStub).arg(point);
+
+    // Start counting again, but keep the carriers
+    if (point > 0)
+    {
+        par.currentStep = 0;
+        foreach (FluxAgent *flux, m_world.fluxes())
+        {
+            flux->resetCounters();
+        }
+    }
+
+    qDebug("langmuir: sweep point %d of %d; voltage.right = %g; temperature.kelvin = %g",
+           point + 1, size(), par.voltageRight, par.temperatureKelvin);
+}
+
+}
@@ -0,0 +1,468 @@
+#include "trajectory.h"
+#include "parameters.h"
+#include "cubicgrid.h"
+#include "gzipper.h"
+#include "output.h"
+#include "world.h"
+
+#include <QtEndian>
+#include <QHash>
+
+#include <cstring>
+
+namespace LangmuirCore
+{
+
+namespace
+{
+
+// The binary trajectory (output.xyz.format = binary), fixed size numbers little-endian:
+//   header : magic (8 bytes), version (quint32), species written (quint32: 1 electrons,
+//            2 holes, 4 defects, 8 traps), grid.x, grid.y, grid.z (quint32 each), and
+//            frames per chunk (quint32)
+//   chunks : magic (4 bytes), number of frames (quint32), step of the first frame
+//            (quint64), size of the data (quint64), then the frames as one gzip member
+//   index  : magic (4 bytes), number of chunks (quint32), then for each chunk the step
+//            of its first frame (quint64), number of frames (quint32), zero (quint32),
+//            and offset from the start of the file (quint64)
+//   trailer: offset of the index (quint64), magic (8 bytes)
+//
+// The frames are made of varints (unsigned LEB128; signed numbers are zigzag encoded)
+// and columns.  A column of n numbers, n known from what came before, is the minimum
+// (signed varint), a width w in bits (one byte), then the n differences from the
+// minimum in w bits each, least significant bit first, padded to a byte; a column of
+// equal numbers takes no bits.
+//   frame    : step (varint), then the carriers of each species written (electrons,
+//              then holes), then, in the first frame of a chunk only, the sites of
+//              each species written (defects, then traps), as they do not move
+//   carriers : one bit for each carrier of the last frame (set if it is left), padded
+//              to a byte; the columns dx, dy, dz, dlifetime and dpathlength of the
+//              carriers left; the number of new carriers (varint); the columns id
+//              (difference from the previous id, the first from 0), x, y, z, lifetime
+//              and pathlength of the new carriers.  The carriers of the frame are the
+//              ones left, in order, then the new ones.  The first frame of a chunk has
+//              no last frame, so it is a keyframe: all of its carriers are new.
+//   sites    : the number of sites (varint), then a column of site ids
+// The site of a carrier is x + grid.x * (y + grid.y * z).
+const char fileMagic[8] = {'L', 'A', 'N', 'G', 'T', 'R', 'J', '\0'};
+const char chunkMagic[4] = {'L', 'T', 'C', 'K'};
+const char indexMagic[4] = {'L', 'T', 'I', 'X'};
+const char trailerMagic[8] = {'L', 'A', 'N', 'G', 'I', 'D', 'X', '\0'};
+const int headerSize = 32;
+const int chunkHeaderSize = 24;
+const int indexEntrySize = 24;
+
+enum Species
+{
+    Electrons = 0x1,
+    Holes     = 0x2,
+    Defects   = 0x4,
+    Traps     = 0x8
+};
+
+void putVarint(QByteArray &buffer, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        buffer.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buffer.append(char(value));
+}
+
+void putSigned(QByteArray &buffer, qint64 value)
+{
+    putVarint(buffer, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+//! Packs numbers of a fixed width into bytes, least significant bit first
+struct BitWriter
+{
+    BitWriter(QByteArray &buffer) : buffer(buffer), bits(0), used(0)
+    {
+    }
+
+    void put(quint64 value, int width)
+    {
+        while (width > 0)
+        {
+            int take = qMin(width, 24);
+            bits |= quint32(value & ((quint64(1) << take) - 1)) << used;
+            used += take;
+            value >>= take;
+            width -= take;
+            while (used >= 8)
+            {
+                buffer.append(char(bits & 0xff));
+                bits >>= 8;
+                used -= 8;
+            }
+        }
+    }
+
+    void finish()
+    {
+        if (used > 0)
+        {
+            buffer.append(char(bits & 0xff));
+        }
+        bits = 0;
+        used = 0;
+    }
+
+    QByteArray &buffer;
+    quint32 bits;
+    int used;
+};
+
+void putColumn(QByteArray &buffer, const QVector<qint64> &values)
+{
+    if (values.isEmpty())
+    {
+        return;
+    }
+
+    qint64 minimum = values.at(0);
+    qint64 maximum = values.at(0);
+    for (int i = 1; i < values.size(); i++)
+    {
+        minimum = qMin(minimum, values.at(i));
+        maximum = qMax(maximum, values.at(i));
+    }
+
+    int width = 0;
+    quint64 range = quint64(maximum) - quint64(minimum);
+    while (width < 64 && (range >> width) != 0)
+    {
+        width++;
+    }
+
+    putSigned(buffer, minimum);
+    buffer.append(char(width));
+
+    BitWriter writer(buffer);
+    for (int i = 0; i < values.size(); i++)
+    {
+        writer.put(quint64(values.at(i)) - quint64(minimum), width);
+    }
+    writer.finish();
+}
+
+bool idLessThan(const TrajectoryWriter::Carrier &a, const TrajectoryWriter::Carrier &b)
+{
+    return a.id < b.id;
+}
+
+}
+
+TrajectoryWriter::TrajectoryWriter(World &world, const QString &name, QObject *parent)
+    : QObject(parent), m_world(world), m_species(0)
+{
+    SimulationParameters &par = m_world.parameters();
+
+    if (par.outputXyzE) { m_species |= Electrons; }
+    if (par.outputXyzH) { m_species |= Holes;     }
+    if (par.outputXyzD) { m_species |= Defects;   }
+    if (par.outputXyzT) { m_species |= Traps;     }
+    m_keyframe = par.outputXyzKeyframe;
+
+    m_current.firstStep = 0;
+    m_current.frames = 0;
+    m_current.offset = 0;
+
+    OutputInfo info(name, &par);
+    m_file.setFileName(info.absoluteFilePath());
+    if (!m_file.open(QIODevice::ReadWrite))
+    {
+        qFatal("langmuir: can not open file:\n\t%s", qPrintable(info.absoluteFilePath()));
+    }
+
+    if (m_file.size() > 0)
+    {
+        recover();
+        return;
+    }
+
+    QByteArray header(headerSize, '\0');
+    uchar *h = reinterpret_cast<uchar*>(header.data());
+    memcpy(h, fileMagic, sizeof(fileMagic));
+    qToLittleEndian<quint32>(Version, h + 8);
+    qToLittleEndian<quint32>(m_species, h + 12);
+    qToLittleEndian<quint32>(par.gridX, h + 16);
+    qToLittleEndian<quint32>(par.gridY, h + 20);
+    qToLittleEndian<quint32>(par.gridZ, h + 24);
+    qToLittleEndian<quint32>(m_keyframe, h + 28);
+    if (m_file.write(header) != header.size())
+    {
+        qFatal("langmuir: error writing file: %s", qPrintable(m_file.fileName()));
+    }
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    writeChunk();
+    writeIndex();
+    m_file.close();
+}
+
+void TrajectoryWriter::recover()
+{
+    SimulationParameters &par = m_world.parameters();
+
+    QByteArray header = m_file.read(headerSize);
+    const uchar *h = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() != headerSize || memcmp(h, fileMagic, sizeof(fileMagic)) != 0)
+    {
+        qFatal("langmuir: can not append to %s: it is not a binary trajectory",
+               qPrintable(m_file.fileName()));
+    }
+    if (qFromLittleEndian<quint32>(h + 8) != Version)
+    {
+        qFatal("langmuir: can not append to %s: it has version %u",
+               qPrintable(m_file.fileName()), qFromLittleEndian<quint32>(h + 8));
+    }
+    if (qFromLittleEndian<quint32>(h + 12) != m_species ||
+        qFromLittleEndian<quint32>(h + 16) != quint32(par.gridX) ||
+        qFromLittleEndian<quint32>(h + 20) != quint32(par.gridY) ||
+        qFromLittleEndian<quint32>(h + 24) != quint32(par.gridZ))
+    {
+        qFatal("langmuir: can not append to %s: it was written with other grid or output.xyz parameters",
+               qPrintable(m_file.fileName()));
+    }
+
+    // Walk the chunks; stop at the index, or at a chunk cut short by a killed run
+    qint64 size = m_file.size();
+    qint64 offset = headerSize;
+    while (offset + chunkHeaderSize <= size)
+    {
+        m_file.seek(offset);
+        QByteArray chunk = m_file.read(chunkHeaderSize);
+        const uchar *c = reinterpret_cast<const uchar*>(chunk.constData());
+        if (chunk.size() != chunkHeaderSize || memcmp(c, chunkMagic, sizeof(chunkMagic)) != 0)
+        {
+            break;
+        }
+        quint64 bytes = qFromLittleEndian<quint64>(c + 16);
+        if (bytes > quint64(size - offset - chunkHeaderSize))
+        {
+            qDebug("langmuir: %s ends with an incomplete chunk; it is removed", qPrintable(m_file.fileName()));
+            break;
+        }
+
+        Chunk entry;
+        entry.frames = qFromLittleEndian<quint32>(c + 4);
+        entry.firstStep = qFromLittleEndian<quint64>(c + 8);
+        entry.offset = offset;
+        m_chunks.push_back(entry);
+
+        offset += chunkHeaderSize + bytes;
+    }
+
+    // The index is written again when the file is closed
+    if (!m_file.resize(offset) || !m_file.seek(offset))
+    {
+        qFatal("langmuir: error writing file: %s", qPrintable(m_file.fileName()));
+    }
+}
+
+void TrajectoryWriter::write(const OutputSnapshot &snapshot)
+{
+    if (m_current.frames >= quint32(m_keyframe))
+    {
+        writeChunk();
+    }
+
+    bool keyframe = (m_current.frames == 0);
+    if (keyframe)
+    {
+        m_current.firstStep = snapshot.currentStep;
+        m_electrons.clear();
+        m_holes.clear();
+    }
+
+    putVarint(m_buffer, snapshot.currentStep);
+
+    if (m_species & Electrons)
+    {
+        encodeCarriers(snapshot.electrons, m_electrons);
+    }
+
+    if (m_species & Holes)
+    {
+        encodeCarriers(snapshot.holes, m_holes);
+    }
+
+    if (keyframe && (m_species & Defects))
+    {
+        encodeSites(snapshot.defects);
+    }
+
+    if (keyframe && (m_species & Traps))
+    {
+        encodeSites(snapshot.traps);
+    }
+
+    m_current.frames += 1;
+}
+
+void TrajectoryWriter::encodeCarriers(const QVector<OutputSnapshot::Carrier> &carriers,
+                                      QVector<Carrier> &previous)
+{
+    Grid &grid = m_world.electronGrid();
+
+    // The carriers of this frame, by id
+    QHash<quint64, int> index;
+    index.reserve(carriers.size());
+    for (int i = 0; i < carriers.size(); i++)
+    {
+        index.insert(carriers.at(i).id, i);
+    }
+
+    QVector<Carrier> current;
+    current.reserve(carriers.size());
+
+    QVector<qint64> dx, dy, dz, dlifetime, dpathlength;
+
+    // Which carriers of the last frame are left, and how they moved
+    BitWriter left(m_buffer);
+    for (int i = 0; i < previous.size(); i++)
+    {
+        const Carrier &last = previous.at(i);
+        QHash<quint64, int>::iterator it = index.find(last.id);
+        left.put(it != index.end(), 1);
+        if (it == index.end())
+        {
+            continue;
+        }
+
+        const OutputSnapshot::Carrier &charge = carriers.at(it.value());
+        Carrier next;
+        next.id = charge.id;
+        grid.getIndexXYZ(charge.site, next.x, next.y, next.z);
+        next.lifetime = charge.lifetime;
+        next.pathlength = charge.pathlength;
+        current.push_back(next);
+        index.erase(it);
+
+        dx          << next.x          - last.x;
+        dy          << next.y          - last.y;
+        dz          << next.z          - last.z;
+        dlifetime   << next.lifetime   - last.lifetime;
+        dpathlength << next.pathlength - last.pathlength;
+    }
+    left.finish();
+
+    putColumn(m_buffer, dx);
+    putColumn(m_buffer, dy);
+    putColumn(m_buffer, dz);
+    putColumn(m_buffer, dlifetime);
+    putColumn(m_buffer, dpathlength);
+
+    // The carriers that are new, by id
+    QVector<Carrier> created;
+    created.reserve(index.size());
+    for (QHash<quint64, int>::const_iterator it = index.constBegin(); it != index.constEnd(); ++it)
+    {
+        const OutputSnapshot::Carrier &charge = carriers.at(it.value());
+        Carrier next;
+        next.id = charge.id;
+        grid.getIndexXYZ(charge.site, next.x, next.y, next.z);
+        next.lifetime = charge.lifetime;
+        next.pathlength = charge.pathlength;
+        created.push_back(next);
+    }
+    qSort(created.begin(), created.end(), idLessThan);
+
+    QVector<qint64> id, x, y, z, lifetime, pathlength;
+    quint64 lastID = 0;
+    for (int i = 0; i < created.size(); i++)
+    {
+        const Carrier &next = created.at(i);
+        id         << qint64(next.id - lastID);
+        x          << next.x;
+        y          << next.y;
+        z          << next.z;
+        lifetime   << next.lifetime;
+        pathlength << next.pathlength;
+        lastID = next.id;
+    }
+
+    putVarint(m_buffer, created.size());
+    putColumn(m_buffer, id);
+    putColumn(m_buffer, x);
+    putColumn(m_buffer, y);
+    putColumn(m_buffer, z);
+    putColumn(m_buffer, lifetime);
+    putColumn(m_buffer, pathlength);
+
+    previous = current + created;
+}
+
+void TrajectoryWriter::encodeSites(const QList<int> &sites)
+{
+    QVector<qint64> values;
+    values.reserve(sites.size());
+    for (int i = 0; i < sites.size(); i++)
+    {
+        values << sites.at(i);
+    }
+    putVarint(m_buffer, values.size());
+    putColumn(m_buffer, values);
+}
+
+void TrajectoryWriter::writeChunk()
+{
+    if (m_current.frames == 0)
+    {
+        return;
+    }
+
+    QByteArray data = gzip(m_buffer);
+
+    QByteArray header(chunkHeaderSize, '\0');
+    uchar *c = reinterpret_cast<uchar*>(header.data());
+    memcpy(c, chunkMagic, sizeof(chunkMagic));
+    qToLittleEndian<quint32>(m_current.frames, c + 4);
+    qToLittleEndian<quint64>(m_current.firstStep, c + 8);
+    qToLittleEndian<quint64>(data.size(), c + 16);
+
+    m_current.offset = m_file.pos();
+    if (m_file.write(header) != header.size() || m_file.write(data) != data.size())
+    {
+        qFatal("langmuir: error writing file: %s", qPrintable(m_file.fileName()));
+    }
+    m_chunks.push_back(m_current);
+
+    // A run that is killed keeps every chunk written
+    m_file.flush();
+
+    m_buffer.clear();
+    m_current.frames = 0;
+}
+
+void TrajectoryWriter::writeIndex()
+{
+    quint64 offset = m_file.pos();
+
+    QByteArray index(8 + m_chunks.size() * indexEntrySize + 16, '\0');
+    uchar *i = reinterpret_cast<uchar*>(index.data());
+    memcpy(i, indexMagic, sizeof(indexMagic));
+    qToLittleEndian<quint32>(m_chunks.size(), i + 4);
+    i += 8;
+    for (int j = 0; j < m_chunks.size(); j++, i += indexEntrySize)
+    {
+        const Chunk &chunk = m_chunks.at(j);
+        qToLittleEndian<quint64>(chunk.firstStep, i);
+        qToLittleEndian<quint32>(chunk.frames, i + 8);
+        qToLittleEndian<quint64>(chunk.offset, i + 16);
+    }
+    qToLittleEndian<quint64>(offset, i);
+    memcpy(i + 8, trailerMagic, sizeof(trailerMagic));
+
+    if (m_file.write(index) != index.size())
+    {
+        qFatal("langmuir: error writing file: %s", qPrintable(m_file.fileName()));
+    }
+}
+
+}
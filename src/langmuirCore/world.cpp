@@ -5,6 +5,8 @@
 #include "drainagent.h"
 #include "potential.h"
 #include "cubicgrid.h"
+#include "sitestore.h"
+#include "siteplacer.h"
 #include "writer.h"
 #include "world.h"
 #include "rand.h"
@@ -12,8 +14,10 @@
 #include "output.h"
 #include "keyvalueparser.h"
 #include "checkpointer.h"
+#include "initcache.h"
 #include "fluxagent.h"
 #include "nodefileparser.h"
+#include "affinity.h"
 
 namespace LangmuirCore {
 
@@ -31,6 +35,7 @@ World::World(const QString &fileName, int cores, int gpuID, QObject *parent)
       m_holeDrainAgentRight(NULL),
       m_holeDrainAgentLeft(NULL),
       m_recombinationAgent(NULL),
+      m_sites(NULL),
       m_electronGrid(NULL),
       m_holeGrid(NULL),
       m_rand(NULL),
@@ -38,10 +43,13 @@ World::World(const QString &fileName, int cores, int gpuID, QObject *parent)
       m_parameters(NULL),
       m_logger(NULL),
       m_ocl(NULL),
+      m_primary(this),
+      m_replica(0),
       m_maxElectrons(0),
       m_maxHoles(0),
       m_maxDefects(0),
-      m_maxTraps(0)
+      m_maxTraps(0),
+      m_chargeAgentCount(0)
 {
     initialize(fileName, NULL, NULL, cores, gpuID);
 }
@@ -60,6 +68,7 @@ World::World(SimulationParameters &parameters, int cores, int gpuID, QObject *pa
       m_holeDrainAgentRight(NULL),
       m_holeDrainAgentLeft(NULL),
       m_recombinationAgent(NULL),
+      m_sites(NULL),
       m_electronGrid(NULL),
       m_holeGrid(NULL),
       m_rand(NULL),
@@ -67,10 +76,13 @@ World::World(SimulationParameters &parameters, int cores, int gpuID, QObject *pa
       m_parameters(NULL),
       m_logger(NULL),
       m_ocl(NULL),
+      m_primary(this),
+      m_replica(0),
       m_maxElectrons(0),
       m_maxHoles(0),
       m_maxDefects(0),
-      m_maxTraps(0)
+      m_maxTraps(0),
+      m_chargeAgentCount(0)
 {
     initialize("", &parameters, NULL, cores, gpuID);
 }
@@ -89,6 +101,7 @@ World::World(SimulationParameters &parameters, ConfigurationInfo &configInfo, in
       m_holeDrainAgentRight(NULL),
       m_holeDrainAgentLeft(NULL),
       m_recombinationAgent(NULL),
+      m_sites(NULL),
       m_electronGrid(NULL),
       m_holeGrid(NULL),
       m_rand(NULL),
@@ -96,14 +109,50 @@ World::World(SimulationParameters &parameters, ConfigurationInfo &configInfo, in
       m_parameters(NULL),
       m_logger(NULL),
       m_ocl(NULL),
+      m_primary(this),
+      m_replica(0),
       m_maxElectrons(0),
       m_maxHoles(0),
       m_maxDefects(0),
-      m_maxTraps(0)
+      m_maxTraps(0),
+      m_chargeAgentCount(0)
 {
     initialize("", &parameters, &configInfo, cores, gpuID);
 }
 
+World::World(World &primary, int replica, int gpuID, QObject *parent)
+    : QObject(parent),
+      m_keyValueParser(NULL),
+      m_checkPointer(NULL),
+      m_electronSourceAgentRight(NULL),
+      m_electronSourceAgentLeft(NULL),
+      m_holeSourceAgentRight(NULL),
+      m_holeSourceAgentLeft(NULL),
+      m_excitonSourceAgent(NULL),
+      m_electronDrainAgentRight(NULL),
+      m_electronDrainAgentLeft(NULL),
+      m_holeDrainAgentRight(NULL),
+      m_holeDrainAgentLeft(NULL),
+      m_recombinationAgent(NULL),
+      m_sites(NULL),
+      m_electronGrid(NULL),
+      m_holeGrid(NULL),
+      m_rand(NULL),
+      m_potential(NULL),
+      m_parameters(NULL),
+      m_logger(NULL),
+      m_ocl(NULL),
+      m_primary(&primary),
+      m_replica(replica),
+      m_maxElectrons(0),
+      m_maxHoles(0),
+      m_maxDefects(0),
+      m_maxTraps(0),
+      m_chargeAgentCount(0)
+{
+    initializeReplica(primary, replica, gpuID);
+}
+
 World::~World()
 {
     for(int i = 0; i < m_sources.size(); i++)
@@ -160,6 +209,11 @@ Grid& World::holeGrid()
     return *m_holeGrid;
 }
 
+SiteStore& World::sites()
+{
+    return *m_sites;
+}
+
 Potential& World::potential()
 {
     return *m_potential;
@@ -307,32 +361,47 @@ QList<double>& World::trapSitePotentials()
 
 boost::multi_array<double,3>& World::R1()
 {
-    return m_R1;
+    return m_primary->m_R1;
 }
 
 boost::multi_array<double,3>& World::R2()
 {
-    return m_R2;
+    return m_primary->m_R2;
 }
 
 boost::multi_array<double,3>& World::iR()
 {
-    return m_iR;
+    return m_primary->m_iR;
 }
 
 boost::multi_array<double,3>& World::eR()
 {
-    return m_eR;
+    return m_primary->m_eR;
 }
 
 boost::multi_array<double, 3>& World::sI()
 {
-    return m_sI;
+    return m_primary->m_sI;
 }
 
 boost::multi_array<double,3>& World::couplingConstants()
 {
-    return m_couplingConstants;
+    return m_primary->m_couplingConstants;
+}
+
+World& World::primaryWorld()
+{
+    return *m_primary;
+}
+
+int World::replica()
+{
+    return m_replica;
+}
+
+bool World::isReplica()
+{
+    return m_primary != this;
 }
 
 int World::maxElectronAgents()
@@ -355,6 +424,11 @@ int World::maxTraps()
     return m_maxTraps;
 }
 
+quint64 World::nextChargeAgentID()
+{
+    return m_chargeAgentCount++;
+}
+
 int World::maxChargeAgents()
 {
     return maxElectronAgents() + maxHoleAgents();
@@ -484,6 +558,15 @@ void World::alterMaxThreads(int cores)
     QThreadPool& threadPool = *QThreadPool::globalInstance();
     int maxThreadCount = threadPool.maxThreadCount();
 
+    // The nodefile and Qt do not know about cpusets and cgroup quotas
+    if (m_parameters->threadsAffinity) {
+        maxThreadCount = Affinity::availableCPUs();
+        if (cores > maxThreadCount) {
+            qDebug("langmuir: requested %d cores, but only %d are available", cores, maxThreadCount);
+            cores = maxThreadCount;
+        }
+    }
+
     if (cores < 0) {
         cores = maxThreadCount;
     }
@@ -496,6 +579,10 @@ void World::alterMaxThreads(int cores)
 
     threadPool.setMaxThreadCount(cores);
     qDebug("langmuir: QThreadPool::maxThreadCount set to %d", threadPool.maxThreadCount());
+
+    if (m_parameters->threadsAffinity) {
+        Affinity::pinThreads(threadPool, Affinity::spreadCPUs(Affinity::allowedCPUs()));
+    }
 }
 
 void World::initialize(const QString &fileName, SimulationParameters *pparameters, ConfigurationInfo *pconfigInfo, int cores, int gpuID)
@@ -519,7 +606,7 @@ void World::initialize(const QString &fileName, SimulationParameters *pparameter
     // names and their locations in the simulationParameters struct
     // It is also the global location of the simulationParameters struct,
     // that a lot of objects carry around references to
-    m_keyValueParser = new KeyValueParser(refWorld,this);
+    m_keyValueParser = new KeyValueParser(this);
 
     // Copy passed parameters
     if (pparameters != NULL) {
@@ -560,6 +647,7 @@ void World::initialize(const QString &fileName, SimulationParameters *pparameter
         qDebug("langmuir: skipping input file");
         qDebug("langmuir: seeding random number generator with random.seed = %d",
                (unsigned int)m_parameters->randomSeed);
+        m_rand->setEngine(RandomEngine::toType(m_parameters->randomEngine));
         m_rand->seed(m_parameters->randomSeed);
     }
     checkSimulationParameters(*m_parameters);
@@ -585,11 +673,14 @@ void World::initialize(const QString &fileName, SimulationParameters *pparameter
     m_parameters->randomSeed = m_rand->seed();
     qDebug() << "langmuir: random.seed is" << parameters().randomSeed;
 
+    // Create the site records shared by the Grids
+    m_sites = new SiteStore(refWorld, this);
+
     // Create Electron Grid
-    m_electronGrid = new Grid(refWorld, this);
+    m_electronGrid = new Grid(refWorld, *m_sites, SiteStore::Electron, this);
 
     // Create Hole Grid
-    m_holeGrid = new Grid(refWorld, this);
+    m_holeGrid = new Grid(refWorld, *m_sites, SiteStore::Hole, this);
 
     // Calculate the max number of holes
     m_maxHoles = parameters().holePercentage*double(holeGrid().volume());
@@ -621,6 +712,11 @@ void World::initialize(const QString &fileName, SimulationParameters *pparameter
     // Create Logger
     m_logger = new Logger(refWorld, this);
 
+    // Reuse the sites and tables of an earlier run with the same input (cache.directory)
+    // If found, configInfo holds every site, and no random numbers are used to place them
+    InitCache cache(refWorld, configInfo);
+    bool cached = cache.load(configInfo);
+
     // Place Defects
     placeDefects(configInfo.defects);
 
@@ -630,23 +726,42 @@ void World::initialize(const QString &fileName, SimulationParameters *pparameter
     // Place Holes
     placeHoles(configInfo.holes);
 
-    // Zero potential
-    potential().setPotentialZero();
+    if (cached && cache.hasPotential())
+    {
+        // Copy the potential, traps included
+        cache.loadPotential();
+    }
+    else
+    {
+        // Zero potential
+        potential().setPotentialZero();
 
-    // Set Linear Potential
-    potential().setPotentialLinear();
+        // Set Linear Potential
+        potential().setPotentialLinear();
 
-    // Set Gate Potential (does nothing is slope.z is zero or if there is only 1 layer)
-    potential().setPotentialGate();
+        // Set Gate Potential (does nothing is slope.z is zero or if there is only 1 layer)
+        potential().setPotentialGate();
 
-    // Place Traps
-    potential().setPotentialTraps(configInfo.traps,configInfo.trapPotentials);
+        // Place Traps
+        potential().setPotentialTraps(configInfo.traps,configInfo.trapPotentials);
+    }
 
-    // precalculate and store coulomb interaction energies
-    potential().precalculateArrays();
+    if (cached)
+    {
+        // Copy the coulomb interaction energies and coupling constants
+        cache.loadArrays();
+    }
+    else
+    {
+        // precalculate and store coulomb interaction energies
+        potential().precalculateArrays();
 
-    // precalculate and store coupling constants
-    potential().updateCouplingConstants();
+        // precalculate and store coupling constants
+        potential().updateCouplingConstants();
+
+        // Save everything for the next run with the same input
+        cache.save();
+    }
 
     // Initialize OpenCL
     opencl().initializeOpenCL(gpuID);
@@ -656,6 +771,102 @@ void World::initialize(const QString &fileName, SimulationParameters *pparameter
     qDebug() << *m_keyValueParser;
 }
 
+void World::initializeReplica(World &primary, int replica, int gpuID)
+{
+    if (primary.isReplica()) {
+        qFatal("langmuir: can not create a replica of a replica");
+    }
+
+    // Pointers are EVIL
+    World &refWorld = *this;
+
+    // Set the Key Value Parser and copy the primary parameters
+    m_keyValueParser = new KeyValueParser(this);
+    m_keyValueParser->parameters() = primary.parameters();
+    m_parameters = &m_keyValueParser->parameters();
+
+    // Each replica gets its own stream of random numbers
+    m_rand = new Random(0,this);
+    m_rand->setEngine(RandomEngine::toType(m_parameters->randomEngine));
+    m_rand->seed(primary.parameters().randomSeed);
+    m_rand->setStream(replica);
+    m_parameters->randomSeed = m_rand->seed();
+    qDebug() << "langmuir: replica" << replica << "random.seed is" << parameters().randomSeed;
+
+    // Create CheckPointer
+    m_checkPointer = new CheckPointer(refWorld, this);
+
+    // Create the site records shared by the Grids
+    m_sites = new SiteStore(refWorld, this);
+
+    // Create Electron Grid
+    m_electronGrid = new Grid(refWorld, *m_sites, SiteStore::Electron, this);
+
+    // Create Hole Grid
+    m_holeGrid = new Grid(refWorld, *m_sites, SiteStore::Hole, this);
+
+    // The max numbers are the same as for the primary
+    m_maxHoles = primary.maxHoleAgents();
+    m_maxElectrons = primary.maxElectronAgents();
+    m_maxDefects = primary.maxDefects();
+    m_maxTraps = primary.maxTraps();
+
+    // Create Potential Calculator
+    m_potential = new Potential(refWorld, this);
+
+    // Create OpenCL Objects
+    m_ocl = new OpenClHelper(refWorld, this);
+
+    // Create SourceAgents
+    createSources();
+
+    // Create DrainAgents
+    createDrains();
+
+    // Start from the same flux counters as the primary
+    QList<quint64> fluxInfo;
+    foreach (FluxAgent *flux, primary.fluxes())
+    {
+        fluxInfo.push_back(flux->attempts());
+        fluxInfo.push_back(flux->successes());
+    }
+    setFluxInfo(fluxInfo);
+
+    // Create Logger
+    m_logger = new Logger(refWorld, this);
+
+    // Share the morphology
+    placeDefects(primary.defectSiteIDs());
+
+    // Start from the same carrier configuration as the primary
+    QList<int> electronIDs;
+    foreach (ChargeAgent *charge, primary.electrons())
+    {
+        electronIDs.push_back(charge->getCurrentSite());
+    }
+    placeElectrons(electronIDs);
+
+    QList<int> holeIDs;
+    foreach (ChargeAgent *charge, primary.holes())
+    {
+        holeIDs.push_back(charge->getCurrentSite());
+    }
+    placeHoles(holeIDs);
+
+    // Copy the background potential (the Grids share it)
+    m_trapSiteIDs = primary.trapSiteIDs();
+    m_trapSitePotentials = primary.trapSitePotentials();
+    electronGrid().copyPotential(primary.electronGrid());
+
+    // The coupling constants are shared, but the Grids keep flat copies
+    electronGrid().updateCouplingConstants();
+    holeGrid().updateCouplingConstants();
+
+    // Initialize OpenCL
+    opencl().initializeOpenCL(gpuID);
+    opencl().toggleOpenCL(parameters().useOpenCL);
+}
+
 void World::placeDefects(const QList<int>& siteIDs)
 {
     qDebug("langmuir: World::placeDefects");
@@ -708,16 +919,20 @@ void World::placeDefects(const QList<int>& siteIDs)
         return;
     }
 
+    // Sites already used are marked here, so checking a site is cheap
+    SitePlacer placer(*this, electronGrid(), SitePlacer::toAlgorithm(parameters().placementAlgorithm));
+
     if (toBePlacedIDs > 0) {
         qDebug("langmuir: placing %d defects from checkpoint", toBePlacedIDs);
         for (int i = 0; i < toBePlacedIDs; i++)
         {
             int site = siteIDs.at(i);
-            if (defectSiteIDs().contains(site) )
+            if (placer.isTaken(site))
             {
                 qDebug("langmuir: can not add defect");
                 qFatal("langmuir: defect already exists");
             }
+            placer.take(site);
             electronGrid().registerDefect(site);
             holeGrid().registerDefect(site);
             defectSiteIDs().push_back(site);
@@ -728,29 +943,15 @@ void World::placeDefects(const QList<int>& siteIDs)
     // Place the rest of the defects randomly
     if (toBeSeeded > 0)
     {
-        int tries = 0;
-        int maxTries = 10 * (electronGrid().volume());
-
-        qDebug("langmuir: seeding %d defects", toBeSeeded);
-        for(int i = num; i < max;)
+        qDebug("langmuir: seeding %d defects", max - num);
+        QList<int> sites = placer.seedAndGrow(randomNumberGenerator(), max - num, 0);
+        for (int i = 0; i < sites.size(); i++)
         {
-            tries++;
-            int site = randomNumberGenerator().integer(0, electronGrid().volume() - 1);
-
-            if (!defectSiteIDs().contains(site))
-            {
-                electronGrid().registerDefect(site);
-                holeGrid().registerDefect(site);
-                defectSiteIDs().push_back(site);
-                num++;
-                i++;
-            }
-
-            if (tries > maxTries)
-            {
-                qDebug("langmuir: exceeded max tries (%d)", maxTries);
-                qFatal("langmuir: can not seed defects");
-            }
+            int site = sites.at(i);
+            electronGrid().registerDefect(site);
+            holeGrid().registerDefect(site);
+            defectSiteIDs().push_back(site);
+            num++;
         }
     }
     qDebug("langmuir: placed %d defects", numDefects());
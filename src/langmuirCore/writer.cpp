@@ -5,6 +5,8 @@
 #include "chargeagent.h"
 #include "fluxagent.h"
 #include "openclhelper.h"
+#include "trajectory.h"
+#include "checkpointer.h"
 
 namespace LangmuirCore
 {
@@ -91,21 +93,21 @@ ExcitonWriter::ExcitonWriter(World &world, const QString &name, QObject *parent)
              << flush;
 }
 
-void XYZWriter::write()
+void XYZWriter::write(const OutputSnapshot &snapshot)
 {
     if (m_world.parameters().outputXyzMode == 0)
     {
         int num = 0;
-        if (m_world.parameters().outputXyzE == true) { num += m_world.numElectronAgents(); }
-        if (m_world.parameters().outputXyzH == true) { num += m_world.numHoleAgents(); }
-        if (m_world.parameters().outputXyzD == true) { num += m_world.numDefects(); }
-        if (m_world.parameters().outputXyzT == true) { num += m_world.numTraps(); }
+        if (m_world.parameters().outputXyzE == true) { num += snapshot.electrons.size(); }
+        if (m_world.parameters().outputXyzH == true) { num += snapshot.holes.size(); }
+        if (m_world.parameters().outputXyzD == true) { num += snapshot.defects.size(); }
+        if (m_world.parameters().outputXyzT == true) { num += snapshot.traps.size(); }
 
         m_stream << qSetFieldWidth(0)
                  << num
                  << newline;
 
-        m_stream << m_world.parameters().currentStep
+        m_stream << snapshot.currentStep
                  << newline;
 
         m_stream << qSetRealNumberPrecision(m_world.parameters().outputPrecision)
@@ -116,48 +118,48 @@ void XYZWriter::write()
         if (m_world.parameters().outputXyzE == true)
         {
             Grid &grid = m_world.electronGrid();
-            QList<ChargeAgent*> &charges = m_world.electrons();
-            foreach( ChargeAgent* pCharge, charges)
+            const QVector<OutputSnapshot::Carrier> &charges = snapshot.electrons;
+            for (int i = 0; i < charges.size(); i++)
             {
-                ChargeAgent &charge = *pCharge;
-                int site = charge.getCurrentSite();
+                const OutputSnapshot::Carrier &charge = charges.at(i);
+                int site = charge.site;
                 m_stream << 'E'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
                          << grid.getIndexZ(site) << ' '
                          << site                 << ' '
-                         << &charge              << ' '
-                         << charge.lifetime()    << ' '
-                         << charge.pathlength()  << '\n';
+                         << charge.address       << ' '
+                         << charge.lifetime      << ' '
+                         << charge.pathlength    << '\n';
             }
         }
 
         if (m_world.parameters().outputXyzH == true)
         {
             Grid &grid = m_world.holeGrid();
-            QList<ChargeAgent*> &charges = m_world.holes();
-            foreach( ChargeAgent* pCharge, charges)
+            const QVector<OutputSnapshot::Carrier> &charges = snapshot.holes;
+            for (int i = 0; i < charges.size(); i++)
             {
-                ChargeAgent &charge = *pCharge;
-                int site = charge.getCurrentSite();
+                const OutputSnapshot::Carrier &charge = charges.at(i);
+                int site = charge.site;
                 m_stream << 'H'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
                          << grid.getIndexZ(site) << ' '
                          << site                 << ' '
-                         << &charge              << ' '
-                         << charge.lifetime()    << ' '
-                         << charge.pathlength()  << '\n';
+                         << charge.address       << ' '
+                         << charge.lifetime      << ' '
+                         << charge.pathlength    << '\n';
             }
         }
 
         if (m_world.parameters().outputXyzD == true)
         {
             Grid &grid = m_world.electronGrid();
-            QList<int> &ids = m_world.defectSiteIDs();
+            const QList<int> &ids = snapshot.defects;
             for (int i = 0; i < ids.size(); i++)
             {
-                int site = ids[i];
+                int site = ids.at(i);
                 m_stream << 'D'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
@@ -170,10 +172,10 @@ void XYZWriter::write()
         if (m_world.parameters().outputXyzT == true)
         {
             Grid &grid = m_world.electronGrid();
-            QList<int> &ids = m_world.trapSiteIDs();
+            const QList<int> &ids = snapshot.traps;
             for (int i = 0; i < ids.size(); i++)
             {
-                int site = ids[i];
+                int site = ids.at(i);
                 m_stream << 'T'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
@@ -186,16 +188,16 @@ void XYZWriter::write()
     else if (m_world.parameters().outputXyzMode == 1)
     {
         int num = 0;
-        if (m_world.parameters().outputXyzE == true) { num += m_world.maxElectronAgents(); }
-        if (m_world.parameters().outputXyzH == true) { num += m_world.maxHoleAgents(); }
-        if (m_world.parameters().outputXyzD == true) { num += m_world.maxDefects(); }
-        if (m_world.parameters().outputXyzT == true) { num += m_world.maxTraps(); }
+        if (m_world.parameters().outputXyzE == true) { num += snapshot.maxElectrons; }
+        if (m_world.parameters().outputXyzH == true) { num += snapshot.maxHoles; }
+        if (m_world.parameters().outputXyzD == true) { num += snapshot.maxDefects; }
+        if (m_world.parameters().outputXyzT == true) { num += snapshot.maxTraps; }
 
         m_stream << qSetFieldWidth(0)
                  << num
                  << newline;
 
-        m_stream << m_world.parameters().currentStep
+        m_stream << snapshot.currentStep
                  << newline;
 
         m_stream << qSetRealNumberPrecision(m_world.parameters().outputPrecision)
@@ -206,21 +208,21 @@ void XYZWriter::write()
         if (m_world.parameters().outputXyzE == true)
         {
             Grid &grid = m_world.electronGrid();
-            QList<ChargeAgent*> &charges = m_world.electrons();
-            foreach( ChargeAgent* pCharge, charges)
+            const QVector<OutputSnapshot::Carrier> &charges = snapshot.electrons;
+            for (int i = 0; i < charges.size(); i++)
             {
-                ChargeAgent &charge = *pCharge;
-                int site = charge.getCurrentSite();
+                const OutputSnapshot::Carrier &charge = charges.at(i);
+                int site = charge.site;
                 m_stream << 'E'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
                          << grid.getIndexZ(site) << ' '
                          << site                 << ' '
-                         << &charge              << ' '
-                         << charge.lifetime()    << ' '
-                         << charge.pathlength()  << '\n';
+                         << charge.address       << ' '
+                         << charge.lifetime      << ' '
+                         << charge.pathlength    << '\n';
             }
-            for (int i = 0; i < m_world.maxElectronAgents() - m_world.numElectronAgents(); i++)
+            for (int i = 0; i < snapshot.maxElectrons - charges.size(); i++)
             {
                 m_stream << 'E'   << ' '
                          << -1024 << ' '
@@ -236,21 +238,21 @@ void XYZWriter::write()
         if (m_world.parameters().outputXyzH == true)
         {
             Grid &grid = m_world.holeGrid();
-            QList<ChargeAgent*> &charges = m_world.holes();
-            foreach( ChargeAgent* pCharge, charges)
+            const QVector<OutputSnapshot::Carrier> &charges = snapshot.holes;
+            for (int i = 0; i < charges.size(); i++)
             {
-                ChargeAgent &charge = *pCharge;
-                int site = charge.getCurrentSite();
+                const OutputSnapshot::Carrier &charge = charges.at(i);
+                int site = charge.site;
                 m_stream << 'H'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
                          << grid.getIndexZ(site) << ' '
                          << site                 << ' '
-                         << &charge              << ' '
-                         << charge.lifetime()    << ' '
-                         << charge.pathlength()  << '\n';
+                         << charge.address       << ' '
+                         << charge.lifetime      << ' '
+                         << charge.pathlength    << '\n';
             }
-            for (int i = 0; i < m_world.maxHoleAgents() - m_world.numHoleAgents(); i++)
+            for (int i = 0; i < snapshot.maxHoles - charges.size(); i++)
             {
                 m_stream << 'H'   << ' '
                          << -1024 << ' '
@@ -266,10 +268,10 @@ void XYZWriter::write()
         if (m_world.parameters().outputXyzD == true)
         {
             Grid &grid = m_world.electronGrid();
-            QList<int> &ids = m_world.defectSiteIDs();
+            const QList<int> &ids = snapshot.defects;
             for (int i = 0; i < ids.size(); i++)
             {
-                int site = ids[i];
+                int site = ids.at(i);
                 m_stream << 'D'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
@@ -277,7 +279,7 @@ void XYZWriter::write()
                          << site                 << ' '
                          << i                    << '\n';
             }
-            for (int i = 0; i < m_world.maxDefects() - m_world.numDefects(); i++)
+            for (int i = 0; i < snapshot.maxDefects - ids.size(); i++)
             {
                 m_stream << 'D'   << ' '
                          << -1024 << ' '
@@ -292,10 +294,10 @@ void XYZWriter::write()
         if (m_world.parameters().outputXyzT == true)
         {
             Grid &grid = m_world.electronGrid();
-            QList<int> &ids = m_world.trapSiteIDs();
+            const QList<int> &ids = snapshot.traps;
             for (int i = 0; i < ids.size(); i++)
             {
-                int site = ids[i];
+                int site = ids.at(i);
                 m_stream << 'T'                  << ' '
                          << grid.getIndexX(site) << ' '
                          << grid.getIndexY(site) << ' '
@@ -304,7 +306,7 @@ void XYZWriter::write()
                          << i                    << '\n';
             }
         }
-        for (int i = 0; i < m_world.maxTraps() - m_world.numTraps(); i++)
+        for (int i = 0; i < snapshot.maxTraps - snapshot.traps.size(); i++)
         {
             m_stream << 'T'   << ' '
                      << -1024 << ' '
@@ -357,23 +359,16 @@ void XYZWriter::writeVMDInitFile()
     stream.flush();
 }
 
-void FluxWriter::write()
+void FluxWriter::write(const OutputSnapshot &snapshot)
 {
-    QDateTime now = QDateTime::currentDateTime();
-    QList<FluxAgent *>& fluxAgents =  m_world.fluxes();
-    m_stream << m_world.parameters().currentStep;
-    foreach(FluxAgent *flux, fluxAgents)
+    m_stream << snapshot.currentStep;
+    for (int i = 0; i < snapshot.attempts.size(); i++)
     {
-        m_stream << flux->attempts() << flux->successes();
-        // << flux->successProbability() << flux->successRate();
+        m_stream << snapshot.attempts.at(i) << snapshot.successes.at(i);
     }
-    m_stream << m_world.numElectronAgents()
-             //<< m_world.percentElectronAgents()
-             //<< m_world.reachedElectronAgents()
-             << m_world.numHoleAgents()
-             //<< m_world.percentHoleAgents()
-             //<< m_world.reachedHoleAgents()
-             << m_world.parameters().simulationStart.msecsTo(now)
+    m_stream << snapshot.electronCount
+             << snapshot.holeCount
+             << snapshot.elapsed
              << newline;
     m_stream.flush();
 }
@@ -475,31 +470,164 @@ void GridImage::drawCharges( QList<ChargeAgent *> &charges,QColor color, int lay
     }
 }
 
+void GridImage::drawCarriers(const QVector<OutputSnapshot::Carrier> &carriers, QColor color, int layer)
+{
+    if (carriers.size()<=0)return;
+    Grid &grid = m_world.electronGrid();
+    m_painter.setPen(color);
+    for(int i = 0; i < carriers.size(); i++)
+    {
+        int ndx = carriers.at(i).site;
+        if(grid.getIndexZ(ndx)== layer)
+        {
+            m_painter.drawPoint(QPoint(grid.getIndexX(ndx),grid.getIndexY(ndx)));
+        }
+    }
+}
+
+OutputQueue::OutputQueue(Logger &logger, int size, QObject *parent)
+    : QThread(parent), m_logger(logger), m_writing(0), m_stop(false)
+{
+    for (int i = 0; i < size; i++)
+    {
+        m_free.push_back(new OutputSnapshot);
+    }
+}
+
+OutputQueue::~OutputQueue()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stop = true;
+        m_submitted.wakeAll();
+    }
+    wait();
+
+    qDeleteAll(m_free);
+    qDeleteAll(m_pending);
+}
+
+OutputSnapshot *OutputQueue::acquire()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_free.isEmpty())
+    {
+        m_written.wait(&m_mutex);
+    }
+    return m_free.takeFirst();
+}
+
+void OutputQueue::submit(OutputSnapshot *snapshot)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.push_back(snapshot);
+    m_submitted.wakeAll();
+}
+
+void OutputQueue::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_pending.isEmpty() || m_writing > 0)
+    {
+        m_written.wait(&m_mutex);
+    }
+}
+
+void OutputQueue::run()
+{
+    QMutexLocker locker(&m_mutex);
+    while (true)
+    {
+        while (m_pending.isEmpty() && !m_stop)
+        {
+            m_submitted.wait(&m_mutex);
+        }
+
+        if (m_pending.isEmpty())
+        {
+            return;
+        }
+
+        OutputSnapshot *snapshot = m_pending.takeFirst();
+        m_writing++;
+
+        // Format and write without holding the lock
+        locker.unlock();
+        m_logger.writeSnapshot(*snapshot);
+        locker.relock();
+
+        m_writing--;
+        m_free.push_back(snapshot);
+        m_written.wakeAll();
+    }
+}
+
 Logger::Logger(World &world, QObject *parent)
-    : QObject(parent), m_world(world), m_xyzWriter(0), m_fluxWriter(0), m_carrierWriter(0)
+    : QObject(parent), m_world(world), m_xyzWriter(0), m_trajectoryWriter(0), m_fluxWriter(0), m_carrierWriter(0), m_excitonWriter(0),
+      m_outputQueue(0)
 {
 }
 
+Logger::~Logger()
+{
+    // The thread uses the writers, so stop it first
+    delete m_outputQueue;
+    m_outputQueue = 0;
+}
+
 void Logger::initialize()
 {
+    // Finish writing to the streams opened by a previous call
+    delete m_outputQueue;
+    m_outputQueue = 0;
+
+    // Close streams opened by a previous call (for example, at the last sweep point)
+    delete m_xyzWriter;
+    m_xyzWriter = 0;
+
+    delete m_trajectoryWriter;
+    m_trajectoryWriter = 0;
+
+    delete m_carrierWriter;
+    m_carrierWriter = 0;
+
+    delete m_excitonWriter;
+    m_excitonWriter = 0;
+
+    delete m_fluxWriter;
+    m_fluxWriter = 0;
+
     if (m_world.parameters().outputIsOn)
     {
-        if (m_world.parameters().outputXyz)
+        // the stream output is compressed if its name ends in .gz
+        QString gz = m_world.parameters().outputGzip ? ".gz" : "";
+
+        if (m_world.parameters().outputXyz && m_world.parameters().outputXyzFormat == "binary")
+        {
+            m_trajectoryWriter = new TrajectoryWriter(m_world,"%stub.traj",this);
+        }
+        else if (m_world.parameters().outputXyz)
         {
             m_xyzWriter = new XYZWriter(m_world,"%stub.xyz",this);
         }
 
         if (m_world.parameters().outputIdsOnDelete)
         {
-            m_carrierWriter = new CarrierWriter(m_world,"%stub-carriers.dat",this);
+            m_carrierWriter = new CarrierWriter(m_world,"%stub-carriers.dat" + gz,this);
         }
 
         if (m_world.parameters().outputIdsOnEncounter)
         {
-            m_excitonWriter = new ExcitonWriter(m_world,"%stub-excitons.dat",this);
+            m_excitonWriter = new ExcitonWriter(m_world,"%stub-excitons.dat" + gz,this);
         }
 
-        m_fluxWriter = new FluxWriter(m_world,"%stub.dat",this);
+        m_fluxWriter = new FluxWriter(m_world,"%stub.dat" + gz,this);
+
+        if (m_world.parameters().outputAsync)
+        {
+            m_outputQueue = new OutputQueue(*this, m_world.parameters().outputQueueSize, this);
+            m_outputQueue->start();
+        }
     }
 }
 
@@ -582,12 +710,166 @@ void Logger::saveCoulombEnergy(const QString& name)
 
 void Logger::reportFluxStream()
 {
-    if (m_fluxWriter && m_world.parameters().outputIsOn) m_fluxWriter->write();
+    report(OutputSnapshot::Flux);
 }
 
 void Logger::reportXYZStream()
 {
-    if (m_xyzWriter && m_world.parameters().outputIsOn) m_xyzWriter->write();
+    report(OutputSnapshot::XYZ);
+}
+
+void Logger::report(int tasks)
+{
+    if (!m_world.parameters().outputIsOn) return;
+    if (m_fluxWriter == 0) tasks &= ~OutputSnapshot::Flux;
+    if (m_xyzWriter == 0 && m_trajectoryWriter == 0) tasks &= ~OutputSnapshot::XYZ;
+    if (tasks == 0) return;
+
+    if (m_outputQueue)
+    {
+        OutputSnapshot *snapshot = m_outputQueue->acquire();
+        takeSnapshot(*snapshot, tasks);
+        m_outputQueue->submit(snapshot);
+    }
+    else
+    {
+        OutputSnapshot snapshot;
+        takeSnapshot(snapshot, tasks);
+        writeSnapshot(snapshot);
+    }
+}
+
+void Logger::waitForOutput()
+{
+    if (m_outputQueue) m_outputQueue->flush();
+}
+
+void Logger::takeSnapshot(OutputSnapshot &snapshot, int tasks)
+{
+    SimulationParameters &par = m_world.parameters();
+
+    snapshot.tasks = tasks;
+    snapshot.currentStep = par.currentStep;
+    snapshot.elapsed = par.simulationStart.msecsTo(QDateTime::currentDateTime());
+
+    // Reuse the memory of the snapshot, it was probably filled before
+    QList<FluxAgent *>& fluxAgents = m_world.fluxes();
+    snapshot.attempts.resize(fluxAgents.size());
+    snapshot.successes.resize(fluxAgents.size());
+    for (int i = 0; i < fluxAgents.size(); i++)
+    {
+        snapshot.attempts[i] = fluxAgents.at(i)->attempts();
+        snapshot.successes[i] = fluxAgents.at(i)->successes();
+    }
+
+    QList<ChargeAgent*> &electrons = m_world.electrons();
+    QList<ChargeAgent*> &holes = m_world.holes();
+    snapshot.electronCount = electrons.size();
+    snapshot.holeCount = holes.size();
+
+    // Only the trajectory and the images need every carrier
+    if (!(tasks & (OutputSnapshot::XYZ | OutputSnapshot::Images)))
+    {
+        snapshot.electrons.resize(0);
+        snapshot.holes.resize(0);
+        snapshot.defects.clear();
+        snapshot.traps.clear();
+    }
+    else
+    {
+        snapshot.electrons.resize(electrons.size());
+        for (int i = 0; i < electrons.size(); i++)
+        {
+            ChargeAgent &charge = *electrons.at(i);
+            OutputSnapshot::Carrier &carrier = snapshot.electrons[i];
+            carrier.site = charge.getCurrentSite();
+            carrier.id = charge.id();
+            carrier.address = &charge;
+            carrier.lifetime = charge.lifetime();
+            carrier.pathlength = charge.pathlength();
+        }
+
+        snapshot.holes.resize(holes.size());
+        for (int i = 0; i < holes.size(); i++)
+        {
+            ChargeAgent &charge = *holes.at(i);
+            OutputSnapshot::Carrier &carrier = snapshot.holes[i];
+            carrier.site = charge.getCurrentSite();
+            carrier.id = charge.id();
+            carrier.address = &charge;
+            carrier.lifetime = charge.lifetime();
+            carrier.pathlength = charge.pathlength();
+        }
+
+        snapshot.defects = m_world.defectSiteIDs();
+        snapshot.traps = m_world.trapSiteIDs();
+    }
+
+    snapshot.maxElectrons = m_world.maxElectronAgents();
+    snapshot.maxHoles = m_world.maxHoleAgents();
+    snapshot.maxDefects = m_world.maxDefects();
+    snapshot.maxTraps = m_world.maxTraps();
+
+    // Resolve %step now, the background thread sees a later step
+    if (tasks & OutputSnapshot::Images)
+    {
+        snapshot.carriersImage = OutputInfo("%stub-%step-carriers.png", &par).absoluteFilePath();
+        snapshot.electronImage = OutputInfo("%stub-%step-electrons.png", &par).absoluteFilePath();
+        snapshot.holeImage = OutputInfo("%stub-%step-holes.png", &par).absoluteFilePath();
+    }
+
+    if (tasks & OutputSnapshot::CheckPoint)
+    {
+        m_world.checkPointer().takeState(snapshot.checkPoint);
+    }
+}
+
+void Logger::writeSnapshot(const OutputSnapshot &snapshot)
+{
+    if ((snapshot.tasks & OutputSnapshot::Flux) && m_fluxWriter)
+    {
+        m_fluxWriter->write(snapshot);
+    }
+
+    if ((snapshot.tasks & OutputSnapshot::XYZ) && m_xyzWriter)
+    {
+        m_xyzWriter->write(snapshot);
+    }
+
+    if ((snapshot.tasks & OutputSnapshot::XYZ) && m_trajectoryWriter)
+    {
+        m_trajectoryWriter->write(snapshot);
+    }
+
+    if (snapshot.tasks & OutputSnapshot::Images)
+    {
+        if ((snapshot.electrons.size() + snapshot.holes.size()) > 0)
+        {
+            GridImage image(m_world,Qt::white);
+            image.drawCarriers(snapshot.electrons,Qt::red,0);
+            image.drawCarriers(snapshot.holes,Qt::blue,0);
+            image.save(snapshot.carriersImage);
+        }
+
+        if (snapshot.electrons.size() > 0)
+        {
+            GridImage image(m_world,Qt::white);
+            image.drawCarriers(snapshot.electrons,Qt::red,0);
+            image.save(snapshot.electronImage);
+        }
+
+        if (snapshot.holes.size() > 0)
+        {
+            GridImage image(m_world,Qt::white);
+            image.drawCarriers(snapshot.holes,Qt::blue,0);
+            image.save(snapshot.holeImage);
+        }
+    }
+
+    if (snapshot.tasks & OutputSnapshot::CheckPoint)
+    {
+        m_world.checkPointer().write(snapshot.checkPoint);
+    }
 }
 
 void Logger::reportCarrier(ChargeAgent &charge)
@@ -0,0 +1,127 @@
+#include <QVector>
+#include <QDebug>
+
+#include "randomengine.h"
+using namespace LangmuirCore;
+
+// Compare the first outputs of each random engine with published reference
+// values; returns the number of engines that do not match.
+//
+//   mt19937      : seed 5489 (C++11 requires the 10000th output to be 4123659995)
+//   xoshiro256** : state {1, 2, 3, 4} (xoshiro256starstar.c by Blackman and Vigna)
+//   pcg64        : pcg64(42, 54), as in the pcg-cpp test suite (check-pcg64.out)
+//   philox       : counter 0 and key 0 (kat_vectors of Random123, philox4x32 10)
+//
+// The 64-bit engines give the low half of each value first.
+
+static bool check(RandomEngine::Type type, RandomEngine &engine, const quint32 *expected, int size)
+{
+    QVector<quint32> values(size);
+    engine.generate(values.data(), size);
+    for (int i = 0; i < size; i++)
+    {
+        if (values[i] != expected[i])
+        {
+            qDebug("%s: value %d is %u, expected %u",
+                   qPrintable(RandomEngine::name(type)), i, values[i], expected[i]);
+            return false;
+        }
+    }
+    qDebug("%s: ok", qPrintable(RandomEngine::name(type)));
+    return true;
+}
+
+static QList<quint64> makeState(quint64 a, quint64 b, quint64 c, quint64 d, quint64 e, quint64 f)
+{
+    QList<quint64> state;
+    state << a << b << c << d << e << f;
+    return state;
+}
+
+int main (int argc, char *argv[])
+{
+    Q_UNUSED(argc);
+    Q_UNUSED(argv);
+
+    int failed = 0;
+
+    // mt19937
+    {
+        static const quint32 expected[] = {
+            3499211612u, 581869302u, 3890346734u, 3586334585u, 545404204u
+        };
+        static const quint32 last[] = { 4123659995u };
+        RandomEngine *engine = RandomEngine::create(RandomEngine::MT19937);
+        engine->seed(5489u);
+        if (!check(RandomEngine::MT19937, *engine, expected, 5))
+        {
+            failed++;
+        }
+        else
+        {
+            engine->seed(5489u);
+            engine->discard(9999);
+            if (!check(RandomEngine::MT19937, *engine, last, 1))
+            {
+                failed++;
+            }
+        }
+        delete engine;
+    }
+
+    // xoshiro256**: 11520, 0, 1509978240, 1215971899390074240
+    {
+        static const quint32 expected[] = {
+            0x00002d00u, 0x00000000u, 0x00000000u, 0x00000000u,
+            0x5a007080u, 0x00000000u, 0x00009d80u, 0x10e00000u
+        };
+        RandomEngine *engine = RandomEngine::create(RandomEngine::Xoshiro256);
+        if (!engine->setState(makeState(1, 2, 3, 4, 0, 0)))
+        {
+            qDebug("xoshiro256**: can not set state");
+            failed++;
+        }
+        else if (!check(RandomEngine::Xoshiro256, *engine, expected, 8))
+        {
+            failed++;
+        }
+        delete engine;
+    }
+
+    // pcg64: 0x86b1da1d72062b68, 0x1304aa46c9853d39, 0xa3670e9e0dd50358, 0xf9090e529a7dae00
+    {
+        static const quint32 expected[] = {
+            0x72062b68u, 0x86b1da1du, 0xc9853d39u, 0x1304aa46u,
+            0x0dd50358u, 0xa3670e9eu, 0x9a7dae00u, 0xf9090e52u
+        };
+        // The state of pcg64(42, 54) after seeding; the increment is 2 * 54 + 1
+        RandomEngine *engine = RandomEngine::create(RandomEngine::PCG64);
+        if (!engine->setState(makeState(Q_UINT64_C(0xde2bce05be013be3),
+                                        Q_UINT64_C(0xd3f6c45a41e54320), 0, 109, 0, 0)))
+        {
+            qDebug("pcg64: can not set state");
+            failed++;
+        }
+        else if (!check(RandomEngine::PCG64, *engine, expected, 8))
+        {
+            failed++;
+        }
+        delete engine;
+    }
+
+    // philox
+    {
+        static const quint32 expected[] = {
+            0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u
+        };
+        RandomEngine *engine = RandomEngine::create(RandomEngine::Philox);
+        engine->setStream(0, 0);
+        if (!check(RandomEngine::Philox, *engine, expected, 4))
+        {
+            failed++;
+        }
+        delete engine;
+    }
+
+    return failed;
+}
@@ -0,0 +1,129 @@
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QVector>
+#include <QFile>
+#include <QDebug>
+
+#include "parameters.h"
+#include "cubicgrid.h"
+#include "rand.h"
+#include "trajectory.h"
+#include "writer.h"
+#include "world.h"
+using namespace LangmuirCore;
+
+// Write a short binary trajectory (test.traj) and the frames it holds as text
+// (test.txt), in the working directory; testtrajectory.py reads both back.
+//
+// Each line of test.txt is one of
+//   F step
+//   E id site lifetime pathlength
+//   H id site lifetime pathlength
+//   D site
+//   T site
+
+static void moveCarriers(QVector<OutputSnapshot::Carrier> &carriers, Grid &grid, Random &random,
+                         quint64 &nextID)
+{
+    QVector<OutputSnapshot::Carrier> moved;
+    for (int i = 0; i < carriers.size(); i++)
+    {
+        // Some carriers leave
+        if (random.integer(0, 7) == 0)
+        {
+            continue;
+        }
+
+        // The others hop to a neighbour, across the periodic boundaries
+        OutputSnapshot::Carrier charge = carriers.at(i);
+        int x = (grid.getIndexX(charge.site) + random.integer(-1, 1) + grid.xSize()) % grid.xSize();
+        int y = (grid.getIndexY(charge.site) + random.integer(-1, 1) + grid.ySize()) % grid.ySize();
+        int z = (grid.getIndexZ(charge.site) + random.integer(-1, 1) + grid.zSize()) % grid.zSize();
+        charge.site = grid.getIndexS(x, y, z);
+        charge.lifetime += 10;
+        charge.pathlength += random.integer(0, 3);
+        moved.push_back(charge);
+    }
+
+    // Some carriers are new
+    int created = random.integer(0, 3);
+    for (int i = 0; i < created; i++)
+    {
+        OutputSnapshot::Carrier charge;
+        charge.id = nextID++;
+        charge.site = random.integer(0, grid.volume() - 1);
+        charge.address = 0;
+        charge.lifetime = 0;
+        charge.pathlength = 0;
+        moved.insert(random.integer(0, moved.size()), charge);
+    }
+
+    carriers = moved;
+}
+
+static void writeCarriers(QTextStream &stream, char type, const QVector<OutputSnapshot::Carrier> &carriers)
+{
+    for (int i = 0; i < carriers.size(); i++)
+    {
+        const OutputSnapshot::Carrier &charge = carriers.at(i);
+        stream << type << " " << charge.id << " " << charge.site << " "
+               << charge.lifetime << " " << charge.pathlength << "\n";
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    SimulationParameters par;
+    par.gridX = 16;
+    par.gridY = 8;
+    par.gridZ = 4;
+    par.electronPercentage = 0;
+    par.holePercentage = 0;
+    par.outputIsOn = false;
+    par.outputStub = "test";
+    par.outputXyzFormat = "binary";
+    par.outputXyzKeyframe = 5;
+    World world(par);
+    Grid &grid = world.electronGrid();
+
+    QFile::remove("test.traj");
+    QFile file("test.txt");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qFatal("langmuir: can not open file: test.txt");
+    }
+    QTextStream stream(&file);
+
+    Random random(5489u);
+    quint64 nextID = 1;
+    OutputSnapshot snapshot;
+    snapshot.defects << 3 << 77;
+    snapshot.traps << 5 << 9 << 400;
+
+    // 12 frames make two full chunks and one that is cut short
+    TrajectoryWriter *writer = new TrajectoryWriter(world, "%stub.traj");
+    for (int frame = 0; frame < 12; frame++)
+    {
+        snapshot.currentStep = 1000 + 10 * frame;
+        moveCarriers(snapshot.electrons, grid, random, nextID);
+        moveCarriers(snapshot.holes, grid, random, nextID);
+        writer->write(snapshot);
+
+        stream << "F " << snapshot.currentStep << "\n";
+        writeCarriers(stream, 'E', snapshot.electrons);
+        writeCarriers(stream, 'H', snapshot.holes);
+        for (int i = 0; i < snapshot.defects.size(); i++)
+        {
+            stream << "D " << snapshot.defects.at(i) << "\n";
+        }
+        for (int i = 0; i < snapshot.traps.size(); i++)
+        {
+            stream << "T " << snapshot.traps.at(i) << "\n";
+        }
+    }
+    delete writer;
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+# -*- coding: utf-8 -*-
+"""
+Write a binary trajectory with testtrajectory, and read it back with
+langmuir.trajectory.
+
+    python testtrajectory.py path/to/testtrajectory
+"""
+import subprocess
+import unittest
+import tempfile
+import shutil
+import sys
+import os
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', '..', 'LangmuirPython'))
+import langmuir as lm
+
+program = 'testtrajectory'
+
+
+def load_frames(handle):
+    """
+    Read the frames written by testtrajectory as text.
+    """
+    frames = []
+    with open(handle, 'r') as stream:
+        lines = stream.readlines()
+    for line in lines:
+        tokens = line.split()
+        if tokens[0] == 'F':
+            frames.append((int(tokens[1]), [], [], [], []))
+        elif tokens[0] in 'EH':
+            carriers = frames[-1][1 if tokens[0] == 'E' else 2]
+            carriers.append(tuple(int(token) for token in tokens[1:]))
+        elif tokens[0] == 'D':
+            frames[-1][3].append(int(tokens[1]))
+        elif tokens[0] == 'T':
+            frames[-1][4].append(int(tokens[1]))
+    return frames
+
+
+class TestTrajectory(unittest.TestCase):
+    def setUp(self):
+        self.work = tempfile.mkdtemp()
+        subprocess.check_call([os.path.abspath(program)], cwd=self.work)
+        self.traj = lm.trajectory.Trajectory(
+            os.path.join(self.work, 'test.traj'))
+        self.frames = load_frames(os.path.join(self.work, 'test.txt'))
+
+    def tearDown(self):
+        self.traj.handle.close()
+        shutil.rmtree(self.work)
+
+    def check_frame(self, frame, expected):
+        step, electrons, holes, defects, traps = expected
+        self.assertEqual(frame.step, step)
+        for carriers, values in [(frame.electrons, electrons),
+                                 (frame.holes, holes)]:
+            found = sorted((int(c['id']), int(c['s']), int(c['lifetime']),
+                            int(c['pathlength'])) for c in carriers)
+            self.assertEqual(found, sorted(values))
+        self.assertEqual(list(frame.defects), defects)
+        self.assertEqual(list(frame.traps), traps)
+
+    def test_header(self):
+        self.assertEqual((self.traj.nx, self.traj.ny, self.traj.nz), (16, 8, 4))
+        self.assertEqual(self.traj.keyframe, 5)
+        self.assertEqual(self.traj.steps, [1000, 1050, 1100])
+
+    def test_frames(self):
+        self.assertEqual(len(self.traj), len(self.frames))
+        for frame, expected in zip(self.traj, self.frames):
+            self.check_frame(frame, expected)
+
+    def test_index(self):
+        self.check_frame(self.traj[-1], self.frames[-1])
+        self.check_frame(self.traj[7], self.frames[7])
+        self.check_frame(self.traj.at_step(1065), self.frames[6])
+        self.assertRaises(IndexError, self.traj.at_step, 999)
+
+if __name__ == '__main__':
+    if len(sys.argv) > 1:
+        program = sys.argv.pop(1)
+    unittest.main()